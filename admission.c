@@ -0,0 +1,69 @@
+/*! \file    admission.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Bounded admission control
+ * \details  Implementation of a counter of jobs in progress with a FIFO
+ * of the jobs waiting for their turn.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include "admission.h"
+
+void janus_admission_init(janus_admission *admission, guint max) {
+	if(admission == NULL)
+		return;
+	admission->max = max;
+	admission->active = 0;
+	admission->waiting = g_queue_new();
+}
+
+gboolean janus_admission_enter(janus_admission *admission, gpointer job) {
+	if(admission == NULL)
+		return TRUE;
+	if(admission->max == 0 || admission->active < admission->max) {
+		admission->active++;
+		return TRUE;
+	}
+	g_queue_push_tail(admission->waiting, job);
+	return FALSE;
+}
+
+gpointer janus_admission_leave(janus_admission *admission) {
+	if(admission == NULL || admission->active == 0)
+		return NULL;
+	admission->active--;
+	if(admission->waiting == NULL || g_queue_is_empty(admission->waiting))
+		return NULL;
+	if(admission->max != 0 && admission->active >= admission->max)
+		return NULL;
+	/* The slot goes to the job that has been waiting the longest */
+	admission->active++;
+	return g_queue_pop_head(admission->waiting);
+}
+
+gboolean janus_admission_cancel(janus_admission *admission, gpointer job) {
+	if(admission == NULL || admission->waiting == NULL)
+		return FALSE;
+	return g_queue_remove(admission->waiting, job);
+}
+
+guint janus_admission_waiting(janus_admission *admission) {
+	if(admission == NULL || admission->waiting == NULL)
+		return 0;
+	return g_queue_get_length(admission->waiting);
+}
+
+void janus_admission_clear(janus_admission *admission, GDestroyNotify destroy) {
+	if(admission == NULL)
+		return;
+	if(admission->waiting != NULL) {
+		if(destroy != NULL)
+			g_queue_free_full(admission->waiting, destroy);
+		else
+			g_queue_free(admission->waiting);
+	}
+	admission->waiting = NULL;
+	admission->active = 0;
+}
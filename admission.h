@@ -0,0 +1,59 @@
+/*! \file    admission.h
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Bounded admission control (headers)
+ * \details  Helper to limit how many jobs of some kind can be in progress
+ * at the same time: a job that asks to enter when all the slots are taken
+ * is queued, and gets the slot of the first job that leaves, in the order
+ * they asked. This is used by the DTLS stack, to keep a burst of handshakes
+ * from hogging the CPU. The helper does no locking of its own: the owner
+ * is expected to serialize access to it (e.g., with a mutex it already
+ * needs for the jobs themselves).
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef _JANUS_ADMISSION_H
+#define _JANUS_ADMISSION_H
+
+#include <glib.h>
+
+/*! \brief Bounded admission control */
+typedef struct janus_admission {
+	/*! \brief How many jobs can be in progress at the same time (0 means no limit) */
+	guint max;
+	/*! \brief How many jobs are in progress */
+	guint active;
+	/*! \brief Jobs waiting for a slot, in the order they asked for one */
+	GQueue *waiting;
+} janus_admission;
+
+/*! \brief Initialize an admission control instance
+ * @param[in] admission The janus_admission instance to initialize
+ * @param[in] max How many jobs can be in progress at the same time (0 means no limit) */
+void janus_admission_init(janus_admission *admission, guint max);
+/*! \brief Ask for a slot for a job: if none is available, the job is queued
+ * @param[in] admission The janus_admission instance to use
+ * @param[in] job Opaque pointer to the job
+ * @returns TRUE if the job can start now, FALSE if it has been queued */
+gboolean janus_admission_enter(janus_admission *admission, gpointer job);
+/*! \brief Give the slot of a job that was admitted back
+ * @param[in] admission The janus_admission instance to use
+ * @returns The queued job that gets the slot, if any, or NULL otherwise */
+gpointer janus_admission_leave(janus_admission *admission);
+/*! \brief Take a job that is still waiting for a slot off the queue
+ * @param[in] admission The janus_admission instance to use
+ * @param[in] job Opaque pointer to the job
+ * @returns TRUE if the job was queued, FALSE otherwise */
+gboolean janus_admission_cancel(janus_admission *admission, gpointer job);
+/*! \brief Get the number of jobs waiting for a slot
+ * @param[in] admission The janus_admission instance to query
+ * @returns The number of queued jobs */
+guint janus_admission_waiting(janus_admission *admission);
+/*! \brief Get rid of the queued jobs, and reset an admission control instance
+ * @param[in] admission The janus_admission instance to clear
+ * @param[in] destroy Callback to invoke on each job that was still queued (optional) */
+void janus_admission_clear(janus_admission *admission, GDestroyNotify destroy);
+
+#endif
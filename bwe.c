@@ -0,0 +1,357 @@
+/*! \file    bwe.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Send-side bandwidth estimation
+ * \details  Implementation of a delay and loss based bandwidth estimator
+ * driven by transport wide CC feedback. Packets sent within a few
+ * milliseconds of each other are grouped together, and for each pair of
+ * consecutive groups the difference between the receive and send deltas
+ * is accumulated and smoothed: a linear regression over the most recent
+ * samples tells us whether the queuing delay is growing (overuse), going
+ * down (underuse) or stable, compared to a threshold that adapts over
+ * time. The delay based estimate is decreased to a fraction of the
+ * bitrate the peer acknowledged on overuse, held on underuse, and slowly
+ * increased otherwise; the loss based estimate is decreased when losses
+ * are high, and increased when they're negligible. The actual estimate is
+ * the lowest of the two.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <math.h>
+
+#include "bwe.h"
+#include "debug.h"
+
+/* Packets sent within this interval belong to the same group */
+#define JANUS_BWE_GROUP_INTERVAL	5000
+/* Smoothing factor for the accumulated delay */
+#define JANUS_BWE_SMOOTHING			0.9
+/* Gain applied to the trend, and cap on the number of deltas it's scaled by */
+#define JANUS_BWE_THRESHOLD_GAIN	4.0
+#define JANUS_BWE_MAX_DELTAS		60
+/* Initial value, boundaries and adaptation speed of the overuse threshold */
+#define JANUS_BWE_THRESHOLD_INIT	12.5
+#define JANUS_BWE_THRESHOLD_MIN		6.0
+#define JANUS_BWE_THRESHOLD_MAX		600.0
+#define JANUS_BWE_THRESHOLD_K_UP	0.0087
+#define JANUS_BWE_THRESHOLD_K_DOWN	0.039
+/* How long the trend must be above the threshold before we signal overuse */
+#define JANUS_BWE_OVERUSE_TIME		10000
+/* Window for the acknowledged bitrate */
+#define JANUS_BWE_ACKED_WINDOW		500000
+/* Fraction of the acknowledged bitrate we go back to on overuse */
+#define JANUS_BWE_DECREASE_FACTOR	0.85
+/* Multiplicative increase per second, when the link is fine */
+#define JANUS_BWE_INCREASE_FACTOR	1.08
+/* Minimum number of packets before we look at losses */
+#define JANUS_BWE_LOSS_MIN_PACKETS	20
+
+janus_bwe_context *janus_bwe_context_create(guint32 start_bitrate, guint32 min_bitrate, guint32 max_bitrate) {
+	janus_bwe_context *bwe = g_malloc0(sizeof(janus_bwe_context));
+	if(max_bitrate < min_bitrate)
+		max_bitrate = min_bitrate;
+	if(start_bitrate < min_bitrate)
+		start_bitrate = min_bitrate;
+	if(start_bitrate > max_bitrate)
+		start_bitrate = max_bitrate;
+	bwe->min_bitrate = min_bitrate;
+	bwe->max_bitrate = max_bitrate;
+	bwe->estimate = start_bitrate;
+	bwe->delay_bitrate = start_bitrate;
+	bwe->loss_bitrate = start_bitrate;
+	bwe->threshold = JANUS_BWE_THRESHOLD_INIT;
+	bwe->usage = janus_bwe_usage_normal;
+	janus_mutex_init(&bwe->mutex);
+	return bwe;
+}
+
+void janus_bwe_context_destroy(janus_bwe_context *bwe) {
+	if(bwe == NULL)
+		return;
+	janus_mutex_destroy(&bwe->mutex);
+	g_free(bwe);
+}
+
+guint16 janus_bwe_next_seq(janus_bwe_context *bwe) {
+	if(bwe == NULL)
+		return 0;
+	janus_mutex_lock(&bwe->mutex);
+	guint16 seq = bwe->next_seq;
+	janus_mutex_unlock(&bwe->mutex);
+	return seq;
+}
+
+void janus_bwe_packet_sent(janus_bwe_context *bwe, guint16 seq, int size, gint64 now) {
+	if(bwe == NULL)
+		return;
+	janus_mutex_lock(&bwe->mutex);
+	bwe->next_seq = seq+1;
+	janus_bwe_sent_packet *p = &bwe->history[seq & (JANUS_BWE_HISTORY_SIZE-1)];
+	p->seq = seq;
+	p->size = size > 0xFFFF ? 0xFFFF : size;
+	p->sent_time = now > 0 ? now : 1;
+	janus_mutex_unlock(&bwe->mutex);
+}
+
+/* Adapt the overuse threshold to the current trend */
+static void janus_bwe_update_threshold(janus_bwe_context *bwe, double trend, gint64 now) {
+	if(bwe->threshold_updated == 0)
+		bwe->threshold_updated = now;
+	double abs_trend = fabs(trend);
+	/* Don't adapt to sudden spikes */
+	if(abs_trend > bwe->threshold + 15.0) {
+		bwe->threshold_updated = now;
+		return;
+	}
+	double k = abs_trend < bwe->threshold ? JANUS_BWE_THRESHOLD_K_DOWN : JANUS_BWE_THRESHOLD_K_UP;
+	gint64 dt = (now - bwe->threshold_updated)/1000;
+	if(dt > 100)
+		dt = 100;
+	bwe->threshold += k * (abs_trend - bwe->threshold) * dt;
+	if(bwe->threshold < JANUS_BWE_THRESHOLD_MIN)
+		bwe->threshold = JANUS_BWE_THRESHOLD_MIN;
+	else if(bwe->threshold > JANUS_BWE_THRESHOLD_MAX)
+		bwe->threshold = JANUS_BWE_THRESHOLD_MAX;
+	bwe->threshold_updated = now;
+}
+
+/* Compare the trend to the threshold, and update the status of the link */
+static void janus_bwe_detect(janus_bwe_context *bwe, double trend, gint64 recv_time) {
+	if(bwe->trend_count < JANUS_BWE_TRENDLINE_WINDOW) {
+		/* Not enough samples yet */
+		bwe->trend = trend;
+		return;
+	}
+	if(trend > bwe->threshold) {
+		if(bwe->overuse_start == 0)
+			bwe->overuse_start = recv_time;
+		bwe->overuse_count++;
+		if(recv_time - bwe->overuse_start >= JANUS_BWE_OVERUSE_TIME &&
+				bwe->overuse_count > 1 && trend >= bwe->trend) {
+			bwe->overuse_start = 0;
+			bwe->overuse_count = 0;
+			bwe->usage = janus_bwe_usage_overuse;
+		}
+	} else if(trend < -bwe->threshold) {
+		bwe->overuse_start = 0;
+		bwe->overuse_count = 0;
+		bwe->usage = janus_bwe_usage_underuse;
+	} else {
+		bwe->overuse_start = 0;
+		bwe->overuse_count = 0;
+		bwe->usage = janus_bwe_usage_normal;
+	}
+	bwe->trend = trend;
+	janus_bwe_update_threshold(bwe, trend, recv_time);
+}
+
+/* Add a delay variation sample (in milliseconds) to the trendline filter */
+static void janus_bwe_trendline_update(janus_bwe_context *bwe, double delta, gint64 recv_time) {
+	if(bwe->first_recv == 0)
+		bwe->first_recv = recv_time;
+	if(bwe->deltas < JANUS_BWE_MAX_DELTAS)
+		bwe->deltas++;
+	bwe->accumulated_delay += delta;
+	bwe->smoothed_delay = JANUS_BWE_SMOOTHING * bwe->smoothed_delay +
+		(1.0 - JANUS_BWE_SMOOTHING) * bwe->accumulated_delay;
+	bwe->trend_x[bwe->trend_index] = (double)(recv_time - bwe->first_recv)/1000.0;
+	bwe->trend_y[bwe->trend_index] = bwe->smoothed_delay;
+	bwe->trend_index = (bwe->trend_index+1) % JANUS_BWE_TRENDLINE_WINDOW;
+	if(bwe->trend_count < JANUS_BWE_TRENDLINE_WINDOW)
+		bwe->trend_count++;
+	/* Linear regression over the samples we have */
+	double trend = bwe->trend;
+	if(bwe->trend_count == JANUS_BWE_TRENDLINE_WINDOW) {
+		double avg_x = 0, avg_y = 0;
+		int i = 0;
+		for(i=0; i<bwe->trend_count; i++) {
+			avg_x += bwe->trend_x[i];
+			avg_y += bwe->trend_y[i];
+		}
+		avg_x /= bwe->trend_count;
+		avg_y /= bwe->trend_count;
+		double num = 0, den = 0;
+		for(i=0; i<bwe->trend_count; i++) {
+			num += (bwe->trend_x[i] - avg_x) * (bwe->trend_y[i] - avg_y);
+			den += (bwe->trend_x[i] - avg_x) * (bwe->trend_x[i] - avg_x);
+		}
+		if(den != 0)
+			trend = (num/den) * bwe->deltas * JANUS_BWE_THRESHOLD_GAIN;
+	}
+	janus_bwe_detect(bwe, trend, recv_time);
+}
+
+/* Take note of a packet the peer received, grouping it with the ones sent right before it */
+static void janus_bwe_packet_received(janus_bwe_context *bwe, gint64 sent_time, gint64 recv_time) {
+	if(!bwe->group_started) {
+		bwe->group_started = TRUE;
+		bwe->group_first_sent = sent_time;
+		bwe->group_last_sent = sent_time;
+		bwe->group_last_recv = recv_time;
+		return;
+	}
+	if(sent_time < bwe->group_first_sent) {
+		/* Reordered packet from an older group, ignore it */
+		return;
+	}
+	if(sent_time - bwe->group_first_sent <= JANUS_BWE_GROUP_INTERVAL) {
+		/* Same group */
+		if(sent_time > bwe->group_last_sent)
+			bwe->group_last_sent = sent_time;
+		if(recv_time > bwe->group_last_recv)
+			bwe->group_last_recv = recv_time;
+		return;
+	}
+	/* New group: compare the one we just completed to the previous one */
+	if(bwe->prev_group) {
+		gint64 send_delta = bwe->group_last_sent - bwe->prev_group_sent;
+		gint64 recv_delta = bwe->group_last_recv - bwe->prev_group_recv;
+		janus_bwe_trendline_update(bwe, (double)(recv_delta - send_delta)/1000.0, bwe->group_last_recv);
+	}
+	bwe->prev_group = TRUE;
+	bwe->prev_group_sent = bwe->group_last_sent;
+	bwe->prev_group_recv = bwe->group_last_recv;
+	bwe->group_first_sent = sent_time;
+	bwe->group_last_sent = sent_time;
+	bwe->group_last_recv = recv_time;
+}
+
+/* Update the delay based estimate, according to the status of the link */
+static void janus_bwe_update_delay_bitrate(janus_bwe_context *bwe, gint64 now) {
+	if(bwe->delay_updated == 0)
+		bwe->delay_updated = now;
+	double elapsed = (double)(now - bwe->delay_updated)/G_USEC_PER_SEC;
+	if(elapsed > 1.0)
+		elapsed = 1.0;
+	bwe->delay_updated = now;
+	if(bwe->usage == janus_bwe_usage_overuse) {
+		/* Only decrease once per round trip or so */
+		if(bwe->delay_decreased == 0 || now - bwe->delay_decreased >= 200000) {
+			guint32 target = bwe->acked_bitrate > 0 ?
+				(guint32)(JANUS_BWE_DECREASE_FACTOR * bwe->acked_bitrate) :
+				(guint32)(JANUS_BWE_DECREASE_FACTOR * bwe->delay_bitrate);
+			if(target < bwe->delay_bitrate)
+				bwe->delay_bitrate = target;
+			bwe->delay_decreased = now;
+		}
+	} else if(bwe->usage == janus_bwe_usage_normal) {
+		guint32 target = (guint32)(bwe->delay_bitrate * pow(JANUS_BWE_INCREASE_FACTOR, elapsed)) + 1000;
+		/* Don't drift too far away from what we're actually sending */
+		if(bwe->acked_bitrate > 0) {
+			guint32 cap = (guint32)(1.5 * bwe->acked_bitrate) + 10000;
+			if(target > cap)
+				target = MAX(cap, bwe->delay_bitrate);
+		}
+		bwe->delay_bitrate = target;
+	}
+	/* On underuse, we keep the estimate as it is, as queues are draining */
+	if(bwe->delay_bitrate < bwe->min_bitrate)
+		bwe->delay_bitrate = bwe->min_bitrate;
+	else if(bwe->delay_bitrate > bwe->max_bitrate)
+		bwe->delay_bitrate = bwe->max_bitrate;
+}
+
+/* Update the loss based estimate, if we have enough packets */
+static void janus_bwe_update_loss_bitrate(janus_bwe_context *bwe, gint64 now) {
+	guint32 total = bwe->lost + bwe->received;
+	if(total < JANUS_BWE_LOSS_MIN_PACKETS)
+		return;
+	double loss = (double)bwe->lost/(double)total;
+	bwe->loss_fraction = (guint8)(loss * 255.0);
+	bwe->lost = 0;
+	bwe->received = 0;
+	if(loss > 0.10) {
+		bwe->loss_bitrate = (guint32)(bwe->estimate * (1.0 - 0.5*loss));
+	} else if(loss < 0.02) {
+		if(bwe->loss_increased == 0 || now - bwe->loss_increased >= G_USEC_PER_SEC) {
+			bwe->loss_bitrate = (guint32)(bwe->loss_bitrate * 1.05) + 1000;
+			bwe->loss_increased = now;
+		}
+	}
+	if(bwe->loss_bitrate < bwe->min_bitrate)
+		bwe->loss_bitrate = bwe->min_bitrate;
+	else if(bwe->loss_bitrate > bwe->max_bitrate)
+		bwe->loss_bitrate = bwe->max_bitrate;
+}
+
+guint32 janus_bwe_feedback(janus_bwe_context *bwe, janus_rtcp_transport_wide_cc_result *results, int count, gint64 now) {
+	if(bwe == NULL)
+		return 0;
+	janus_mutex_lock(&bwe->mutex);
+	if(results == NULL || count <= 0) {
+		guint32 estimate = bwe->estimate;
+		janus_mutex_unlock(&bwe->mutex);
+		return estimate;
+	}
+	int i = 0;
+	for(i=0; i<count; i++) {
+		janus_bwe_sent_packet *p = &bwe->history[results[i].seq & (JANUS_BWE_HISTORY_SIZE-1)];
+		if(p->sent_time == 0 || p->seq != results[i].seq) {
+			/* We don't know (anymore) about this packet */
+			continue;
+		}
+		if(!results[i].received) {
+			bwe->lost++;
+			continue;
+		}
+		bwe->received++;
+		bwe->acked_bytes += p->size;
+		janus_bwe_packet_received(bwe, p->sent_time, results[i].received_time);
+		/* Don't account for the same packet twice, if it's reported again */
+		p->sent_time = 0;
+	}
+	/* Update the acknowledged bitrate */
+	if(bwe->acked_window_start == 0)
+		bwe->acked_window_start = now;
+	if(now - bwe->acked_window_start >= JANUS_BWE_ACKED_WINDOW) {
+		bwe->acked_bitrate = (guint32)((guint64)bwe->acked_bytes * 8 * G_USEC_PER_SEC / (now - bwe->acked_window_start));
+		bwe->acked_bytes = 0;
+		bwe->acked_window_start = now;
+	}
+	janus_bwe_update_delay_bitrate(bwe, now);
+	janus_bwe_update_loss_bitrate(bwe, now);
+	bwe->estimate = MIN(bwe->delay_bitrate, bwe->loss_bitrate);
+	guint32 estimate = bwe->estimate;
+	janus_mutex_unlock(&bwe->mutex);
+	return estimate;
+}
+
+guint32 janus_bwe_get_estimate(janus_bwe_context *bwe) {
+	if(bwe == NULL)
+		return 0;
+	janus_mutex_lock(&bwe->mutex);
+	guint32 estimate = bwe->estimate;
+	janus_mutex_unlock(&bwe->mutex);
+	return estimate;
+}
+
+guint32 janus_bwe_get_status(janus_bwe_context *bwe, guint32 *acked_bitrate, guint8 *loss_fraction, janus_bwe_usage *usage) {
+	if(bwe == NULL)
+		return 0;
+	janus_mutex_lock(&bwe->mutex);
+	guint32 estimate = bwe->estimate;
+	if(acked_bitrate)
+		*acked_bitrate = bwe->acked_bitrate;
+	if(loss_fraction)
+		*loss_fraction = bwe->loss_fraction;
+	if(usage)
+		*usage = bwe->usage;
+	janus_mutex_unlock(&bwe->mutex);
+	return estimate;
+}
+
+const char *janus_bwe_usage_str(janus_bwe_usage usage) {
+	switch(usage) {
+		case janus_bwe_usage_normal:
+			return "normal";
+		case janus_bwe_usage_overuse:
+			return "overuse";
+		case janus_bwe_usage_underuse:
+			return "underuse";
+		default:
+			break;
+	}
+	return NULL;
+}
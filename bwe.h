@@ -0,0 +1,159 @@
+/*! \file    bwe.h
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Send-side bandwidth estimation (headers)
+ * \details  Implementation of a delay and loss based bandwidth estimator
+ * for the media Janus sends to a peer, driven by the transport wide CC
+ * feedback (https://tools.ietf.org/html/draft-holmer-rmcat-transport-wide-cc-extensions-01)
+ * the peer sends back. Outgoing packets are stamped with a transport wide
+ * sequence number and their send time is recorded: when feedback arrives,
+ * packets are grouped in bursts, and the variation of the delay between
+ * groups is fed to a trendline filter to detect overuse of the link, as
+ * in Google Congestion Control. The delay based estimate follows an
+ * AIMD approach around the bitrate the peer acknowledged, and is capped
+ * by a loss based estimate. No clock is ever read by the estimator: all
+ * times are provided by the caller, which makes it easy to drive it with
+ * synthetic traces as well.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef _JANUS_BWE_H
+#define _JANUS_BWE_H
+
+#include <glib.h>
+
+#include "rtcp.h"
+#include "mutex.h"
+
+/*! \brief Number of sent packets the estimator keeps track of (must be a power of two) */
+#define JANUS_BWE_HISTORY_SIZE		4096
+/*! \brief Number of delay samples the trendline filter uses */
+#define JANUS_BWE_TRENDLINE_WINDOW	20
+/*! \brief Initial estimate, before any feedback is received */
+#define JANUS_BWE_START_BITRATE		300000
+/*! \brief Lowest estimate we'll ever provide */
+#define JANUS_BWE_MIN_BITRATE		30000
+/*! \brief Highest estimate we'll ever provide */
+#define JANUS_BWE_MAX_BITRATE		10000000
+
+/*! \brief Status of the link, according to the delay based detector */
+typedef enum janus_bwe_usage {
+	janus_bwe_usage_normal = 0,
+	janus_bwe_usage_overuse,
+	janus_bwe_usage_underuse
+} janus_bwe_usage;
+
+/*! \brief Sent packet, as tracked by the estimator */
+typedef struct janus_bwe_sent_packet {
+	/*! \brief When the packet was sent (0 if the slot is unused) */
+	gint64 sent_time;
+	/*! \brief Transport wide sequence number of the packet */
+	guint16 seq;
+	/*! \brief Size of the packet */
+	guint16 size;
+} janus_bwe_sent_packet;
+
+/*! \brief Send-side bandwidth estimator (one per PeerConnection) */
+typedef struct janus_bwe_context {
+	/*! \brief Packets we sent, indexed by transport wide sequence number */
+	janus_bwe_sent_packet history[JANUS_BWE_HISTORY_SIZE];
+	/*! \brief Next transport wide sequence number to use */
+	guint16 next_seq;
+	/*! \brief Send and receive times of the current group of packets */
+	gint64 group_first_sent, group_last_sent, group_last_recv;
+	/*! \brief Send and receive times of the previous group of packets */
+	gint64 prev_group_sent, prev_group_recv;
+	/*! \brief Whether the current and the previous groups are valid */
+	gboolean group_started, prev_group;
+	/*! \brief Receive time of the first group, used as the origin for the trendline */
+	gint64 first_recv;
+	/*! \brief Accumulated and smoothed delay variation, in milliseconds */
+	double accumulated_delay, smoothed_delay;
+	/*! \brief Trendline samples (receive time and smoothed delay, in milliseconds) */
+	double trend_x[JANUS_BWE_TRENDLINE_WINDOW], trend_y[JANUS_BWE_TRENDLINE_WINDOW];
+	/*! \brief Number of trendline samples, and index of the next one */
+	int trend_count, trend_index;
+	/*! \brief Number of delay samples so far (capped), used to scale the trend */
+	int deltas;
+	/*! \brief Last (scaled) trend we computed */
+	double trend;
+	/*! \brief Adaptive overuse threshold */
+	double threshold;
+	/*! \brief When the threshold was last updated */
+	gint64 threshold_updated;
+	/*! \brief When overuse was first detected, and how many times in a row */
+	gint64 overuse_start;
+	/*! \brief How many times in a row the trend was above the threshold */
+	int overuse_count;
+	/*! \brief Current status of the link */
+	janus_bwe_usage usage;
+	/*! \brief Bytes acknowledged since acked_window_start */
+	guint32 acked_bytes;
+	/*! \brief Start of the current acknowledged bitrate window */
+	gint64 acked_window_start;
+	/*! \brief Bitrate the peer acknowledged receiving, recently */
+	guint32 acked_bitrate;
+	/*! \brief Packets reported as lost and received since the last loss update */
+	guint32 lost, received;
+	/*! \brief Most recent loss fraction (0-255) */
+	guint8 loss_fraction;
+	/*! \brief When the loss based estimate was last increased */
+	gint64 loss_increased;
+	/*! \brief Delay based and loss based estimates */
+	guint32 delay_bitrate, loss_bitrate;
+	/*! \brief When the delay based estimate was last updated and decreased */
+	gint64 delay_updated, delay_decreased;
+	/*! \brief Current estimate, and its boundaries */
+	guint32 estimate, min_bitrate, max_bitrate;
+	/*! \brief Mutex, as packets are sent and feedback is received by different threads */
+	janus_mutex mutex;
+} janus_bwe_context;
+
+/*! \brief Create a new estimator
+ * @param[in] start_bitrate The initial estimate
+ * @param[in] min_bitrate The estimate will never go below this value
+ * @param[in] max_bitrate The estimate will never go above this value
+ * @returns A new janus_bwe_context instance */
+janus_bwe_context *janus_bwe_context_create(guint32 start_bitrate, guint32 min_bitrate, guint32 max_bitrate);
+/*! \brief Destroy an estimator
+ * @param[in] bwe The janus_bwe_context instance to destroy */
+void janus_bwe_context_destroy(janus_bwe_context *bwe);
+/*! \brief Get the transport wide sequence number to stamp the next packet with
+ * \note The number is only consumed by janus_bwe_packet_sent: if the packet
+ * can't be protected or sent, the next one will reuse it, so that the peer
+ * never sees a gap that would look like a loss
+ * @param[in] bwe The janus_bwe_context instance
+ * @returns The transport wide sequence number to put in the packet */
+guint16 janus_bwe_next_seq(janus_bwe_context *bwe);
+/*! \brief Take note of a packet we sent
+ * @param[in] bwe The janus_bwe_context instance to update
+ * @param[in] seq The transport wide sequence number the packet was stamped with (see janus_bwe_next_seq)
+ * @param[in] size The size of the packet
+ * @param[in] now When the packet was sent, in microseconds */
+void janus_bwe_packet_sent(janus_bwe_context *bwe, guint16 seq, int size, gint64 now);
+/*! \brief Update the estimate with transport wide CC feedback from the peer
+ * @param[in] bwe The janus_bwe_context instance to update
+ * @param[in] results The parsed feedback, as returned by janus_rtcp_get_transport_wide_cc_feedback()
+ * @param[in] count The number of packets in the feedback
+ * @param[in] now When the feedback was received, in microseconds (same clock as janus_bwe_packet_sent)
+ * @returns The updated estimate, in bits per second */
+guint32 janus_bwe_feedback(janus_bwe_context *bwe, janus_rtcp_transport_wide_cc_result *results, int count, gint64 now);
+/*! \brief Get the current estimate
+ * @param[in] bwe The janus_bwe_context instance to query
+ * @returns The current estimate, in bits per second */
+guint32 janus_bwe_get_estimate(janus_bwe_context *bwe);
+/*! \brief Get a summary of the estimator state, for the Admin API
+ * @param[in] bwe The janus_bwe_context instance to query
+ * @param[out] acked_bitrate The bitrate the peer acknowledged receiving recently
+ * @param[out] loss_fraction The most recent loss fraction (0-255)
+ * @param[out] usage The current status of the link
+ * @returns The current estimate, in bits per second */
+guint32 janus_bwe_get_status(janus_bwe_context *bwe, guint32 *acked_bitrate, guint8 *loss_fraction, janus_bwe_usage *usage);
+/*! \brief Helper to stringify a janus_bwe_usage value
+ * @param[in] usage The janus_bwe_usage value
+ * @returns The usage as a string */
+const char *janus_bwe_usage_str(janus_bwe_usage usage);
+
+#endif
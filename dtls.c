@@ -17,13 +17,21 @@
 #include "dtls.h"
 #include "rtcp.h"
 #include "events.h"
+#include "admission.h"
 
 #include <openssl/err.h>
 #include <openssl/bn.h>
 #include <openssl/evp.h>
 #include <openssl/rsa.h>
+#include <openssl/ec.h>
+#include <openssl/pem.h>
 #include <openssl/asn1.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+
 
 const gchar *janus_get_dtls_srtp_state(janus_dtls_state state) {
 	switch(state) {
@@ -86,6 +94,8 @@ static void janus_dtls_notify_state_change(janus_dtls_srtp *dtls) {
 #define DTLS_CIPHERS	"HIGH:!aNULL:!MD5:!RC4"
 /* Duration for the self-generated certs: 1 year */
 #define DTLS_AUTOCERT_DURATION	60*60*24*365
+/* Cached self-generated certs are replaced when they're this close to expiring: 1 month */
+#define DTLS_AUTOCERT_RENEWAL	60*60*24*30
 
 
 static SSL_CTX *ssl_ctx = NULL;
@@ -97,6 +107,10 @@ gchar *janus_dtls_get_local_fingerprint(void) {
 	return (gchar *)local_fingerprint;
 }
 
+SSL_CTX *janus_dtls_get_context(void) {
+	return ssl_ctx;
+}
+
 
 #ifdef HAVE_SCTP
 /* Helper thread to create a SCTP association that will use this DTLS stack */
@@ -129,8 +143,14 @@ void *janus_dtls_sctp_setup_thread(void *data);
  * 		https://github.com/sipwise/rtpengine/commit/935487b66363c9932684d8085f47450d65a8c37e
  * which does indeed implement the callbacks the OpenSSL docs suggest.
  *
+ * Most of the time OpenSSL only needs these locks to read shared state
+ * (e.g., the error strings or the certificate store), so we use
+ * read/write locks: that way handshakes on different threads don't end
+ * up serialized on the same global locks. OpenSSL >= 1.1.0 takes care
+ * of all this internally, so none of this is compiled in there.
+ *
  */
-static janus_mutex *janus_dtls_locks;
+static pthread_rwlock_t *janus_dtls_locks = NULL;
 
 static void janus_dtls_cb_openssl_threadid(CRYPTO_THREADID *tid) {
 	/* FIXME Assuming pthread, which is fine as GLib wraps pthread and
@@ -146,21 +166,23 @@ static void janus_dtls_cb_openssl_threadid(CRYPTO_THREADID *tid) {
 
 static void janus_dtls_cb_openssl_lock(int mode, int type, const char *file, int line) {
 	if((mode & CRYPTO_LOCK)) {
-		janus_mutex_lock(&janus_dtls_locks[type]);
+		if((mode & CRYPTO_READ))
+			pthread_rwlock_rdlock(&janus_dtls_locks[type]);
+		else
+			pthread_rwlock_wrlock(&janus_dtls_locks[type]);
 	} else {
-		janus_mutex_unlock(&janus_dtls_locks[type]);
+		pthread_rwlock_unlock(&janus_dtls_locks[type]);
 	}
 }
 #endif
 
 
-static int janus_dtls_generate_keys(X509 **certificate, EVP_PKEY **private_key) {
+/* Helper to generate a 2048 bits RSA key */
+static EVP_PKEY *janus_dtls_generate_rsa_key(void) {
 	static const int num_bits = 2048;
 	BIGNUM *bne = NULL;
 	RSA *rsa_key = NULL;
-	X509_NAME *cert_name = NULL;
-
-	JANUS_LOG(LOG_VERB, "Generating DTLS key / cert\n");
+	EVP_PKEY *private_key = NULL;
 
 	/* Create a big number object. */
 	bne = BN_new();
@@ -188,18 +210,79 @@ static int janus_dtls_generate_keys(X509 **certificate, EVP_PKEY **private_key)
 	}
 
 	/* Create a private key object (needed to hold the RSA key). */
-	*private_key = EVP_PKEY_new();
-	if(!*private_key) {
+	private_key = EVP_PKEY_new();
+	if(!private_key) {
 		JANUS_LOG(LOG_FATAL, "EVP_PKEY_new() failed\n");
 		goto error;
 	}
 
-	if(!EVP_PKEY_assign_RSA(*private_key, rsa_key)) {
+	if(!EVP_PKEY_assign_RSA(private_key, rsa_key)) {
 		JANUS_LOG(LOG_FATAL, "EVP_PKEY_assign_RSA() failed\n");
 		goto error;
 	}
 	/* The RSA key now belongs to the private key, so don't clean it up separately. */
-	rsa_key = NULL;
+	BN_free(bne);
+	return private_key;
+
+error:
+	if(bne)
+		BN_free(bne);
+	if(rsa_key)
+		RSA_free(rsa_key);
+	if(private_key)
+		EVP_PKEY_free(private_key);
+	return NULL;
+}
+
+/* Helper to generate an ECDSA key on the P-256 curve, which is what browsers
+ * use themselves: signing with it is much cheaper than with a RSA key */
+static EVP_PKEY *janus_dtls_generate_ec_key(void) {
+	EC_KEY *ec_key = NULL;
+	EVP_PKEY *private_key = NULL;
+
+	ec_key = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+	if(!ec_key) {
+		JANUS_LOG(LOG_FATAL, "EC_KEY_new_by_curve_name() failed\n");
+		goto error;
+	}
+	/* Make sure the certificate will name the curve, rather than list its parameters */
+	EC_KEY_set_asn1_flag(ec_key, OPENSSL_EC_NAMED_CURVE);
+
+	if(!EC_KEY_generate_key(ec_key)) {
+		JANUS_LOG(LOG_FATAL, "EC_KEY_generate_key() failed\n");
+		goto error;
+	}
+
+	private_key = EVP_PKEY_new();
+	if(!private_key) {
+		JANUS_LOG(LOG_FATAL, "EVP_PKEY_new() failed\n");
+		goto error;
+	}
+
+	if(!EVP_PKEY_assign_EC_KEY(private_key, ec_key)) {
+		JANUS_LOG(LOG_FATAL, "EVP_PKEY_assign_EC_KEY() failed\n");
+		goto error;
+	}
+	/* The EC key now belongs to the private key, so don't clean it up separately. */
+	return private_key;
+
+error:
+	if(ec_key)
+		EC_KEY_free(ec_key);
+	if(private_key)
+		EVP_PKEY_free(private_key);
+	return NULL;
+}
+
+static int janus_dtls_generate_keys(gboolean ecdsa, X509 **certificate, EVP_PKEY **private_key) {
+	X509_NAME *cert_name = NULL;
+
+	JANUS_LOG(LOG_VERB, "Generating DTLS key / cert (%s)\n", ecdsa ? "ECDSA" : "RSA");
+
+	/* Generate the key. */
+	*private_key = ecdsa ? janus_dtls_generate_ec_key() : janus_dtls_generate_rsa_key();
+	if(!*private_key)
+		goto error;
 
 	/* Create the X509 certificate. */
 	*certificate = X509_new();
@@ -239,28 +322,103 @@ static int janus_dtls_generate_keys(X509 **certificate, EVP_PKEY **private_key)
 		goto error;
 	}
 
-	/* Sign the certificate with the private key. */
-	if(!X509_sign(*certificate, *private_key, EVP_sha1())) {
+	/* Sign the certificate with the private key (ECDSA with SHA-1 is not an option). */
+	if(!X509_sign(*certificate, *private_key, ecdsa ? EVP_sha256() : EVP_sha1())) {
 		JANUS_LOG(LOG_FATAL, "X509_sign() failed\n");
 		goto error;
 	}
 
-	/* Free stuff and resurn. */
-	BN_free(bne);
 	return 0;
 
 error:
-	if(bne)
-		BN_free(bne);
-	if(rsa_key && !*private_key)
-		RSA_free(rsa_key);
-	if(*private_key)
-		EVP_PKEY_free(*private_key);  /* This also frees the RSA key. */
+	if(*private_key) {
+		EVP_PKEY_free(*private_key);
+		*private_key = NULL;
+	}
+	if(*certificate) {
+		X509_free(*certificate);
+		*certificate = NULL;
+	}
+	return -1;
+}
+
+
+/* Helper to load a self-generated cert/key we cached on disk, if it's still
+ * good: it must be of the type we want, and not about to expire */
+static int janus_dtls_load_cached_keys(const char *path, gboolean ecdsa, X509 **certificate, EVP_PKEY **private_key) {
+	FILE *f = fopen(path, "r");
+	if(!f)
+		return -1;
+	*certificate = PEM_read_X509(f, NULL, NULL, NULL);
 	if(*certificate)
+		*private_key = PEM_read_PrivateKey(f, NULL, NULL, NULL);
+	fclose(f);
+	if(!*certificate || !*private_key) {
+		JANUS_LOG(LOG_WARN, "Couldn't read cached DTLS key / cert (%s), generating new ones\n", path);
+		goto error;
+	}
+	if(EVP_PKEY_id(*private_key) != (ecdsa ? EVP_PKEY_EC : EVP_PKEY_RSA)) {
+		JANUS_LOG(LOG_INFO, "Cached DTLS key is not %s, generating new ones\n", ecdsa ? "ECDSA" : "RSA");
+		goto error;
+	}
+	if(!X509_check_private_key(*certificate, *private_key)) {
+		JANUS_LOG(LOG_WARN, "Cached DTLS key doesn't match the certificate, generating new ones\n");
+		goto error;
+	}
+	time_t renewal = time(NULL) + DTLS_AUTOCERT_RENEWAL;
+	if(X509_cmp_time(X509_get_notAfter(*certificate), &renewal) <= 0) {
+		JANUS_LOG(LOG_INFO, "Cached DTLS certificate is about to expire, generating new ones\n");
+		goto error;
+	}
+	return 0;
+
+error:
+	if(*certificate) {
 		X509_free(*certificate);
+		*certificate = NULL;
+	}
+	if(*private_key) {
+		EVP_PKEY_free(*private_key);
+		*private_key = NULL;
+	}
 	return -1;
 }
 
+/* Helper to cache a self-generated cert/key on disk: as the key is not
+ * encrypted, only the user Janus runs as can read the file. We write to a
+ * temporary file first, so that a crash never leaves a broken cache behind */
+static int janus_dtls_save_cached_keys(const char *path, X509 *certificate, EVP_PKEY *private_key) {
+	char *dir = g_path_get_dirname(path);
+	int res = g_mkdir_with_parents(dir, 0700);
+	g_free(dir);
+	if(res < 0) {
+		JANUS_LOG(LOG_WARN, "Couldn't create folder for the DTLS key / cert cache: %s\n", g_strerror(errno));
+		return -1;
+	}
+	char *tmp = g_strdup_printf("%s.tmp", path);
+	int fd = g_open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	FILE *f = fd > -1 ? fdopen(fd, "w") : NULL;
+	if(!f) {
+		JANUS_LOG(LOG_WARN, "Couldn't open %s to cache the DTLS key / cert: %s\n", tmp, g_strerror(errno));
+		if(fd > -1)
+			close(fd);
+		g_free(tmp);
+		return -1;
+	}
+	gboolean ok = PEM_write_X509(f, certificate) && PEM_write_PrivateKey(f, private_key, NULL, NULL, 0, NULL, NULL);
+	if(fclose(f) != 0)
+		ok = FALSE;
+	if(!ok || g_rename(tmp, path) < 0) {
+		JANUS_LOG(LOG_WARN, "Couldn't cache the DTLS key / cert in %s\n", path);
+		g_unlink(tmp);
+		g_free(tmp);
+		return -1;
+	}
+	g_free(tmp);
+	JANUS_LOG(LOG_INFO, "Cached the DTLS key / cert in %s\n", path);
+	return 0;
+}
+
 
 static int janus_dtls_load_keys(const char *server_pem, const char *server_key, const char *password,
 		X509 **certificate, EVP_PKEY **private_key) {
@@ -306,7 +464,8 @@ error:
 
 
 /* DTLS-SRTP initialization */
-gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const char *password) {
+gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const char *password,
+		gboolean ecdsa, const char *cache_dir) {
 	const char *crypto_lib = NULL;
 #if JANUS_USE_OPENSSL_PRE_1_1_API
 #if defined(LIBRESSL_VERSION_NUMBER)
@@ -318,7 +477,7 @@ gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const
 	janus_dtls_locks = g_malloc0(sizeof(*janus_dtls_locks) * CRYPTO_num_locks());
 	int l=0;
 	for(l = 0; l < CRYPTO_num_locks(); l++) {
-		janus_mutex_init(&janus_dtls_locks[l]);
+		pthread_rwlock_init(&janus_dtls_locks[l], NULL);
 	}
 	CRYPTO_THREADID_set_callback(janus_dtls_cb_openssl_threadid);
 	CRYPTO_set_locking_callback(janus_dtls_cb_openssl_lock);
@@ -351,18 +510,61 @@ gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const
 		"SRTP_AES128_CM_SHA1_80:SRTP_AES128_CM_SHA1_32");
 #endif
 
+#ifdef SSL_CTX_set_ecdh_auto
+	/* Needed for ECDHE on OpenSSL 1.0.2 (and so for ECDSA certificates), the default since 1.1.0 */
+	SSL_CTX_set_ecdh_auto(ssl_ctx, 1);
+#elif !defined(OPENSSL_NO_ECDH)
+	/* Older versions can't pick a curve by themselves: set P-256 once here, rather than per handshake */
+	EC_KEY *ecdh = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+	if(ecdh != NULL) {
+		SSL_CTX_set_tmp_ecdh(ssl_ctx, ecdh);
+		EC_KEY_free(ecdh);
+	}
+#endif
+	/* All stacks share this context: since DTLS-SRTP never resumes sessions, there's
+	 * no point in caching them (or issuing tickets), which would mean taking the
+	 * context lock for each handshake, and a context wide cache to flush */
+	SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_OFF);
+	SSL_CTX_set_options(ssl_ctx, SSL_OP_NO_TICKET);
+
 	if(!server_pem && !server_key) {
-		JANUS_LOG(LOG_WARN, "No cert/key specified, autogenerating some...\n");
-		if(janus_dtls_generate_keys(&ssl_cert, &ssl_key) != 0) {
-			JANUS_LOG(LOG_FATAL, "Error generating DTLS key/certificate\n");
-			return -2;
+		/* If we have a cache, check if there's something we generated on a previous run first */
+		char *cache = NULL;
+		if(cache_dir != NULL) {
+			char name[32];
+			g_snprintf(name, sizeof(name), "janus-dtls-%s.pem", ecdsa ? "ecdsa" : "rsa");
+			cache = g_build_filename(cache_dir, name, NULL);
 		}
+		if(cache != NULL && janus_dtls_load_cached_keys(cache, ecdsa, &ssl_cert, &ssl_key) == 0) {
+			JANUS_LOG(LOG_INFO, "No cert/key specified, using the ones we cached in %s\n", cache);
+		} else {
+			JANUS_LOG(LOG_WARN, "No cert/key specified, autogenerating some...\n");
+			if(janus_dtls_generate_keys(ecdsa, &ssl_cert, &ssl_key) != 0) {
+				JANUS_LOG(LOG_FATAL, "Error generating DTLS key/certificate\n");
+				g_free(cache);
+				return -2;
+			}
+			if(cache != NULL)
+				janus_dtls_save_cached_keys(cache, ssl_cert, ssl_key);
+		}
+		g_free(cache);
 	} else if(!server_pem || !server_key) {
 		JANUS_LOG(LOG_FATAL, "DTLS certificate and key must be specified\n");
 		return -2;
 	} else if(janus_dtls_load_keys(server_pem, server_key, password, &ssl_cert, &ssl_key) != 0) {
 		return -3;
+	} else if(EVP_PKEY_id(ssl_key) == EVP_PKEY_EC) {
+		/* Browsers only support a few curves for ECDSA certificates: P-256 is the safe bet */
+		EC_KEY *ec_key = EVP_PKEY_get1_EC_KEY(ssl_key);
+		int curve = ec_key ? EC_GROUP_get_curve_name(EC_KEY_get0_group(ec_key)) : NID_undef;
+		if(ec_key)
+			EC_KEY_free(ec_key);
+		if(curve != NID_X9_62_prime256v1) {
+			JANUS_LOG(LOG_WARN, "The DTLS key is ECDSA but not on the P-256 curve (%s), some peers may not support it\n",
+				curve != NID_undef ? OBJ_nid2sn(curve) : "unknown");
+		}
 	}
+	JANUS_LOG(LOG_INFO, "DTLS key type: %s\n", EVP_PKEY_id(ssl_key) == EVP_PKEY_EC ? "ECDSA" : "RSA");
 
 	if(!SSL_CTX_use_certificate(ssl_ctx, ssl_cert)) {
 		JANUS_LOG(LOG_FATAL, "Certificate error (%s)\n", ERR_reason_error_string(ERR_get_error()));
@@ -408,7 +610,9 @@ gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const
 }
 
 
+static void janus_dtls_handshake_workers_deinit(void);
 void janus_dtls_srtp_cleanup(void) {
+	janus_dtls_handshake_workers_deinit();
 	if(ssl_cert != NULL) {
 		X509_free(ssl_cert);
 		ssl_cert = NULL;
@@ -421,6 +625,512 @@ void janus_dtls_srtp_cleanup(void) {
 		SSL_CTX_free(ssl_ctx);
 		ssl_ctx = NULL;
 	}
+#if JANUS_USE_OPENSSL_PRE_1_1_API
+	if(janus_dtls_locks != NULL) {
+		CRYPTO_set_locking_callback(NULL);
+		CRYPTO_THREADID_set_callback(NULL);
+		int l=0;
+		for(l = 0; l < CRYPTO_num_locks(); l++) {
+			pthread_rwlock_destroy(&janus_dtls_locks[l]);
+		}
+		g_free(janus_dtls_locks);
+		janus_dtls_locks = NULL;
+	}
+#endif
+}
+
+
+/* Helper to pass an incoming DTLS record to OpenSSL, and send whatever it wants to send back */
+static gboolean janus_dtls_srtp_feed(janus_dtls_srtp *dtls, guint64 handle_id, char *buf, int len, char *data, int size, int *read) {
+	janus_dtls_fd_bridge(dtls);
+	int written = BIO_write(dtls->read_bio, buf, len);
+	if(written != len) {
+		JANUS_LOG(LOG_WARN, "[%"SCNu64"]     Only written %d/%d of those bytes on the read BIO...\n", handle_id, written, len);
+	} else {
+		JANUS_LOG(LOG_HUGE, "[%"SCNu64"]     Written %d bytes on the read BIO...\n", handle_id, written);
+	}
+	janus_dtls_fd_bridge(dtls);
+	memset(data, 0, size);
+	*read = SSL_read(dtls->ssl, data, size);
+	JANUS_LOG(LOG_HUGE, "[%"SCNu64"]     ... and read %d of them from SSL...\n", handle_id, *read);
+	if(*read < 0) {
+		unsigned long err = SSL_get_error(dtls->ssl, *read);
+		if(err == SSL_ERROR_SSL) {
+			/* Ops, something went wrong with the DTLS handshake */
+			char error[200];
+			ERR_error_string_n(ERR_get_error(), error, 200);
+			JANUS_LOG(LOG_ERR, "[%"SCNu64"] Handshake error: %s\n", handle_id, error);
+			return FALSE;
+		}
+	}
+	janus_dtls_fd_bridge(dtls);
+	return TRUE;
+}
+
+/* Helper to check the remote fingerprint and set SRTP up, once the handshake has been completed */
+static void janus_dtls_srtp_established(janus_dtls_srtp *dtls) {
+	janus_ice_component *component = (janus_ice_component *)dtls->component;
+	if(component == NULL)
+		return;
+	janus_ice_stream *stream = component->stream;
+	if(!stream)
+		return;
+	janus_ice_handle *handle = stream->handle;
+	if(!handle || !handle->agent)
+		return;
+	JANUS_LOG(LOG_VERB, "[%"SCNu64"] DTLS established, yay!\n", handle->handle_id);
+	/* Check the remote fingerprint */
+	X509 *rcert = SSL_get_peer_certificate(dtls->ssl);
+	if(!rcert) {
+		JANUS_LOG(LOG_ERR, "[%"SCNu64"] No remote certificate?? (%s)\n",
+			handle->handle_id, ERR_reason_error_string(ERR_get_error()));
+	} else {
+		unsigned int rsize;
+		unsigned char rfingerprint[EVP_MAX_MD_SIZE];
+		char remote_fingerprint[160];
+		char *rfp = (char *)&remote_fingerprint;
+		if(stream->remote_hashing && !strcasecmp(stream->remote_hashing, "sha-1")) {
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Computing sha-1 fingerprint of remote certificate...\n", handle->handle_id);
+			X509_digest(rcert, EVP_sha1(), (unsigned char *)rfingerprint, &rsize);
+		} else {
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Computing sha-256 fingerprint of remote certificate...\n", handle->handle_id);
+			X509_digest(rcert, EVP_sha256(), (unsigned char *)rfingerprint, &rsize);
+		}
+		X509_free(rcert);
+		rcert = NULL;
+		unsigned int i = 0;
+		for(i = 0; i < rsize; i++) {
+			g_snprintf(rfp, 4, "%.2X:", rfingerprint[i]);
+			rfp += 3;
+		}
+		*(rfp-1) = 0;
+		JANUS_LOG(LOG_VERB, "[%"SCNu64"] Remote fingerprint (%s) of the client is %s\n",
+			handle->handle_id, stream->remote_hashing ? stream->remote_hashing : "sha-256", remote_fingerprint);
+		if(!strcasecmp(remote_fingerprint, stream->remote_fingerprint ? stream->remote_fingerprint : "(none)")) {
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"]  Fingerprint is a match!\n", handle->handle_id);
+			dtls->dtls_state = JANUS_DTLS_STATE_CONNECTED;
+			dtls->dtls_connected = janus_get_monotonic_time();
+			/* Notify event handlers */
+			janus_dtls_notify_state_change(dtls);
+		} else {
+			/* FIXME NOT a match! MITM? */
+			JANUS_LOG(LOG_ERR, "[%"SCNu64"]  Fingerprint is NOT a match! got %s, expected %s\n", handle->handle_id, remote_fingerprint, stream->remote_fingerprint);
+			dtls->dtls_state = JANUS_DTLS_STATE_FAILED;
+			/* Notify event handlers */
+			janus_dtls_notify_state_change(dtls);
+			goto done;
+		}
+		if(dtls->dtls_state == JANUS_DTLS_STATE_CONNECTED) {
+			/* Which SRTP profile is being negotiated? */
+			SRTP_PROTECTION_PROFILE *srtp_profile = SSL_get_selected_srtp_profile(dtls->ssl);
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] %s\n", handle->handle_id, srtp_profile->name);
+			int key_length = 0, salt_length = 0, master_length = 0;
+			switch(srtp_profile->id) {
+				case SRTP_AES128_CM_SHA1_80:
+				case SRTP_AES128_CM_SHA1_32:
+					key_length = SRTP_MASTER_KEY_LENGTH;
+					salt_length = SRTP_MASTER_SALT_LENGTH;
+					master_length = SRTP_MASTER_LENGTH;
+					break;
+#ifdef HAVE_SRTP_AESGCM
+				case SRTP_AEAD_AES_256_GCM:
+					key_length = SRTP_AESGCM256_MASTER_KEY_LENGTH;
+					salt_length = SRTP_AESGCM256_MASTER_SALT_LENGTH;
+					master_length = SRTP_AESGCM256_MASTER_LENGTH;
+					break;
+				case SRTP_AEAD_AES_128_GCM:
+					key_length = SRTP_AESGCM128_MASTER_KEY_LENGTH;
+					salt_length = SRTP_AESGCM128_MASTER_SALT_LENGTH;
+					master_length = SRTP_AESGCM128_MASTER_LENGTH;
+					break;
+#endif
+				default:
+					/* Will never happen? */
+					JANUS_LOG(LOG_WARN, "[%"SCNu64"] Unsupported SRTP profile %lu\n", handle->handle_id, srtp_profile->id);
+					break;
+			}
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Key/Salt/Master: %d/%d/%d\n",
+				handle->handle_id, master_length, key_length, salt_length);
+			/* Complete with SRTP setup */
+			unsigned char material[master_length*2];
+			unsigned char *local_key, *local_salt, *remote_key, *remote_salt;
+			/* Export keying material for SRTP */
+			if(!SSL_export_keying_material(dtls->ssl, material, master_length*2, "EXTRACTOR-dtls_srtp", 19, NULL, 0, 0)) {
+				/* Oops... */
+				JANUS_LOG(LOG_ERR, "[%"SCNu64"] Oops, couldn't extract SRTP keying material for component %d in stream %d?? (%s)\n",
+					handle->handle_id, component->component_id, stream->stream_id, ERR_reason_error_string(ERR_get_error()));
+				goto done;
+			}
+			/* Key derivation (http://tools.ietf.org/html/rfc5764#section-4.2) */
+			if(dtls->dtls_role == JANUS_DTLS_ROLE_CLIENT) {
+				local_key = material;
+				remote_key = local_key + key_length;
+				local_salt = remote_key + key_length;
+				remote_salt = local_salt + salt_length;
+			} else {
+				remote_key = material;
+				local_key = remote_key + key_length;
+				remote_salt = local_key + key_length;
+				local_salt = remote_salt + salt_length;
+			}
+			/* Build master keys and set SRTP policies */
+				/* Remote (inbound) */
+			switch(srtp_profile->id) {
+				case SRTP_AES128_CM_SHA1_80:
+					srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->remote_policy.rtp));
+					srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->remote_policy.rtcp));
+					break;
+				case SRTP_AES128_CM_SHA1_32:
+					srtp_crypto_policy_set_aes_cm_128_hmac_sha1_32(&(dtls->remote_policy.rtp));
+					srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->remote_policy.rtcp));
+					break;
+#ifdef HAVE_SRTP_AESGCM
+				case SRTP_AEAD_AES_256_GCM:
+					srtp_crypto_policy_set_aes_gcm_256_16_auth(&(dtls->remote_policy.rtp));
+					srtp_crypto_policy_set_aes_gcm_256_16_auth(&(dtls->remote_policy.rtcp));
+					break;
+				case SRTP_AEAD_AES_128_GCM:
+					srtp_crypto_policy_set_aes_gcm_128_16_auth(&(dtls->remote_policy.rtp));
+					srtp_crypto_policy_set_aes_gcm_128_16_auth(&(dtls->remote_policy.rtcp));
+					break;
+#endif
+				default:
+					/* Will never happen? */
+					JANUS_LOG(LOG_WARN, "[%"SCNu64"] Unsupported SRTP profile %s\n", handle->handle_id, srtp_profile->name);
+					break;
+			}
+			dtls->remote_policy.ssrc.type = ssrc_any_inbound;
+			unsigned char remote_policy_key[master_length];
+			dtls->remote_policy.key = (unsigned char *)&remote_policy_key;
+			memcpy(dtls->remote_policy.key, remote_key, key_length);
+			memcpy(dtls->remote_policy.key + key_length, remote_salt, salt_length);
+#if HAS_DTLS_WINDOW_SIZE
+			dtls->remote_policy.window_size = 128;
+			dtls->remote_policy.allow_repeat_tx = 0;
+#endif
+			dtls->remote_policy.next = NULL;
+				/* Local (outbound) */
+			switch(srtp_profile->id) {
+				case SRTP_AES128_CM_SHA1_80:
+					srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->local_policy.rtp));
+					srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->local_policy.rtcp));
+					break;
+				case SRTP_AES128_CM_SHA1_32:
+					srtp_crypto_policy_set_aes_cm_128_hmac_sha1_32(&(dtls->local_policy.rtp));
+					srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->local_policy.rtcp));
+					break;
+#ifdef HAVE_SRTP_AESGCM
+				case SRTP_AEAD_AES_256_GCM:
+					srtp_crypto_policy_set_aes_gcm_256_16_auth(&(dtls->local_policy.rtp));
+					srtp_crypto_policy_set_aes_gcm_256_16_auth(&(dtls->local_policy.rtcp));
+					break;
+				case SRTP_AEAD_AES_128_GCM:
+					srtp_crypto_policy_set_aes_gcm_128_16_auth(&(dtls->local_policy.rtp));
+					srtp_crypto_policy_set_aes_gcm_128_16_auth(&(dtls->local_policy.rtcp));
+					break;
+#endif
+				default:
+					/* Will never happen? */
+					JANUS_LOG(LOG_WARN, "[%"SCNu64"] Unsupported SRTP profile %s\n", handle->handle_id, srtp_profile->name);
+					break;
+			}
+			dtls->local_policy.ssrc.type = ssrc_any_outbound;
+			unsigned char local_policy_key[master_length];
+			dtls->local_policy.key = (unsigned char *)&local_policy_key;
+			memcpy(dtls->local_policy.key, local_key, key_length);
+			memcpy(dtls->local_policy.key + key_length, local_salt, salt_length);
+#if HAS_DTLS_WINDOW_SIZE
+			dtls->local_policy.window_size = 128;
+			dtls->local_policy.allow_repeat_tx = 0;
+#endif
+			dtls->local_policy.next = NULL;
+			/* Create SRTP sessions */
+			srtp_err_status_t res = srtp_create(&(dtls->srtp_in), &(dtls->remote_policy));
+			if(res != srtp_err_status_ok) {
+				/* Something went wrong... */
+				JANUS_LOG(LOG_ERR, "[%"SCNu64"] Oops, error creating inbound SRTP session for component %d in stream %d??\n", handle->handle_id, component->component_id, stream->stream_id);
+				JANUS_LOG(LOG_ERR, "[%"SCNu64"]  -- %d (%s)\n", handle->handle_id, res, janus_srtp_error_str(res));
+				goto done;
+			}
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Created inbound SRTP session for component %d in stream %d\n", handle->handle_id, component->component_id, stream->stream_id);
+			res = srtp_create(&(dtls->srtp_out), &(dtls->local_policy));
+			if(res != srtp_err_status_ok) {
+				/* Something went wrong... */
+				JANUS_LOG(LOG_ERR, "[%"SCNu64"] Oops, error creating outbound SRTP session for component %d in stream %d??\n", handle->handle_id, component->component_id, stream->stream_id);
+				JANUS_LOG(LOG_ERR, "[%"SCNu64"]  -- %d (%s)\n", handle->handle_id, res, janus_srtp_error_str(res));
+				goto done;
+			}
+			dtls->srtp_valid = 1;
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Created outbound SRTP session for component %d in stream %d\n", handle->handle_id, component->component_id, stream->stream_id);
+#ifdef HAVE_SCTP
+			if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_DATA_CHANNELS)) {
+				/* Create SCTP association as well */
+				janus_dtls_srtp_create_sctp(dtls);
+			}
+#endif
+			dtls->ready = 1;
+		}
+done:
+		if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT) && dtls->srtp_valid) {
+			/* Handshake successfully completed */
+			janus_ice_dtls_handshake_done(handle, component);
+		} else {
+			/* Something went wrong in either DTLS or SRTP... tell the plugin about it */
+			janus_dtls_callback(dtls->ssl, SSL_CB_ALERT, 0);
+			janus_flags_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_CLEANING);
+		}
+	}
+}
+
+/* DTLS handshake workers: rather than doing handshakes on the ICE loop of
+ * each handle, where they'd delay the media of all the other handles on the
+ * same loop, incoming records are queued for a pool of threads until the
+ * handshake is done. To keep a burst of handshakes (e.g., a whole room
+ * reconnecting) from hogging the CPU, only so many can be in progress at
+ * the same time: the others wait for their turn in a queue. Fingerprint
+ * check and SRTP setup are still done on the ICE loop of the handle */
+#define JANUS_DTLS_PENDING_MAX				64
+#define JANUS_DTLS_HANDSHAKE_SAMPLES		1024
+static guint handshake_workers_num = 0;
+static GThread **handshake_workers = NULL;
+static GAsyncQueue *handshake_jobs = NULL;
+static janus_dtls_srtp handshake_exit;
+/* This protects the waiting queue and stats, and the handshake fields of the stacks (except the SSL context) */
+static janus_mutex handshake_mutex = JANUS_MUTEX_INITIALIZER;
+static janus_admission handshake_admission;
+static guint64 handshake_completed = 0;
+static gint64 handshake_durations[JANUS_DTLS_HANDSHAKE_SAMPLES];
+static guint handshake_durations_count = 0, handshake_durations_next = 0;
+
+static void janus_dtls_srtp_ref(janus_dtls_srtp *dtls) {
+	g_atomic_int_inc(&dtls->ref);
+}
+
+static void janus_dtls_srtp_unref(janus_dtls_srtp *dtls) {
+	if(g_atomic_int_dec_and_test(&dtls->ref)) {
+		if(dtls->pending != NULL)
+			g_queue_free_full(dtls->pending, (GDestroyNotify)g_bytes_unref);
+		janus_mutex_destroy(&dtls->mutex);
+		g_free(dtls);
+	}
+}
+
+/* Helper to give the handshake slot of a stack back, and let the next one in (handshake_mutex must be locked) */
+static void janus_dtls_handshake_release(janus_dtls_srtp *dtls) {
+	if(!dtls->admitted)
+		return;
+	dtls->admitted = FALSE;
+	janus_dtls_srtp *next = janus_admission_leave(&handshake_admission);
+	if(next != NULL) {
+		next->admitted = TRUE;
+		g_async_queue_push(handshake_jobs, next);
+	}
+}
+
+/* Helper to queue an incoming record for the handshake workers: returns FALSE
+ * if the workers are done with this stack, and the record must be processed here */
+static gboolean janus_dtls_handshake_enqueue(janus_dtls_srtp *dtls, char *buf, uint16_t len) {
+	janus_mutex_lock(&handshake_mutex);
+	if(dtls->handshake_handed_over) {
+		janus_mutex_unlock(&handshake_mutex);
+		return FALSE;
+	}
+	if(g_queue_get_length(dtls->pending) >= JANUS_DTLS_PENDING_MAX) {
+		/* We're way behind, drop this: the peer will retransmit */
+		janus_mutex_unlock(&handshake_mutex);
+		return TRUE;
+	}
+	g_queue_push_tail(dtls->pending, g_bytes_new(buf, len));
+	if(dtls->handshake_queued == 0)
+		dtls->handshake_queued = janus_get_monotonic_time();
+	if(!dtls->scheduled && !dtls->handshake_finished) {
+		/* Wake a worker up, or wait for our turn if too many handshakes are in progress */
+		dtls->scheduled = TRUE;
+		janus_dtls_srtp_ref(dtls);
+		if(dtls->admitted || janus_admission_enter(&handshake_admission, dtls)) {
+			dtls->admitted = TRUE;
+			g_async_queue_push(handshake_jobs, dtls);
+		}
+	}
+	janus_mutex_unlock(&handshake_mutex);
+	return TRUE;
+}
+
+/* Callback, on the ICE loop of the handle, to take over once a worker completed the handshake */
+static gboolean janus_dtls_handshake_handover(gpointer user_data) {
+	janus_dtls_srtp *dtls = (janus_dtls_srtp *)user_data;
+	janus_mutex_lock(&dtls->mutex);
+	gboolean alive = (dtls->component != NULL && dtls->ssl != NULL);
+	janus_mutex_unlock(&dtls->mutex);
+	if(!alive)
+		return G_SOURCE_REMOVE;
+	janus_dtls_srtp_established(dtls);
+	/* Whatever arrived in the meanwhile (e.g., SCTP) can now be processed as usual */
+	janus_mutex_lock(&handshake_mutex);
+	dtls->handshake_handed_over = TRUE;
+	GQueue *pending = dtls->pending;
+	dtls->pending = g_queue_new();
+	janus_mutex_unlock(&handshake_mutex);
+	GBytes *record = NULL;
+	while((record = g_queue_pop_head(pending)) != NULL) {
+		gsize size = 0;
+		const char *buf = g_bytes_get_data(record, &size);
+		janus_dtls_srtp_incoming_msg(dtls, (char *)buf, size);
+		g_bytes_unref(record);
+	}
+	g_queue_free(pending);
+	return G_SOURCE_REMOVE;
+}
+
+static void *janus_dtls_handshake_worker(void *data) {
+	JANUS_LOG(LOG_INFO, "Joining DTLS handshake worker #%u\n", GPOINTER_TO_UINT(data));
+	char buffer[1500];
+	while(TRUE) {
+		janus_dtls_srtp *dtls = g_async_queue_pop(handshake_jobs);
+		if(dtls == &handshake_exit)
+			break;
+		janus_mutex_lock(&dtls->mutex);
+		while(TRUE) {
+			janus_mutex_lock(&handshake_mutex);
+			GBytes *record = (dtls->component && dtls->ssl && !dtls->handshake_finished) ?
+				g_queue_pop_head(dtls->pending) : NULL;
+			if(record == NULL) {
+				/* Nothing left to do, for now */
+				dtls->scheduled = FALSE;
+				janus_mutex_unlock(&handshake_mutex);
+				break;
+			}
+			janus_mutex_unlock(&handshake_mutex);
+			janus_ice_component *component = (janus_ice_component *)dtls->component;
+			janus_ice_stream *stream = component->stream;
+			janus_ice_handle *handle = stream ? stream->handle : NULL;
+			if(handle == NULL || handle->agent == NULL || janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT)) {
+				g_bytes_unref(record);
+				continue;
+			}
+			gsize size = 0;
+			const char *buf = g_bytes_get_data(record, &size);
+			int read = 0;
+			gboolean ok = janus_dtls_srtp_feed(dtls, handle->handle_id, (char *)buf, size, buffer, sizeof(buffer), &read);
+			g_bytes_unref(record);
+			if(!ok) {
+				/* Don't let a broken handshake keep the others waiting */
+				janus_mutex_lock(&handshake_mutex);
+				janus_dtls_handshake_release(dtls);
+				janus_mutex_unlock(&handshake_mutex);
+				continue;
+			}
+			if(!SSL_is_init_finished(dtls->ssl))
+				continue;
+			/* Done: keep track of how long it took, and let the ICE loop take it from here */
+			janus_mutex_lock(&handshake_mutex);
+			dtls->handshake_finished = TRUE;
+			handshake_durations[handshake_durations_next] = janus_get_monotonic_time() - dtls->handshake_queued;
+			handshake_durations_next = (handshake_durations_next + 1) % JANUS_DTLS_HANDSHAKE_SAMPLES;
+			if(handshake_durations_count < JANUS_DTLS_HANDSHAKE_SAMPLES)
+				handshake_durations_count++;
+			handshake_completed++;
+			janus_dtls_handshake_release(dtls);
+			janus_mutex_unlock(&handshake_mutex);
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] DTLS handshake completed by a worker\n", handle->handle_id);
+			janus_dtls_srtp_ref(dtls);
+			GSource *source = g_idle_source_new();
+			g_source_set_callback(source, janus_dtls_handshake_handover, dtls, (GDestroyNotify)janus_dtls_srtp_unref);
+			g_source_attach(source, handle->icectx);
+			g_source_unref(source);
+		}
+		janus_mutex_unlock(&dtls->mutex);
+		janus_dtls_srtp_unref(dtls);
+	}
+#if JANUS_USE_OPENSSL_PRE_1_1_API && !defined(HAVE_BORINGSSL)
+	/* Older versions of OpenSSL don't free the error queue of a thread by themselves */
+	ERR_remove_thread_state(NULL);
+#endif
+	JANUS_LOG(LOG_INFO, "Leaving DTLS handshake worker #%u\n", GPOINTER_TO_UINT(data));
+	return NULL;
+}
+
+gint janus_dtls_handshake_workers_init(guint workers, guint max_handshakes) {
+	if(workers == 0)
+		return 0;
+	handshake_jobs = g_async_queue_new();
+	janus_admission_init(&handshake_admission, max_handshakes);
+	handshake_workers = g_malloc0(workers * sizeof(GThread *));
+	guint w = 0;
+	for(w=0; w<workers; w++) {
+		GError *error = NULL;
+		char tname[16];
+		g_snprintf(tname, sizeof(tname), "dtls %u", w+1);
+		handshake_workers[w] = g_thread_try_new(tname, &janus_dtls_handshake_worker, GUINT_TO_POINTER(w+1), &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_FATAL, "Got error %d (%s) trying to launch DTLS handshake worker #%u...\n",
+				error->code, error->message ? error->message : "??", w+1);
+			g_error_free(error);
+			return -1;
+		}
+		handshake_workers_num++;
+	}
+	JANUS_LOG(LOG_INFO, "Started %u DTLS handshake workers (max concurrent handshakes: %u)\n",
+		handshake_workers_num, max_handshakes);
+	return 0;
+}
+
+static void janus_dtls_handshake_workers_deinit(void) {
+	if(handshake_workers == NULL)
+		return;
+	guint w = 0;
+	for(w=0; w<handshake_workers_num; w++)
+		g_async_queue_push(handshake_jobs, &handshake_exit);
+	for(w=0; w<handshake_workers_num; w++) {
+		if(handshake_workers[w] != NULL)
+			g_thread_join(handshake_workers[w]);
+	}
+	g_free(handshake_workers);
+	handshake_workers = NULL;
+	handshake_workers_num = 0;
+	/* Get rid of the references to the stacks that never got their turn */
+	janus_dtls_srtp *dtls = NULL;
+	while((dtls = g_async_queue_try_pop(handshake_jobs)) != NULL) {
+		if(dtls != &handshake_exit)
+			janus_dtls_srtp_unref(dtls);
+	}
+	g_async_queue_unref(handshake_jobs);
+	handshake_jobs = NULL;
+	janus_mutex_lock(&handshake_mutex);
+	janus_admission_clear(&handshake_admission, (GDestroyNotify)janus_dtls_srtp_unref);
+	janus_mutex_unlock(&handshake_mutex);
+}
+
+guint janus_dtls_get_handshake_workers(void) {
+	return handshake_workers_num;
+}
+
+static int janus_dtls_compare_durations(const void *a, const void *b) {
+	gint64 da = *(const gint64 *)a, db = *(const gint64 *)b;
+	return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+json_t *janus_dtls_handshake_workers_info(void) {
+	json_t *info = json_object();
+	gint64 durations[JANUS_DTLS_HANDSHAKE_SAMPLES];
+	janus_mutex_lock(&handshake_mutex);
+	json_object_set_new(info, "workers", json_integer(handshake_workers_num));
+	json_object_set_new(info, "max-handshakes", json_integer(handshake_admission.max));
+	json_object_set_new(info, "active", json_integer(handshake_admission.active));
+	/* Stacks waiting for a slot, plus those admitted but not picked by a worker yet */
+	gint jobs = handshake_jobs ? g_async_queue_length(handshake_jobs) : 0;
+	json_object_set_new(info, "queued", json_integer(janus_admission_waiting(&handshake_admission) + (jobs > 0 ? jobs : 0)));
+	json_object_set_new(info, "completed", json_integer(handshake_completed));
+	guint count = handshake_durations_count;
+	memcpy(durations, handshake_durations, count * sizeof(gint64));
+	janus_mutex_unlock(&handshake_mutex);
+	/* Percentiles of the most recent handshakes, from when the first record was queued (in ms) */
+	if(count > 0) {
+		qsort(durations, count, sizeof(gint64), janus_dtls_compare_durations);
+		json_object_set_new(info, "duration-p50", json_integer(durations[(count-1)*50/100]/1000));
+		json_object_set_new(info, "duration-p99", json_integer(durations[(count-1)*99/100]/1000));
+	}
+	return info;
 }
 
 
@@ -441,6 +1151,9 @@ janus_dtls_srtp *janus_dtls_srtp_create(void *ice_component, janus_dtls_role rol
 		return NULL;
 	}
 	janus_dtls_srtp *dtls = g_malloc0(sizeof(janus_dtls_srtp));
+	g_atomic_int_set(&dtls->ref, 1);
+	janus_mutex_init(&dtls->mutex);
+	dtls->pending = g_queue_new();
 	/* Create SSL context, at last */
 	dtls->srtp_valid = 0;
 	dtls->ssl = SSL_new(ssl_ctx);
@@ -482,22 +1195,11 @@ janus_dtls_srtp *janus_dtls_srtp_create(void *ice_component, janus_dtls_role rol
 	SSL_set_bio(dtls->ssl, dtls->read_bio, dtls->filter_bio);
 	/* The role may change later, depending on the negotiation */
 	dtls->dtls_role = role;
-	/* https://code.google.com/p/chromium/issues/detail?id=406458
-	 * Specify an ECDH group for ECDHE ciphers, otherwise they cannot be
-	 * negotiated when acting as the server. Use NIST's P-256 which is
-	 * commonly supported.
-	 */
-	EC_KEY *ecdh = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
-	if(ecdh == NULL) {
-		JANUS_LOG(LOG_ERR, "[%"SCNu64"]   Error creating ECDH group! (%s)\n",
-			handle->handle_id, ERR_reason_error_string(ERR_get_error()));
-		janus_dtls_srtp_destroy(dtls);
-		return NULL;
-	}
+	/* The ECDH group for ECDHE ciphers (needed to negotiate them when acting as
+	 * the server, see https://code.google.com/p/chromium/issues/detail?id=406458)
+	 * is set on the shared context in janus_dtls_srtp_init, and not per stack */
 	const long flags = SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION | SSL_OP_SINGLE_ECDH_USE;
 	SSL_set_options(dtls->ssl, flags);
-	SSL_set_tmp_ecdh(dtls->ssl, ecdh);
-	EC_KEY_free(ecdh);
 #ifdef HAVE_DTLS_SETTIMEOUT
 	guint ms = 100;
 	JANUS_LOG(LOG_VERB, "[%"SCNu64"]   Setting DTLS initial timeout: %u\n", handle->handle_id, ms);
@@ -528,8 +1230,10 @@ void janus_dtls_srtp_handshake(janus_dtls_srtp *dtls) {
 		}
 		dtls->dtls_state = JANUS_DTLS_STATE_TRYING;
 	}
+	janus_mutex_lock(&dtls->mutex);
 	SSL_do_handshake(dtls->ssl);
 	janus_dtls_fd_bridge(dtls);
+	janus_mutex_unlock(&dtls->mutex);
 
 	/* Notify event handlers */
 	janus_dtls_notify_state_change(dtls);
@@ -604,30 +1308,14 @@ void janus_dtls_srtp_incoming_msg(janus_dtls_srtp *dtls, char *buf, uint16_t len
 		/* Handshake not started yet: maybe we're still waiting for the answer and the DTLS role? */
 		return;
 	}
-	janus_dtls_fd_bridge(dtls);
-	int written = BIO_write(dtls->read_bio, buf, len);
-	if(written != len) {
-		JANUS_LOG(LOG_WARN, "[%"SCNu64"]     Only written %d/%d of those bytes on the read BIO...\n", handle->handle_id, written, len);
-	} else {
-		JANUS_LOG(LOG_HUGE, "[%"SCNu64"]     Written %d bytes on the read BIO...\n", handle->handle_id, written);
-	}
-	janus_dtls_fd_bridge(dtls);
+	/* If we have handshake workers, they take care of this until the handshake is done */
+	if(handshake_workers_num > 0 && janus_dtls_handshake_enqueue(dtls, buf, len))
+		return;
 	/* Try to read data */
 	char data[1500];	/* FIXME */
-	memset(&data, 0, 1500);
-	int read = SSL_read(dtls->ssl, &data, 1500);
-	JANUS_LOG(LOG_HUGE, "[%"SCNu64"]     ... and read %d of them from SSL...\n", handle->handle_id, read);
-	if(read < 0) {
-		unsigned long err = SSL_get_error(dtls->ssl, read);
-		if(err == SSL_ERROR_SSL) {
-			/* Ops, something went wrong with the DTLS handshake */
-			char error[200];
-			ERR_error_string_n(ERR_get_error(), error, 200);
-			JANUS_LOG(LOG_ERR, "[%"SCNu64"] Handshake error: %s\n", handle->handle_id, error);
-			return;
-		}
-	}
-	janus_dtls_fd_bridge(dtls);
+	int read = 0;
+	if(!janus_dtls_srtp_feed(dtls, handle->handle_id, buf, len, data, sizeof(data), &read))
+		return;
 	if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP) || janus_is_stopping()) {
 		/* DTLS alert triggered, we should end it here */
 		JANUS_LOG(LOG_VERB, "[%"SCNu64"] Forced to stop it here...\n", handle->handle_id);
@@ -652,216 +1340,17 @@ void janus_dtls_srtp_incoming_msg(janus_dtls_srtp *dtls, char *buf, uint16_t len
 		}
 #endif
 	} else {
-		JANUS_LOG(LOG_VERB, "[%"SCNu64"] DTLS established, yay!\n", handle->handle_id);
-		/* Check the remote fingerprint */
-		X509 *rcert = SSL_get_peer_certificate(dtls->ssl);
-		if(!rcert) {
-			JANUS_LOG(LOG_ERR, "[%"SCNu64"] No remote certificate?? (%s)\n",
-				handle->handle_id, ERR_reason_error_string(ERR_get_error()));
-		} else {
-			unsigned int rsize;
-			unsigned char rfingerprint[EVP_MAX_MD_SIZE];
-			char remote_fingerprint[160];
-			char *rfp = (char *)&remote_fingerprint;
-			if(stream->remote_hashing && !strcasecmp(stream->remote_hashing, "sha-1")) {
-				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Computing sha-1 fingerprint of remote certificate...\n", handle->handle_id);
-				X509_digest(rcert, EVP_sha1(), (unsigned char *)rfingerprint, &rsize);
-			} else {
-				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Computing sha-256 fingerprint of remote certificate...\n", handle->handle_id);
-				X509_digest(rcert, EVP_sha256(), (unsigned char *)rfingerprint, &rsize);
-			}
-			X509_free(rcert);
-			rcert = NULL;
-			unsigned int i = 0;
-			for(i = 0; i < rsize; i++) {
-				g_snprintf(rfp, 4, "%.2X:", rfingerprint[i]);
-				rfp += 3;
-			}
-			*(rfp-1) = 0;
-			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Remote fingerprint (%s) of the client is %s\n",
-				handle->handle_id, stream->remote_hashing ? stream->remote_hashing : "sha-256", remote_fingerprint);
-			if(!strcasecmp(remote_fingerprint, stream->remote_fingerprint ? stream->remote_fingerprint : "(none)")) {
-				JANUS_LOG(LOG_VERB, "[%"SCNu64"]  Fingerprint is a match!\n", handle->handle_id);
-				dtls->dtls_state = JANUS_DTLS_STATE_CONNECTED;
-				dtls->dtls_connected = janus_get_monotonic_time();
-				/* Notify event handlers */
-				janus_dtls_notify_state_change(dtls);
-			} else {
-				/* FIXME NOT a match! MITM? */
-				JANUS_LOG(LOG_ERR, "[%"SCNu64"]  Fingerprint is NOT a match! got %s, expected %s\n", handle->handle_id, remote_fingerprint, stream->remote_fingerprint);
-				dtls->dtls_state = JANUS_DTLS_STATE_FAILED;
-				/* Notify event handlers */
-				janus_dtls_notify_state_change(dtls);
-				goto done;
-			}
-			if(dtls->dtls_state == JANUS_DTLS_STATE_CONNECTED) {
-				/* Which SRTP profile is being negotiated? */
-				SRTP_PROTECTION_PROFILE *srtp_profile = SSL_get_selected_srtp_profile(dtls->ssl);
-				JANUS_LOG(LOG_VERB, "[%"SCNu64"] %s\n", handle->handle_id, srtp_profile->name);
-				int key_length = 0, salt_length = 0, master_length = 0;
-				switch(srtp_profile->id) {
-					case SRTP_AES128_CM_SHA1_80:
-					case SRTP_AES128_CM_SHA1_32:
-						key_length = SRTP_MASTER_KEY_LENGTH;
-						salt_length = SRTP_MASTER_SALT_LENGTH;
-						master_length = SRTP_MASTER_LENGTH;
-						break;
-#ifdef HAVE_SRTP_AESGCM
-					case SRTP_AEAD_AES_256_GCM:
-						key_length = SRTP_AESGCM256_MASTER_KEY_LENGTH;
-						salt_length = SRTP_AESGCM256_MASTER_SALT_LENGTH;
-						master_length = SRTP_AESGCM256_MASTER_LENGTH;
-						break;
-					case SRTP_AEAD_AES_128_GCM:
-						key_length = SRTP_AESGCM128_MASTER_KEY_LENGTH;
-						salt_length = SRTP_AESGCM128_MASTER_SALT_LENGTH;
-						master_length = SRTP_AESGCM128_MASTER_LENGTH;
-						break;
-#endif
-					default:
-						/* Will never happen? */
-						JANUS_LOG(LOG_WARN, "[%"SCNu64"] Unsupported SRTP profile %lu\n", handle->handle_id, srtp_profile->id);
-						break;
-				}
-				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Key/Salt/Master: %d/%d/%d\n",
-					handle->handle_id, master_length, key_length, salt_length);
-				/* Complete with SRTP setup */
-				unsigned char material[master_length*2];
-				unsigned char *local_key, *local_salt, *remote_key, *remote_salt;
-				/* Export keying material for SRTP */
-				if(!SSL_export_keying_material(dtls->ssl, material, master_length*2, "EXTRACTOR-dtls_srtp", 19, NULL, 0, 0)) {
-					/* Oops... */
-					JANUS_LOG(LOG_ERR, "[%"SCNu64"] Oops, couldn't extract SRTP keying material for component %d in stream %d?? (%s)\n",
-						handle->handle_id, component->component_id, stream->stream_id, ERR_reason_error_string(ERR_get_error()));
-					goto done;
-				}
-				/* Key derivation (http://tools.ietf.org/html/rfc5764#section-4.2) */
-				if(dtls->dtls_role == JANUS_DTLS_ROLE_CLIENT) {
-					local_key = material;
-					remote_key = local_key + key_length;
-					local_salt = remote_key + key_length;
-					remote_salt = local_salt + salt_length;
-				} else {
-					remote_key = material;
-					local_key = remote_key + key_length;
-					remote_salt = local_key + key_length;
-					local_salt = remote_salt + salt_length;
-				}
-				/* Build master keys and set SRTP policies */
-					/* Remote (inbound) */
-				switch(srtp_profile->id) {
-					case SRTP_AES128_CM_SHA1_80:
-						srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->remote_policy.rtp));
-						srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->remote_policy.rtcp));
-						break;
-					case SRTP_AES128_CM_SHA1_32:
-						srtp_crypto_policy_set_aes_cm_128_hmac_sha1_32(&(dtls->remote_policy.rtp));
-						srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->remote_policy.rtcp));
-						break;
-#ifdef HAVE_SRTP_AESGCM
-					case SRTP_AEAD_AES_256_GCM:
-						srtp_crypto_policy_set_aes_gcm_256_16_auth(&(dtls->remote_policy.rtp));
-						srtp_crypto_policy_set_aes_gcm_256_16_auth(&(dtls->remote_policy.rtcp));
-						break;
-					case SRTP_AEAD_AES_128_GCM:
-						srtp_crypto_policy_set_aes_gcm_128_16_auth(&(dtls->remote_policy.rtp));
-						srtp_crypto_policy_set_aes_gcm_128_16_auth(&(dtls->remote_policy.rtcp));
-						break;
-#endif
-					default:
-						/* Will never happen? */
-						JANUS_LOG(LOG_WARN, "[%"SCNu64"] Unsupported SRTP profile %s\n", handle->handle_id, srtp_profile->name);
-						break;
-				}
-				dtls->remote_policy.ssrc.type = ssrc_any_inbound;
-				unsigned char remote_policy_key[master_length];
-				dtls->remote_policy.key = (unsigned char *)&remote_policy_key;
-				memcpy(dtls->remote_policy.key, remote_key, key_length);
-				memcpy(dtls->remote_policy.key + key_length, remote_salt, salt_length);
-#if HAS_DTLS_WINDOW_SIZE
-				dtls->remote_policy.window_size = 128;
-				dtls->remote_policy.allow_repeat_tx = 0;
-#endif
-				dtls->remote_policy.next = NULL;
-					/* Local (outbound) */
-				switch(srtp_profile->id) {
-					case SRTP_AES128_CM_SHA1_80:
-						srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->local_policy.rtp));
-						srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->local_policy.rtcp));
-						break;
-					case SRTP_AES128_CM_SHA1_32:
-						srtp_crypto_policy_set_aes_cm_128_hmac_sha1_32(&(dtls->local_policy.rtp));
-						srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->local_policy.rtcp));
-						break;
-#ifdef HAVE_SRTP_AESGCM
-					case SRTP_AEAD_AES_256_GCM:
-						srtp_crypto_policy_set_aes_gcm_256_16_auth(&(dtls->local_policy.rtp));
-						srtp_crypto_policy_set_aes_gcm_256_16_auth(&(dtls->local_policy.rtcp));
-						break;
-					case SRTP_AEAD_AES_128_GCM:
-						srtp_crypto_policy_set_aes_gcm_128_16_auth(&(dtls->local_policy.rtp));
-						srtp_crypto_policy_set_aes_gcm_128_16_auth(&(dtls->local_policy.rtcp));
-						break;
-#endif
-					default:
-						/* Will never happen? */
-						JANUS_LOG(LOG_WARN, "[%"SCNu64"] Unsupported SRTP profile %s\n", handle->handle_id, srtp_profile->name);
-						break;
-				}
-				dtls->local_policy.ssrc.type = ssrc_any_outbound;
-				unsigned char local_policy_key[master_length];
-				dtls->local_policy.key = (unsigned char *)&local_policy_key;
-				memcpy(dtls->local_policy.key, local_key, key_length);
-				memcpy(dtls->local_policy.key + key_length, local_salt, salt_length);
-#if HAS_DTLS_WINDOW_SIZE
-				dtls->local_policy.window_size = 128;
-				dtls->local_policy.allow_repeat_tx = 0;
-#endif
-				dtls->local_policy.next = NULL;
-				/* Create SRTP sessions */
-				srtp_err_status_t res = srtp_create(&(dtls->srtp_in), &(dtls->remote_policy));
-				if(res != srtp_err_status_ok) {
-					/* Something went wrong... */
-					JANUS_LOG(LOG_ERR, "[%"SCNu64"] Oops, error creating inbound SRTP session for component %d in stream %d??\n", handle->handle_id, component->component_id, stream->stream_id);
-					JANUS_LOG(LOG_ERR, "[%"SCNu64"]  -- %d (%s)\n", handle->handle_id, res, janus_srtp_error_str(res));
-					goto done;
-				}
-				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Created inbound SRTP session for component %d in stream %d\n", handle->handle_id, component->component_id, stream->stream_id);
-				res = srtp_create(&(dtls->srtp_out), &(dtls->local_policy));
-				if(res != srtp_err_status_ok) {
-					/* Something went wrong... */
-					JANUS_LOG(LOG_ERR, "[%"SCNu64"] Oops, error creating outbound SRTP session for component %d in stream %d??\n", handle->handle_id, component->component_id, stream->stream_id);
-					JANUS_LOG(LOG_ERR, "[%"SCNu64"]  -- %d (%s)\n", handle->handle_id, res, janus_srtp_error_str(res));
-					goto done;
-				}
-				dtls->srtp_valid = 1;
-				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Created outbound SRTP session for component %d in stream %d\n", handle->handle_id, component->component_id, stream->stream_id);
-#ifdef HAVE_SCTP
-				if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_DATA_CHANNELS)) {
-					/* Create SCTP association as well */
-					janus_dtls_srtp_create_sctp(dtls);
-				}
-#endif
-				dtls->ready = 1;
-			}
-done:
-			if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT) && dtls->srtp_valid) {
-				/* Handshake successfully completed */
-				janus_ice_dtls_handshake_done(handle, component);
-			} else {
-				/* Something went wrong in either DTLS or SRTP... tell the plugin about it */
-				janus_dtls_callback(dtls->ssl, SSL_CB_ALERT, 0);
-				janus_flags_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_CLEANING);
-			}
-		}
+		janus_dtls_srtp_established(dtls);
 	}
 }
 
 void janus_dtls_srtp_send_alert(janus_dtls_srtp *dtls) {
 	/* Send alert */
 	if(dtls != NULL && dtls->ssl != NULL) {
+		janus_mutex_lock(&dtls->mutex);
 		SSL_shutdown(dtls->ssl);
 		janus_dtls_fd_bridge(dtls);
+		janus_mutex_unlock(&dtls->mutex);
 	}
 }
 
@@ -877,6 +1366,16 @@ void janus_dtls_srtp_destroy(janus_dtls_srtp *dtls) {
 		dtls->sctp = NULL;
 	}
 #endif
+	/* Make sure no handshake worker is using this stack, and that none will */
+	janus_mutex_lock(&dtls->mutex);
+	janus_mutex_lock(&handshake_mutex);
+	if(janus_admission_cancel(&handshake_admission, dtls))
+		janus_dtls_srtp_unref(dtls);
+	janus_dtls_handshake_release(dtls);
+	dtls->handshake_handed_over = TRUE;
+	g_queue_free_full(dtls->pending, (GDestroyNotify)g_bytes_unref);
+	dtls->pending = g_queue_new();
+	janus_mutex_unlock(&handshake_mutex);
 	/* Destroy DTLS stack and free resources */
 	dtls->component = NULL;
 	if(dtls->ssl != NULL) {
@@ -898,8 +1397,9 @@ void janus_dtls_srtp_destroy(janus_dtls_srtp *dtls) {
 		}
 		/* FIXME What about dtls->remote_policy and dtls->local_policy? */
 	}
-	g_free(dtls);
-	dtls = NULL;
+	janus_mutex_unlock(&dtls->mutex);
+	/* Handshake workers may still have a reference */
+	janus_dtls_srtp_unref(dtls);
 }
 
 /* DTLS alert callback */
@@ -987,10 +1487,10 @@ void janus_dtls_fd_bridge(janus_dtls_srtp *dtls) {
 }
 
 #ifdef HAVE_SCTP
-void janus_dtls_wrap_sctp_data(janus_dtls_srtp *dtls, char *buf, int len) {
+void janus_dtls_wrap_sctp_data(janus_dtls_srtp *dtls, char *buf, int len, gboolean binary) {
 	if(dtls == NULL || !dtls->ready || dtls->sctp == NULL || buf == NULL || len < 1)
 		return;
-	janus_sctp_send_data(dtls->sctp, buf, len);
+	janus_sctp_send_data(dtls->sctp, buf, len, binary);
 }
 
 int janus_dtls_send_sctp_data(janus_dtls_srtp *dtls, char *buf, int len) {
@@ -1006,7 +1506,7 @@ int janus_dtls_send_sctp_data(janus_dtls_srtp *dtls, char *buf, int len) {
 	return res;
 }
 
-void janus_dtls_notify_data(janus_dtls_srtp *dtls, char *buf, int len) {
+void janus_dtls_notify_data(janus_dtls_srtp *dtls, char *buf, int len, gboolean binary) {
 	if(dtls == NULL || buf == NULL || len < 1)
 		return;
 	janus_ice_component *component = (janus_ice_component *)dtls->component;
@@ -1024,7 +1524,7 @@ void janus_dtls_notify_data(janus_dtls_srtp *dtls, char *buf, int len) {
 		JANUS_LOG(LOG_ERR, "No handle...\n");
 		return;
 	}
-	janus_ice_incoming_data(handle, buf, len);
+	janus_ice_incoming_data(handle, buf, len, binary);
 }
 #endif
 
@@ -1054,6 +1554,13 @@ gboolean janus_dtls_retry(gpointer stack) {
 		janus_ice_webrtc_hangup(handle, "DTLS timeout");
 		goto stoptimer;
 	}
+	/* If a handshake worker is busy with this stack, we'll check again on the next tick */
+	if(janus_mutex_trylock(&dtls->mutex) != 0)
+		return TRUE;
+	if(dtls->ssl == NULL) {
+		janus_mutex_unlock(&dtls->mutex);
+		goto stoptimer;
+	}
 	struct timeval timeout = {0};
 	DTLSv1_get_timeout(dtls->ssl, &timeout);
 	guint64 timeout_value = timeout.tv_sec*1000 + timeout.tv_usec/1000;
@@ -1067,6 +1574,7 @@ gboolean janus_dtls_retry(gpointer stack) {
 		DTLSv1_handle_timeout(dtls->ssl);
 		janus_dtls_fd_bridge(dtls);
 	}
+	janus_mutex_unlock(&dtls->mutex);
 	return TRUE;
 
 stoptimer:
@@ -17,6 +17,7 @@
 
 #include <inttypes.h>
 #include <glib.h>
+#include <jansson.h>
 
 #include "rtp.h"
 #include "rtpsrtp.h"
@@ -27,12 +28,33 @@
  * @param[in] server_pem Path to the certificate to use
  * @param[in] server_key Path to the key to use
  * @param[in] password Password needed to use the key, if any
+ * @param[in] ecdsa Whether the key to generate, if no certificate and key were provided, should be ECDSA (P-256) rather than RSA
+ * @param[in] cache_dir Folder where to cache the generated certificate and key, so that they can be reused on the next run (NULL to always generate new ones)
  * @returns 0 in case of success, a negative integer on errors */
-gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const char *password);
+gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const char *password,
+	gboolean ecdsa, const char *cache_dir);
 /*! \brief Method to cleanup DTLS stuff before exiting */
 void janus_dtls_srtp_cleanup(void);
+/*! \brief Start a pool of workers to take care of DTLS handshakes, rather than
+ * doing that on the ICE loop of each handle
+ * \note The expensive part of the handshake (e.g., signing and key exchange)
+ * happens on the workers, while the SRTP setup that follows it is still done
+ * on the ICE loop of the handle. When more handshakes than allowed are
+ * in progress, new ones wait for their turn in a queue
+ * @param[in] workers The number of workers to start (0 disables the pool)
+ * @param[in] max_handshakes How many handshakes can be in progress at the same time (0 means no limit)
+ * @returns 0 in case of success, a negative integer on errors */
+gint janus_dtls_handshake_workers_init(guint workers, guint max_handshakes);
+/*! \brief Method to get the number of DTLS handshake workers
+ * @returns The number of workers (0 if handshakes are done on the ICE loops) */
+guint janus_dtls_get_handshake_workers(void);
+/*! \brief Method to get info on the DTLS handshake workers (e.g., queue depth and durations), for the Admin API
+ * @returns A json_t object with the info */
+json_t *janus_dtls_handshake_workers_info(void);
 /*! \brief Method to return a string representation (SHA-256) of the certificate fingerprint */
 gchar *janus_dtls_get_local_fingerprint(void);
+/*! \brief Method to return the DTLS context janus_dtls_srtp_init created, which all DTLS stacks share */
+SSL_CTX *janus_dtls_get_context(void);
 
 
 /*! \brief DTLS roles */
@@ -90,6 +112,20 @@ typedef struct janus_dtls_srtp {
 	/*! \brief SCTP association, if DataChannels are involved */
 	janus_sctp_association *sctp;
 #endif
+	/*! \brief Reference counter (handshake workers may still have the stack around after it's been destroyed) */
+	volatile gint ref;
+	/*! \brief Mutex to serialize access to the SSL context, while the handshake is taken care of by a worker */
+	janus_mutex mutex;
+	/*! \brief DTLS records waiting for a handshake worker */
+	GQueue *pending;
+	/*! \brief Whether the stack is queued for a handshake worker (or waiting for its turn to get one) */
+	gboolean scheduled;
+	/*! \brief Whether this handshake is taking one of the concurrent handshake slots */
+	gboolean admitted;
+	/*! \brief Whether a worker completed the handshake, and whether the ICE loop took it from there */
+	gboolean handshake_finished, handshake_handed_over;
+	/*! \brief Monotonic time of when the first handshake record was queued for a worker */
+	gint64 handshake_queued;
 } janus_dtls_srtp;
 
 
@@ -141,8 +177,9 @@ void janus_dtls_fd_bridge(janus_dtls_srtp *dtls);
 /*! \brief Callback (called from the ICE handle) to encapsulate in DTLS outgoing SCTP data (DataChannel)
  * @param[in] dtls The janus_dtls_srtp instance to use
  * @param[in] buf The data buffer to encapsulate
- * @param[in] len The data length */
-void janus_dtls_wrap_sctp_data(janus_dtls_srtp *dtls, char *buf, int len);
+ * @param[in] len The data length
+ * @param[in] binary Whether this is a binary message (text otherwise) */
+void janus_dtls_wrap_sctp_data(janus_dtls_srtp *dtls, char *buf, int len, gboolean binary);
 
 /*! \brief Callback (called from the SCTP stack) to encapsulate in DTLS outgoing SCTP data (DataChannel)
  * @param[in] dtls The janus_dtls_srtp instance to use
@@ -154,8 +191,9 @@ int janus_dtls_send_sctp_data(janus_dtls_srtp *dtls, char *buf, int len);
 /*! \brief Callback to be notified about incoming SCTP data (DataChannel) to forward to the handle
  * @param[in] dtls The janus_dtls_srtp instance to use
  * @param[in] buf The data buffer
- * @param[in] len The data length */
-void janus_dtls_notify_data(janus_dtls_srtp *dtls, char *buf, int len);
+ * @param[in] len The data length
+ * @param[in] binary Whether this is a binary message (text otherwise) */
+void janus_dtls_notify_data(janus_dtls_srtp *dtls, char *buf, int len, gboolean binary);
 #endif
 
 /*! \brief DTLS retransmission timer
@@ -0,0 +1,164 @@
+/*! \file    fec.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Forward error correction
+ * \details  Implementation of a ULPFEC generator, with RED encapsulation.
+ * Rather than storing the media packets of a group, we XOR them into
+ * the context as soon as they're sent: when the group is complete, the
+ * accumulated values are all we need to write the FEC header (RFC5109,
+ * section 7.3), a single level 0 header with a short mask, and the
+ * protected payload. Groups are closed when they reach the size the
+ * configured overhead asks for, even if they span more than a frame,
+ * so that the overhead is the same no matter how large frames are.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include "fec.h"
+#include "rtp.h"
+#include "debug.h"
+
+/* Size of the fixed RTP header, of the RED header for the primary block, and of the FEC headers */
+#define JANUS_FEC_RTP_HEADER		12
+#define JANUS_FEC_RED_HEADER		1
+#define JANUS_FEC_HEADER			10
+#define JANUS_FEC_LEVEL0_HEADER		4
+
+janus_fec_context *janus_fec_context_create(int red_pt, int ulpfec_pt, guint overhead) {
+	if(red_pt < 0 || red_pt > 127 || ulpfec_pt < 0 || ulpfec_pt > 127 || overhead == 0)
+		return NULL;
+	janus_fec_context *fec = g_malloc0(sizeof(janus_fec_context));
+	fec->red_pt = red_pt;
+	fec->ulpfec_pt = ulpfec_pt;
+	if(overhead > 100)
+		overhead = 100;
+	fec->group_size = (100 + overhead - 1) / overhead;
+	if(fec->group_size > JANUS_FEC_MAX_GROUP)
+		fec->group_size = JANUS_FEC_MAX_GROUP;
+	return fec;
+}
+
+void janus_fec_context_destroy(janus_fec_context *fec) {
+	g_free(fec);
+}
+
+/* Helper to start a new group */
+static void janus_fec_reset(janus_fec_context *fec) {
+	fec->count = 0;
+	fec->mask = 0;
+	fec->xor_header[0] = 0;
+	fec->xor_header[1] = 0;
+	fec->xor_ts = 0;
+	fec->xor_length = 0;
+	if(fec->protection_length > 0)
+		memset(fec->xor_payload, 0, fec->protection_length);
+	fec->protection_length = 0;
+	fec->ready = FALSE;
+}
+
+void janus_fec_update_seq(janus_fec_context *fec, char *buf, int len) {
+	if(fec == NULL || buf == NULL || len < JANUS_FEC_RTP_HEADER || fec->seq_offset == 0)
+		return;
+	janus_rtp_header *header = (janus_rtp_header *)buf;
+	header->seq_number = htons(ntohs(header->seq_number) + fec->seq_offset);
+}
+
+int janus_fec_protect(janus_fec_context *fec, char *buf, int len, int maxlen) {
+	if(fec == NULL || buf == NULL || len < JANUS_FEC_RTP_HEADER || len+JANUS_FEC_RED_HEADER > maxlen)
+		return -1;
+	int plen = 0;
+	char *payload = janus_rtp_payload(buf, len, &plen);
+	if(payload == NULL)
+		return -1;
+	janus_rtp_header *header = (janus_rtp_header *)buf;
+	guint16 seq = ntohs(header->seq_number);
+	guint32 ssrc = ntohl(header->ssrc);
+	if(fec->ready || (fec->count > 0 && (ssrc != fec->ssrc ||
+			(guint16)(seq - fec->seq_base) >= JANUS_FEC_MAX_GROUP || (gint16)(seq - fec->last_seq) <= 0))) {
+		/* Either a FEC packet we never sent, or we can't fit this
+		 * packet in the current group: give up on it, and start again */
+		janus_fec_reset(fec);
+	}
+	/* Add the packet (as the peer will see it, after removing RED) to the group */
+	if(len - JANUS_FEC_RTP_HEADER <= JANUS_FEC_MAX_LENGTH) {
+		if(fec->count == 0) {
+			fec->seq_base = seq;
+			fec->ssrc = ssrc;
+		}
+		fec->count++;
+		fec->mask |= (0x8000 >> (guint16)(seq - fec->seq_base));
+		fec->last_seq = seq;
+		fec->last_ts = ntohl(header->timestamp);
+		fec->xor_header[0] ^= (guint8)buf[0];
+		fec->xor_header[1] ^= (guint8)buf[1];
+		fec->xor_ts ^= fec->last_ts;
+		int protected = len - JANUS_FEC_RTP_HEADER;
+		fec->xor_length ^= (guint16)protected;
+		guint8 *data = (guint8 *)buf + JANUS_FEC_RTP_HEADER;
+		int i = 0;
+		for(i=0; i<protected; i++)
+			fec->xor_payload[i] ^= data[i];
+		if(protected > fec->protection_length)
+			fec->protection_length = protected;
+		if(fec->count >= fec->group_size)
+			fec->ready = TRUE;
+	} else {
+		/* Too large to protect, start a new group after this */
+		janus_fec_reset(fec);
+	}
+	/* Now encapsulate the packet in RED (primary block only) */
+	int hlen = payload - buf;
+	memmove(payload + JANUS_FEC_RED_HEADER, payload, len - hlen);
+	*payload = (char)(header->type & 0x7F);
+	header->type = fec->red_pt;
+	fec->media_packets++;
+	return len + JANUS_FEC_RED_HEADER;
+}
+
+int janus_fec_generate(janus_fec_context *fec, char *buf, int maxlen) {
+	if(fec == NULL || buf == NULL)
+		return -1;
+	if(!fec->ready || fec->count == 0)
+		return 0;
+	int len = JANUS_FEC_RTP_HEADER + JANUS_FEC_RED_HEADER + JANUS_FEC_HEADER +
+		JANUS_FEC_LEVEL0_HEADER + fec->protection_length;
+	if(len > maxlen) {
+		janus_fec_reset(fec);
+		return -1;
+	}
+	/* RTP header: the FEC packet immediately follows the last packet it protects */
+	janus_rtp_header *header = (janus_rtp_header *)buf;
+	memset(header, 0, JANUS_FEC_RTP_HEADER);
+	header->version = 2;
+	header->type = fec->red_pt;
+	header->seq_number = htons(fec->last_seq + 1);
+	header->timestamp = htonl(fec->last_ts);
+	header->ssrc = htonl(fec->ssrc);
+	guint8 *p = (guint8 *)buf + JANUS_FEC_RTP_HEADER;
+	/* RED header */
+	*p = (guint8)fec->ulpfec_pt;
+	p += JANUS_FEC_RED_HEADER;
+	/* FEC header (E=0, L=0, then the recovery fields) */
+	p[0] = fec->xor_header[0] & 0x3F;
+	p[1] = fec->xor_header[1];
+	guint16 seq_base = htons(fec->seq_base);
+	memcpy(p+2, &seq_base, 2);
+	guint32 ts = htonl(fec->xor_ts);
+	memcpy(p+4, &ts, 4);
+	guint16 length = htons(fec->xor_length);
+	memcpy(p+8, &length, 2);
+	p += JANUS_FEC_HEADER;
+	/* Level 0 header (protection length and short mask), and payload */
+	guint16 protection_length = htons(fec->protection_length);
+	memcpy(p, &protection_length, 2);
+	guint16 mask = htons(fec->mask);
+	memcpy(p+2, &mask, 2);
+	p += JANUS_FEC_LEVEL0_HEADER;
+	memcpy(p, fec->xor_payload, fec->protection_length);
+	/* The media packets that follow will have to make room for this one */
+	fec->seq_offset++;
+	fec->fec_packets++;
+	janus_fec_reset(fec);
+	return len;
+}
@@ -0,0 +1,94 @@
+/*! \file    fec.h
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Forward error correction (headers)
+ * \details  Implementation of a ULPFEC (https://tools.ietf.org/html/rfc5109)
+ * generator for the video Janus sends to a peer, using RED
+ * (https://tools.ietf.org/html/rfc2198) to carry both media and FEC
+ * packets on the same SSRC, as browsers expect. Outgoing media packets
+ * are encapsulated in RED and XOR-ed into a group: when the group is
+ * complete (its size depends on the configured overhead), a FEC packet
+ * protecting all of them is generated, which allows the peer to recover
+ * any single packet of the group that was lost without waiting for a
+ * retransmission. As FEC packets share the sequence number space of the
+ * media, the sequence numbers of outgoing media are shifted accordingly.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef _JANUS_FEC_H
+#define _JANUS_FEC_H
+
+#include <glib.h>
+
+/*! \brief Maximum number of media packets a single FEC packet can protect (short mask) */
+#define JANUS_FEC_MAX_GROUP		16
+/*! \brief Largest media packet we can protect */
+#define JANUS_FEC_MAX_LENGTH	1500
+
+/*! \brief ULPFEC generator (one per PeerConnection) */
+typedef struct janus_fec_context {
+	/*! \brief RED and ULPFEC payload types negotiated with the peer */
+	int red_pt, ulpfec_pt;
+	/*! \brief Number of media packets each FEC packet protects */
+	int group_size;
+	/*! \brief How much the sequence numbers of outgoing media must be shifted, because of the FEC packets we added */
+	guint16 seq_offset;
+	/*! \brief Number of media packets in the current group */
+	int count;
+	/*! \brief Sequence number of the first packet in the current group */
+	guint16 seq_base;
+	/*! \brief Mask of the packets in the current group, relative to seq_base */
+	guint16 mask;
+	/*! \brief Sequence number, timestamp and SSRC of the last packet in the current group */
+	guint16 last_seq;
+	guint32 last_ts, ssrc;
+	/*! \brief XOR of the first two bytes of the RTP headers in the group */
+	guint8 xor_header[2];
+	/*! \brief XOR of the timestamps in the group */
+	guint32 xor_ts;
+	/*! \brief XOR of the lengths (minus the fixed RTP header) in the group */
+	guint16 xor_length;
+	/*! \brief Longest packet (minus the fixed RTP header) in the group */
+	int protection_length;
+	/*! \brief XOR of everything following the fixed RTP headers in the group */
+	guint8 xor_payload[JANUS_FEC_MAX_LENGTH];
+	/*! \brief Whether a FEC packet for the current group is ready to be generated */
+	gboolean ready;
+	/*! \brief How many media and FEC packets we sent so far */
+	guint32 media_packets, fec_packets;
+} janus_fec_context;
+
+/*! \brief Create a new ULPFEC generator
+ * @param[in] red_pt The RED payload type negotiated with the peer
+ * @param[in] ulpfec_pt The ULPFEC payload type negotiated with the peer
+ * @param[in] overhead The FEC overhead, as a percentage of the media packets (1-100)
+ * @returns A new janus_fec_context instance */
+janus_fec_context *janus_fec_context_create(int red_pt, int ulpfec_pt, guint overhead);
+/*! \brief Destroy a ULPFEC generator
+ * @param[in] fec The janus_fec_context instance to destroy */
+void janus_fec_context_destroy(janus_fec_context *fec);
+/*! \brief Shift the sequence number of an outgoing media packet to account for the FEC packets we added
+ * \note This must be done for all outgoing video, even when FEC isn't being generated anymore
+ * @param[in] fec The janus_fec_context instance to use
+ * @param[in,out] buf The RTP packet to update
+ * @param[in] len The length of the RTP packet */
+void janus_fec_update_seq(janus_fec_context *fec, char *buf, int len);
+/*! \brief Add an outgoing media packet to the current group, and encapsulate it in RED in place
+ * @param[in] fec The janus_fec_context instance to use
+ * @param[in,out] buf The RTP packet to protect and encapsulate
+ * @param[in] len The length of the RTP packet
+ * @param[in] maxlen The size of the buffer (encapsulation adds a byte)
+ * @returns The length of the RED packet, or -1 in case of errors (the packet is left untouched) */
+int janus_fec_protect(janus_fec_context *fec, char *buf, int len, int maxlen);
+/*! \brief Generate a FEC packet for the current group, if it's complete
+ * \note The FEC packet is a full RTP packet, encapsulated in RED: as it
+ * takes a sequence number, the media packets that follow will be shifted
+ * @param[in] fec The janus_fec_context instance to use
+ * @param[out] buf The buffer to write the FEC packet to
+ * @param[in] maxlen The size of the buffer
+ * @returns The length of the FEC packet, 0 if no FEC packet is due yet, or -1 in case of errors */
+int janus_fec_generate(janus_fec_context *fec, char *buf, int maxlen);
+
+#endif
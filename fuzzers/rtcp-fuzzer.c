@@ -0,0 +1,43 @@
+/*! \file    rtcp-fuzzer.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    libFuzzer target for the single-pass RTCP parser
+ * \details  Feeds arbitrary bytes to janus_rtcp_summarize, which parses
+ * the compound RTCP packets peers send us on the hot path, and then
+ * applies the result to an RTCP context, as the ICE loop does. Build it
+ * with --enable-fuzzers (clang only), and run it, e.g., as
+ * "./fuzzers/rtcp-fuzzer -max_len=1500 corpus/".
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <glib.h>
+
+#include "../rtcp.h"
+
+/* The core would define these */
+int janus_log_level = 0;	/* LOG_NONE */
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	if(size > 1500)
+		return 0;
+	/* The parser takes a mutable buffer, so work on a copy the fuzzer doesn't own */
+	char buf[1500];
+	memcpy(buf, data, size);
+	janus_rtcp_summary summary;
+	if(janus_rtcp_summarize(buf, size, &summary) < 0)
+		return 0;
+	janus_rtcp_context ctx;
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.tb = 90000;
+	janus_rtcp_summary_update_context(&ctx, &summary);
+	return 0;
+}
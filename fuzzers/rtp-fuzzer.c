@@ -0,0 +1,48 @@
+/*! \file    rtp-fuzzer.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    libFuzzer target for the single-pass RTP extensions parser
+ * \details  Feeds arbitrary bytes to janus_rtp_header_extensions_parse,
+ * which parses the RTP header extensions of every packet peers send us.
+ * The first byte of the input picks the IDs the extensions we know about
+ * were negotiated with, so that all the decoders get exercised, with
+ * both the one-byte and the two-byte header formats. Build it with
+ * --enable-fuzzers (clang only), and run it, e.g., as
+ * "./fuzzers/rtp-fuzzer -max_len=1500 corpus/".
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "../rtp.h"
+
+/* The core would define these */
+int janus_log_level = 0;	/* LOG_NONE */
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	if(size < 1 || size > 1501)
+		return 0;
+	/* Use the first byte to shuffle the negotiated IDs (1-14, as in the one-byte format) */
+	int base = data[0] % 14;
+	janus_rtp_extmap extmap = {
+		.audio_level = 1 + (base % 14),
+		.video_orientation = 1 + ((base + 1) % 14),
+		.playout_delay = 1 + ((base + 2) % 14),
+		.rtp_stream_id = 1 + ((base + 3) % 14),
+		.transport_wide_cc = 1 + ((base + 4) % 14)
+	};
+	/* The parser takes a mutable buffer, so work on a copy the fuzzer doesn't own */
+	char buf[1500];
+	memcpy(buf, data+1, size-1);
+	janus_rtp_extensions extensions;
+	janus_rtp_header_extensions_parse(buf, size-1, &extmap, &extensions);
+	return 0;
+}
@@ -18,8 +18,10 @@
 #include <net/if.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <netinet/udp.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <stun/usages/bind.h>
 #include <nice/debug.h>
 
@@ -202,6 +204,200 @@ uint16_t rtp_range_min = 0;
 uint16_t rtp_range_max = 0;
 
 
+/* Shared event loops: rather than spawning a GMainLoop thread per handle,
+ * handles can be pinned to one of a fixed number of loops for their lifetime */
+static int static_event_loops = -1;
+static janus_ice_static_event_loop *event_loops = NULL;
+void janus_ice_set_static_event_loops(int loops) {
+	if(loops < 0) {
+		JANUS_LOG(LOG_WARN, "Invalid number of static event loops (%d), using the default\n", loops);
+		return;
+	}
+	static_event_loops = loops;
+}
+int janus_ice_get_static_event_loops(void) {
+	return static_event_loops;
+}
+static void *janus_ice_static_event_loop_thread(void *data) {
+	janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)data;
+	JANUS_LOG(LOG_VERB, "[loop#%d] Event loop thread started\n", loop->id);
+	g_main_loop_run(loop->mainloop);
+	JANUS_LOG(LOG_VERB, "[loop#%d] Event loop thread ended!\n", loop->id);
+	return NULL;
+}
+/* Helper to pick the least loaded loop for a new handle */
+static janus_ice_static_event_loop *janus_ice_static_event_loop_assign(void) {
+	if(event_loops == NULL || static_event_loops < 1)
+		return NULL;
+	janus_ice_static_event_loop *loop = &event_loops[0];
+	int i = 0;
+	for(i=1; i<static_event_loops; i++) {
+		if(g_atomic_int_get(&event_loops[i].handles) < g_atomic_int_get(&loop->handles))
+			loop = &event_loops[i];
+	}
+	g_atomic_int_inc(&loop->handles);
+	return loop;
+}
+json_t *janus_ice_static_event_loops_info(void) {
+	json_t *list = json_array();
+	if(event_loops == NULL || static_event_loops < 1)
+		return list;
+	int i = 0;
+	for(i=0; i<static_event_loops; i++) {
+		json_t *l = json_object();
+		json_object_set_new(l, "id", json_integer(event_loops[i].id));
+		json_object_set_new(l, "handles", json_integer(g_atomic_int_get(&event_loops[i].handles)));
+		json_array_append_new(list, l);
+	}
+	return list;
+}
+
+/* Send workers: rather than spawning a send thread per handle, handles can
+ * be served by one of a fixed number of workers, which drain their queues in
+ * batches and take care of the periodic stuff using a timer wheel */
+#define JANUS_ICE_SEND_WHEEL_TICK	20000
+#define JANUS_ICE_SEND_BATCH		32
+static int send_workers_num = 0;
+static janus_ice_send_worker *send_workers = NULL;
+void janus_ice_set_send_workers(int workers) {
+	if(workers < 0) {
+		JANUS_LOG(LOG_WARN, "Invalid number of send workers (%d), using a send thread per handle\n", workers);
+		workers = 0;
+	}
+	send_workers_num = workers;
+}
+int janus_ice_get_send_workers(void) {
+	return send_workers_num;
+}
+static void *janus_ice_send_worker_thread(void *data);
+static void janus_ice_send_worker_release_all(janus_ice_send_worker *worker);
+
+/* Outgoing queue of each handle: how many packets it can contain, and
+ * whether we should flush the oldest ones when it gets full */
+#define DEFAULT_SEND_QUEUE_SIZE	2048
+static guint send_queue_size = DEFAULT_SEND_QUEUE_SIZE;
+static gboolean send_queue_drop_oldest = FALSE;
+void janus_ice_set_send_queue_size(guint size) {
+	if(size < 64) {
+		JANUS_LOG(LOG_WARN, "Send queue size too small (%u), using 64\n", size);
+		size = 64;
+	}
+	send_queue_size = size;
+	JANUS_LOG(LOG_VERB, "Setting send queue size to %u\n", send_queue_size);
+}
+guint janus_ice_get_send_queue_size(void) {
+	return send_queue_size;
+}
+void janus_ice_set_send_queue_drop_oldest(gboolean enabled) {
+	send_queue_drop_oldest = enabled;
+	JANUS_LOG(LOG_VERB, "When send queues are full, %s\n",
+		send_queue_drop_oldest ? "the oldest packets will be flushed" : "new packets will be dropped");
+}
+gboolean janus_ice_is_send_queue_drop_oldest(void) {
+	return send_queue_drop_oldest;
+}
+
+/* Batched egress: once a pair has been selected, outgoing media can be sent
+ * on the underlying socket directly, in batches, rather than with a
+ * nice_agent_send call per packet (only available with sendmmsg support) */
+#if defined(HAVE_SENDMMSG) && defined(HAVE_LIBNICE_SELECTED_SOCKET)
+#define JANUS_ICE_EGRESS_SUPPORTED
+#endif
+static gboolean egress_batching = FALSE;
+#ifdef UDP_SEGMENT
+/* Whether we can ask the kernel to split batches of same-sized packets (UDP GSO) */
+static volatile gint egress_gso = 1;
+#endif
+void janus_ice_set_egress_batching(gboolean enabled) {
+#ifdef JANUS_ICE_EGRESS_SUPPORTED
+	egress_batching = enabled;
+	if(egress_batching)
+		JANUS_LOG(LOG_INFO, "Outgoing media will be sent in batches, when possible\n");
+#else
+	if(enabled)
+		JANUS_LOG(LOG_WARN, "Batched egress not supported on this platform (needs sendmmsg and nice_agent_get_selected_socket)\n");
+	egress_batching = FALSE;
+#endif
+}
+gboolean janus_ice_is_egress_batching_enabled(void) {
+	return egress_batching;
+}
+/* Send-side bandwidth estimation, driven by transport wide CC feedback */
+static gboolean send_side_bwe = FALSE;
+void janus_ice_set_send_side_bwe(gboolean enabled) {
+	send_side_bwe = enabled;
+	if(send_side_bwe)
+		JANUS_LOG(LOG_INFO, "Send-side bandwidth estimation enabled (when transport wide CC is negotiated)\n");
+}
+gboolean janus_ice_is_send_side_bwe_enabled(void) {
+	return send_side_bwe;
+}
+/* Outbound pacing: rather than sending video bursts (e.g., keyframes) to the
+ * network all at once, send them at a multiple of the bitrate we know the
+ * peer can receive (our own estimate, or the peer's REMB) */
+static gdouble pacing_multiplier = 0.0;
+void janus_ice_set_pacing_multiplier(gdouble multiplier) {
+	if(multiplier < 0.0)
+		multiplier = 0.0;
+	else if(multiplier > 0.0 && multiplier < 1.0) {
+		JANUS_LOG(LOG_WARN, "Pacing multiplier can't be lower than 1.0, using 1.0 instead of %.2f\n", multiplier);
+		multiplier = 1.0;
+	}
+	pacing_multiplier = multiplier;
+	if(pacing_multiplier > 0.0)
+		JANUS_LOG(LOG_INFO, "Outgoing video will be paced at %.2fx the estimated bitrate\n", pacing_multiplier);
+}
+gdouble janus_ice_get_pacing_multiplier(void) {
+	return pacing_multiplier;
+}
+/* Batched ingress: once ICE is done, incoming packets can be read in batches */
+static gboolean ingress_batching = FALSE;
+void janus_ice_set_ingress_batching(gboolean enabled) {
+#ifdef HAVE_LIBNICE_SELECTED_SOCKET
+	ingress_batching = enabled;
+	if(ingress_batching)
+		JANUS_LOG(LOG_INFO, "Incoming media will be received in batches, when possible\n");
+#else
+	if(enabled)
+		JANUS_LOG(LOG_WARN, "Batched ingress not supported by this libnice version (needs nice_agent_get_selected_socket)\n");
+	ingress_batching = FALSE;
+#endif
+}
+gboolean janus_ice_is_ingress_batching_enabled(void) {
+	return ingress_batching;
+}
+
+/* Helper to pick the least loaded worker for a handle */
+static void janus_ice_send_worker_assign(janus_ice_handle *handle) {
+	janus_ice_send_worker *worker = &send_workers[0];
+	int i = 0;
+	for(i=1; i<send_workers_num; i++) {
+		if(g_atomic_int_get(&send_workers[i].handles) < g_atomic_int_get(&worker->handles))
+			worker = &send_workers[i];
+	}
+	g_atomic_int_inc(&worker->handles);
+	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Handle assigned to send worker #%d\n", handle->handle_id, worker->id);
+	g_atomic_pointer_set(&handle->send_worker, worker);
+	/* Wake the worker up, in case something has been queued already */
+	if(g_atomic_int_compare_and_exchange(&handle->send_scheduled, 0, 1))
+		g_async_queue_push(worker->ready, handle);
+}
+json_t *janus_ice_send_workers_info(void) {
+	json_t *list = json_array();
+	if(send_workers == NULL)
+		return list;
+	int i = 0;
+	for(i=0; i<send_workers_num; i++) {
+		json_t *w = json_object();
+		json_object_set_new(w, "id", json_integer(send_workers[i].id));
+		json_object_set_new(w, "handles", json_integer(g_atomic_int_get(&send_workers[i].handles)));
+		json_object_set_new(w, "ready", json_integer(g_async_queue_length(send_workers[i].ready)));
+		json_array_append_new(list, w);
+	}
+	return list;
+}
+
+
 /* Helpers to demultiplex protocols */
 static gboolean janus_is_dtls(gchar *buf) {
 	return ((*buf >= 20) && (*buf <= 64));
@@ -229,24 +425,259 @@ typedef struct janus_ice_queued_packet {
 	gboolean control;
 	gboolean retransmission;
 	gboolean encrypted;
+	/* Size of the buffer data points to */
+	gint capacity;
+	/* Buffer embedded in the packet, if it comes from the pool (NULL otherwise) */
+	char *buffer;
+	/* Next packet, when in a free list of the pool */
+	struct janus_ice_queued_packet *next;
+	/* When the packet entered the pacer, if it did */
+	gint64 paced;
+	/* Shared RTP packet, and the header to give it, if a plugin relayed it
+	 * to many peers: in that case, data is only filled right before SRTP */
+	janus_rtp_shared_packet *shared;
+	janus_rtp_header_override override;
+	/* Data channel message a plugin relayed without copying it, if any */
+	janus_plugin_data *shared_data;
+	/* References to the packet: a batch of outgoing packets holds one until it's sent */
+	volatile gint refs;
 } janus_ice_queued_packet;
 /* This is a static, fake, message we use as a trigger to send a DTLS alert */
 static janus_ice_queued_packet janus_ice_dtls_alert;
+/* Flushes of the queue the consumer may be asked to perform */
+#define JANUS_ICE_QUEUE_FLUSH_NONE		0
+#define JANUS_ICE_QUEUE_FLUSH_OLDEST	1
+#define JANUS_ICE_QUEUE_FLUSH_ALL		2
+
+/* Pool of packets to send: rather than allocating a struct and a buffer for
+ * each packet, and freeing them after they've been sent, we recycle MTU-sized
+ * buffers, with enough room for SRTP to protect them in place. Each thread
+ * keeps a small cache of free packets, and exchanges them in batches with a
+ * shared depot when it has too many or runs out of them */
+#define JANUS_ICE_PACKET_POOL_BUFSIZE	2048
+#define JANUS_ICE_PACKET_CACHE_MAX		256
+#define JANUS_ICE_PACKET_DEPOT_MAX		8192
+#define JANUS_ICE_PACKET_POOL_BATCH		64
+typedef struct janus_ice_packet_cache {
+	janus_ice_queued_packet *packets;
+	int count;
+	guint64 hits, misses;
+	gint64 outstanding;
+	/* RTP packets plugins asked us to relay, and bytes of outgoing RTP we copied around */
+	guint64 relayed, copied;
+} janus_ice_packet_cache;
+static janus_mutex packet_pool_mutex;
+static janus_ice_queued_packet *packet_depot = NULL;
+static int packet_depot_count = 0;
+static GList *packet_caches = NULL;
+static guint64 packet_pool_hits = 0, packet_pool_misses = 0;
+static gint64 packet_pool_outstanding = 0;
+static guint64 packet_pool_relayed = 0, packet_pool_copied = 0;
+static void janus_ice_packet_cache_destroy(gpointer data) {
+	/* The thread is going away: give its packets back, and keep track of its stats */
+	janus_ice_packet_cache *cache = (janus_ice_packet_cache *)data;
+	janus_mutex_lock(&packet_pool_mutex);
+	while(cache->packets != NULL) {
+		janus_ice_queued_packet *pkt = cache->packets;
+		cache->packets = pkt->next;
+		if(packet_depot_count < JANUS_ICE_PACKET_DEPOT_MAX) {
+			pkt->next = packet_depot;
+			packet_depot = pkt;
+			packet_depot_count++;
+		} else {
+			g_free(pkt);
+		}
+	}
+	packet_pool_hits += cache->hits;
+	packet_pool_misses += cache->misses;
+	packet_pool_outstanding += cache->outstanding;
+	packet_pool_relayed += cache->relayed;
+	packet_pool_copied += cache->copied;
+	packet_caches = g_list_remove(packet_caches, cache);
+	janus_mutex_unlock(&packet_pool_mutex);
+	g_free(cache);
+}
+static GPrivate packet_cache_key = G_PRIVATE_INIT(janus_ice_packet_cache_destroy);
+static janus_ice_packet_cache *janus_ice_packet_cache_get(void) {
+	janus_ice_packet_cache *cache = g_private_get(&packet_cache_key);
+	if(cache == NULL) {
+		cache = g_malloc0(sizeof(janus_ice_packet_cache));
+		g_private_set(&packet_cache_key, cache);
+		janus_mutex_lock(&packet_pool_mutex);
+		packet_caches = g_list_prepend(packet_caches, cache);
+		janus_mutex_unlock(&packet_pool_mutex);
+	}
+	return cache;
+}
+static janus_ice_queued_packet *janus_ice_queued_packet_alloc(int len) {
+	janus_ice_packet_cache *cache = janus_ice_packet_cache_get();
+	janus_ice_queued_packet *pkt = NULL;
+	if(len + SRTP_MAX_TRAILER_LEN > JANUS_ICE_PACKET_POOL_BUFSIZE) {
+		/* Too large for the pool, allocate it separately */
+		pkt = g_malloc(sizeof(janus_ice_queued_packet));
+		pkt->data = g_malloc(len);
+		pkt->capacity = len;
+		pkt->buffer = NULL;
+		pkt->next = NULL;
+		pkt->shared = NULL;
+		pkt->shared_data = NULL;
+		pkt->refs = 1;
+		cache->misses++;
+		cache->outstanding += len;
+		return pkt;
+	}
+	if(cache->packets == NULL) {
+		/* Try getting a batch of packets from the depot */
+		janus_mutex_lock(&packet_pool_mutex);
+		while(packet_depot != NULL && cache->count < JANUS_ICE_PACKET_POOL_BATCH) {
+			pkt = packet_depot;
+			packet_depot = pkt->next;
+			packet_depot_count--;
+			pkt->next = cache->packets;
+			cache->packets = pkt;
+			cache->count++;
+		}
+		janus_mutex_unlock(&packet_pool_mutex);
+	}
+	if(cache->packets != NULL) {
+		pkt = cache->packets;
+		cache->packets = pkt->next;
+		cache->count--;
+		cache->hits++;
+	} else {
+		pkt = g_malloc(sizeof(janus_ice_queued_packet) + JANUS_ICE_PACKET_POOL_BUFSIZE);
+		pkt->buffer = (char *)pkt + sizeof(janus_ice_queued_packet);
+		cache->misses++;
+	}
+	pkt->data = pkt->buffer;
+	pkt->capacity = JANUS_ICE_PACKET_POOL_BUFSIZE;
+	pkt->next = NULL;
+	pkt->shared = NULL;
+	pkt->shared_data = NULL;
+	pkt->refs = 1;
+	cache->outstanding += JANUS_ICE_PACKET_POOL_BUFSIZE;
+	return pkt;
+}
+static void janus_ice_queued_packet_free(janus_ice_queued_packet *pkt) {
+	if(pkt == NULL || pkt == &janus_ice_dtls_alert)
+		return;
+	/* A batch of outgoing packets may still point to its buffer */
+	if(!g_atomic_int_dec_and_test(&pkt->refs))
+		return;
+	janus_ice_packet_cache *cache = janus_ice_packet_cache_get();
+	if(pkt->shared != NULL) {
+		janus_rtp_shared_packet_unref(pkt->shared);
+		pkt->shared = NULL;
+	}
+	if(pkt->shared_data != NULL) {
+		janus_plugin_data_unref(pkt->shared_data);
+		pkt->shared_data = NULL;
+	}
+	if(pkt->buffer == NULL) {
+		/* Not from the pool */
+		cache->outstanding -= pkt->capacity;
+		g_free(pkt->data);
+		g_free(pkt);
+		return;
+	}
+	cache->outstanding -= JANUS_ICE_PACKET_POOL_BUFSIZE;
+	if(pkt->data != pkt->buffer) {
+		/* The data was replaced by a larger buffer at some point */
+		g_free(pkt->data);
+	}
+	pkt->data = NULL;
+	pkt->next = cache->packets;
+	cache->packets = pkt;
+	cache->count++;
+	if(cache->count > JANUS_ICE_PACKET_CACHE_MAX) {
+		/* Too many packets here, give a batch back to the depot */
+		janus_mutex_lock(&packet_pool_mutex);
+		int i = 0;
+		for(i=0; i<JANUS_ICE_PACKET_POOL_BATCH && cache->packets != NULL; i++) {
+			pkt = cache->packets;
+			cache->packets = pkt->next;
+			cache->count--;
+			if(packet_depot_count < JANUS_ICE_PACKET_DEPOT_MAX) {
+				pkt->next = packet_depot;
+				packet_depot = pkt;
+				packet_depot_count++;
+			} else {
+				g_free(pkt);
+			}
+		}
+		janus_mutex_unlock(&packet_pool_mutex);
+	}
+}
+json_t *janus_ice_packet_pool_info(void) {
+	json_t *info = json_object();
+	janus_mutex_lock(&packet_pool_mutex);
+	guint64 hits = packet_pool_hits, misses = packet_pool_misses;
+	guint64 relayed = packet_pool_relayed, copied = packet_pool_copied;
+	gint64 outstanding = packet_pool_outstanding;
+	int cached = packet_depot_count;
+	GList *l = packet_caches;
+	while(l) {
+		/* Note: these are updated without locking, so they're only an estimate */
+		janus_ice_packet_cache *cache = (janus_ice_packet_cache *)l->data;
+		hits += cache->hits;
+		misses += cache->misses;
+		outstanding += cache->outstanding;
+		cached += cache->count;
+		relayed += cache->relayed;
+		copied += cache->copied;
+		l = l->next;
+	}
+	json_object_set_new(info, "threads", json_integer(g_list_length(packet_caches)));
+	janus_mutex_unlock(&packet_pool_mutex);
+	json_object_set_new(info, "buffer-size", json_integer(JANUS_ICE_PACKET_POOL_BUFSIZE));
+	json_object_set_new(info, "hits", json_integer(hits));
+	json_object_set_new(info, "misses", json_integer(misses));
+	json_object_set_new(info, "bytes-outstanding", json_integer(outstanding));
+	json_object_set_new(info, "cached", json_integer(cached));
+	json_object_set_new(info, "rtp-relayed", json_integer(relayed));
+	json_object_set_new(info, "rtp-bytes-copied", json_integer(copied));
+	return info;
+}
 
-/* Janus NACKed packet we're tracking (to avoid duplicates) */
-typedef struct janus_ice_nacked_packet {
+/* Per-handle state of the outgoing media path: when using send workers
+ * this also embeds the timer of the handle in the worker timer wheel */
+typedef struct janus_ice_egress janus_ice_egress;
+struct janus_ice_send_context {
 	janus_ice_handle *handle;
-	int vindex;
-	guint16 seq_number;
-} janus_ice_nacked_packet;
-static gboolean janus_ice_nacked_packet_cleanup(gpointer user_data) {
-	janus_ice_nacked_packet *pkt = (janus_ice_nacked_packet *)user_data;
-
-	JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Cleaning up NACKed packet %"SCNu16" (SSRC %"SCNu32", vindex %d)...\n",
-		pkt->handle->handle_id, pkt->seq_number, pkt->handle->stream->video_ssrc_peer[pkt->vindex], pkt->vindex);
-	g_hash_table_remove(pkt->handle->stream->rtx_nacked[pkt->vindex], GUINT_TO_POINTER(pkt->seq_number));
-
-	return G_SOURCE_REMOVE;
+	gint64 before, rtcp_last_sr_rr, last_event, last_srtp_summary, last_nack_cleanup;
+	janus_timer_wheel_entry timer;
+	gboolean alert_sent;
+	gboolean detaching;
+	janus_ice_egress *egress;
+	/* Outbound pacer: video packets waiting for their turn, and bytes we can send right now */
+	gboolean pacing;
+	GQueue *pacer;
+	gint64 pacer_budget, pacer_updated;
+};
+static void janus_ice_send_context_init(janus_ice_send_context *ctx, janus_ice_handle *handle, gint64 now) {
+	ctx->handle = handle;
+	ctx->before = now;
+	ctx->rtcp_last_sr_rr = now;
+	ctx->last_event = now;
+	ctx->last_srtp_summary = now;
+	ctx->last_nack_cleanup = now;
+	janus_timer_wheel_entry_init(&ctx->timer, ctx);
+	ctx->alert_sent = FALSE;
+	ctx->detaching = FALSE;
+	ctx->egress = NULL;
+	ctx->pacing = FALSE;
+	ctx->pacer = NULL;
+	ctx->pacer_budget = 0;
+	ctx->pacer_updated = 0;
+}
+static void janus_ice_egress_destroy(janus_ice_egress *egress);
+static void janus_ice_send_context_cleanup(janus_ice_send_context *ctx) {
+	janus_ice_egress_destroy(ctx->egress);
+	ctx->egress = NULL;
+	if(ctx->pacer != NULL) {
+		g_queue_free_full(ctx->pacer, (GDestroyNotify)janus_ice_queued_packet_free);
+		ctx->pacer = NULL;
+	}
 }
 
 /* Time, in seconds, that should pass with no media (audio or video) being
@@ -275,6 +706,21 @@ gboolean janus_is_rfc4588_enabled(void) {
 	return rfc4588_enabled;
 }
 
+/* Forward error correction (ULPFEC, in RED) for outgoing video */
+static guint fec_overhead = 0;
+void janus_ice_set_fec_overhead(guint overhead) {
+	if(overhead > 100) {
+		JANUS_LOG(LOG_WARN, "FEC overhead can't be higher than 100%%, using 100%% instead of %u%%\n", overhead);
+		overhead = 100;
+	}
+	fec_overhead = overhead;
+	if(fec_overhead > 0)
+		JANUS_LOG(LOG_INFO, "Outgoing video will be protected by ULPFEC (%u%% overhead), when negotiated\n", fec_overhead);
+}
+guint janus_ice_get_fec_overhead(void) {
+	return fec_overhead;
+}
+
 
 /* Maximum value, in milliseconds, for the NACK queue/retransmissions (default=500ms) */
 #define DEFAULT_MAX_NACK_QUEUE	500
@@ -292,43 +738,127 @@ void janus_set_max_nack_queue(uint mnq) {
 uint janus_get_max_nack_queue(void) {
 	return max_nack_queue;
 }
+/* Size of the rings of sent packets for retransmissions */
+#define DEFAULT_RETRANSMIT_BUFFER_SIZE	2048
+/* Audio packets are much fewer than video ones, no need for a big ring there */
+#define AUDIO_RETRANSMIT_BUFFER_SIZE	256
+static guint retransmit_buffer_size = DEFAULT_RETRANSMIT_BUFFER_SIZE;
+void janus_set_retransmit_buffer_size(guint size) {
+	guint rbs = 64;
+	while(rbs < size && rbs < 65536)
+		rbs <<= 1;
+	retransmit_buffer_size = rbs;
+	JANUS_LOG(LOG_VERB, "Setting retransmit buffer size to %u packets\n", retransmit_buffer_size);
+}
+guint janus_get_retransmit_buffer_size(void) {
+	return retransmit_buffer_size;
+}
+
+/* Retransmission rings: packets are stored in the slot their sequence number
+ * points to, and the ring covers a window of sequence numbers that moves
+ * forward as new packets are sent, which makes inserts, lookups and
+ * expiration O(1) without any hashing or list nodes involved */
+static janus_ice_retransmit_buffer *janus_ice_retransmit_buffer_create(guint size) {
+	janus_ice_retransmit_buffer *rb = g_malloc0(sizeof(janus_ice_retransmit_buffer));
+	rb->slots = g_malloc0(size * sizeof(janus_ice_retransmit_slot));
+	rb->mask = size-1;
+	return rb;
+}
+/* Get rid of the oldest sequence number in the window */
+static void janus_ice_retransmit_buffer_pop(janus_ice_retransmit_buffer *rb) {
+	janus_ice_retransmit_slot *slot = &rb->slots[rb->oldest & rb->mask];
+	if(slot->packet != NULL && slot->seq == rb->oldest) {
+		janus_ice_queued_packet_free(slot->packet);
+		slot->packet = NULL;
+		rb->count--;
+	}
+	rb->oldest++;
+}
+static void janus_ice_retransmit_buffer_clear(janus_ice_retransmit_buffer *rb) {
+	guint i = 0;
+	for(i=0; i<=rb->mask; i++) {
+		if(rb->slots[i].packet != NULL) {
+			janus_ice_queued_packet_free(rb->slots[i].packet);
+			rb->slots[i].packet = NULL;
+		}
+	}
+	rb->count = 0;
+}
+static void janus_ice_retransmit_buffer_destroy(janus_ice_retransmit_buffer *rb) {
+	if(rb == NULL)
+		return;
+	janus_ice_retransmit_buffer_clear(rb);
+	g_free(rb->slots);
+	g_free(rb);
+}
+static void janus_ice_retransmit_buffer_store(janus_ice_retransmit_buffer *rb, guint16 seq, janus_ice_queued_packet *pkt, gint64 now) {
+	if(rb->count == 0) {
+		rb->oldest = seq;
+		rb->newest = seq;
+	} else {
+		gint16 diff = (gint16)(seq - rb->newest);
+		if(diff > 0) {
+			/* Move the window forward, evicting what falls out of it */
+			if((guint)diff > rb->mask) {
+				janus_ice_retransmit_buffer_clear(rb);
+				rb->oldest = seq;
+			} else {
+				while(rb->count > 0 && (guint16)(seq - rb->oldest) > rb->mask)
+					janus_ice_retransmit_buffer_pop(rb);
+				if(rb->count == 0)
+					rb->oldest = seq;
+			}
+			rb->newest = seq;
+		} else if((guint16)(rb->newest - seq) > (guint16)(rb->newest - rb->oldest)) {
+			/* Older than anything we have, there's no room for this */
+			janus_ice_queued_packet_free(pkt);
+			return;
+		}
+	}
+	janus_ice_retransmit_slot *slot = &rb->slots[seq & rb->mask];
+	if(slot->packet != NULL) {
+		janus_ice_queued_packet_free(slot->packet);
+		rb->count--;
+	}
+	slot->packet = pkt;
+	slot->seq = seq;
+	slot->created = now;
+	slot->last_retransmit = 0;
+	rb->count++;
+}
+static janus_ice_retransmit_slot *janus_ice_retransmit_buffer_lookup(janus_ice_retransmit_buffer *rb, guint16 seq) {
+	if(rb == NULL || rb->count == 0)
+		return NULL;
+	janus_ice_retransmit_slot *slot = &rb->slots[seq & rb->mask];
+	if(slot->packet == NULL || slot->seq != seq)
+		return NULL;
+	return slot;
+}
+/* Get rid of the packets older than the max NACK queue (or all of them, if now is 0) */
+static void janus_ice_retransmit_buffer_expire(janus_ice_retransmit_buffer *rb, gint64 now) {
+	if(rb == NULL)
+		return;
+	if(!now) {
+		janus_ice_retransmit_buffer_clear(rb);
+		return;
+	}
+	while(rb->count > 0) {
+		janus_ice_retransmit_slot *slot = &rb->slots[rb->oldest & rb->mask];
+		if(slot->packet != NULL && slot->seq == rb->oldest && now - slot->created < (gint64)max_nack_queue*1000)
+			break;
+		janus_ice_retransmit_buffer_pop(rb);
+	}
+}
+
 /* Helper to clean old NACK packets in the buffer when they exceed the queue time limit */
 static void janus_cleanup_nack_buffer(gint64 now, janus_ice_stream *stream, gboolean audio, gboolean video) {
 	if(stream && stream->component) {
 		janus_ice_component *component = stream->component;
 		janus_mutex_lock(&component->mutex);
-		if(audio && component->audio_retransmit_buffer) {
-			janus_rtp_packet *p = (janus_rtp_packet *)g_queue_peek_head(component->audio_retransmit_buffer);
-			while(p && (!now || (now - p->created >= (gint64)max_nack_queue*1000))) {
-				/* Packet is too old, get rid of it */
-				g_queue_pop_head(component->audio_retransmit_buffer);
-				/* Remove from hashtable too */
-				janus_rtp_header *header = (janus_rtp_header *)p->data;
-				guint16 seq = ntohs(header->seq_number);
-				g_hash_table_remove(component->audio_retransmit_seqs, GUINT_TO_POINTER(seq));
-				/* Free the packet */
-				g_free(p->data);
-				p->data = NULL;
-				g_free(p);
-				p = (janus_rtp_packet *)g_queue_peek_head(component->audio_retransmit_buffer);
-			}
-		}
-		if(video && component->video_retransmit_buffer) {
-			janus_rtp_packet *p = (janus_rtp_packet *)g_queue_peek_head(component->video_retransmit_buffer);
-			while(p && (!now || (now - p->created >= (gint64)max_nack_queue*1000))) {
-				/* Packet is too old, get rid of it */
-				g_queue_pop_head(component->video_retransmit_buffer);
-				/* Remove from hashtable too */
-				janus_rtp_header *header = (janus_rtp_header *)p->data;
-				guint16 seq = ntohs(header->seq_number);
-				g_hash_table_remove(component->video_retransmit_seqs, GUINT_TO_POINTER(seq));
-				/* Free the packet */
-				g_free(p->data);
-				p->data = NULL;
-				g_free(p);
-				p = (janus_rtp_packet *)g_queue_peek_head(component->video_retransmit_buffer);
-			}
-		}
+		if(audio)
+			janus_ice_retransmit_buffer_expire(component->audio_retransmit_buffer, now);
+		if(video)
+			janus_ice_retransmit_buffer_expire(component->video_retransmit_buffer, now);
 		janus_mutex_unlock(&component->mutex);
 	}
 }
@@ -336,58 +866,157 @@ static void janus_cleanup_nack_buffer(gint64 now, janus_ice_stream *stream, gboo
 
 #define SEQ_MISSING_WAIT 12000 /*  12ms */
 #define SEQ_NACKED_WAIT 155000 /* 155ms */
-/* janus_seq_info list functions */
-static void janus_seq_append(janus_seq_info **head, janus_seq_info *new_seq) {
-	if(*head == NULL) {
-		new_seq->prev = new_seq;
-		new_seq->next = new_seq;
-		*head = new_seq;
-	} else {
-		janus_seq_info *last_seq = (*head)->prev;
-		new_seq->prev = last_seq;
-		new_seq->next = *head;
-		(*head)->prev = new_seq;
-		last_seq->next = new_seq;
-	}
-}
-static janus_seq_info *janus_seq_pop_head(janus_seq_info **head) {
-	janus_seq_info *pop_seq = *head;
-	if(pop_seq) {
-		janus_seq_info *new_head = pop_seq->next;
-		if(pop_seq == new_head || new_head == NULL) {
-			*head = NULL;
-		} else {
-			*head = new_head;
-			new_head->prev = pop_seq->prev;
-			new_head->prev->next = new_head;
+/* Missing packets are checked (and NACKed in a single message) at most once per interval */
+#define SEQ_NACK_INTERVAL 10000 /* 10ms */
+#define SEQ_MISSING_ROUNDS (SEQ_MISSING_WAIT/SEQ_NACK_INTERVAL + 1)
+#define SEQ_NACKED_ROUNDS (SEQ_NACKED_WAIT/SEQ_NACK_INTERVAL + 1)
+/* Sequence numbers moving back more than this mean the stream restarted */
+#define SEQ_MAX_BACKWARDS 1000
+/* janus_seq_window bitmap helpers */
+#define SEQ_SLOT(seq) ((seq) & (JANUS_SEQ_WINDOW_SIZE-1))
+#define SEQ_BIT_SET(map, slot) (map)[(slot) >> 5] |= (1U << ((slot) & 31))
+#define SEQ_BIT_CLEAR(map, slot) (map)[(slot) >> 5] &= ~(1U << ((slot) & 31))
+#define SEQ_BIT_IS_SET(map, slot) (((map)[(slot) >> 5] >> ((slot) & 31)) & 1)
+/* janus_seq_window functions */
+static void janus_seq_window_start(janus_seq_window *win, guint16 seq) {
+	memset(win->received, 0, sizeof(win->received));
+	memset(win->nacked, 0, sizeof(win->nacked));
+	memset(win->giveup, 0, sizeof(win->giveup));
+	win->highest = seq;
+	win->tracked = 1;
+	SEQ_BIT_SET(win->received, SEQ_SLOT(seq));
+}
+void janus_seq_window_reset(janus_seq_window *win) {
+	if(win == NULL)
+		return;
+	win->tracked = 0;
+}
+/* Track a received sequence number: returns 1 if it was missing,
+ * -1 if the jump was too big and we started fresh, 0 otherwise */
+static int janus_seq_window_update(janus_seq_window *win, guint16 seq) {
+	if(win->tracked == 0) {
+		janus_seq_window_start(win, seq);
+		return 0;
+	}
+	gint16 diff = (gint16)(seq - win->highest);
+	if(diff > 0) {
+		if(diff >= JANUS_SEQ_WINDOW_SIZE) {
+			janus_seq_window_start(win, seq);
+			return -1;
+		}
+		/* Move the window forward: the sequence numbers we skipped are missing */
+		guint16 cur = win->highest;
+		while(cur != seq) {
+			cur++;
+			guint slot = SEQ_SLOT(cur);
+			SEQ_BIT_CLEAR(win->received, slot);
+			SEQ_BIT_CLEAR(win->nacked, slot);
+			SEQ_BIT_CLEAR(win->giveup, slot);
+			win->round[slot] = win->current_round;
+		}
+		SEQ_BIT_SET(win->received, SEQ_SLOT(seq));
+		win->highest = seq;
+		win->tracked = MIN(win->tracked + diff, JANUS_SEQ_WINDOW_SIZE);
+		return 0;
+	}
+	guint16 back = (guint16)(win->highest - seq);
+	if(back >= win->tracked) {
+		/* Too old to be tracked, unless the stream restarted */
+		if(back > SEQ_MAX_BACKWARDS) {
+			janus_seq_window_start(win, seq);
+			return -1;
+		}
+		return 0;
+	}
+	guint slot = SEQ_SLOT(seq);
+	if(SEQ_BIT_IS_SET(win->received, slot))
+		return 0;
+	SEQ_BIT_SET(win->received, slot);
+	return 1;
+}
+/* Check whether a sequence number was NACKed and we received it already (e.g., duplicates with RFC4588) */
+static gboolean janus_seq_window_is_duplicate(janus_seq_window *win, guint16 seq) {
+	if(win == NULL || win->tracked == 0)
+		return FALSE;
+	guint16 back = (guint16)(win->highest - seq);
+	if(back >= win->tracked)
+		return FALSE;
+	guint slot = SEQ_SLOT(seq);
+	return SEQ_BIT_IS_SET(win->nacked, slot) && SEQ_BIT_IS_SET(win->received, slot);
+}
+/* Start a new NACK round, if it's time, and write the ordered sequence numbers
+ * to NACK in the provided array (which must fit JANUS_SEQ_WINDOW_SIZE items):
+ * missing ones are NACKed once, and then once more if still missing after
+ * a while, after which we give up on them. Returns how many were written */
+static int janus_seq_window_nacks(janus_seq_window *win, gint64 now, guint16 *nacks) {
+	if(win == NULL || win->tracked == 0 || now - win->round_started < SEQ_NACK_INTERVAL)
+		return 0;
+	win->current_round++;
+	win->round_started = now;
+	int count = 0;
+	guint16 seq = win->highest - win->tracked + 1;
+	guint i = 0;
+	for(i=0; i<win->tracked; i++, seq++) {
+		guint slot = SEQ_SLOT(seq);
+		if((slot & 31) == 0 && i+32 <= win->tracked &&
+				(win->received[slot >> 5] | win->giveup[slot >> 5]) == 0xFFFFFFFF) {
+			/* Nothing to do for this whole block */
+			i += 31;
+			seq += 31;
+			continue;
+		}
+		if(SEQ_BIT_IS_SET(win->received, slot) || SEQ_BIT_IS_SET(win->giveup, slot))
+			continue;
+		guint8 age = win->current_round - win->round[slot];
+		if(!SEQ_BIT_IS_SET(win->nacked, slot)) {
+			if(age >= SEQ_MISSING_ROUNDS) {
+				/* First NACK */
+				nacks[count++] = seq;
+				SEQ_BIT_SET(win->nacked, slot);
+				win->round[slot] = win->current_round;
+			}
+		} else if(age >= SEQ_NACKED_ROUNDS) {
+			/* Second NACK, we won't ask again */
+			nacks[count++] = seq;
+			SEQ_BIT_SET(win->giveup, slot);
 		}
 	}
-	return pop_seq;
+	return count;
 }
-void janus_seq_list_free(janus_seq_info **head) {
-	if(!*head)
+
+
+/* SSRC routing table */
+void janus_ice_stream_update_ssrc_table(janus_ice_stream *stream) {
+	if(stream == NULL)
 		return;
-	janus_seq_info *cur = *head;
-	do {
-		janus_seq_info *next = cur->next;
-		g_free(cur);
-		cur = next;
-	} while(cur != *head);
-	*head = NULL;
-}
-static int janus_seq_in_range(guint16 seqn, guint16 start, guint16 len) {
-	/* Supports wrapping sequence (easier with int range) */
-	int n = seqn;
-	int nh = (1<<16) + n;
-	int s = start;
-	int e = s + len;
-	return (s <= n && n < e) || (s <= nh && nh < e);
+	janus_mutex_lock(&stream->mutex);
+	janus_ssrc_table *table = &stream->ssrc_table;
+	janus_ssrc_table_update_begin(table);
+	/* Same precedence as the checks we used to do for each packet */
+	int vindex = 0;
+	for(vindex=0; vindex<3; vindex++) {
+		janus_ssrc_table_add(table, stream->video_ssrc_peer[vindex], TRUE, vindex, FALSE);
+		janus_ssrc_table_add(table, stream->video_ssrc_peer_rtx[vindex], TRUE, vindex, TRUE);
+	}
+	janus_ssrc_table_add(table, stream->audio_ssrc_peer, FALSE, 0, FALSE);
+	janus_ssrc_table_update_end(table);
+	janus_mutex_unlock(&stream->mutex);
 }
 
 
 /* Internal method for relaying RTCP messages, optionally filtering them in case they come from plugins */
 void janus_ice_relay_rtcp_internal(janus_ice_handle *handle, int video, char *buf, int len, gboolean filter_rtcp);
 
+/* Internal method to get rid of the ICE loop of a handle, whether it's dedicated or shared */
+static void janus_ice_loop_quit(janus_ice_handle *handle);
+
+/* Internal methods to start and stop reading incoming packets in batches */
+static void janus_ice_ingress_start(janus_ice_handle *handle, janus_ice_stream *stream, janus_ice_component *component);
+static void janus_ice_ingress_stop(janus_ice_handle *handle, gboolean reattach);
+
+/* Internal method to enqueue an outgoing packet, and wake up whoever's in charge of sending it */
+static void janus_ice_queue_packet(janus_ice_handle *handle, janus_ice_queued_packet *pkt, gboolean priority);
+
 
 /* Map of active plugin sessions */
 static GHashTable *plugin_sessions;
@@ -403,69 +1032,99 @@ gboolean janus_plugin_session_is_alive(janus_plugin_session *plugin_session) {
 	return (result != NULL);
 }
 
-/* Watchdog for removing old handles */
+/* Watchdog for removing old handles: detached handles are put on a timer
+ * wheel, so that each tick only checks the ones whose timer expired */
 static GHashTable *old_handles = NULL;
+static janus_timer_wheel *old_handles_wheel = NULL;
 static GMainContext *handles_watchdog_context = NULL;
 GMainLoop *handles_watchdog_loop = NULL;
 GThread *handles_watchdog = NULL;
 static janus_mutex old_handles_mutex;
-
-static gboolean janus_ice_handles_cleanup(gpointer user_data) {
-	janus_ice_handle *handle = (janus_ice_handle *) user_data;
-
-	JANUS_LOG(LOG_INFO, "Cleaning up handle %"SCNu64"...\n", handle->handle_id);
-	janus_ice_free(handle);
-
-	return G_SOURCE_REMOVE;
-}
+/* How often we check if a detached handle can be freed, and how long we wait before doing that */
+#define JANUS_ICE_HANDLES_CHECK_INTERVAL	G_USEC_PER_SEC
+#define JANUS_ICE_HANDLES_CLEANUP_DELAY		(3*G_USEC_PER_SEC)
 
 static gboolean janus_ice_handles_check(gpointer user_data) {
-	GMainContext *watchdog_context = (GMainContext *) user_data;
+	GList *freeable = NULL;
 	janus_mutex_lock(&old_handles_mutex);
-	if(old_handles && g_hash_table_size(old_handles) > 0) {
-		GHashTableIter iter;
-		gpointer value;
-		g_hash_table_iter_init(&iter, old_handles);
-		while (g_hash_table_iter_next(&iter, NULL, &value)) {
-			janus_ice_handle *handle = (janus_ice_handle *) value;
-			if (!handle) {
-				continue;
-			}
-			/* Be sure that iceloop is not running, before freeing */
-			if(handle->iceloop != NULL && g_main_loop_is_running(handle->iceloop)) {
-				JANUS_LOG(LOG_WARN, "Handle %"SCNu64" cleanup skipped because iceloop is still running...\n", handle->handle_id);
-				g_main_loop_quit(handle->iceloop);
-				continue;
-			}
-			/* Be sure that icethread has finished, before freeing*/
-			if(handle->icethread != NULL) {
-				JANUS_LOG(LOG_WARN, "Handle %"SCNu64" cleanup skipped because icethread is still running...\n", handle->handle_id);
-				continue;
-			}
-			/* Be sure that ice send thread has finished, before freeing*/
-			if (g_atomic_int_get(&handle->send_thread_created) && handle->send_thread != NULL) {
-				JANUS_LOG(LOG_WARN, "Handle %"SCNu64" cleanup skipped because icesendthread is still running...\n", handle->handle_id);
-				continue;
-			}
-			/* Schedule the ICE handle for deletion */
-			g_hash_table_iter_remove(&iter);
-			GSource *timeout_source = g_timeout_source_new_seconds(3);
-			g_source_set_callback(timeout_source, janus_ice_handles_cleanup, handle, NULL);
-			g_source_attach(timeout_source, watchdog_context);
-			g_source_unref(timeout_source);
+	gint64 now = janus_get_monotonic_time();
+	GList *expired = janus_timer_wheel_advance(old_handles_wheel, now), *l = expired;
+	while(l != NULL) {
+		janus_timer_wheel_entry *timer = (janus_timer_wheel_entry *)l->data;
+		janus_ice_handle *handle = (janus_ice_handle *)timer->data;
+		l = l->next;
+		if(handle->cleanup_ready) {
+			/* We waited long enough, get rid of the handle */
+			freeable = g_list_prepend(freeable, handle);
+			continue;
+		}
+		/* Be sure that the cleanup scheduled on a static event loop is done, before freeing */
+		if(g_atomic_int_get(&handle->static_loop_cleanup) == JANUS_ICE_STATIC_LOOP_CLEANUP_PENDING) {
+			JANUS_LOG(LOG_WARN, "Handle %"SCNu64" cleanup skipped because its static event loop cleanup is still pending...\n", handle->handle_id);
+			janus_timer_wheel_schedule(old_handles_wheel, timer, now + JANUS_ICE_HANDLES_CHECK_INTERVAL);
+			continue;
+		}
+		/* Be sure that iceloop is not running, before freeing */
+		if(handle->iceloop != NULL && (handle->static_event_loop != NULL || g_main_loop_is_running(handle->iceloop))) {
+			JANUS_LOG(LOG_WARN, "Handle %"SCNu64" cleanup skipped because iceloop is still running...\n", handle->handle_id);
+			janus_ice_loop_quit(handle);
+			janus_timer_wheel_schedule(old_handles_wheel, timer, now + JANUS_ICE_HANDLES_CHECK_INTERVAL);
+			continue;
+		}
+		/* Be sure that icethread has finished, before freeing*/
+		if(handle->icethread != NULL) {
+			JANUS_LOG(LOG_WARN, "Handle %"SCNu64" cleanup skipped because icethread is still running...\n", handle->handle_id);
+			janus_timer_wheel_schedule(old_handles_wheel, timer, now + JANUS_ICE_HANDLES_CHECK_INTERVAL);
+			continue;
+		}
+		/* Be sure that ice send thread has finished, before freeing*/
+		if (g_atomic_int_get(&handle->send_thread_created) && (handle->send_thread != NULL || handle->send_worker != NULL)) {
+			JANUS_LOG(LOG_WARN, "Handle %"SCNu64" cleanup skipped because icesendthread is still running...\n", handle->handle_id);
+			janus_timer_wheel_schedule(old_handles_wheel, timer, now + JANUS_ICE_HANDLES_CHECK_INTERVAL);
+			continue;
 		}
+		/* Schedule the ICE handle for deletion */
+		g_hash_table_remove(old_handles, &handle->handle_id);
+		handle->cleanup_ready = TRUE;
+		janus_timer_wheel_schedule(old_handles_wheel, timer, now + JANUS_ICE_HANDLES_CLEANUP_DELAY);
 	}
+	g_list_free(expired);
 	janus_mutex_unlock(&old_handles_mutex);
+	/* Free the handles we're done with */
+	l = freeable;
+	while(l != NULL) {
+		janus_ice_handle *handle = (janus_ice_handle *)l->data;
+		JANUS_LOG(LOG_INFO, "Cleaning up handle %"SCNu64"...\n", handle->handle_id);
+		janus_ice_free(handle);
+		l = l->next;
+	}
+	g_list_free(freeable);
 
 	return G_SOURCE_CONTINUE;
 }
 
+json_t *janus_ice_handles_watchdog_info(void) {
+	json_t *info = json_object();
+	json_t *levels = json_array();
+	guint occupancy[JANUS_TIMER_WHEEL_LEVELS];
+	janus_mutex_lock(&old_handles_mutex);
+	guint count = janus_timer_wheel_occupancy(old_handles_wheel, occupancy);
+	janus_mutex_unlock(&old_handles_mutex);
+	int i = 0;
+	for(i=0; i<JANUS_TIMER_WHEEL_LEVELS; i++)
+		json_array_append_new(levels, json_integer(occupancy[i]));
+	json_object_set_new(info, "tick", json_integer(JANUS_ICE_HANDLES_CHECK_INTERVAL/1000));
+	json_object_set_new(info, "timers", json_integer(count));
+	json_object_set_new(info, "levels", levels);
+	return info;
+}
+
 static gpointer janus_ice_handles_watchdog(gpointer user_data) {
 	GMainLoop *loop = (GMainLoop *) user_data;
 	GMainContext *watchdog_context = g_main_loop_get_context(loop);
 	GSource *timeout_source;
 
-	timeout_source = g_timeout_source_new_seconds(1);
+	timeout_source = g_timeout_source_new(JANUS_ICE_HANDLES_CHECK_INTERVAL/1000);
 	g_source_set_callback(timeout_source, janus_ice_handles_check, watchdog_context, NULL);
 	g_source_attach(timeout_source, watchdog_context);
 	g_source_unref(timeout_source);
@@ -696,6 +1355,9 @@ void janus_ice_init(gboolean ice_lite, gboolean ice_tcp, gboolean full_trickle,
 #endif
 	}
 
+	/* Packets to send are recycled using a pool */
+	janus_mutex_init(&packet_pool_mutex);
+
 	/* We keep track of plugin sessions to avoid problems */
 	plugin_sessions = g_hash_table_new(NULL, NULL);
 	janus_mutex_init(&plugin_sessions_mutex);
@@ -703,6 +1365,7 @@ void janus_ice_init(gboolean ice_lite, gboolean ice_tcp, gboolean full_trickle,
 	/* Start the handles watchdog */
 	janus_mutex_init(&old_handles_mutex);
 	old_handles = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, NULL);
+	old_handles_wheel = janus_timer_wheel_create(JANUS_ICE_HANDLES_CHECK_INTERVAL, janus_get_monotonic_time());
 	handles_watchdog_context = g_main_context_new();
 	handles_watchdog_loop = g_main_loop_new(handles_watchdog_context, FALSE);
 	GError *error = NULL;
@@ -712,6 +1375,61 @@ void janus_ice_init(gboolean ice_lite, gboolean ice_tcp, gboolean full_trickle,
 		exit(1);
 	}
 
+	/* Start the shared event loops, unless we've been asked to use a thread per handle */
+	if(static_event_loops < 0) {
+#if GLIB_CHECK_VERSION(2, 36, 0)
+		static_event_loops = g_get_num_processors();
+#else
+		static_event_loops = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		if(static_event_loops < 1)
+			static_event_loops = 1;
+	}
+	if(static_event_loops == 0) {
+		JANUS_LOG(LOG_INFO, "Using a dedicated event loop thread per handle\n");
+	} else {
+		JANUS_LOG(LOG_INFO, "Spawning %d static event loops\n", static_event_loops);
+		event_loops = g_malloc0(static_event_loops * sizeof(janus_ice_static_event_loop));
+		int i = 0;
+		for(i=0; i<static_event_loops; i++) {
+			janus_ice_static_event_loop *loop = &event_loops[i];
+			loop->id = i;
+			loop->mainctx = g_main_context_new();
+			loop->mainloop = g_main_loop_new(loop->mainctx, FALSE);
+			char tname[16];
+			g_snprintf(tname, sizeof(tname), "hloop %d", i);
+			loop->thread = g_thread_try_new(tname, &janus_ice_static_event_loop_thread, loop, &error);
+			if(error != NULL) {
+				JANUS_LOG(LOG_FATAL, "Got error %d (%s) trying to start static event loop #%d...\n",
+					error->code, error->message ? error->message : "??", i);
+				exit(1);
+			}
+		}
+	}
+
+	/* Start the send workers, if we've been asked to use them */
+	if(send_workers_num == 0) {
+		JANUS_LOG(LOG_INFO, "Using a dedicated send thread per handle\n");
+	} else {
+		JANUS_LOG(LOG_INFO, "Spawning %d send workers\n", send_workers_num);
+		send_workers = g_malloc0(send_workers_num * sizeof(janus_ice_send_worker));
+		int i = 0;
+		for(i=0; i<send_workers_num; i++) {
+			janus_ice_send_worker *worker = &send_workers[i];
+			worker->id = i;
+			worker->ready = g_async_queue_new();
+			worker->wheel = janus_timer_wheel_create(JANUS_ICE_SEND_WHEEL_TICK, janus_get_monotonic_time());
+			char tname[16];
+			g_snprintf(tname, sizeof(tname), "icesend w%d", i);
+			worker->thread = g_thread_try_new(tname, &janus_ice_send_worker_thread, worker, &error);
+			if(error != NULL) {
+				JANUS_LOG(LOG_FATAL, "Got error %d (%s) trying to start send worker #%d...\n",
+					error->code, error->message ? error->message : "??", i);
+				exit(1);
+			}
+		}
+	}
+
 #ifdef HAVE_LIBCURL
 	/* Initialize the TURN REST API client stack, whether we're going to use it or not */
 	janus_turnrest_init();
@@ -726,10 +1444,51 @@ void janus_ice_deinit(void) {
 	handles_watchdog = NULL;
 	g_main_loop_unref(handles_watchdog_loop);
 	g_main_context_unref(handles_watchdog_context);
+	if(send_workers != NULL) {
+		JANUS_LOG(LOG_INFO, "Ending send workers...\n");
+		int i = 0;
+		for(i=0; i<send_workers_num; i++)
+			g_atomic_int_set(&send_workers[i].stop, 1);
+		for(i=0; i<send_workers_num; i++) {
+			janus_ice_send_worker *worker = &send_workers[i];
+			g_thread_join(worker->thread);
+			janus_ice_send_worker_release_all(worker);
+			janus_timer_wheel_destroy(worker->wheel);
+			g_list_free(worker->paced);
+			g_async_queue_unref(worker->ready);
+		}
+		g_free(send_workers);
+		send_workers = NULL;
+	}
+	if(event_loops != NULL) {
+		JANUS_LOG(LOG_INFO, "Ending static event loops...\n");
+		int i = 0;
+		for(i=0; i<static_event_loops; i++) {
+			g_main_loop_quit(event_loops[i].mainloop);
+			g_main_context_wakeup(event_loops[i].mainctx);
+		}
+		for(i=0; i<static_event_loops; i++) {
+			g_thread_join(event_loops[i].thread);
+			g_main_loop_unref(event_loops[i].mainloop);
+			g_main_context_unref(event_loops[i].mainctx);
+		}
+		g_free(event_loops);
+		event_loops = NULL;
+	}
+	janus_mutex_lock(&packet_pool_mutex);
+	while(packet_depot != NULL) {
+		janus_ice_queued_packet *pkt = packet_depot;
+		packet_depot = pkt->next;
+		g_free(pkt);
+	}
+	packet_depot_count = 0;
+	janus_mutex_unlock(&packet_pool_mutex);
 	janus_mutex_lock(&old_handles_mutex);
 	if(old_handles != NULL)
 		g_hash_table_destroy(old_handles);
 	old_handles = NULL;
+	janus_timer_wheel_destroy(old_handles_wheel);
+	old_handles_wheel = NULL;
 	janus_mutex_unlock(&old_handles_mutex);
 #ifdef HAVE_LIBCURL
 	janus_turnrest_deinit();
@@ -987,13 +1746,18 @@ janus_ice_handle *janus_ice_handle_create(void *gateway_session, const char *opa
 	handle->handle_id = handle_id;
 	handle->app = NULL;
 	handle->app_handle = NULL;
-	handle->queued_packets = g_async_queue_new();
+	handle->queued_packets = janus_mpsc_queue_create(send_queue_size);
+	janus_timer_wheel_entry_init(&handle->cleanup_timer, handle);
 	janus_mutex_init(&handle->mutex);
+	/* Pin the handle to one of the static event loops, if any */
+	handle->static_event_loop = janus_ice_static_event_loop_assign();
 
 	/* Set up other stuff. */
+	janus_mutex_lock(&session->handles_mutex);
 	if(session->ice_handles == NULL)
 		session->ice_handles = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, NULL);
 	g_hash_table_insert(session->ice_handles, janus_uint64_dup(handle->handle_id), handle);
+	janus_mutex_unlock(&session->handles_mutex);
 
 	return handle;
 }
@@ -1002,7 +1766,9 @@ janus_ice_handle *janus_ice_handle_find(void *gateway_session, guint64 handle_id
 	if(gateway_session == NULL)
 		return NULL;
 	janus_session *session = (janus_session *)gateway_session;
+	janus_mutex_lock(&session->handles_mutex);
 	janus_ice_handle *handle = session->ice_handles ? g_hash_table_lookup(session->ice_handles, &handle_id) : NULL;
+	janus_mutex_unlock(&session->handles_mutex);
 	return handle;
 }
 
@@ -1068,11 +1834,10 @@ gint janus_ice_handle_destroy(void *gateway_session, guint64 handle_id) {
 		janus_flags_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP);
 		if(handle->iceloop != NULL) {
 			if(handle->stream_id > 0) {
+				janus_ice_ingress_stop(handle, FALSE);
 				nice_agent_attach_recv(handle->agent, handle->stream_id, 1, g_main_loop_get_context (handle->iceloop), NULL, NULL);
 			}
-			if(handle->iceloop != NULL && g_main_loop_is_running(handle->iceloop)) {
-				g_main_loop_quit(handle->iceloop);
-			}
+			janus_ice_loop_quit(handle);
 		}
 		return 0;
 	}
@@ -1090,11 +1855,10 @@ gint janus_ice_handle_destroy(void *gateway_session, guint64 handle_id) {
 	janus_flags_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP);
 	if(handle->iceloop != NULL) {
 		if(handle->stream_id > 0) {
+			janus_ice_ingress_stop(handle, FALSE);
 			nice_agent_attach_recv(handle->agent, handle->stream_id, 1, g_main_loop_get_context (handle->iceloop), NULL, NULL);
 		}
-		if(handle->iceloop != NULL && g_main_loop_is_running(handle->iceloop)) {
-			g_main_loop_quit(handle->iceloop);
-		}
+		janus_ice_loop_quit(handle);
 	}
 
 	/* Prepare JSON event to notify user/application */
@@ -1109,6 +1873,8 @@ gint janus_ice_handle_destroy(void *gateway_session, guint64 handle_id) {
 	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Handle detached (error=%d), scheduling destruction\n", handle_id, error);
 	janus_mutex_lock(&old_handles_mutex);
 	g_hash_table_insert(old_handles, janus_uint64_dup(handle->handle_id), handle);
+	if(!handle->cleanup_ready)
+		janus_timer_wheel_schedule(old_handles_wheel, &handle->cleanup_timer, janus_get_monotonic_time() + JANUS_ICE_HANDLES_CHECK_INTERVAL);
 	janus_mutex_unlock(&old_handles_mutex);
 	/* Notify event handlers as well */
 	if(janus_events_is_enabled())
@@ -1122,14 +1888,9 @@ void janus_ice_free(janus_ice_handle *handle) {
 		return;
 	janus_mutex_lock(&handle->mutex);
 	janus_ice_queued_packet *pkt = NULL;
-	while(g_async_queue_length(handle->queued_packets) > 0) {
-		pkt = g_async_queue_try_pop(handle->queued_packets);
-		if(pkt != NULL && pkt != &janus_ice_dtls_alert) {
-			g_free(pkt->data);
-			g_free(pkt);
-		}
-	}
-	g_async_queue_unref(handle->queued_packets);
+	while((pkt = janus_mpsc_queue_try_pop(handle->queued_packets)) != NULL)
+		janus_ice_queued_packet_free(pkt);
+	janus_mpsc_queue_destroy(handle->queued_packets);
 	handle->queued_packets = NULL;
 	handle->session = NULL;
 	handle->app = NULL;
@@ -1144,6 +1905,10 @@ void janus_ice_free(janus_ice_handle *handle) {
 	}
 	janus_mutex_unlock(&handle->mutex);
 	janus_ice_webrtc_free(handle);
+	if(handle->static_event_loop != NULL) {
+		g_atomic_int_dec_and_test(&handle->static_event_loop->handles);
+		handle->static_event_loop = NULL;
+	}
 	JANUS_LOG(LOG_INFO, "[%"SCNu64"] Handle and related resources freed\n", handle->handle_id);
 	g_free(handle->opaque_id);
 	g_free(handle);
@@ -1167,19 +1932,16 @@ void janus_ice_webrtc_hangup(janus_ice_handle *handle, const char *reason) {
 		handle->hangup_reason = reason;
 	}
 	if(handle->queued_packets != NULL && handle->send_thread_created)
-#if GLIB_CHECK_VERSION(2, 46, 0)
-		g_async_queue_push_front(handle->queued_packets, &janus_ice_dtls_alert);
-#else
-		g_async_queue_push(handle->queued_packets, &janus_ice_dtls_alert);
-#endif
+		janus_ice_queue_packet(handle, &janus_ice_dtls_alert, TRUE);
 	/* Get rid of the loop */
-	if(handle->send_thread == NULL) {
+	if(handle->send_thread == NULL && handle->send_worker == NULL) {
 		if(handle->iceloop != NULL) {
 			if(handle->stream_id > 0) {
+				janus_ice_ingress_stop(handle, FALSE);
 				nice_agent_attach_recv(handle->agent, handle->stream_id, 1, g_main_loop_get_context (handle->iceloop), NULL, NULL);
 			}
 			gint64 waited = 0;
-			while(handle->iceloop && !g_main_loop_is_running(handle->iceloop)) {
+			while(handle->static_event_loop == NULL && handle->iceloop && !g_main_loop_is_running(handle->iceloop)) {
 				JANUS_LOG(LOG_VERB, "[%"SCNu64"] ICE loop exists but is not running, waiting for it to run\n", handle->handle_id);
 				g_usleep (100000);
 				waited += 100000;
@@ -1188,13 +1950,8 @@ void janus_ice_webrtc_hangup(janus_ice_handle *handle, const char *reason) {
 					break;
 				}
 			}
-			if(handle->iceloop != NULL && g_main_loop_is_running(handle->iceloop)) {
-				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Forcing ICE loop to quit (%s)\n", handle->handle_id, g_main_loop_is_running(handle->iceloop) ? "running" : "NOT running");
-				g_main_loop_quit(handle->iceloop);
-				if (handle->icectx != NULL) {
-					g_main_context_wakeup(handle->icectx);
-				}
-			}
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Forcing ICE loop to quit\n", handle->handle_id);
+			janus_ice_loop_quit(handle);
 		}
 	}
 }
@@ -1302,6 +2059,10 @@ void janus_ice_stream_free(janus_ice_stream *stream) {
 	stream->audio_codec = NULL;
 	g_free(stream->video_codec);
 	stream->video_codec = NULL;
+	janus_bwe_context_destroy(stream->bwe);
+	stream->bwe = NULL;
+	janus_fec_context_destroy(stream->fec);
+	stream->fec = NULL;
 	g_free(stream->audio_rtcp_ctx);
 	stream->audio_rtcp_ctx = NULL;
 	g_free(stream->video_rtcp_ctx[0]);
@@ -1310,15 +2071,6 @@ void janus_ice_stream_free(janus_ice_stream *stream) {
 	stream->video_rtcp_ctx[1] = NULL;
 	g_free(stream->video_rtcp_ctx[2]);
 	stream->video_rtcp_ctx[2] = NULL;
-	if(stream->rtx_nacked[0])
-		g_hash_table_destroy(stream->rtx_nacked[0]);
-	stream->rtx_nacked[0] = NULL;
-	if(stream->rtx_nacked[1])
-		g_hash_table_destroy(stream->rtx_nacked[1]);
-	stream->rtx_nacked[1] = NULL;
-	if(stream->rtx_nacked[2])
-		g_hash_table_destroy(stream->rtx_nacked[2]);
-	stream->rtx_nacked[2] = NULL;
 	g_slist_free_full(stream->transport_wide_received_seq_nums, (GDestroyNotify)g_free);
 	stream->transport_wide_received_seq_nums = NULL;
 	stream->audio_first_ntp_ts = 0;
@@ -1356,40 +2108,19 @@ void janus_ice_component_free(janus_ice_component *component) {
 		g_source_unref(component->dtlsrt_source);
 		component->dtlsrt_source = NULL;
 	}
+	GSource *ingress_source = g_atomic_pointer_get(&component->ingress_source);
+	if(ingress_source != NULL && g_atomic_pointer_compare_and_exchange(&component->ingress_source, ingress_source, NULL)) {
+		g_source_destroy(ingress_source);
+		g_source_unref(ingress_source);
+	}
 	if(component->dtls != NULL) {
 		janus_dtls_srtp_destroy(component->dtls);
 		component->dtls = NULL;
 	}
-	if(component->audio_retransmit_buffer != NULL) {
-		janus_rtp_packet *p = NULL;
-		while((p = (janus_rtp_packet *)g_queue_pop_head(component->audio_retransmit_buffer)) != NULL) {
-			/* Remove from hashtable too */
-			janus_rtp_header *header = (janus_rtp_header *)p->data;
-			guint16 seq = ntohs(header->seq_number);
-			g_hash_table_remove(component->audio_retransmit_seqs, GUINT_TO_POINTER(seq));
-			/* Free the packet */
-			g_free(p->data);
-			p->data = NULL;
-			g_free(p);
-		}
-		g_queue_free(component->audio_retransmit_buffer);
-		g_hash_table_destroy(component->audio_retransmit_seqs);
-	}
-	if(component->video_retransmit_buffer != NULL) {
-		janus_rtp_packet *p = NULL;
-		while((p = (janus_rtp_packet *)g_queue_pop_head(component->video_retransmit_buffer)) != NULL) {
-			/* Remove from hashtable too */
-			janus_rtp_header *header = (janus_rtp_header *)p->data;
-			guint16 seq = ntohs(header->seq_number);
-			g_hash_table_remove(component->video_retransmit_seqs, GUINT_TO_POINTER(seq));
-			/* Free the packet */
-			g_free(p->data);
-			p->data = NULL;
-			g_free(p);
-		}
-		g_queue_free(component->video_retransmit_buffer);
-		g_hash_table_destroy(component->video_retransmit_seqs);
-	}
+	janus_ice_retransmit_buffer_destroy(component->audio_retransmit_buffer);
+	component->audio_retransmit_buffer = NULL;
+	janus_ice_retransmit_buffer_destroy(component->video_retransmit_buffer);
+	component->video_retransmit_buffer = NULL;
 	if(component->candidates != NULL) {
 		GSList *i = NULL, *candidates = component->candidates;
 		for (i = candidates; i; i = i->next) {
@@ -1432,18 +2163,41 @@ void janus_ice_component_free(janus_ice_component *component) {
 	if(component->selected_pair != NULL)
 		g_free(component->selected_pair);
 	component->selected_pair = NULL;
-	if(component->last_seqs_audio)
-		janus_seq_list_free(&component->last_seqs_audio);
-	if(component->last_seqs_video[0])
-		janus_seq_list_free(&component->last_seqs_video[0]);
-	if(component->last_seqs_video[1])
-		janus_seq_list_free(&component->last_seqs_video[1]);
-	if(component->last_seqs_video[2])
-		janus_seq_list_free(&component->last_seqs_video[2]);
+	g_free(component->audio_seq_window);
+	component->audio_seq_window = NULL;
+	g_free(component->video_seq_window[0]);
+	component->video_seq_window[0] = NULL;
+	g_free(component->video_seq_window[1]);
+	component->video_seq_window[1] = NULL;
+	g_free(component->video_seq_window[2]);
+	component->video_seq_window[2] = NULL;
 	g_free(component);
 	//~ janus_mutex_unlock(&handle->mutex);
 }
 
+/* Call plugin estimated_bandwidth callback if the estimate changed enough, or if it's been a while */
+#define BWE_NOTIFY_MIN_INTERVAL	(200*1000)
+#define BWE_NOTIFY_MAX_INTERVAL	G_USEC_PER_SEC
+/* Maximum number of packets we look at in a single transport wide CC feedback */
+#define JANUS_ICE_BWE_MAX_FEEDBACK	512
+static void janus_ice_bwe_update(janus_ice_handle *handle, janus_ice_stream *stream, guint32 estimate, gint64 now) {
+	gint64 elapsed = now - stream->bwe_notified_time;
+	if(elapsed < BWE_NOTIFY_MIN_INTERVAL)
+		return;
+	guint32 last = stream->bwe_notified;
+	guint32 diff = estimate > last ? estimate - last : last - estimate;
+	if(last > 0 && diff*10 < last && elapsed < BWE_NOTIFY_MAX_INTERVAL) {
+		/* Less than 10% change, wait a bit more */
+		return;
+	}
+	stream->bwe_notified = estimate;
+	stream->bwe_notified_time = now;
+	JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Estimated bandwidth: %"SCNu32"\n", handle->handle_id, estimate);
+	janus_plugin *plugin = (janus_plugin *)handle->app;
+	if(plugin && plugin->estimated_bandwidth && janus_plugin_session_is_alive(handle->app_handle))
+		plugin->estimated_bandwidth(handle->app_handle, estimate);
+}
+
 /* Call plugin slow_link callback if enough NACKs within a second */
 #define SLOW_LINK_NACKS_PER_SEC 8
 static void
@@ -1607,6 +2361,9 @@ static void janus_ice_cb_component_state_changed(NiceAgent *agent, guint stream_
 		return;
 	}
 	component->state = state;
+	/* ICE is done, check if we can start receiving in batches */
+	if(state == NICE_COMPONENT_STATE_READY && !janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP))
+		janus_ice_ingress_start(handle, stream, component);
 	/* Notify event handlers */
 	if(janus_events_is_enabled()) {
 		janus_session *session = (janus_session *)handle->session;
@@ -1618,11 +2375,16 @@ static void janus_ice_cb_component_state_changed(NiceAgent *agent, guint stream_
 	}
 	/* Handle new state */
 	if((state == NICE_COMPONENT_STATE_CONNECTED || state == NICE_COMPONENT_STATE_READY)
-			&& handle->send_thread == NULL) {
+			&& handle->send_thread == NULL && handle->send_worker == NULL) {
 		/* Make sure we're not trying to start the thread more than once */
 		if(!g_atomic_int_compare_and_exchange(&handle->send_thread_created, 0, 1)) {
 			return;
 		}
+		if(send_workers != NULL) {
+			/* No dedicated thread, one of the send workers will take care of us */
+			janus_ice_send_worker_assign(handle);
+			return;
+		}
 		/* Start the outgoing data thread */
 		GError *error = NULL;
 		char tname[16];
@@ -1735,6 +2497,10 @@ static void janus_ice_cb_new_selected_pair (NiceAgent *agent, guint stream_id, g
 	gchar *prev_selected_pair = component->selected_pair;
 	component->selected_pair = g_strdup(sp);
 	g_clear_pointer(&prev_selected_pair, g_free);
+	/* Have the send path check if it can use the new pair for batched egress */
+	g_atomic_int_set(&handle->egress_refresh, 1);
+	/* If we were receiving in batches on the previous pair, let libnice take over again */
+	janus_ice_ingress_stop(handle, TRUE);
 	/* Notify event handlers */
 	if(janus_events_is_enabled()) {
 		janus_session *session = (janus_session *)handle->session;
@@ -2053,86 +2819,92 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 			guint32 packet_ssrc = ntohl(header->ssrc);
 			/* Is this audio or video? */
 			int video = 0, vindex = 0, rtx = 0;
-			/* Bundled streams, check SSRC */
-			video = ((stream->video_ssrc_peer[0] == packet_ssrc
-				|| stream->video_ssrc_peer_rtx[0] == packet_ssrc
-				|| stream->video_ssrc_peer[1] == packet_ssrc
-				|| stream->video_ssrc_peer_rtx[1] == packet_ssrc
-				|| stream->video_ssrc_peer[2] == packet_ssrc
-				|| stream->video_ssrc_peer_rtx[2] == packet_ssrc) ? 1 : 0);
-			if(!video && stream->audio_ssrc_peer != packet_ssrc) {
-				/* FIXME In case it happens, we should check what it is */
-				if(stream->audio_ssrc_peer == 0 || stream->video_ssrc_peer[0] == 0) {
-					/* Apparently we were not told the peer SSRCs, try to guess from the payload type */
-					gboolean found = FALSE;
-					guint16 pt = header->type;
-					if(stream->audio_ssrc_peer == 0 && stream->audio_payload_types) {
-						GList *pts = stream->audio_payload_types;
-						while(pts) {
-							guint16 audio_pt = GPOINTER_TO_UINT(pts->data);
-							if(pt == audio_pt) {
-								JANUS_LOG(LOG_VERB, "[%"SCNu64"] Unadvertized SSRC (%"SCNu32") is audio! (payload type %"SCNu16")\n", handle->handle_id, packet_ssrc, pt);
-								video = 0;
-								stream->audio_ssrc_peer = packet_ssrc;
-								found = TRUE;
-								break;
+			if(!janus_ssrc_table_lookup(&stream->ssrc_table, packet_ssrc, &video, &vindex, &rtx)) {
+				/* Not in the table (yet?), check the SSRCs one by one */
+				/* Bundled streams, check SSRC */
+				video = ((stream->video_ssrc_peer[0] == packet_ssrc
+					|| stream->video_ssrc_peer_rtx[0] == packet_ssrc
+					|| stream->video_ssrc_peer[1] == packet_ssrc
+					|| stream->video_ssrc_peer_rtx[1] == packet_ssrc
+					|| stream->video_ssrc_peer[2] == packet_ssrc
+					|| stream->video_ssrc_peer_rtx[2] == packet_ssrc) ? 1 : 0);
+				if(!video && stream->audio_ssrc_peer != packet_ssrc) {
+					/* FIXME In case it happens, we should check what it is */
+					if(stream->audio_ssrc_peer == 0 || stream->video_ssrc_peer[0] == 0) {
+						/* Apparently we were not told the peer SSRCs, try to guess from the payload type */
+						gboolean found = FALSE;
+						guint16 pt = header->type;
+						if(stream->audio_ssrc_peer == 0 && stream->audio_payload_types) {
+							GList *pts = stream->audio_payload_types;
+							while(pts) {
+								guint16 audio_pt = GPOINTER_TO_UINT(pts->data);
+								if(pt == audio_pt) {
+									JANUS_LOG(LOG_VERB, "[%"SCNu64"] Unadvertized SSRC (%"SCNu32") is audio! (payload type %"SCNu16")\n", handle->handle_id, packet_ssrc, pt);
+									video = 0;
+									stream->audio_ssrc_peer = packet_ssrc;
+									found = TRUE;
+									break;
+								}
+								pts = pts->next;
 							}
-							pts = pts->next;
 						}
-					}
-					if(!found && stream->video_ssrc_peer[0] == 0 && stream->video_payload_types) {
-						GList *pts = stream->video_payload_types;
-						while(pts) {
-							guint16 video_pt = GPOINTER_TO_UINT(pts->data);
-							if(pt == video_pt) {
-								JANUS_LOG(LOG_VERB, "[%"SCNu64"] Unadvertized SSRC (%"SCNu32") is video! (payload type %"SCNu16")\n", handle->handle_id, packet_ssrc, pt);
-								video = 1;
-								stream->video_ssrc_peer[0] = packet_ssrc;
-								found = TRUE;
-								break;
+						if(!found && stream->video_ssrc_peer[0] == 0 && stream->video_payload_types) {
+							GList *pts = stream->video_payload_types;
+							while(pts) {
+								guint16 video_pt = GPOINTER_TO_UINT(pts->data);
+								if(pt == video_pt) {
+									JANUS_LOG(LOG_VERB, "[%"SCNu64"] Unadvertized SSRC (%"SCNu32") is video! (payload type %"SCNu16")\n", handle->handle_id, packet_ssrc, pt);
+									video = 1;
+									stream->video_ssrc_peer[0] = packet_ssrc;
+									found = TRUE;
+									break;
+								}
+								pts = pts->next;
 							}
-							pts = pts->next;
 						}
+						/* We guessed a new SSRC, so the set of SSRCs changed: add it to the table */
+						if(found)
+							janus_ice_stream_update_ssrc_table(stream);
+					}
+					if(!video && stream->audio_ssrc_peer != packet_ssrc) {
+						JANUS_LOG(LOG_WARN, "[%"SCNu64"] Not video and not audio? dropping (SSRC %"SCNu32")...\n", handle->handle_id, packet_ssrc);
+						return;
 					}
 				}
-				if(!video && stream->audio_ssrc_peer != packet_ssrc) {
-					JANUS_LOG(LOG_WARN, "[%"SCNu64"] Not video and not audio? dropping (SSRC %"SCNu32")...\n", handle->handle_id, packet_ssrc);
-					return;
-				}
-			}
-			/* Make sure we're prepared to receive this media packet */
-			if((!video && !stream->audio_recv) || (video && !stream->video_recv))
-				return;
-			/* If this is video, check if this is simulcast and/or a retransmission using RFC4588 */
-			if(video) {
-				if(stream->video_ssrc_peer[1] == packet_ssrc) {
-					/* FIXME Simulcast (1) */
-					JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Simulcast #1 (SSRC %"SCNu32")...\n", handle->handle_id, packet_ssrc);
-					vindex = 1;
-				} else if(stream->video_ssrc_peer[2] == packet_ssrc) {
-					/* FIXME Simulcast (2) */
-					JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Simulcast #2 (SSRC %"SCNu32")...\n", handle->handle_id, packet_ssrc);
-					vindex = 2;
-				} else {
-					/* Maybe a video retransmission using RFC4588? */
-					if(stream->video_ssrc_peer_rtx[0] == packet_ssrc) {
-						rtx = 1;
-						vindex = 0;
-						JANUS_LOG(LOG_HUGE, "[%"SCNu64"] RFC4588 rtx packet on video (SSRC %"SCNu32")...\n",
-							handle->handle_id, packet_ssrc);
-					} else if(stream->video_ssrc_peer_rtx[1] == packet_ssrc) {
-						rtx = 1;
+				/* If this is video, check if this is simulcast and/or a retransmission using RFC4588 */
+				if(video) {
+					if(stream->video_ssrc_peer[1] == packet_ssrc) {
+						/* FIXME Simulcast (1) */
+						JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Simulcast #1 (SSRC %"SCNu32")...\n", handle->handle_id, packet_ssrc);
 						vindex = 1;
-						JANUS_LOG(LOG_HUGE, "[%"SCNu64"] RFC4588 rtx packet on video #%d (SSRC %"SCNu32")...\n",
-							handle->handle_id, vindex, packet_ssrc);
-					} else if(stream->video_ssrc_peer_rtx[2] == packet_ssrc) {
-						rtx = 1;
+					} else if(stream->video_ssrc_peer[2] == packet_ssrc) {
+						/* FIXME Simulcast (2) */
+						JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Simulcast #2 (SSRC %"SCNu32")...\n", handle->handle_id, packet_ssrc);
 						vindex = 2;
-						JANUS_LOG(LOG_HUGE, "[%"SCNu64"] RFC4588 rtx packet on video #%d (SSRC %"SCNu32")...\n",
-							handle->handle_id, vindex, packet_ssrc);
+					} else {
+						/* Maybe a video retransmission using RFC4588? */
+						if(stream->video_ssrc_peer_rtx[0] == packet_ssrc) {
+							rtx = 1;
+							vindex = 0;
+							JANUS_LOG(LOG_HUGE, "[%"SCNu64"] RFC4588 rtx packet on video (SSRC %"SCNu32")...\n",
+								handle->handle_id, packet_ssrc);
+						} else if(stream->video_ssrc_peer_rtx[1] == packet_ssrc) {
+							rtx = 1;
+							vindex = 1;
+							JANUS_LOG(LOG_HUGE, "[%"SCNu64"] RFC4588 rtx packet on video #%d (SSRC %"SCNu32")...\n",
+								handle->handle_id, vindex, packet_ssrc);
+						} else if(stream->video_ssrc_peer_rtx[2] == packet_ssrc) {
+							rtx = 1;
+							vindex = 2;
+							JANUS_LOG(LOG_HUGE, "[%"SCNu64"] RFC4588 rtx packet on video #%d (SSRC %"SCNu32")...\n",
+								handle->handle_id, vindex, packet_ssrc);
+						}
 					}
 				}
 			}
+			/* Make sure we're prepared to receive this media packet */
+			if((!video && !stream->audio_recv) || (video && !stream->video_recv))
+				return;
 
 			int buflen = len;
 			srtp_err_status_t res = srtp_unprotect(component->dtls->srtp_in, buf, &buflen);
@@ -2148,11 +2920,13 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 					if(stream->video_ssrc_peer[0] == 0) {
 						stream->video_ssrc_peer[0] = ntohl(header->ssrc);
 						JANUS_LOG(LOG_VERB, "[%"SCNu64"]     Peer video SSRC: %u\n", handle->handle_id, stream->video_ssrc_peer[0]);
+						janus_ice_stream_update_ssrc_table(stream);
 					}
 				} else {
 					if(stream->audio_ssrc_peer == 0) {
 						stream->audio_ssrc_peer = ntohl(header->ssrc);
 						JANUS_LOG(LOG_VERB, "[%"SCNu64"]     Peer audio SSRC: %u\n", handle->handle_id, stream->audio_ssrc_peer);
+						janus_ice_stream_update_ssrc_table(stream);
 					}
 				}
 				/* Do we need to dump this packet for debugging? */
@@ -2181,16 +2955,10 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 					buf += 2;
 					header = (janus_rtp_header *)buf;
 				}
-				if(video && stream->rtx_nacked[vindex] != NULL) {
+				if(video && janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX)) {
 					/* Check if this packet is a duplicate: can happen with RFC4588 */
 					guint16 seqno = ntohs(header->seq_number);
-					int nstate = GPOINTER_TO_INT(g_hash_table_lookup(stream->rtx_nacked[vindex], GUINT_TO_POINTER(seqno)));
-					if(nstate == 1) {
-						/* Packet was NACKed and this is the first time we receive it: change state to received */
-						JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Received NACKed packet %"SCNu16" (SSRC %"SCNu32", vindex %d)...\n",
-							handle->handle_id, seqno, packet_ssrc, vindex);
-						g_hash_table_insert(stream->rtx_nacked[vindex], GUINT_TO_POINTER(seqno), GUINT_TO_POINTER(2));
-					} else if(nstate == 2) {
+					if(janus_seq_window_is_duplicate(component->video_seq_window[vindex], seqno)) {
 						/* We already received this packet: drop it */
 						JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Detected duplicate packet %"SCNu16" (SSRC %"SCNu32", vindex %d)...\n",
 							handle->handle_id, seqno, packet_ssrc, vindex);
@@ -2240,11 +3008,14 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 							stream->video_is_keyframe = &janus_h264_is_keyframe;
 					}
 				}
+				/* Parse all the RTP extensions we know about in one go: plugins get them too */
+				janus_rtp_extensions extensions;
+				janus_rtp_header_extensions_parse(buf, buflen, &stream->rtp_extmap, &extensions);
 				/* Check if we need to handle transport wide cc */
 				if(stream->do_transport_wide_cc) {
-					guint16 transport_seq_num;
 					/* Get transport wide seq num */
-					if(janus_rtp_header_extension_parse_transport_wide_cc(buf, buflen, stream->transport_wide_cc_ext_id, &transport_seq_num)==0) {
+					if(extensions.transport_seq_num >= 0) {
+						guint16 transport_seq_num = extensions.transport_seq_num;
 						/* Get current timestamp */
 						struct timeval now;
 						gettimeofday(&now,0);
@@ -2271,7 +3042,7 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 				/* Pass the data to the responsible plugin */
 				janus_plugin *plugin = (janus_plugin *)handle->app;
 				if(plugin && plugin->incoming_rtp)
-					plugin->incoming_rtp(handle->app_handle, video, buf, buflen);
+					plugin->incoming_rtp(handle->app_handle, video, buf, buflen, &extensions);
 				/* Restore the header for the stats (plugins may have messed with it) */
 				*header = backup;
 				/* Update stats (overall data received, and data received in the last second) */
@@ -2330,110 +3101,40 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 					/* ... unless NACKs are disabled for this medium */
 					return;
 				}
+				guint16 new_seqn = ntohs(header->seq_number);
+				janus_mutex_lock(&component->mutex);
+				janus_seq_window **win = video ? &component->video_seq_window[vindex] : &component->audio_seq_window;
+				if(*win == NULL)
+					*win = g_malloc0(sizeof(janus_seq_window));
 				/* If this is video, check if this is a keyframe: if so, we empty our NACK queue */
 				if(video && stream->video_is_keyframe) {
 					int plen = 0;
 					char *payload = janus_rtp_payload(buf, buflen, &plen);
 					if(stream->video_is_keyframe(payload, plen)) {
 						JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Keyframe received, resetting NACK queue\n", handle->handle_id);
-						if(component->last_seqs_video[vindex])
-							janus_seq_list_free(&component->last_seqs_video[vindex]);
+						janus_seq_window_reset(*win);
 					}
 				}
-				guint16 new_seqn = ntohs(header->seq_number);
-				guint16 cur_seqn;
-				int last_seqs_len = 0;
-				janus_mutex_lock(&component->mutex);
-				janus_seq_info **last_seqs = video ? &component->last_seqs_video[vindex] : &component->last_seqs_audio;
-				janus_seq_info *cur_seq = *last_seqs;
-				if(cur_seq) {
-					cur_seq = cur_seq->prev;
-					cur_seqn = cur_seq->seq;
-				} else {
-					/* First seq, set up to add one seq */
-					cur_seqn = new_seqn - (guint16)1; /* Can wrap */
-				}
-				if(!janus_seq_in_range(new_seqn, cur_seqn, LAST_SEQS_MAX_LEN) &&
-						!janus_seq_in_range(cur_seqn, new_seqn, 1000)) {
+				guint16 last_seqn = (*win)->highest;
+				int update = janus_seq_window_update(*win, new_seqn);
+				if(update < 0) {
 					/* Jump too big, start fresh */
 					JANUS_LOG(LOG_WARN, "[%"SCNu64"] Big sequence number jump %hu -> %hu (%s stream #%d)\n",
-						handle->handle_id, cur_seqn, new_seqn, video ? "video" : "audio", vindex);
-					janus_seq_list_free(last_seqs);
-					cur_seq = NULL;
-					cur_seqn = new_seqn - (guint16)1;
+						handle->handle_id, last_seqn, new_seqn, video ? "video" : "audio", vindex);
+				} else if(update > 0) {
+					JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Received missed sequence number %"SCNu16" (%s stream #%d)\n",
+						handle->handle_id, new_seqn, video ? "video" : "audio", vindex);
 				}
-
-				GSList *nacks = NULL;
+				/* Check if there's anything we should NACK (all at once) */
 				gint64 now = janus_get_monotonic_time();
-
-				if(janus_seq_in_range(new_seqn, cur_seqn, LAST_SEQS_MAX_LEN)) {
-					/* Add new seq objs forward */
-					while(cur_seqn != new_seqn) {
-						cur_seqn += (guint16)1; /* can wrap */
-						janus_seq_info *seq_obj = g_malloc0(sizeof(janus_seq_info));
-						seq_obj->seq = cur_seqn;
-						seq_obj->ts = now;
-						seq_obj->state = (cur_seqn == new_seqn) ? SEQ_RECVED : SEQ_MISSING;
-						janus_seq_append(last_seqs, seq_obj);
-						last_seqs_len++;
-					}
-				}
-				if(cur_seq) {
-					/* Scan old seq objs backwards */
-					while(cur_seq != NULL) {
-						last_seqs_len++;
-						if(cur_seq->seq == new_seqn) {
-							JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Received missed sequence number %"SCNu16" (%s stream #%d)\n",
-								handle->handle_id, cur_seq->seq, video ? "video" : "audio", vindex);
-							cur_seq->state = SEQ_RECVED;
-						} else if(cur_seq->state == SEQ_MISSING && now - cur_seq->ts > SEQ_MISSING_WAIT) {
-							JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Missed sequence number %"SCNu16" (%s stream #%d), sending 1st NACK\n",
-								handle->handle_id, cur_seq->seq, video ? "video" : "audio", vindex);
-							nacks = g_slist_append(nacks, GUINT_TO_POINTER(cur_seq->seq));
-							cur_seq->state = SEQ_NACKED;
-							if(video && janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX)) {
-								/* Keep track of this sequence number, we need to avoid duplicates */
-								JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Tracking NACKed packet %"SCNu16" (SSRC %"SCNu32", vindex %d)...\n",
-									handle->handle_id, cur_seq->seq, packet_ssrc, vindex);
-								if(stream->rtx_nacked[vindex] == NULL)
-									stream->rtx_nacked[vindex] = g_hash_table_new(NULL, NULL);
-								g_hash_table_insert(stream->rtx_nacked[vindex], GUINT_TO_POINTER(cur_seq->seq), GINT_TO_POINTER(1));
-								/* We don't track it forever, though: add a timed source to remove it in a few seconds */
-								janus_ice_nacked_packet *np = g_malloc(sizeof(janus_ice_nacked_packet));
-								np->handle = handle;
-								np->seq_number = new_seqn;
-								np->vindex = vindex;
-								GSource *timeout_source = g_timeout_source_new_seconds(5);
-								g_source_set_callback(timeout_source, janus_ice_nacked_packet_cleanup, np, (GDestroyNotify)g_free);
-								g_source_attach(timeout_source, handle->icectx);
-								g_source_unref(timeout_source);
-							}
-						} else if(cur_seq->state == SEQ_NACKED  && now - cur_seq->ts > SEQ_NACKED_WAIT) {
-							JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Missed sequence number %"SCNu16" (%s stream #%d), sending 2nd NACK\n",
-								handle->handle_id, cur_seq->seq, video ? "video" : "audio", vindex);
-							nacks = g_slist_append(nacks, GUINT_TO_POINTER(cur_seq->seq));
-							cur_seq->state = SEQ_GIVEUP;
-						}
-						if(cur_seq == *last_seqs) {
-							/* Just processed head */
-							break;
-						}
-						cur_seq = cur_seq->prev;
-					}
-				}
-				while(last_seqs_len > LAST_SEQS_MAX_LEN) {
-					janus_seq_info *node = janus_seq_pop_head(last_seqs);
-					g_free(node);
-					last_seqs_len--;
-				}
-
-				guint nacks_count = g_slist_length(nacks);
+				guint16 nacks[JANUS_SEQ_WINDOW_SIZE];
+				guint nacks_count = janus_seq_window_nacks(*win, now, nacks);
 				if(nacks_count) {
 					/* Generate a NACK and send it */
 					JANUS_LOG(LOG_DBG, "[%"SCNu64"] Now sending NACK for %u missed packets (%s stream #%d)\n",
 						handle->handle_id, nacks_count, video ? "video" : "audio", vindex);
 					char nackbuf[120];
-					int res = janus_rtcp_nacks(nackbuf, sizeof(nackbuf), nacks);
+					int res = janus_rtcp_nacks_array(nackbuf, sizeof(nackbuf), nacks, nacks_count);
 					if(res > 0) {
 						/* Set the right local and remote SSRC in the RTCP packet */
 						janus_rtcp_fix_ssrc(NULL, nackbuf, res, 1,
@@ -2459,8 +3160,6 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 					component->nack_sent_log_ts = now;
 				}
 				janus_mutex_unlock(&component->mutex);
-				g_slist_free(nacks);
-				nacks = NULL;
 			}
 		}
 		return;
@@ -2479,8 +3178,11 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 				if(g_atomic_int_get(&handle->dump_packets))
 					janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTCP, TRUE, buf, buflen,
 						"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
+				/* Parse the whole (compound?) packet once: everything below uses the summary */
+				janus_rtcp_summary summary;
+				janus_rtcp_summarize(buf, buflen, &summary);
 				/* Check if there's an RTCP BYE: in case, let's log it */
-				if(janus_rtcp_has_bye(buf, buflen)) {
+				if(summary.has_bye) {
 					/* Note: we used to use this as a trigger to close the PeerConnection, but not anymore
 					 * Discussion here, https://groups.google.com/forum/#!topic/meetecho-janus/4XtfbYB7Jvc */
 					JANUS_LOG(LOG_VERB, "[%"SCNu64"] Got RTCP BYE on stream %"SCNu16" (component %"SCNu16")\n", handle->handle_id, stream->stream_id, component->component_id);
@@ -2501,14 +3203,14 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 						/* We don't know the remote SSRC: this can happen for recvonly clients
 						 * (see https://groups.google.com/forum/#!topic/discuss-webrtc/5yuZjV7lkNc)
 						 * Check the local SSRC, compare it to what we have */
-						guint32 rtcp_ssrc = janus_rtcp_get_receiver_ssrc(buf, len);
+						guint32 rtcp_ssrc = summary.receiver_ssrc;
 						if(rtcp_ssrc == stream->audio_ssrc) {
 							video = 0;
 						} else if(rtcp_ssrc == stream->video_ssrc) {
 							video = 1;
 						} else {
 							/* Mh, no SR or RR? Try checking if there's any FIR, PLI or REMB */
-							if(janus_rtcp_has_fir(buf, len) || janus_rtcp_has_pli(buf, len) || janus_rtcp_get_remb(buf, len)) {
+							if(summary.has_fir || summary.has_pli || summary.remb) {
 								video = 1;
 							}
 						}
@@ -2517,17 +3219,27 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 					} else {
 						/* Check the remote SSRC, compare it to what we have: in case
 						 * we're simulcasting, let's compare to the other SSRCs too */
-						guint32 rtcp_ssrc = janus_rtcp_get_sender_ssrc(buf, len);
-						if(rtcp_ssrc == stream->audio_ssrc_peer) {
+						guint32 rtcp_ssrc = summary.sender_ssrc;
+						int rtx = 0;
+						if(!janus_ssrc_table_lookup(&stream->ssrc_table, rtcp_ssrc, &video, &vindex, &rtx)) {
+							/* Not in the table (yet?), or the table is being updated: check the SSRCs one by one */
 							video = 0;
-						} else if(rtcp_ssrc == stream->video_ssrc_peer[0]) {
-							video = 1;
-						} else if(stream->video_ssrc_peer[1] && rtcp_ssrc == stream->video_ssrc_peer[1]) {
-							video = 1;
-							vindex = 1;
-						} else if(stream->video_ssrc_peer[2] && rtcp_ssrc == stream->video_ssrc_peer[2]) {
-							video = 1;
-							vindex = 2;
+							vindex = 0;
+							if(rtcp_ssrc == stream->audio_ssrc_peer) {
+								video = 0;
+							} else if(rtcp_ssrc == stream->video_ssrc_peer[0]) {
+								video = 1;
+							} else if(stream->video_ssrc_peer[1] && rtcp_ssrc == stream->video_ssrc_peer[1]) {
+								video = 1;
+								vindex = 1;
+							} else if(stream->video_ssrc_peer[2] && rtcp_ssrc == stream->video_ssrc_peer[2]) {
+								video = 1;
+								vindex = 2;
+							}
+						} else if(rtx) {
+							/* Retransmission SSRC, we treat it as audio as before */
+							video = 0;
+							vindex = 0;
 						}
 						JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Incoming RTCP, bundling: this is %s (remote SSRC: video=%"SCNu32" #%d, audio=%"SCNu32", got %"SCNu32")\n",
 							handle->handle_id, video ? "video" : "audio", stream->video_ssrc_peer[vindex], vindex, stream->audio_ssrc_peer, rtcp_ssrc);
@@ -2536,32 +3248,30 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 
 				/* Let's process this RTCP (compound?) packet, and update the RTCP context for this stream in case */
 				rtcp_context *rtcp_ctx = video ? stream->video_rtcp_ctx[vindex] : stream->audio_rtcp_ctx;
-				janus_rtcp_parse(rtcp_ctx, buf, buflen);
+				janus_rtcp_summary_update_context(rtcp_ctx, &summary);
 
 				/* Now let's see if there are any NACKs to handle */
 				gint64 now = janus_get_monotonic_time();
-				GSList *nacks = janus_rtcp_get_nacks(buf, buflen);
-				guint nacks_count = g_slist_length(nacks);
+				guint nacks_count = summary.nacks_count;
 				if(nacks_count && ((!video && component->do_audio_nacks) || (video && component->do_video_nacks))) {
 					/* Handle NACK */
 					JANUS_LOG(LOG_HUGE, "[%"SCNu64"]     Just got some NACKS (%d) we should handle...\n", handle->handle_id, nacks_count);
-					GSList *list = nacks;
+					guint i = 0;
 					int retransmits_cnt = 0;
 					janus_mutex_lock(&component->mutex);
-					while(list) {
-						unsigned int seqnr = GPOINTER_TO_UINT(list->data);
+					for(i=0; i<nacks_count; i++) {
+						unsigned int seqnr = summary.nacks[i];
 						JANUS_LOG(LOG_DBG, "[%"SCNu64"]   >> %u\n", handle->handle_id, seqnr);
 						int in_rb = 0;
 						/* Check if we have the packet */
-						janus_rtp_packet *p = g_hash_table_lookup(video ?
-							component->video_retransmit_seqs : component->audio_retransmit_seqs, GUINT_TO_POINTER(seqnr));
+						janus_ice_retransmit_slot *p = janus_ice_retransmit_buffer_lookup(video ?
+							component->video_retransmit_buffer : component->audio_retransmit_buffer, seqnr);
 						if(p == NULL) {
 							JANUS_LOG(LOG_HUGE, "[%"SCNu64"]   >> >> Can't retransmit packet %u, we don't have it...\n", handle->handle_id, seqnr);
 						} else {
 							/* Should we retransmit this packet? */
 							if((p->last_retransmit > 0) && (now-p->last_retransmit < MAX_NACK_IGNORE)) {
 								JANUS_LOG(LOG_HUGE, "[%"SCNu64"]   >> >> Packet %u was retransmitted just %"SCNi64"ms ago, skipping\n", handle->handle_id, seqnr, now-p->last_retransmit);
-								list = list->next;
 								continue;
 							}
 							in_rb = 1;
@@ -2569,10 +3279,9 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 							p->last_retransmit = now;
 							retransmits_cnt++;
 							/* Enqueue it */
-							janus_ice_queued_packet *pkt = g_malloc(sizeof(janus_ice_queued_packet));
-							pkt->data = g_malloc(p->length);
-							memcpy(pkt->data, p->data, p->length);
-							pkt->length = p->length;
+							janus_ice_queued_packet *pkt = janus_ice_queued_packet_alloc(p->packet->length);
+							memcpy(pkt->data, p->packet->data, p->packet->length);
+							pkt->length = p->packet->length;
 							pkt->type = video ? JANUS_ICE_PACKET_VIDEO : JANUS_ICE_PACKET_AUDIO;
 							pkt->control = FALSE;
 							pkt->retransmission = TRUE;
@@ -2588,21 +3297,16 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 								component->rtx_seq_number++;
 								header->seq_number = htons(component->rtx_seq_number);
 							}
-							if(handle->queued_packets != NULL)
-#if GLIB_CHECK_VERSION(2, 46, 0)
-								g_async_queue_push_front(handle->queued_packets, pkt);
-#else
-								g_async_queue_push(handle->queued_packets, pkt);
-#endif
+							janus_ice_queue_packet(handle, pkt, TRUE);
 						}
 						if (rtcp_ctx != NULL && in_rb) {
 							g_atomic_int_inc(&rtcp_ctx->nack_count);
 						}
-						list = list->next;
 					}
 					component->retransmit_recent_cnt += retransmits_cnt;
 					/* FIXME Remove the NACK compound packet, we've handled it */
 					buflen = janus_rtcp_remove_nacks(buf, buflen);
+					summary.nacks_count = 0;
 					/* Update stats */
 					if(video) {
 						component->in_stats.video[vindex].nacks += nacks_count;
@@ -2612,8 +3316,6 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 					/* Inform the plugin about the slow uplink in case it's needed */
 					janus_slow_link_update(component, handle, retransmits_cnt, video, 1, now);
 					janus_mutex_unlock(&component->mutex);
-					g_slist_free(nacks);
-					nacks = NULL;
 				}
 				if(component->retransmit_recent_cnt &&
 						now - component->retransmit_log_ts > 5*G_USEC_PER_SEC) {
@@ -2623,9 +3325,23 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 					component->retransmit_log_ts = now;
 				}
 
+				/* Keep track of the bitrate the peer says it can receive, the pacer may need it */
+				if(summary.remb > 0)
+					stream->remb_bitrate = summary.remb;
+
+				/* If we're estimating the bandwidth ourselves, this may be feedback for us */
+				if(summary.has_twcc && stream->bwe != NULL) {
+					janus_rtcp_transport_wide_cc_result results[JANUS_ICE_BWE_MAX_FEEDBACK];
+					int count = janus_rtcp_get_transport_wide_cc_feedback(buf, buflen, results, JANUS_ICE_BWE_MAX_FEEDBACK);
+					if(count > 0) {
+						guint32 estimate = janus_bwe_feedback(stream->bwe, results, count, now);
+						janus_ice_bwe_update(handle, stream, estimate, now);
+					}
+				}
+
 				janus_plugin *plugin = (janus_plugin *)handle->app;
 				if(plugin && plugin->incoming_rtcp)
-					plugin->incoming_rtcp(handle->app_handle, video, buf, buflen);
+					plugin->incoming_rtcp(handle->app_handle, video, buf, buflen, &summary);
 			}
 		}
 		return;
@@ -2641,15 +3357,70 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 	}
 }
 
-void janus_ice_incoming_data(janus_ice_handle *handle, char *buffer, int length) {
+void janus_ice_incoming_data(janus_ice_handle *handle, char *buffer, int length, gboolean binary) {
 	if(handle == NULL || buffer == NULL || length <= 0)
 		return;
 	janus_plugin *plugin = (janus_plugin *)handle->app;
-	if(plugin && plugin->incoming_data)
+	if(plugin == NULL)
+		return;
+	/* Plugins that don't know about binary messages get them as they always did */
+	if(binary && plugin->incoming_binary_data)
+		plugin->incoming_binary_data(handle->app_handle, buffer, length);
+	else if(plugin->incoming_data)
 		plugin->incoming_data(handle->app_handle, buffer, length);
 }
 
 
+/* Callback to tear down the WebRTC resources of a handle pinned to a static event loop */
+static gboolean janus_ice_static_loop_cleanup(gpointer user_data) {
+	janus_ice_handle *handle = (janus_ice_handle *)user_data;
+	if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP) &&
+			g_atomic_int_get(&handle->send_thread_created) && (handle->send_thread != NULL || handle->send_worker != NULL)) {
+		/* The send thread is still using the agent, try again later */
+		return G_SOURCE_CONTINUE;
+	}
+	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Cleaning up WebRTC resources on static event loop #%d\n",
+		handle->handle_id, handle->static_event_loop ? handle->static_event_loop->id : -1);
+	if(handle->cdone == 0)
+		handle->cdone = -1;
+	if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP)) {
+		janus_flags_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_CLEANING);
+		janus_flags_clear(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ICE_RESTART);
+	}
+	/* We can't wait for janus_ice_free, here: the agent must go away while we're in the loop */
+	janus_ice_webrtc_free(handle);
+	return G_SOURCE_REMOVE;
+}
+
+/* Called when the cleanup source goes away, whether it ran or not: the handle is not held anymore */
+static void janus_ice_static_loop_cleanup_done(gpointer user_data) {
+	janus_ice_handle *handle = (janus_ice_handle *)user_data;
+	g_atomic_int_set(&handle->static_loop_cleanup, JANUS_ICE_STATIC_LOOP_CLEANUP_DONE);
+}
+
+static void janus_ice_loop_quit(janus_ice_handle *handle) {
+	if(handle == NULL || handle->iceloop == NULL)
+		return;
+	if(handle->static_event_loop == NULL) {
+		/* Dedicated loop: stopping it will make janus_ice_thread clean up */
+		if(g_main_loop_is_running(handle->iceloop)) {
+			g_main_loop_quit(handle->iceloop);
+			if(handle->icectx != NULL)
+				g_main_context_wakeup(handle->icectx);
+		}
+		return;
+	}
+	/* Shared loop: we can't stop it, so schedule the cleanup there instead; the
+	 * source holds the handle, and the watchdog won't free it until it's gone */
+	if(!g_atomic_int_compare_and_exchange(&handle->static_loop_cleanup,
+			JANUS_ICE_STATIC_LOOP_CLEANUP_NONE, JANUS_ICE_STATIC_LOOP_CLEANUP_PENDING))
+		return;
+	GSource *timeout_source = g_timeout_source_new(50);
+	g_source_set_callback(timeout_source, janus_ice_static_loop_cleanup, handle, janus_ice_static_loop_cleanup_done);
+	g_source_attach(timeout_source, handle->icectx);
+	g_source_unref(timeout_source);
+}
+
 /* Thread to create agent */
 void *janus_ice_thread(void *data) {
 	janus_ice_handle *handle = data;
@@ -2981,8 +3752,17 @@ int janus_ice_setup_local(janus_ice_handle *handle, int offer, int audio, int vi
 	janus_flags_clear(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALL_TRICKLES);
 	janus_flags_clear(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_TRICKLE_SYNCED);
 
-	handle->icectx = g_main_context_new();
-	handle->iceloop = g_main_loop_new(handle->icectx, FALSE);
+	if(handle->static_event_loop != NULL) {
+		/* Use the static event loop this handle has been pinned to */
+		handle->icectx = g_main_context_ref(handle->static_event_loop->mainctx);
+		handle->iceloop = g_main_loop_ref(handle->static_event_loop->mainloop);
+		/* A cleanup still pending on the loop holds the handle: only start over once it's done */
+		g_atomic_int_compare_and_exchange(&handle->static_loop_cleanup,
+			JANUS_ICE_STATIC_LOOP_CLEANUP_DONE, JANUS_ICE_STATIC_LOOP_CLEANUP_NONE);
+	} else {
+		handle->icectx = g_main_context_new();
+		handle->iceloop = g_main_loop_new(handle->icectx, FALSE);
+	}
 	/* Note: NICE_COMPATIBILITY_RFC5245 is only available in more recent versions of libnice */
 	handle->controlling = janus_ice_lite_enabled ? FALSE : !offer;
 	JANUS_LOG(LOG_INFO, "[%"SCNu64"] Creating ICE agent (ICE %s mode, %s)\n", handle->handle_id,
@@ -3142,6 +3922,8 @@ int janus_ice_setup_local(janus_ice_handle *handle, int offer, int audio, int vi
 	stream->audio_payload_type = -1;
 	stream->video_payload_type = -1;
 	stream->video_rtx_payload_type = -1;
+	stream->video_red_payload_type = -1;
+	stream->video_ulpfec_payload_type = -1;
 	/* FIXME By default, if we're being called we're DTLS clients, but this may be changed by ICE... */
 	stream->dtls_role = offer ? JANUS_DTLS_ROLE_CLIENT : JANUS_DTLS_ROLE_ACTPASS;
 	if(audio) {
@@ -3199,15 +3981,14 @@ int janus_ice_setup_local(janus_ice_handle *handle, int offer, int audio, int vi
 	/* FIXME: libnice supports this since 0.1.0, but the 0.1.3 on Fedora fails with an undefined reference! */
 	nice_agent_set_port_range(handle->agent, handle->stream_id, 1, rtp_range_min, rtp_range_max);
 #endif
-	nice_agent_gather_candidates(handle->agent, handle->stream_id);
-	nice_agent_attach_recv(handle->agent, handle->stream_id, 1, g_main_loop_get_context(handle->iceloop), janus_ice_cb_nice_recv, component);
 #ifdef HAVE_LIBCURL
 	if(turnrest_credentials != NULL) {
 		janus_turnrest_response_destroy(turnrest_credentials);
 		turnrest_credentials = NULL;
 	}
 #endif
-	/* Create DTLS-SRTP context, at last */
+	/* Create DTLS-SRTP context: we do this before gathering, as with a
+	 * static event loop callbacks may fire as soon as we attach */
 	component->dtls = janus_dtls_srtp_create(component, stream->dtls_role);
 	if(!component->dtls) {
 		/* FIXME We should clear some resources... */
@@ -3215,6 +3996,12 @@ int janus_ice_setup_local(janus_ice_handle *handle, int offer, int audio, int vi
 		janus_flags_clear(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_HAS_AGENT);
 		return -1;
 	}
+	nice_agent_gather_candidates(handle->agent, handle->stream_id);
+	nice_agent_attach_recv(handle->agent, handle->stream_id, 1, g_main_loop_get_context(handle->iceloop), janus_ice_cb_nice_recv, component);
+	if(handle->static_event_loop != NULL) {
+		/* The loop is already running, no need for a thread */
+		return 0;
+	}
 	GError *error = NULL;
 	char tname[16];
 	g_snprintf(tname, sizeof(tname), "iceloop %"SCNu64, handle->handle_id);
@@ -3231,7 +4018,8 @@ int janus_ice_setup_local(janus_ice_handle *handle, int offer, int audio, int vi
 void janus_ice_restart(janus_ice_handle *handle) {
 	if(!handle || !handle->agent || !handle->stream)
 		return;
-	/* Restart ICE */
+	/* Restart ICE: libnice will need to read from all sockets again */
+	janus_ice_ingress_stop(handle, TRUE);
 	if(nice_agent_restart(handle->agent) == FALSE) {
 		JANUS_LOG(LOG_WARN, "[%"SCNu64"] ICE restart failed...\n", handle->handle_id);
 	}
@@ -3273,806 +4061,1469 @@ static gint rtcp_transport_wide_cc_stats_comparator(gconstpointer item1, gconstp
 	return ((rtcp_transport_wide_cc_stats*)item1)->transport_seq_num - ((rtcp_transport_wide_cc_stats*)item2)->transport_seq_num;
 }
 
-void *janus_ice_send_thread(void *data) {
-	janus_ice_handle *handle = (janus_ice_handle *)data;
+/* Periodic tasks on the outgoing media path (stats, no-media events, RTCP SR/RR,
+ * TWCC feedback, NACK buffer cleanup): returns when they should be checked again */
+static gint64 janus_ice_send_periodic(janus_ice_handle *handle, janus_ice_send_context *ctx, gint64 now) {
 	janus_session *session = (janus_session *)handle->session;
-	JANUS_LOG(LOG_VERB, "[%"SCNu64"] ICE send thread started...\n", handle->handle_id);
-	janus_ice_queued_packet *pkt = NULL;
-	gint64 before = janus_get_monotonic_time(),
-		rtcp_last_sr_rr = before, last_event = before,
-		last_srtp_summary = before, last_nack_cleanup = before;
-	gboolean alert_sent = FALSE;
-	while(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP)) {
-		if(handle->queued_packets != NULL) {
-			pkt = g_async_queue_timeout_pop(handle->queued_packets, 500000);
-		} else {
-			g_usleep(100000);
+	/* Reset the last second counters if too much time passed with no data in or out */
+	janus_ice_stream *stream = handle->stream;
+	if(stream && stream->component) {
+		janus_ice_component *component = stream->component;
+		/* Audio */
+		gint64 last = component->in_stats.audio.updated;
+		if(last && now > last && now-last >= 2*G_USEC_PER_SEC && component->in_stats.audio.bytes_lastsec_temp > 0) {
+			component->in_stats.audio.bytes_lastsec = 0;
+			component->in_stats.audio.bytes_lastsec_temp = 0;
 		}
-		if(pkt == &janus_ice_dtls_alert) {
-			/* The session is over, send an alert on all streams and components */
-			if(!alert_sent && handle->stream && handle->stream->component && janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_READY)) {
-				janus_dtls_srtp_send_alert(handle->stream->component->dtls);
-				alert_sent = TRUE;
-			}
-			while(g_async_queue_length(handle->queued_packets) > 0) {
-				pkt = g_async_queue_try_pop(handle->queued_packets);
-				if(pkt != NULL && pkt != &janus_ice_dtls_alert) {
-					g_free(pkt->data);
-					pkt->data = NULL;
-					g_free(pkt);
-					pkt = NULL;
-				}
+		last = component->out_stats.audio.updated;
+		if(last && now > last && now-last >= 2*G_USEC_PER_SEC && component->out_stats.audio.bytes_lastsec_temp > 0) {
+			component->out_stats.audio.bytes_lastsec = 0;
+			component->out_stats.audio.bytes_lastsec_temp = 0;
+		}
+		/* Video */
+		int vindex = 0;
+		for(vindex=0; vindex < 3; vindex++) {
+			gint64 last = component->in_stats.video[vindex].updated;
+			if(last && now > last && now-last >= 2*G_USEC_PER_SEC && component->in_stats.video[vindex].bytes_lastsec_temp > 0) {
+				component->in_stats.video[vindex].bytes_lastsec = 0;
+				component->in_stats.video[vindex].bytes_lastsec_temp = 0;
 			}
-			if(handle->iceloop != NULL && g_main_loop_is_running(handle->iceloop)) {
-				g_main_loop_quit(handle->iceloop);
-				if (handle->icectx != NULL) {
-					g_main_context_wakeup(handle->icectx);
-				}
+			last = component->out_stats.video[vindex].updated;
+			if(last && now > last && now-last >= 2*G_USEC_PER_SEC && component->out_stats.video[vindex].bytes_lastsec_temp > 0) {
+				component->out_stats.video[vindex].bytes_lastsec = 0;
+				component->out_stats.video[vindex].bytes_lastsec_temp = 0;
 			}
-			continue;
 		}
-		if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_READY)) {
-			if(pkt)
-				g_free(pkt->data);
-			g_free(pkt);
-			pkt = NULL;
-			continue;
-		}
-		if(alert_sent)
-			alert_sent = FALSE;
-		/* Reset the last second counters if too much time passed with no data in or out */
-		gint64 now = janus_get_monotonic_time();
-		janus_ice_stream *stream = handle->stream;
+	}
+	/* Let's see if we need to notify the user about no incoming audio or video */
+	if(no_media_timer > 0 && now-ctx->before >= G_USEC_PER_SEC) {
+		stream = handle->stream;
 		if(stream && stream->component) {
 			janus_ice_component *component = stream->component;
 			/* Audio */
 			gint64 last = component->in_stats.audio.updated;
-			if(last && now > last && now-last >= 2*G_USEC_PER_SEC && component->in_stats.audio.bytes_lastsec_temp > 0) {
-				component->in_stats.audio.bytes_lastsec = 0;
-				component->in_stats.audio.bytes_lastsec_temp = 0;
-			}
-			last = component->out_stats.audio.updated;
-			if(last && now > last && now-last >= 2*G_USEC_PER_SEC && component->out_stats.audio.bytes_lastsec_temp > 0) {
-				component->out_stats.audio.bytes_lastsec = 0;
-				component->out_stats.audio.bytes_lastsec_temp = 0;
+			if(!component->in_stats.audio.notified_lastsec && last &&
+					!component->in_stats.audio.bytes_lastsec && !component->in_stats.audio.bytes_lastsec_temp &&
+						now-last >= (gint64)no_media_timer*G_USEC_PER_SEC) {
+				/* We missed more than no_second_timer seconds of audio! */
+				component->in_stats.audio.notified_lastsec = TRUE;
+				JANUS_LOG(LOG_WARN, "[%"SCNu64"] Didn't receive audio for more than %d seconds...\n", handle->handle_id, no_media_timer);
+				janus_ice_notify_media(handle, FALSE, FALSE);
 			}
 			/* Video */
-			int vindex = 0;
-			for(vindex=0; vindex < 3; vindex++) {
-				gint64 last = component->in_stats.video[vindex].updated;
-				if(last && now > last && now-last >= 2*G_USEC_PER_SEC && component->in_stats.video[vindex].bytes_lastsec_temp > 0) {
-					component->in_stats.video[vindex].bytes_lastsec = 0;
-					component->in_stats.video[vindex].bytes_lastsec_temp = 0;
-				}
-				last = component->out_stats.video[vindex].updated;
-				if(last && now > last && now-last >= 2*G_USEC_PER_SEC && component->out_stats.video[vindex].bytes_lastsec_temp > 0) {
-					component->out_stats.video[vindex].bytes_lastsec = 0;
-					component->out_stats.video[vindex].bytes_lastsec_temp = 0;
-				}
+			last = component->in_stats.video[0].updated;
+			if(!component->in_stats.video[0].notified_lastsec && last &&
+					!component->in_stats.video[0].bytes_lastsec && !component->in_stats.video[0].bytes_lastsec_temp &&
+						now-last >= (gint64)no_media_timer*G_USEC_PER_SEC) {
+				/* We missed more than no_second_timer seconds of video! */
+				component->in_stats.video[0].notified_lastsec = TRUE;
+				JANUS_LOG(LOG_WARN, "[%"SCNu64"] Didn't receive video for more than a second...\n", handle->handle_id);
+				janus_ice_notify_media(handle, TRUE, FALSE);
 			}
 		}
-		/* Let's see if we need to notify the user about no incoming audio or video */
-		if(no_media_timer > 0 && now-before >= G_USEC_PER_SEC) {
-			stream = handle->stream;
-			if(stream && stream->component) {
-				janus_ice_component *component = stream->component;
-				/* Audio */
-				gint64 last = component->in_stats.audio.updated;
-				if(!component->in_stats.audio.notified_lastsec && last &&
-						!component->in_stats.audio.bytes_lastsec && !component->in_stats.audio.bytes_lastsec_temp &&
-							now-last >= (gint64)no_media_timer*G_USEC_PER_SEC) {
-					/* We missed more than no_second_timer seconds of audio! */
-					component->in_stats.audio.notified_lastsec = TRUE;
-					JANUS_LOG(LOG_WARN, "[%"SCNu64"] Didn't receive audio for more than %d seconds...\n", handle->handle_id, no_media_timer);
-					janus_ice_notify_media(handle, FALSE, FALSE);
-				}
-				/* Video */
-				last = component->in_stats.video[0].updated;
-				if(!component->in_stats.video[0].notified_lastsec && last &&
-						!component->in_stats.video[0].bytes_lastsec && !component->in_stats.video[0].bytes_lastsec_temp &&
-							now-last >= (gint64)no_media_timer*G_USEC_PER_SEC) {
-					/* We missed more than no_second_timer seconds of video! */
-					component->in_stats.video[0].notified_lastsec = TRUE;
-					JANUS_LOG(LOG_WARN, "[%"SCNu64"] Didn't receive video for more than a second...\n", handle->handle_id);
-					janus_ice_notify_media(handle, TRUE, FALSE);
-				}
+		ctx->before = now;
+	}
+	/* Let's check if it's time to send a RTCP SR/SDES/RR as well */
+	if(now-ctx->rtcp_last_sr_rr >= 1*G_USEC_PER_SEC) {
+		ctx->rtcp_last_sr_rr = now;
+		janus_ice_stream *stream = handle->stream;
+		/* Audio */
+		if(stream && stream->component && stream->component->out_stats.audio.packets > 0) {
+			/* Create a SR/SDES compound */
+			int srlen = 28;
+			int sdeslen = 20;
+			char rtcpbuf[srlen+sdeslen];
+			memset(rtcpbuf, 0, sizeof(rtcpbuf));
+			rtcp_sr *sr = (rtcp_sr *)&rtcpbuf;
+			sr->header.version = 2;
+			sr->header.type = RTCP_SR;
+			sr->header.rc = 0;
+			sr->header.length = htons((srlen/4)-1);
+			sr->ssrc = htonl(stream->audio_ssrc);
+			struct timeval tv;
+			gettimeofday(&tv, NULL);
+			uint32_t s = tv.tv_sec + 2208988800u;
+			uint32_t u = tv.tv_usec;
+			uint32_t f = (u << 12) + (u << 8) - ((u * 3650) >> 6);
+			sr->si.ntp_ts_msw = htonl(s);
+			sr->si.ntp_ts_lsw = htonl(f);
+			/* Compute an RTP timestamp coherent with the NTP one */
+			rtcp_context *rtcp_ctx = stream->audio_rtcp_ctx;
+			if(rtcp_ctx == NULL) {
+				sr->si.rtp_ts = htonl(stream->audio_last_ts);	/* FIXME */
+			} else {
+				int64_t ntp = tv.tv_sec*G_USEC_PER_SEC + tv.tv_usec;
+				uint32_t rtp_ts = ((ntp-stream->audio_first_ntp_ts)*(rtcp_ctx->tb))/1000000 + stream->audio_first_rtp_ts;
+				sr->si.rtp_ts = htonl(rtp_ts);
 			}
-			before = now;
+			sr->si.s_packets = htonl(stream->component->out_stats.audio.packets);
+			sr->si.s_octets = htonl(stream->component->out_stats.audio.bytes);
+			rtcp_sdes *sdes = (rtcp_sdes *)&rtcpbuf[28];
+			janus_rtcp_sdes_cname((char *)sdes, sdeslen, "janusaudio", 10);
+			sdes->chunk.ssrc = htonl(stream->audio_ssrc);
+			/* Enqueue it, we'll send it later */
+			janus_ice_relay_rtcp_internal(handle, 0, rtcpbuf, srlen+sdeslen, FALSE);
 		}
-		/* Let's check if it's time to send a RTCP SR/SDES/RR as well */
-		if(now-rtcp_last_sr_rr >= 1*G_USEC_PER_SEC) {
-			rtcp_last_sr_rr = now;
-			janus_ice_stream *stream = handle->stream;
-			/* Audio */
-			if(stream && stream->component && stream->component->out_stats.audio.packets > 0) {
-				/* Create a SR/SDES compound */
-				int srlen = 28;
-				int sdeslen = 20;
-				char rtcpbuf[srlen+sdeslen];
-				memset(rtcpbuf, 0, sizeof(rtcpbuf));
-				rtcp_sr *sr = (rtcp_sr *)&rtcpbuf;
-				sr->header.version = 2;
-				sr->header.type = RTCP_SR;
-				sr->header.rc = 0;
-				sr->header.length = htons((srlen/4)-1);
-				sr->ssrc = htonl(stream->audio_ssrc);
-				struct timeval tv;
-				gettimeofday(&tv, NULL);
-				uint32_t s = tv.tv_sec + 2208988800u;
-				uint32_t u = tv.tv_usec;
-				uint32_t f = (u << 12) + (u << 8) - ((u * 3650) >> 6);
-				sr->si.ntp_ts_msw = htonl(s);
-				sr->si.ntp_ts_lsw = htonl(f);
-				/* Compute an RTP timestamp coherent with the NTP one */
-				rtcp_context *rtcp_ctx = stream->audio_rtcp_ctx;
-				if(rtcp_ctx == NULL) {
-					sr->si.rtp_ts = htonl(stream->audio_last_ts);	/* FIXME */
-				} else {
-					int64_t ntp = tv.tv_sec*G_USEC_PER_SEC + tv.tv_usec;
-					uint32_t rtp_ts = ((ntp-stream->audio_first_ntp_ts)*(rtcp_ctx->tb))/1000000 + stream->audio_first_rtp_ts;
-					sr->si.rtp_ts = htonl(rtp_ts);
-				}
-				sr->si.s_packets = htonl(stream->component->out_stats.audio.packets);
-				sr->si.s_octets = htonl(stream->component->out_stats.audio.bytes);
-				rtcp_sdes *sdes = (rtcp_sdes *)&rtcpbuf[28];
-				janus_rtcp_sdes_cname((char *)sdes, sdeslen, "janusaudio", 10);
-				sdes->chunk.ssrc = htonl(stream->audio_ssrc);
-				/* Enqueue it, we'll send it later */
-				janus_ice_relay_rtcp_internal(handle, 0, rtcpbuf, srlen+sdeslen, FALSE);
-			}
-			if(stream) {
-				/* Create a RR too */
-				int rrlen = 32;
-				char rtcpbuf[32];
-				memset(rtcpbuf, 0, sizeof(rtcpbuf));
-				rtcp_rr *rr = (rtcp_rr *)&rtcpbuf;
-				rr->header.version = 2;
-				rr->header.type = RTCP_RR;
-				rr->header.rc = 1;
-				rr->header.length = htons((rrlen/4)-1);
-				rr->ssrc = htonl(stream->audio_ssrc);
-				janus_rtcp_report_block(stream->audio_rtcp_ctx, &rr->rb[0]);
-				rr->rb[0].ssrc = htonl(stream->audio_ssrc_peer);
-				/* Enqueue it, we'll send it later */
-				janus_ice_relay_rtcp_internal(handle, 0, rtcpbuf, 32, FALSE);
+		if(stream) {
+			/* Create a RR too */
+			int rrlen = 32;
+			char rtcpbuf[32];
+			memset(rtcpbuf, 0, sizeof(rtcpbuf));
+			rtcp_rr *rr = (rtcp_rr *)&rtcpbuf;
+			rr->header.version = 2;
+			rr->header.type = RTCP_RR;
+			rr->header.rc = 1;
+			rr->header.length = htons((rrlen/4)-1);
+			rr->ssrc = htonl(stream->audio_ssrc);
+			janus_rtcp_report_block(stream->audio_rtcp_ctx, &rr->rb[0]);
+			rr->rb[0].ssrc = htonl(stream->audio_ssrc_peer);
+			/* Enqueue it, we'll send it later */
+			janus_ice_relay_rtcp_internal(handle, 0, rtcpbuf, 32, FALSE);
+		}
+		/* Now do the same for video */
+		if(stream && stream->component && stream->component->out_stats.video[0].packets > 0) {
+			/* Create a SR/SDES compound */
+			int srlen = 28;
+			int sdeslen = 20;
+			char rtcpbuf[srlen+sdeslen];
+			memset(rtcpbuf, 0, sizeof(rtcpbuf));
+			rtcp_sr *sr = (rtcp_sr *)&rtcpbuf;
+			sr->header.version = 2;
+			sr->header.type = RTCP_SR;
+			sr->header.rc = 0;
+			sr->header.length = htons((srlen/4)-1);
+			sr->ssrc = htonl(stream->video_ssrc);
+			struct timeval tv;
+			gettimeofday(&tv, NULL);
+			uint32_t s = tv.tv_sec + 2208988800u;
+			uint32_t u = tv.tv_usec;
+			uint32_t f = (u << 12) + (u << 8) - ((u * 3650) >> 6);
+			sr->si.ntp_ts_msw = htonl(s);
+			sr->si.ntp_ts_lsw = htonl(f);
+			/* Compute an RTP timestamp coherent with the NTP one */
+			rtcp_context *rtcp_ctx = stream->video_rtcp_ctx[0];
+			if(rtcp_ctx == NULL) {
+				sr->si.rtp_ts = htonl(stream->video_last_ts);	/* FIXME */
+			} else {
+				int64_t ntp = tv.tv_sec*G_USEC_PER_SEC + tv.tv_usec;
+				uint32_t rtp_ts = ((ntp-stream->video_first_ntp_ts[0])*(rtcp_ctx->tb))/1000000 + stream->video_first_rtp_ts[0];
+				sr->si.rtp_ts = htonl(rtp_ts);
 			}
-			/* Now do the same for video */
-			if(stream && stream->component && stream->component->out_stats.video[0].packets > 0) {
-				/* Create a SR/SDES compound */
-				int srlen = 28;
-				int sdeslen = 20;
-				char rtcpbuf[srlen+sdeslen];
-				memset(rtcpbuf, 0, sizeof(rtcpbuf));
-				rtcp_sr *sr = (rtcp_sr *)&rtcpbuf;
-				sr->header.version = 2;
-				sr->header.type = RTCP_SR;
-				sr->header.rc = 0;
-				sr->header.length = htons((srlen/4)-1);
-				sr->ssrc = htonl(stream->video_ssrc);
-				struct timeval tv;
-				gettimeofday(&tv, NULL);
-				uint32_t s = tv.tv_sec + 2208988800u;
-				uint32_t u = tv.tv_usec;
-				uint32_t f = (u << 12) + (u << 8) - ((u * 3650) >> 6);
-				sr->si.ntp_ts_msw = htonl(s);
-				sr->si.ntp_ts_lsw = htonl(f);
-				/* Compute an RTP timestamp coherent with the NTP one */
-				rtcp_context *rtcp_ctx = stream->video_rtcp_ctx[0];
-				if(rtcp_ctx == NULL) {
-					sr->si.rtp_ts = htonl(stream->video_last_ts);	/* FIXME */
-				} else {
-					int64_t ntp = tv.tv_sec*G_USEC_PER_SEC + tv.tv_usec;
-					uint32_t rtp_ts = ((ntp-stream->video_first_ntp_ts[0])*(rtcp_ctx->tb))/1000000 + stream->video_first_rtp_ts[0];
-					sr->si.rtp_ts = htonl(rtp_ts);
+			sr->si.s_packets = htonl(stream->component->out_stats.video[0].packets);
+			sr->si.s_octets = htonl(stream->component->out_stats.video[0].bytes);
+			rtcp_sdes *sdes = (rtcp_sdes *)&rtcpbuf[28];
+			janus_rtcp_sdes_cname((char *)sdes, sdeslen, "janusvideo", 10);
+			sdes->chunk.ssrc = htonl(stream->video_ssrc);
+			/* Enqueue it, we'll send it later */
+			janus_ice_relay_rtcp_internal(handle, 1, rtcpbuf, srlen+sdeslen, FALSE);
+		}
+		if(stream) {
+			/* Create a RR too (for each SSRC, if we're simulcasting) */
+			int vindex=0;
+			for(vindex=0; vindex<3; vindex++) {
+				if(stream->video_rtcp_ctx[vindex] && stream->video_rtcp_ctx[vindex]->rtp_recvd) {
+					/* Create a RR */
+					int rrlen = 32;
+					char rtcpbuf[32];
+					memset(rtcpbuf, 0, sizeof(rtcpbuf));
+					rtcp_rr *rr = (rtcp_rr *)&rtcpbuf;
+					rr->header.version = 2;
+					rr->header.type = RTCP_RR;
+					rr->header.rc = 1;
+					rr->header.length = htons((rrlen/4)-1);
+					rr->ssrc = htonl(stream->video_ssrc);
+					janus_rtcp_report_block(stream->video_rtcp_ctx[vindex], &rr->rb[0]);
+					rr->rb[0].ssrc = htonl(stream->video_ssrc_peer[vindex]);
+					/* Enqueue it, we'll send it later */
+					janus_ice_relay_rtcp_internal(handle, 1, rtcpbuf, 32, FALSE);
 				}
-				sr->si.s_packets = htonl(stream->component->out_stats.video[0].packets);
-				sr->si.s_octets = htonl(stream->component->out_stats.video[0].bytes);
-				rtcp_sdes *sdes = (rtcp_sdes *)&rtcpbuf[28];
-				janus_rtcp_sdes_cname((char *)sdes, sdeslen, "janusvideo", 10);
-				sdes->chunk.ssrc = htonl(stream->video_ssrc);
-				/* Enqueue it, we'll send it later */
-				janus_ice_relay_rtcp_internal(handle, 1, rtcpbuf, srlen+sdeslen, FALSE);
 			}
-			if(stream) {
-				/* Create a RR too (for each SSRC, if we're simulcasting) */
-				int vindex=0;
-				for(vindex=0; vindex<3; vindex++) {
-					if(stream->video_rtcp_ctx[vindex] && stream->video_rtcp_ctx[vindex]->rtp_recvd) {
-						/* Create a RR */
-						int rrlen = 32;
-						char rtcpbuf[32];
-						memset(rtcpbuf, 0, sizeof(rtcpbuf));
-						rtcp_rr *rr = (rtcp_rr *)&rtcpbuf;
-						rr->header.version = 2;
-						rr->header.type = RTCP_RR;
-						rr->header.rc = 1;
-						rr->header.length = htons((rrlen/4)-1);
-						rr->ssrc = htonl(stream->video_ssrc);
-						janus_rtcp_report_block(stream->video_rtcp_ctx[vindex], &rr->rb[0]);
-						rr->rb[0].ssrc = htonl(stream->video_ssrc_peer[vindex]);
-						/* Enqueue it, we'll send it later */
-						janus_ice_relay_rtcp_internal(handle, 1, rtcpbuf, 32, FALSE);
+		}
+		if (stream && stream->do_transport_wide_cc) {
+			/* Create a transport wide feedback message */
+			size_t size = 1300;
+			char rtcpbuf[1300];
+			/* Lock session */
+			janus_mutex_lock(&handle->stream->mutex);
+			/* Order packet list */
+			GSList *sorted = g_slist_sort(handle->stream->transport_wide_received_seq_nums, rtcp_transport_wide_cc_stats_comparator);
+			/* Create full stats queue */
+			GQueue *packets = g_queue_new();
+			/* For all packets */
+			GSList *it = NULL;
+			for (it = sorted; it; it = it->next) {
+				/* Get stat */
+				janus_rtcp_transport_wide_cc_stats *stats = (janus_rtcp_transport_wide_cc_stats *)it->data;
+				/* Get transport seq */
+				guint32 transport_seq_num = stats->transport_seq_num;
+				/* Check if it is an out of order  */
+				if (transport_seq_num < handle->stream->transport_wide_cc_last_feedback_seq_num)
+					/* Skip, it was already reported as lost */
+					continue;
+				/* If not first */
+				if (handle->stream->transport_wide_cc_last_feedback_seq_num) {
+					/* For each lost */
+					guint32 i = 0;
+					for (i = handle->stream->transport_wide_cc_last_feedback_seq_num+1; i<transport_seq_num; ++i) {
+						/* Create new stat */
+						janus_rtcp_transport_wide_cc_stats *missing = g_malloc(sizeof(janus_rtcp_transport_wide_cc_stats));
+						/* Add missing packet */
+						missing->transport_seq_num = i;
+						missing->timestamp = 0;
+						/* Add it */
+						g_queue_push_tail(packets, missing);
 					}
 				}
+				/* Store last */
+				handle->stream->transport_wide_cc_last_feedback_seq_num = transport_seq_num;
+				/* Add this one */
+				g_queue_push_tail(packets, stats);
 			}
-			if (stream && stream->do_transport_wide_cc) {
-				/* Create a transport wide feedback message */
-				size_t size = 1300;
-				char rtcpbuf[1300];
-				/* Lock session */
-				janus_mutex_lock(&handle->stream->mutex);
-				/* Order packet list */
-				GSList *sorted = g_slist_sort(handle->stream->transport_wide_received_seq_nums, rtcp_transport_wide_cc_stats_comparator);
-				/* Create full stats queue */
-				GQueue *packets = g_queue_new();
-				/* For all packets */
-				GSList *it = NULL;
-				for (it = sorted; it; it = it->next) {
-					/* Get stat */
-					janus_rtcp_transport_wide_cc_stats *stats = (janus_rtcp_transport_wide_cc_stats *)it->data;
-					/* Get transport seq */
-					guint32 transport_seq_num = stats->transport_seq_num;
-					/* Check if it is an out of order  */
-					if (transport_seq_num < handle->stream->transport_wide_cc_last_feedback_seq_num)
-						/* Skip, it was already reported as lost */
-						continue;
-					/* If not first */
-					if (handle->stream->transport_wide_cc_last_feedback_seq_num) {
-						/* For each lost */
-						guint32 i = 0;
-						for (i = handle->stream->transport_wide_cc_last_feedback_seq_num+1; i<transport_seq_num; ++i) {
-							/* Create new stat */
-							janus_rtcp_transport_wide_cc_stats *missing = g_malloc(sizeof(janus_rtcp_transport_wide_cc_stats));
-							/* Add missing packet */
-							missing->transport_seq_num = i;
-							missing->timestamp = 0;
-							/* Add it */
-							g_queue_push_tail(packets, missing);
-						}
-					}
-					/* Store last */
-					handle->stream->transport_wide_cc_last_feedback_seq_num = transport_seq_num;
-					/* Add this one */
-					g_queue_push_tail(packets, stats);
+			/* Clear stats */
+			g_slist_free(handle->stream->transport_wide_received_seq_nums);
+			/* Reset list */
+			handle->stream->transport_wide_received_seq_nums = NULL;
+			/* Get feedback pacakte count and increase it for next one */
+			guint8 feedback_packet_count = handle->stream->transport_wide_cc_feedback_count++;
+			/* Unlock session */
+			janus_mutex_unlock(&handle->stream->mutex);
+			/* Create rtcp packet */
+			int len = janus_rtcp_transport_wide_cc_feedback(rtcpbuf, size, handle->stream->video_ssrc, stream->video_ssrc_peer[0] , feedback_packet_count, packets);
+			/* Enqueue it, we'll send it later */
+			janus_ice_relay_rtcp_internal(handle, 1, rtcpbuf, len, FALSE);
+			/* Free mem */
+			g_queue_free(packets);
+		}
+	}
+	/* We tell event handlers once per second about RTCP-related stuff
+	 * FIXME Should we really do this here? Would this slow down this thread and add delay? */
+	if(janus_ice_event_stats_period > 0 && now-ctx->last_event >= (gint64)janus_ice_event_stats_period*G_USEC_PER_SEC) {
+		ctx->last_event = now;
+		janus_ice_stream *stream = handle->stream;
+		/* Audio */
+		if(janus_events_is_enabled() && janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_HAS_AUDIO)) {
+			if(stream && stream->audio_rtcp_ctx) {
+				json_t *info = json_object();
+				json_object_set_new(info, "media", json_string("audio"));
+				json_object_set_new(info, "base", json_integer(stream->audio_rtcp_ctx->tb));
+				json_object_set_new(info, "rtt", json_integer(janus_rtcp_context_get_rtt(stream->audio_rtcp_ctx)));
+				json_object_set_new(info, "lost", json_integer(janus_rtcp_context_get_lost_all(stream->audio_rtcp_ctx, FALSE)));
+				json_object_set_new(info, "lost-by-remote", json_integer(janus_rtcp_context_get_lost_all(stream->audio_rtcp_ctx, TRUE)));
+				json_object_set_new(info, "jitter-local", json_integer(janus_rtcp_context_get_jitter(stream->audio_rtcp_ctx, FALSE)));
+				json_object_set_new(info, "jitter-remote", json_integer(janus_rtcp_context_get_jitter(stream->audio_rtcp_ctx, TRUE)));
+				json_object_set_new(info, "in-link-quality", json_integer(janus_rtcp_context_get_in_link_quality(stream->audio_rtcp_ctx)));
+				json_object_set_new(info, "in-media-link-quality", json_integer(janus_rtcp_context_get_in_media_link_quality(stream->audio_rtcp_ctx)));
+				json_object_set_new(info, "out-link-quality", json_integer(janus_rtcp_context_get_out_link_quality(stream->audio_rtcp_ctx)));
+				json_object_set_new(info, "out-media-link-quality", json_integer(janus_rtcp_context_get_out_media_link_quality(stream->audio_rtcp_ctx)));
+				if(stream->component) {
+					json_object_set_new(info, "packets-received", json_integer(stream->component->in_stats.audio.packets));
+					json_object_set_new(info, "packets-sent", json_integer(stream->component->out_stats.audio.packets));
+					json_object_set_new(info, "bytes-received", json_integer(stream->component->in_stats.audio.bytes));
+					json_object_set_new(info, "bytes-sent", json_integer(stream->component->out_stats.audio.bytes));
+					json_object_set_new(info, "bytes-received-lastsec", json_integer(stream->component->in_stats.audio.bytes_lastsec));
+					json_object_set_new(info, "bytes-sent-lastsec", json_integer(stream->component->out_stats.audio.bytes_lastsec));
+					json_object_set_new(info, "nacks-received", json_integer(stream->component->in_stats.audio.nacks));
+					json_object_set_new(info, "nacks-sent", json_integer(stream->component->out_stats.audio.nacks));
 				}
-				/* Clear stats */
-				g_slist_free(handle->stream->transport_wide_received_seq_nums);
-				/* Reset list */
-				handle->stream->transport_wide_received_seq_nums = NULL;
-				/* Get feedback pacakte count and increase it for next one */
-				guint8 feedback_packet_count = handle->stream->transport_wide_cc_feedback_count++;
-				/* Unlock session */
-				janus_mutex_unlock(&handle->stream->mutex);
-				/* Create rtcp packet */
-				int len = janus_rtcp_transport_wide_cc_feedback(rtcpbuf, size, handle->stream->video_ssrc, stream->video_ssrc_peer[0] , feedback_packet_count, packets);
-				/* Enqueue it, we'll send it later */
-				janus_ice_relay_rtcp_internal(handle, 1, rtcpbuf, len, FALSE);
-				/* Free mem */
-				g_queue_free(packets);
+				janus_events_notify_handlers(JANUS_EVENT_TYPE_MEDIA, session->session_id, handle->handle_id, handle->opaque_id, info);
 			}
 		}
-		/* We tell event handlers once per second about RTCP-related stuff
-		 * FIXME Should we really do this here? Would this slow down this thread and add delay? */
-		if(janus_ice_event_stats_period > 0 && now-last_event >= (gint64)janus_ice_event_stats_period*G_USEC_PER_SEC) {
-			last_event = now;
-			janus_ice_stream *stream = handle->stream;
-			/* Audio */
-			if(janus_events_is_enabled() && janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_HAS_AUDIO)) {
-				if(stream && stream->audio_rtcp_ctx) {
+		/* Do the same for video */
+		if(janus_events_is_enabled() && janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_HAS_VIDEO)) {
+			int vindex=0;
+			for(vindex=0; vindex<3; vindex++) {
+				if(stream && stream->video_rtcp_ctx[vindex]) {
 					json_t *info = json_object();
-					json_object_set_new(info, "media", json_string("audio"));
-					json_object_set_new(info, "base", json_integer(stream->audio_rtcp_ctx->tb));
-					json_object_set_new(info, "rtt", json_integer(janus_rtcp_context_get_rtt(stream->audio_rtcp_ctx)));
-					json_object_set_new(info, "lost", json_integer(janus_rtcp_context_get_lost_all(stream->audio_rtcp_ctx, FALSE)));
-					json_object_set_new(info, "lost-by-remote", json_integer(janus_rtcp_context_get_lost_all(stream->audio_rtcp_ctx, TRUE)));
-					json_object_set_new(info, "jitter-local", json_integer(janus_rtcp_context_get_jitter(stream->audio_rtcp_ctx, FALSE)));
-					json_object_set_new(info, "jitter-remote", json_integer(janus_rtcp_context_get_jitter(stream->audio_rtcp_ctx, TRUE)));
-					json_object_set_new(info, "in-link-quality", json_integer(janus_rtcp_context_get_in_link_quality(stream->audio_rtcp_ctx)));
-					json_object_set_new(info, "in-media-link-quality", json_integer(janus_rtcp_context_get_in_media_link_quality(stream->audio_rtcp_ctx)));
-					json_object_set_new(info, "out-link-quality", json_integer(janus_rtcp_context_get_out_link_quality(stream->audio_rtcp_ctx)));
-					json_object_set_new(info, "out-media-link-quality", json_integer(janus_rtcp_context_get_out_media_link_quality(stream->audio_rtcp_ctx)));
+					if(vindex == 0)
+						json_object_set_new(info, "media", json_string("video"));
+					else if(vindex == 1)
+						json_object_set_new(info, "media", json_string("video-sim1"));
+					else
+						json_object_set_new(info, "media", json_string("video-sim2"));
+					json_object_set_new(info, "base", json_integer(stream->video_rtcp_ctx[vindex]->tb));
+					if(vindex == 0)
+						json_object_set_new(info, "rtt", json_integer(janus_rtcp_context_get_rtt(stream->video_rtcp_ctx[vindex])));
+					json_object_set_new(info, "lost", json_integer(janus_rtcp_context_get_lost_all(stream->video_rtcp_ctx[vindex], FALSE)));
+					json_object_set_new(info, "lost-by-remote", json_integer(janus_rtcp_context_get_lost_all(stream->video_rtcp_ctx[vindex], TRUE)));
+					json_object_set_new(info, "jitter-local", json_integer(janus_rtcp_context_get_jitter(stream->video_rtcp_ctx[vindex], FALSE)));
+					json_object_set_new(info, "jitter-remote", json_integer(janus_rtcp_context_get_jitter(stream->video_rtcp_ctx[vindex], TRUE)));
+					json_object_set_new(info, "in-link-quality", json_integer(janus_rtcp_context_get_in_link_quality(stream->video_rtcp_ctx[vindex])));
+					json_object_set_new(info, "in-media-link-quality", json_integer(janus_rtcp_context_get_in_media_link_quality(stream->video_rtcp_ctx[vindex])));
+					json_object_set_new(info, "out-link-quality", json_integer(janus_rtcp_context_get_out_link_quality(stream->video_rtcp_ctx[vindex])));
+					json_object_set_new(info, "out-media-link-quality", json_integer(janus_rtcp_context_get_out_media_link_quality(stream->video_rtcp_ctx[vindex])));
 					if(stream->component) {
-						json_object_set_new(info, "packets-received", json_integer(stream->component->in_stats.audio.packets));
-						json_object_set_new(info, "packets-sent", json_integer(stream->component->out_stats.audio.packets));
-						json_object_set_new(info, "bytes-received", json_integer(stream->component->in_stats.audio.bytes));
-						json_object_set_new(info, "bytes-sent", json_integer(stream->component->out_stats.audio.bytes));
-						json_object_set_new(info, "bytes-received-lastsec", json_integer(stream->component->in_stats.audio.bytes_lastsec));
-						json_object_set_new(info, "bytes-sent-lastsec", json_integer(stream->component->out_stats.audio.bytes_lastsec));
-						json_object_set_new(info, "nacks-received", json_integer(stream->component->in_stats.audio.nacks));
-						json_object_set_new(info, "nacks-sent", json_integer(stream->component->out_stats.audio.nacks));
+						json_object_set_new(info, "packets-received", json_integer(stream->component->in_stats.video[vindex].packets));
+						json_object_set_new(info, "packets-sent", json_integer(stream->component->out_stats.video[vindex].packets));
+						json_object_set_new(info, "bytes-received", json_integer(stream->component->in_stats.video[vindex].bytes));
+						json_object_set_new(info, "bytes-sent", json_integer(stream->component->out_stats.video[vindex].bytes));
+						json_object_set_new(info, "bytes-received-lastsec", json_integer(stream->component->in_stats.video[vindex].bytes_lastsec));
+						json_object_set_new(info, "bytes-sent-lastsec", json_integer(stream->component->out_stats.video[vindex].bytes_lastsec));
+						json_object_set_new(info, "nacks-received", json_integer(stream->component->in_stats.video[vindex].nacks));
+						json_object_set_new(info, "nacks-sent", json_integer(stream->component->out_stats.video[vindex].nacks));
 					}
 					janus_events_notify_handlers(JANUS_EVENT_TYPE_MEDIA, session->session_id, handle->handle_id, handle->opaque_id, info);
 				}
 			}
-			/* Do the same for video */
-			if(janus_events_is_enabled() && janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_HAS_VIDEO)) {
-				int vindex=0;
-				for(vindex=0; vindex<3; vindex++) {
-					if(stream && stream->video_rtcp_ctx[vindex]) {
-						json_t *info = json_object();
-						if(vindex == 0)
-							json_object_set_new(info, "media", json_string("video"));
-						else if(vindex == 1)
-							json_object_set_new(info, "media", json_string("video-sim1"));
-						else
-							json_object_set_new(info, "media", json_string("video-sim2"));
-						json_object_set_new(info, "base", json_integer(stream->video_rtcp_ctx[vindex]->tb));
-						if(vindex == 0)
-							json_object_set_new(info, "rtt", json_integer(janus_rtcp_context_get_rtt(stream->video_rtcp_ctx[vindex])));
-						json_object_set_new(info, "lost", json_integer(janus_rtcp_context_get_lost_all(stream->video_rtcp_ctx[vindex], FALSE)));
-						json_object_set_new(info, "lost-by-remote", json_integer(janus_rtcp_context_get_lost_all(stream->video_rtcp_ctx[vindex], TRUE)));
-						json_object_set_new(info, "jitter-local", json_integer(janus_rtcp_context_get_jitter(stream->video_rtcp_ctx[vindex], FALSE)));
-						json_object_set_new(info, "jitter-remote", json_integer(janus_rtcp_context_get_jitter(stream->video_rtcp_ctx[vindex], TRUE)));
-						json_object_set_new(info, "in-link-quality", json_integer(janus_rtcp_context_get_in_link_quality(stream->video_rtcp_ctx[vindex])));
-						json_object_set_new(info, "in-media-link-quality", json_integer(janus_rtcp_context_get_in_media_link_quality(stream->video_rtcp_ctx[vindex])));
-						json_object_set_new(info, "out-link-quality", json_integer(janus_rtcp_context_get_out_link_quality(stream->video_rtcp_ctx[vindex])));
-						json_object_set_new(info, "out-media-link-quality", json_integer(janus_rtcp_context_get_out_media_link_quality(stream->video_rtcp_ctx[vindex])));
-						if(stream->component) {
-							json_object_set_new(info, "packets-received", json_integer(stream->component->in_stats.video[vindex].packets));
-							json_object_set_new(info, "packets-sent", json_integer(stream->component->out_stats.video[vindex].packets));
-							json_object_set_new(info, "bytes-received", json_integer(stream->component->in_stats.video[vindex].bytes));
-							json_object_set_new(info, "bytes-sent", json_integer(stream->component->out_stats.video[vindex].bytes));
-							json_object_set_new(info, "bytes-received-lastsec", json_integer(stream->component->in_stats.video[vindex].bytes_lastsec));
-							json_object_set_new(info, "bytes-sent-lastsec", json_integer(stream->component->out_stats.video[vindex].bytes_lastsec));
-							json_object_set_new(info, "nacks-received", json_integer(stream->component->in_stats.video[vindex].nacks));
-							json_object_set_new(info, "nacks-sent", json_integer(stream->component->out_stats.video[vindex].nacks));
-						}
-						janus_events_notify_handlers(JANUS_EVENT_TYPE_MEDIA, session->session_id, handle->handle_id, handle->opaque_id, info);
-					}
-				}
+		}
+	}
+	/* Should we clean up old NACK buffers? (we check each 1/4 of the max_nack_queue time) */
+	if(max_nack_queue > 0 && (now-ctx->last_nack_cleanup >= (max_nack_queue*250))) {
+		/* Check if we do for all streams */
+		janus_cleanup_nack_buffer(now, handle->stream, TRUE, TRUE);
+		ctx->last_nack_cleanup = now;
+	}
+	/* Check if we should also print a summary of SRTP-related errors */
+	if(now-ctx->last_srtp_summary >= (2*G_USEC_PER_SEC)) {
+		if(handle->srtp_errors_count > 0) {
+			JANUS_LOG(LOG_ERR, "[%"SCNu64"] Got %d SRTP/SRTCP errors in the last few seconds (last error: %s)\n",
+				handle->handle_id, handle->srtp_errors_count, janus_srtp_error_str(handle->last_srtp_error));
+			handle->srtp_errors_count = 0;
+			handle->last_srtp_error = 0;
+		}
+		ctx->last_srtp_summary = now;
+	}
+	/* Figure out when the next task is due */
+	gint64 next = ctx->rtcp_last_sr_rr + G_USEC_PER_SEC;
+	if(no_media_timer > 0 && ctx->before + G_USEC_PER_SEC < next)
+		next = ctx->before + G_USEC_PER_SEC;
+	if(janus_ice_event_stats_period > 0 && ctx->last_event + (gint64)janus_ice_event_stats_period*G_USEC_PER_SEC < next)
+		next = ctx->last_event + (gint64)janus_ice_event_stats_period*G_USEC_PER_SEC;
+	if(max_nack_queue > 0 && ctx->last_nack_cleanup + (max_nack_queue*250) < next)
+		next = ctx->last_nack_cleanup + (max_nack_queue*250);
+	if(ctx->last_srtp_summary + 2*G_USEC_PER_SEC < next)
+		next = ctx->last_srtp_summary + 2*G_USEC_PER_SEC;
+	return next;
+}
+
+/* Helper to get the next packet to send, flushing the queue first if needed */
+static janus_ice_queued_packet *janus_ice_queue_pop(janus_ice_handle *handle, gint64 timeout) {
+	gint flush = g_atomic_int_get(&handle->queue_flush_pending);
+	if(flush != JANUS_ICE_QUEUE_FLUSH_NONE && g_atomic_int_compare_and_exchange(&handle->queue_flush_pending, flush, JANUS_ICE_QUEUE_FLUSH_NONE)) {
+		guint length = janus_mpsc_queue_length(handle->queued_packets);
+		guint dropped = janus_mpsc_queue_drop(handle->queued_packets,
+			flush == JANUS_ICE_QUEUE_FLUSH_ALL ? length : length/2, (GDestroyNotify)janus_ice_queued_packet_free);
+		if(flush == JANUS_ICE_QUEUE_FLUSH_OLDEST) {
+			JANUS_LOG(LOG_WARN, "[%"SCNu64"] Send queue full, flushed the %u oldest packets\n", handle->handle_id, dropped);
+			g_atomic_int_add(&handle->queue_flushed, dropped);
+		}
+	}
+	return timeout > 0 ? janus_mpsc_queue_timeout_pop(handle->queued_packets, timeout) :
+		janus_mpsc_queue_try_pop(handle->queued_packets);
+}
+
+#ifdef HAVE_LIBNICE_SELECTED_SOCKET
+/* Check whether the selected pair of a component is a UDP pair that doesn't
+ * involve a TURN server, that is, one whose socket we can use directly */
+static gboolean janus_ice_selected_pair_is_direct(janus_ice_handle *handle, janus_ice_stream *stream,
+		janus_ice_component *component, NiceCandidate **remote_candidate) {
+	NiceCandidate *local = NULL, *remote = NULL;
+	if(!nice_agent_get_selected_pair(handle->agent, stream->stream_id, component->component_id, &local, &remote) ||
+			local == NULL || remote == NULL)
+		return FALSE;
+	if(local->type == NICE_CANDIDATE_TYPE_RELAYED || remote->type == NICE_CANDIDATE_TYPE_RELAYED)
+		return FALSE;
+#ifdef HAVE_LIBNICE_TCP
+	if(local->transport != NICE_CANDIDATE_TRANSPORT_UDP || remote->transport != NICE_CANDIDATE_TRANSPORT_UDP)
+		return FALSE;
+#endif
+	if(remote_candidate)
+		*remote_candidate = remote;
+	return TRUE;
+}
+#endif
+
+/* Batched egress */
+#ifdef JANUS_ICE_EGRESS_SUPPORTED
+#define JANUS_ICE_EGRESS_BATCH		32
+/* The kernel won't split more than 64 segments per GSO send */
+#define JANUS_ICE_EGRESS_MAX_SEGMENTS	64
+struct janus_ice_egress {
+	/* Socket of the selected pair, if we can send on it directly */
+	GSocket *socket;
+	int fd;
+	/* Address of the remote candidate of the selected pair */
+	struct sockaddr_storage remote;
+	socklen_t remote_len;
+	/* Packets waiting to be sent: the iovecs point to their buffers, and we hold a reference to each */
+	int count;
+	janus_ice_queued_packet *packets[JANUS_ICE_EGRESS_BATCH];
+	struct iovec iov[JANUS_ICE_EGRESS_BATCH];
+	struct mmsghdr msgs[JANUS_ICE_EGRESS_BATCH];
+#ifdef UDP_SEGMENT
+	char control[JANUS_ICE_EGRESS_BATCH][CMSG_SPACE(sizeof(uint16_t))];
+#endif
+};
+/* Give back the packets of the current batch, whether they were sent or not */
+static void janus_ice_egress_release(janus_ice_egress *egress) {
+	int i = 0;
+	for(i=0; i<egress->count; i++) {
+		janus_ice_queued_packet_free(egress->packets[i]);
+		egress->packets[i] = NULL;
+	}
+	egress->count = 0;
+}
+static void janus_ice_egress_destroy(janus_ice_egress *egress) {
+	if(egress == NULL)
+		return;
+	janus_ice_egress_release(egress);
+	if(egress->socket != NULL)
+		g_object_unref(egress->socket);
+	g_free(egress);
+}
+/* Figure out if we can send on the socket of the selected pair directly:
+ * this is only the case for UDP pairs that don't involve a TURN server */
+static void janus_ice_egress_setup(janus_ice_handle *handle, janus_ice_send_context *ctx, janus_ice_stream *stream, janus_ice_component *component) {
+	if(ctx->egress == NULL)
+		ctx->egress = g_malloc0(sizeof(janus_ice_egress));
+	janus_ice_egress *egress = ctx->egress;
+	if(egress->socket != NULL)
+		g_object_unref(egress->socket);
+	egress->socket = NULL;
+	egress->fd = -1;
+	janus_ice_egress_release(egress);
+	g_atomic_int_set(&handle->egress_fast_path, 0);
+	NiceCandidate *remote = NULL;
+	if(!janus_ice_selected_pair_is_direct(handle, stream, component, &remote)) {
+		JANUS_LOG(LOG_VERB, "[%"SCNu64"] Selected pair is not a direct UDP pair, not batching outgoing media\n", handle->handle_id);
+		return;
+	}
+	GSocket *socket = nice_agent_get_selected_socket(handle->agent, stream->stream_id, component->component_id);
+	if(socket == NULL)
+		return;
+	memset(&egress->remote, 0, sizeof(egress->remote));
+	nice_address_copy_to_sockaddr(&remote->addr, (struct sockaddr *)&egress->remote);
+	egress->remote_len = (egress->remote.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+	egress->socket = socket;
+	egress->fd = g_socket_get_fd(socket);
+	g_atomic_int_set(&handle->egress_fast_path, 1);
+	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Sending outgoing media in batches on the selected pair\n", handle->handle_id);
+}
+static void janus_ice_egress_flush(janus_ice_handle *handle, janus_ice_send_context *ctx) {
+	janus_ice_egress *egress = ctx->egress;
+	if(egress == NULL || egress->count == 0)
+		return;
+	/* Prepare the messages: consecutive packets of the same size (except the
+	 * last one, which can be smaller) are merged in a single GSO message */
+	int i = 0, msgs = 0;
+	while(i < egress->count) {
+		struct mmsghdr *m = &egress->msgs[msgs];
+		memset(m, 0, sizeof(*m));
+		m->msg_hdr.msg_name = &egress->remote;
+		m->msg_hdr.msg_namelen = egress->remote_len;
+		m->msg_hdr.msg_iov = &egress->iov[i];
+		int segments = 1;
+#ifdef UDP_SEGMENT
+		if(g_atomic_int_get(&egress_gso)) {
+			size_t size = egress->iov[i].iov_len;
+			while(i+segments < egress->count && segments < JANUS_ICE_EGRESS_MAX_SEGMENTS &&
+					egress->iov[i+segments-1].iov_len == size && egress->iov[i+segments].iov_len <= size)
+				segments++;
+			if(segments > 1) {
+				m->msg_hdr.msg_control = egress->control[msgs];
+				m->msg_hdr.msg_controllen = sizeof(egress->control[msgs]);
+				struct cmsghdr *cm = CMSG_FIRSTHDR(&m->msg_hdr);
+				cm->cmsg_level = SOL_UDP;
+				cm->cmsg_type = UDP_SEGMENT;
+				cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+				uint16_t gso_size = size;
+				memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
 			}
 		}
-		/* Should we clean up old NACK buffers? (we check each 1/4 of the max_nack_queue time) */
-		if(max_nack_queue > 0 && (now-last_nack_cleanup >= (max_nack_queue*250))) {
-			/* Check if we do for all streams */
-			janus_cleanup_nack_buffer(now, handle->stream, TRUE, TRUE);
-			last_nack_cleanup = now;
+#endif
+		m->msg_hdr.msg_iovlen = segments;
+		i += segments;
+		msgs++;
+	}
+	/* Shoot! */
+	int sent = 0;
+	while(sent < msgs) {
+		int res = sendmmsg(egress->fd, &egress->msgs[sent], msgs - sent, 0);
+		handle->egress_syscalls++;
+		if(res < 0) {
+			if(errno == EINTR)
+				continue;
+#ifdef UDP_SEGMENT
+			if(sent == 0 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT) &&
+					g_atomic_int_compare_and_exchange(&egress_gso, 1, 0)) {
+				/* The kernel or the NIC doesn't like GSO: stop using it, and try again */
+				JANUS_LOG(LOG_WARN, "[%"SCNu64"] UDP GSO not supported (%s), disabling it\n", handle->handle_id, g_strerror(errno));
+				janus_ice_egress_flush(handle, ctx);
+				return;
+			}
+#endif
+			/* Don't flood the logs if the socket buffer is just full: media can't
+			 * wait for it to drain, so we drop what's left, and take note of it */
+			int dropped = 0, m = 0;
+			for(m=sent; m<msgs; m++)
+				dropped += egress->msgs[m].msg_hdr.msg_iovlen;
+			handle->egress_dropped += dropped;
+			JANUS_LOG((errno == EAGAIN || errno == EWOULDBLOCK) ? LOG_HUGE : LOG_ERR,
+				"[%"SCNu64"] ... couldn't send %d batched packets (%s)\n", handle->handle_id, dropped, g_strerror(errno));
+			break;
+		}
+		sent += res;
+	}
+	janus_ice_egress_release(egress);
+}
+/* Send an outgoing packet on the wire, or add it to the current batch: owner is
+ * the packet buf belongs to, if any, which the batch holds rather than copying
+ * the data (we only copy temporary buffers, i.e., when owner is NULL) */
+static int janus_ice_egress_send(janus_ice_handle *handle, janus_ice_send_context *ctx,
+		janus_ice_stream *stream, janus_ice_component *component, int len, char *buf, janus_ice_queued_packet *owner) {
+	if(egress_batching) {
+		if(g_atomic_int_compare_and_exchange(&handle->egress_refresh, 1, 0)) {
+			/* A new pair was selected, check if we can send on it directly */
+			janus_ice_egress_flush(handle, ctx);
+			janus_ice_egress_setup(handle, ctx, stream, component);
 		}
-		/* Check if we should also print a summary of SRTP-related errors */
-		if(now-last_srtp_summary >= (2*G_USEC_PER_SEC)) {
-			if(handle->srtp_errors_count > 0) {
-				JANUS_LOG(LOG_ERR, "[%"SCNu64"] Got %d SRTP/SRTCP errors in the last few seconds (last error: %s)\n",
-					handle->handle_id, handle->srtp_errors_count, janus_srtp_error_str(handle->last_srtp_error));
-				handle->srtp_errors_count = 0;
-				handle->last_srtp_error = 0;
+		janus_ice_egress *egress = ctx->egress;
+		if(egress != NULL && egress->fd > -1) {
+			if(owner != NULL) {
+				g_atomic_int_inc(&owner->refs);
+			} else {
+				owner = janus_ice_queued_packet_alloc(len);
+				memcpy(owner->data, buf, len);
+				owner->length = len;
+				janus_ice_packet_cache_get()->copied += len;
+				buf = owner->data;
 			}
-			last_srtp_summary = now;
+			egress->packets[egress->count] = owner;
+			egress->iov[egress->count].iov_base = buf;
+			egress->iov[egress->count].iov_len = len;
+			egress->count++;
+			handle->egress_packets++;
+			if(egress->count == JANUS_ICE_EGRESS_BATCH)
+				janus_ice_egress_flush(handle, ctx);
+			return len;
 		}
+	}
+	handle->egress_packets++;
+	handle->egress_syscalls++;
+	return nice_agent_send(handle->agent, stream->stream_id, component->component_id, len, buf);
+}
+#else
+struct janus_ice_egress {
+	int count;
+};
+static void janus_ice_egress_destroy(janus_ice_egress *egress) {
+	g_free(egress);
+}
+static void janus_ice_egress_flush(janus_ice_handle *handle, janus_ice_send_context *ctx) {
+}
+static int janus_ice_egress_send(janus_ice_handle *handle, janus_ice_send_context *ctx,
+		janus_ice_stream *stream, janus_ice_component *component, int len, char *buf, janus_ice_queued_packet *owner) {
+	handle->egress_packets++;
+	handle->egress_syscalls++;
+	return nice_agent_send(handle->agent, stream->stream_id, component->component_id, len, buf);
+}
+#endif
 
-		/* Now let's get on with the packets */
-		if(pkt == NULL) {
-			continue;
+/* Batched ingress: once ICE is done, rather than having libnice invoke our
+ * callback for each datagram, we wait for the socket of the selected pair
+ * to be readable, and get as many datagrams as available (up to a limit)
+ * from libnice in one go, which still takes care of STUN on its own: the
+ * whole batch then goes through our incoming pipeline back-to-back */
+#ifdef HAVE_LIBNICE_SELECTED_SOCKET
+#define JANUS_ICE_INGRESS_BATCH		16
+#define JANUS_ICE_INGRESS_BUFSIZE	JANUS_ICE_PACKET_POOL_BUFSIZE
+typedef struct janus_ice_ingress {
+	janus_ice_component *component;
+	NiceInputMessage messages[JANUS_ICE_INGRESS_BATCH];
+	NiceInputVector vectors[JANUS_ICE_INGRESS_BATCH];
+	char buffers[JANUS_ICE_INGRESS_BATCH][JANUS_ICE_INGRESS_BUFSIZE];
+} janus_ice_ingress;
+static gboolean janus_ice_ingress_readable(GSocket *socket, GIOCondition condition, gpointer user_data) {
+	janus_ice_ingress *ingress = (janus_ice_ingress *)user_data;
+	janus_ice_component *component = ingress->component;
+	janus_ice_stream *stream = component->stream;
+	janus_ice_handle *handle = stream ? stream->handle : NULL;
+	if(handle == NULL || handle->agent == NULL)
+		return G_SOURCE_REMOVE;
+	int i = 0;
+	for(i=0; i<JANUS_ICE_INGRESS_BATCH; i++) {
+		ingress->vectors[i].buffer = ingress->buffers[i];
+		ingress->vectors[i].size = JANUS_ICE_INGRESS_BUFSIZE;
+		ingress->messages[i].buffers = &ingress->vectors[i];
+		ingress->messages[i].n_buffers = 1;
+		ingress->messages[i].from = NULL;
+		ingress->messages[i].length = 0;
+	}
+	GError *error = NULL;
+	gint received = nice_agent_recv_messages_nonblocking(handle->agent, stream->stream_id, component->component_id,
+		ingress->messages, JANUS_ICE_INGRESS_BATCH, NULL, &error);
+	component->ingress_wakeups++;
+	if(received < 0) {
+		if(!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+			JANUS_LOG(LOG_WARN, "[%"SCNu64"] Error receiving a batch of packets: %s\n", handle->handle_id, error ? error->message : "??");
+		g_clear_error(&error);
+		return G_SOURCE_CONTINUE;
+	}
+	component->ingress_packets += received;
+	for(i=0; i<received; i++) {
+		if(ingress->messages[i].length > 0)
+			janus_ice_cb_nice_recv(handle->agent, stream->stream_id, component->component_id,
+				ingress->messages[i].length, ingress->buffers[i], component);
+	}
+	return G_SOURCE_CONTINUE;
+}
+#endif
+static void janus_ice_ingress_start(janus_ice_handle *handle, janus_ice_stream *stream, janus_ice_component *component) {
+#ifdef HAVE_LIBNICE_SELECTED_SOCKET
+	if(!ingress_batching || g_atomic_pointer_get(&component->ingress_source) != NULL || handle->iceloop == NULL)
+		return;
+	if(!janus_ice_selected_pair_is_direct(handle, stream, component, NULL)) {
+		JANUS_LOG(LOG_VERB, "[%"SCNu64"] Selected pair is not a direct UDP pair, not batching incoming media\n", handle->handle_id);
+		return;
+	}
+	GSocket *socket = nice_agent_get_selected_socket(handle->agent, stream->stream_id, component->component_id);
+	if(socket == NULL)
+		return;
+	janus_ice_ingress *ingress = g_malloc(sizeof(janus_ice_ingress));
+	ingress->component = component;
+	GSource *source = g_socket_create_source(socket, G_IO_IN, NULL);
+	g_object_unref(socket);
+	g_source_set_callback(source, (GSourceFunc)janus_ice_ingress_readable, ingress, g_free);
+	/* From now on, we're the ones reading from libnice */
+	GMainContext *context = g_main_loop_get_context(handle->iceloop);
+	nice_agent_attach_recv(handle->agent, stream->stream_id, component->component_id, context, NULL, NULL);
+	g_source_attach(source, context);
+	g_atomic_pointer_set(&component->ingress_source, source);
+	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Receiving incoming media in batches on the selected pair\n", handle->handle_id);
+#endif
+}
+static void janus_ice_ingress_stop(janus_ice_handle *handle, gboolean reattach) {
+	janus_ice_component *component = handle->stream ? handle->stream->component : NULL;
+	if(component == NULL)
+		return;
+	GSource *source = g_atomic_pointer_get(&component->ingress_source);
+	if(source == NULL || !g_atomic_pointer_compare_and_exchange(&component->ingress_source, source, NULL))
+		return;
+	g_source_destroy(source);
+	g_source_unref(source);
+	if(reattach && handle->iceloop != NULL && handle->agent != NULL) {
+		/* Have libnice invoke our callback for each packet again */
+		nice_agent_attach_recv(handle->agent, handle->stream_id, component->component_id,
+			g_main_loop_get_context(handle->iceloop), janus_ice_cb_nice_recv, component);
+	}
+}
+
+/* Helper to send a DTLS alert when the session is over, and get rid of pending packets */
+static void janus_ice_send_alert(janus_ice_handle *handle, janus_ice_send_context *ctx) {
+	/* Send what we may still have pending first */
+	janus_ice_egress_flush(handle, ctx);
+	/* The session is over, send an alert on all streams and components */
+	if(!ctx->alert_sent && handle->stream && handle->stream->component && janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_READY)) {
+		janus_dtls_srtp_send_alert(handle->stream->component->dtls);
+		ctx->alert_sent = TRUE;
+	}
+	janus_ice_queued_packet *pkt = NULL;
+	while((pkt = janus_mpsc_queue_try_pop(handle->queued_packets)) != NULL)
+		janus_ice_queued_packet_free(pkt);
+	janus_ice_loop_quit(handle);
+}
+
+/* Helper to send the FEC packet protecting the latest group of outgoing video packets, if it's due */
+static void janus_ice_send_fec(janus_ice_handle *handle, janus_ice_send_context *ctx, janus_ice_stream *stream, janus_ice_component *component) {
+	char fbuf[JANUS_BUFSIZE];
+	int flen = janus_fec_generate(stream->fec, fbuf, sizeof(fbuf)-SRTP_MAX_TRAILER_LEN);
+	if(flen <= 0)
+		return;
+	int protected = flen;
+	int res = srtp_protect(component->dtls->srtp_out, fbuf, &protected);
+	if(res != srtp_err_status_ok) {
+		handle->srtp_errors_count++;
+		handle->last_srtp_error = res;
+		JANUS_LOG(LOG_DBG, "[%"SCNu64"] ... SRTP protect error (FEC)... %s (len=%d-->%d)...\n", handle->handle_id, janus_srtp_error_str(res), flen, protected);
+		return;
+	}
+	int sent = janus_ice_egress_send(handle, ctx, stream, component, protected, fbuf, NULL);
+	if(sent < protected) {
+		JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, protected);
+	}
+}
+
+/* Helper to protect and send a single outgoing packet (RTP, RTCP or data) */
+static void janus_ice_send_packet(janus_ice_handle *handle, janus_ice_send_context *ctx, janus_ice_queued_packet *pkt) {
+	janus_session *session = (janus_session *)handle->session;
+	if(pkt == NULL)
+		return;
+	if(pkt->data == NULL) {
+		janus_ice_queued_packet_free(pkt);
+		pkt = NULL;
+		return;
+	}
+	if(pkt->control) {
+		/* RTCP */
+		int video = (pkt->type == JANUS_ICE_PACKET_VIDEO);
+		janus_ice_stream *stream = handle->stream;
+		if(!stream) {
+			janus_ice_queued_packet_free(pkt);
+			pkt = NULL;
+			return;
 		}
-		if(pkt->data == NULL) {
-			g_free(pkt);
+		janus_ice_component *component = stream->component;
+		if(!component) {
+			janus_ice_queued_packet_free(pkt);
 			pkt = NULL;
-			continue;
+			return;
+		}
+		if(!stream->cdone) {
+			if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT) && !stream->noerrorlog) {
+				JANUS_LOG(LOG_ERR, "[%"SCNu64"]     %s candidates not gathered yet for stream??\n", handle->handle_id, video ? "video" : "audio");
+				stream->noerrorlog = TRUE;	/* Don't flood with the same error all over again */
+			}
+			janus_ice_queued_packet_free(pkt);
+			pkt = NULL;
+			return;
+		}
+		stream->noerrorlog = FALSE;
+		if(!component->dtls || !component->dtls->srtp_valid || !component->dtls->srtp_out) {
+			if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT) && !component->noerrorlog) {
+				JANUS_LOG(LOG_WARN, "[%"SCNu64"]     %s stream (#%u) component has no valid SRTP session (yet?)\n", handle->handle_id, video ? "video" : "audio", stream->stream_id);
+				component->noerrorlog = TRUE;	/* Don't flood with the same error all over again */
+			}
+			janus_ice_queued_packet_free(pkt);
+			pkt = NULL;
+			return;
+		}
+		component->noerrorlog = FALSE;
+		if(pkt->encrypted) {
+			/* Already SRTCP */
+			int sent = janus_ice_egress_send(handle, ctx, stream, component, pkt->length, pkt->data, pkt);
+			if(sent < pkt->length) {
+				JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, pkt->length);
+			}
+		} else {
+			/* Check if there's anything we need to do before sending */
+			uint32_t bitrate = janus_rtcp_get_remb(pkt->data, pkt->length);
+			if(bitrate > 0) {
+				/* There's a REMB, prepend a RR as it won't work otherwise */
+				int rrlen = 32;
+				char *rtcpbuf = NULL;
+				if(pkt->data == pkt->buffer && rrlen+pkt->length+SRTP_MAX_TRAILER_LEN <= pkt->capacity) {
+					/* There's enough room in the buffer, make room for the RR in place */
+					memmove(pkt->data+rrlen, pkt->data, pkt->length);
+					rtcpbuf = pkt->data;
+					memset(rtcpbuf, 0, rrlen);
+				} else {
+					rtcpbuf = g_malloc0(rrlen+pkt->length);
+					memcpy(rtcpbuf+rrlen, pkt->data, pkt->length);
+				}
+				rtcp_rr *rr = (rtcp_rr *)rtcpbuf;
+				rr->header.version = 2;
+				rr->header.type = RTCP_RR;
+				rr->header.rc = 0;
+				rr->header.length = htons((rrlen/4)-1);
+				janus_ice_stream *stream = handle->stream;
+				if(stream && stream->video_rtcp_ctx[0] && stream->video_rtcp_ctx[0]->rtp_recvd) {
+					rr->header.rc = 1;
+					janus_rtcp_report_block(stream->video_rtcp_ctx[0], &rr->rb[0]);
+				}
+				/* If we're simulcasting, set the extra SSRCs (the first one will be set by janus_rtcp_fix_ssrc) */
+				if(stream->video_ssrc_peer[1] && pkt->length >= 28) {
+					rtcp_fb *rtcpfb = (rtcp_fb *)(rtcpbuf+rrlen);
+					rtcp_remb *remb = (rtcp_remb *)rtcpfb->fci;
+					remb->ssrc[1] = htonl(stream->video_ssrc_peer[1]);
+					if(stream->video_ssrc_peer[2] && pkt->length >= 32) {
+						remb->ssrc[2] = htonl(stream->video_ssrc_peer[2]);
+					}
+				}
+				/* Free old packet and update */
+				if(rtcpbuf != pkt->data) {
+					if(pkt->data != pkt->buffer)
+						g_free(pkt->data);
+					pkt->data = rtcpbuf;
+					pkt->capacity = rrlen+pkt->length;
+				}
+				pkt->length = rrlen+pkt->length;
+			}
+			/* Protect in place, unless there's no room for the SRTCP trailer */
+			char tbuf[JANUS_BUFSIZE];
+			char *sbuf = pkt->data;
+			if(pkt->length+SRTP_MAX_TRAILER_LEN > pkt->capacity) {
+				memcpy(tbuf, pkt->data, pkt->length);
+				sbuf = tbuf;
+			}
+			/* Do we need to dump this packet for debugging? */
+			if(g_atomic_int_get(&handle->dump_packets))
+				janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTCP, FALSE, sbuf, pkt->length,
+					"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
+			/* Encrypt SRTCP */
+			int protected = pkt->length;
+			int res = srtp_protect_rtcp(component->dtls->srtp_out, sbuf, &protected);
+			if(res != srtp_err_status_ok) {
+				/* We don't spam the logs for every SRTP error: just take note of this, and print a summary later */
+				handle->srtp_errors_count++;
+				handle->last_srtp_error = res;
+				/* If we're debugging, though, print every occurrence */
+				JANUS_LOG(LOG_DBG, "[%"SCNu64"] ... SRTCP protect error... %s (len=%d-->%d)...\n", handle->handle_id, janus_srtp_error_str(res), pkt->length, protected);
+			} else {
+				/* Shoot! */
+				int sent = janus_ice_egress_send(handle, ctx, stream, component, protected, sbuf, sbuf == pkt->data ? pkt : NULL);
+				if(sent < protected) {
+					JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, protected);
+				}
+			}
 		}
-		if(pkt->control) {
-			/* RTCP */
+		janus_ice_queued_packet_free(pkt);
+		return;
+	} else {
+		/* RTP or data */
+		if(pkt->type == JANUS_ICE_PACKET_AUDIO || pkt->type == JANUS_ICE_PACKET_VIDEO) {
+			/* RTP */
 			int video = (pkt->type == JANUS_ICE_PACKET_VIDEO);
 			janus_ice_stream *stream = handle->stream;
 			if(!stream) {
-				g_free(pkt->data);
-				pkt->data = NULL;
-				g_free(pkt);
+				janus_ice_queued_packet_free(pkt);
 				pkt = NULL;
-				continue;
+				return;
+			}
+			if((!video && !stream->audio_send) || (video && !stream->video_send)) {
+				janus_ice_queued_packet_free(pkt);
+				pkt = NULL;
+				return;
 			}
 			janus_ice_component *component = stream->component;
 			if(!component) {
-				g_free(pkt->data);
-				pkt->data = NULL;
-				g_free(pkt);
+				janus_ice_queued_packet_free(pkt);
 				pkt = NULL;
-				continue;
+				return;
 			}
 			if(!stream->cdone) {
 				if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT) && !stream->noerrorlog) {
 					JANUS_LOG(LOG_ERR, "[%"SCNu64"]     %s candidates not gathered yet for stream??\n", handle->handle_id, video ? "video" : "audio");
 					stream->noerrorlog = TRUE;	/* Don't flood with the same error all over again */
 				}
-				g_free(pkt->data);
-				pkt->data = NULL;
-				g_free(pkt);
+				janus_ice_queued_packet_free(pkt);
 				pkt = NULL;
-				continue;
+				return;
 			}
 			stream->noerrorlog = FALSE;
 			if(!component->dtls || !component->dtls->srtp_valid || !component->dtls->srtp_out) {
 				if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT) && !component->noerrorlog) {
-					JANUS_LOG(LOG_WARN, "[%"SCNu64"]     %s stream (#%u) component has no valid SRTP session (yet?)\n", handle->handle_id, video ? "video" : "audio", stream->stream_id);
+					JANUS_LOG(LOG_WARN, "[%"SCNu64"]     %s stream component has no valid SRTP session (yet?)\n", handle->handle_id, video ? "video" : "audio");
 					component->noerrorlog = TRUE;	/* Don't flood with the same error all over again */
 				}
-				g_free(pkt->data);
-				pkt->data = NULL;
-				g_free(pkt);
+				janus_ice_queued_packet_free(pkt);
 				pkt = NULL;
-				continue;
+				return;
 			}
 			component->noerrorlog = FALSE;
 			if(pkt->encrypted) {
-				/* Already SRTCP */
-				int sent = nice_agent_send(handle->agent, stream->stream_id, component->component_id, pkt->length, (const gchar *)pkt->data);
+				/* Already RTP (probably a retransmission?) */
+				janus_rtp_header *header = (janus_rtp_header *)pkt->data;
+				JANUS_LOG(LOG_HUGE, "[%"SCNu64"] ... Retransmitting seq.nr %"SCNu16"\n\n", handle->handle_id, ntohs(header->seq_number));
+				int sent = janus_ice_egress_send(handle, ctx, stream, component, pkt->length, pkt->data, pkt);
 				if(sent < pkt->length) {
 					JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, pkt->length);
 				}
 			} else {
-				/* Check if there's anything we need to do before sending */
-				uint32_t bitrate = janus_rtcp_get_remb(pkt->data, pkt->length);
-				if(bitrate > 0) {
-					/* There's a REMB, prepend a RR as it won't work otherwise */
-					int rrlen = 32;
-					char *rtcpbuf = g_malloc0(rrlen+pkt->length);
-					rtcp_rr *rr = (rtcp_rr *)rtcpbuf;
-					rr->header.version = 2;
-					rr->header.type = RTCP_RR;
-					rr->header.rc = 0;
-					rr->header.length = htons((rrlen/4)-1);
-					janus_ice_stream *stream = handle->stream;
-					if(stream && stream->video_rtcp_ctx[0] && stream->video_rtcp_ctx[0]->rtp_recvd) {
-						rr->header.rc = 1;
-						janus_rtcp_report_block(stream->video_rtcp_ctx[0], &rr->rb[0]);
+				janus_ice_packet_cache *cache = janus_ice_packet_cache_get();
+				if(pkt->shared != NULL) {
+					/* The plugin shared this packet with other peers: time to get our own copy */
+					memcpy(pkt->data, pkt->shared->buffer, pkt->length);
+					janus_rtp_header_override_apply((janus_rtp_header *)pkt->data, &pkt->override);
+					janus_rtp_shared_packet_unref(pkt->shared);
+					pkt->shared = NULL;
+					cache->copied += pkt->length;
+				}
+				/* If we're protecting video with FEC, the sequence numbers of what we send
+				 * must make room for the FEC packets we add (even if we stopped doing that) */
+				gboolean fec = FALSE;
+				if(video && stream->fec != NULL && !pkt->retransmission) {
+					janus_fec_update_seq(stream->fec, pkt->data, pkt->length);
+					fec = janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ULPFEC);
+				}
+				/* Protect in place, unless there's no room for the SRTP trailer (and the
+				 * transport wide CC extension and RED header, if we need to add them), or
+				 * we need the unencrypted packet later on (RFC4588 retransmissions): the copy
+				 * comes from the pool too, so that it can be sent without copying it again */
+				janus_ice_queued_packet *spkt = NULL;
+				char *sbuf = pkt->data;
+				int smax = pkt->capacity;
+				int twcc_room = stream->bwe != NULL ? 8 : 0;
+				int fec_room = fec ? 1 : 0;
+				if(pkt->length+twcc_room+fec_room+SRTP_MAX_TRAILER_LEN > pkt->capacity || (video && max_nack_queue > 0 && component->do_video_nacks &&
+						janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX))) {
+					spkt = janus_ice_queued_packet_alloc(pkt->length+twcc_room+fec_room+SRTP_MAX_TRAILER_LEN);
+					memcpy(spkt->data, pkt->data, pkt->length);
+					sbuf = spkt->data;
+					smax = spkt->capacity;
+					cache->copied += pkt->length;
+				}
+				int slen = pkt->length;
+				/* Overwrite SSRC */
+				janus_rtp_header *header = (janus_rtp_header *)sbuf;
+				if(!pkt->retransmission) {
+					/* ... but only if this isn't a retransmission (for those we already set it before) */
+					header->ssrc = htonl(video ? stream->video_ssrc : stream->audio_ssrc);
+				}
+				/* If we're estimating the bandwidth ourselves, stamp the packet with a transport wide
+				 * sequence number: we only take note of the packet once it's actually been sent, as
+				 * sequence numbers the peer never sees would look like losses later on */
+				gboolean twcc = FALSE;
+				guint16 transport_seq_num = 0;
+				if(stream->bwe != NULL && stream->rtp_extmap.transport_wide_cc > 0) {
+					transport_seq_num = janus_bwe_next_seq(stream->bwe);
+					int res = janus_rtp_header_extension_set_transport_wide_cc(sbuf, slen, smax-SRTP_MAX_TRAILER_LEN,
+						stream->rtp_extmap.transport_wide_cc, transport_seq_num);
+					if(res > 0) {
+						slen = res;
+						twcc = TRUE;
 					}
-					/* Append REMB */
-					memcpy(rtcpbuf+rrlen, pkt->data, pkt->length);
-					/* If we're simulcasting, set the extra SSRCs (the first one will be set by janus_rtcp_fix_ssrc) */
-					if(stream->video_ssrc_peer[1] && pkt->length >= 28) {
-						rtcp_fb *rtcpfb = (rtcp_fb *)(rtcpbuf+rrlen);
-						rtcp_remb *remb = (rtcp_remb *)rtcpfb->fci;
-						remb->ssrc[1] = htonl(stream->video_ssrc_peer[1]);
-						if(stream->video_ssrc_peer[2] && pkt->length >= 32) {
-							remb->ssrc[2] = htonl(stream->video_ssrc_peer[2]);
-						}
+				}
+				/* Keep track of payload types too */
+				if(!video && stream->audio_payload_type < 0) {
+					stream->audio_payload_type = header->type;
+					if(stream->audio_codec == NULL) {
+						const char *codec = janus_get_codec_from_pt(handle->local_sdp, stream->audio_payload_type);
+						if(codec != NULL)
+							stream->audio_codec = g_strdup(codec);
+					}
+				} else if(video && stream->video_payload_type < 0) {
+					stream->video_payload_type = header->type;
+					if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX) &&
+							stream->rtx_payload_types && g_hash_table_size(stream->rtx_payload_types) > 0) {
+						stream->video_rtx_payload_type = GPOINTER_TO_INT(g_hash_table_lookup(stream->rtx_payload_types, GINT_TO_POINTER(stream->video_payload_type)));
+						JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Retransmissions will have payload type %d\n",
+							handle->handle_id, stream->video_rtx_payload_type);
+					}
+					if(stream->video_codec == NULL) {
+						const char *codec = janus_get_codec_from_pt(handle->local_sdp, stream->video_payload_type);
+						if(codec != NULL)
+							stream->video_codec = g_strdup(codec);
+					}
+					if(stream->video_is_keyframe == NULL && stream->video_codec != NULL) {
+						if(!strcasecmp(stream->video_codec, "vp8"))
+							stream->video_is_keyframe = &janus_vp8_is_keyframe;
+						else if(!strcasecmp(stream->video_codec, "vp9"))
+							stream->video_is_keyframe = &janus_vp9_is_keyframe;
+						else if(!strcasecmp(stream->video_codec, "h264"))
+							stream->video_is_keyframe = &janus_h264_is_keyframe;
 					}
-					/* Free old packet and update */
-					char *prev_data = pkt->data;
-					pkt->data = rtcpbuf;
-					pkt->length = rrlen+pkt->length;
-					g_clear_pointer(&prev_data, g_free);
 				}
-				/* FIXME Copy in a buffer and fix SSRC */
-				char sbuf[JANUS_BUFSIZE];
-				memcpy(sbuf, pkt->data, pkt->length);
 				/* Do we need to dump this packet for debugging? */
 				if(g_atomic_int_get(&handle->dump_packets))
-					janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTCP, FALSE, sbuf, pkt->length,
+					janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTP, FALSE, sbuf, slen,
 						"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
-				/* Encrypt SRTCP */
-				int protected = pkt->length;
-				int res = srtp_protect_rtcp(component->dtls->srtp_out, sbuf, &protected);
+				/* If this is video, check if this is a keyframe: if so, we empty our retransmit buffer for incoming NACKs */
+				if(video && stream->video_is_keyframe) {
+					int plen = 0;
+					char *payload = janus_rtp_payload(sbuf, slen, &plen);
+					if(stream->video_is_keyframe(payload, plen)) {
+						JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Keyframe sent, cleaning retransmit buffer\n", handle->handle_id);
+						janus_cleanup_nack_buffer(0, stream, FALSE, TRUE);
+					}
+				}
+				/* If we're doing FEC, take note of the packet for the next FEC packet, and encapsulate it in RED */
+				if(fec) {
+					int res = janus_fec_protect(stream->fec, sbuf, slen, smax-SRTP_MAX_TRAILER_LEN);
+					if(res > 0)
+						slen = res;
+				}
+				/* Encrypt SRTP */
+				int protected = slen;
+				int res = srtp_protect(component->dtls->srtp_out, sbuf, &protected);
 				if(res != srtp_err_status_ok) {
 					/* We don't spam the logs for every SRTP error: just take note of this, and print a summary later */
 					handle->srtp_errors_count++;
 					handle->last_srtp_error = res;
 					/* If we're debugging, though, print every occurrence */
-					JANUS_LOG(LOG_DBG, "[%"SCNu64"] ... SRTCP protect error... %s (len=%d-->%d)...\n", handle->handle_id, janus_srtp_error_str(res), pkt->length, protected);
+					janus_rtp_header *header = (janus_rtp_header *)sbuf;
+					guint32 timestamp = ntohl(header->timestamp);
+					guint16 seq = ntohs(header->seq_number);
+					JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... SRTP protect error... %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")...\n", handle->handle_id, janus_srtp_error_str(res), slen, protected, timestamp, seq);
 				} else {
 					/* Shoot! */
-					int sent = nice_agent_send(handle->agent, stream->stream_id, component->component_id, protected, sbuf);
+					int sent = janus_ice_egress_send(handle, ctx, stream, component, protected, sbuf, spkt ? spkt : pkt);
 					if(sent < protected) {
 						JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, protected);
 					}
-				}
-			}
-			g_free(pkt->data);
-			g_free(pkt);
-			continue;
-		} else {
-			/* RTP or data */
-			if(pkt->type == JANUS_ICE_PACKET_AUDIO || pkt->type == JANUS_ICE_PACKET_VIDEO) {
-				/* RTP */
-				int video = (pkt->type == JANUS_ICE_PACKET_VIDEO);
-				janus_ice_stream *stream = handle->stream;
-				if(!stream) {
-					g_free(pkt->data);
-					pkt->data = NULL;
-					g_free(pkt);
-					pkt = NULL;
-					continue;
-				}
-				if((!video && !stream->audio_send) || (video && !stream->video_send)) {
-					g_free(pkt->data);
-					pkt->data = NULL;
-					g_free(pkt);
-					pkt = NULL;
-					continue;
-				}
-				janus_ice_component *component = stream->component;
-				if(!component) {
-					g_free(pkt->data);
-					pkt->data = NULL;
-					g_free(pkt);
-					pkt = NULL;
-					continue;
-				}
-				if(!stream->cdone) {
-					if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT) && !stream->noerrorlog) {
-						JANUS_LOG(LOG_ERR, "[%"SCNu64"]     %s candidates not gathered yet for stream??\n", handle->handle_id, video ? "video" : "audio");
-						stream->noerrorlog = TRUE;	/* Don't flood with the same error all over again */
-					}
-					g_free(pkt->data);
-					pkt->data = NULL;
-					g_free(pkt);
-					pkt = NULL;
-					continue;
-				}
-				stream->noerrorlog = FALSE;
-				if(!component->dtls || !component->dtls->srtp_valid || !component->dtls->srtp_out) {
-					if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT) && !component->noerrorlog) {
-						JANUS_LOG(LOG_WARN, "[%"SCNu64"]     %s stream component has no valid SRTP session (yet?)\n", handle->handle_id, video ? "video" : "audio");
-						component->noerrorlog = TRUE;	/* Don't flood with the same error all over again */
-					}
-					g_free(pkt->data);
-					pkt->data = NULL;
-					g_free(pkt);
-					pkt = NULL;
-					continue;
-				}
-				component->noerrorlog = FALSE;
-				if(pkt->encrypted) {
-					/* Already RTP (probably a retransmission?) */
-					janus_rtp_header *header = (janus_rtp_header *)pkt->data;
-					JANUS_LOG(LOG_HUGE, "[%"SCNu64"] ... Retransmitting seq.nr %"SCNu16"\n\n", handle->handle_id, ntohs(header->seq_number));
-					int sent = nice_agent_send(handle->agent, stream->stream_id, component->component_id, pkt->length, (const gchar *)pkt->data);
-					if(sent < pkt->length) {
-						JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, pkt->length);
-					}
-				} else {
-					/* FIXME Copy in a buffer and fix SSRC */
-					char sbuf[JANUS_BUFSIZE];
-					memcpy(sbuf, pkt->data, pkt->length);
-					/* Overwrite SSRC */
-					janus_rtp_header *header = (janus_rtp_header *)sbuf;
-					if(!pkt->retransmission) {
-						/* ... but only if this isn't a retransmission (for those we already set it before) */
-						header->ssrc = htonl(video ? stream->video_ssrc : stream->audio_ssrc);
-					}
-					/* Keep track of payload types too */
-					if(!video && stream->audio_payload_type < 0) {
-						stream->audio_payload_type = header->type;
-						if(stream->audio_codec == NULL) {
-							const char *codec = janus_get_codec_from_pt(handle->local_sdp, stream->audio_payload_type);
-							if(codec != NULL)
-								stream->audio_codec = g_strdup(codec);
-						}
-					} else if(video && stream->video_payload_type < 0) {
-						stream->video_payload_type = header->type;
-						if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX) &&
-								stream->rtx_payload_types && g_hash_table_size(stream->rtx_payload_types) > 0) {
-							stream->video_rtx_payload_type = GPOINTER_TO_INT(g_hash_table_lookup(stream->rtx_payload_types, GINT_TO_POINTER(stream->video_payload_type)));
-							JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Retransmissions will have payload type %d\n",
-								handle->handle_id, stream->video_rtx_payload_type);
-						}
-						if(stream->video_codec == NULL) {
-							const char *codec = janus_get_codec_from_pt(handle->local_sdp, stream->video_payload_type);
-							if(codec != NULL)
-								stream->video_codec = g_strdup(codec);
-						}
-						if(stream->video_is_keyframe == NULL && stream->video_codec != NULL) {
-							if(!strcasecmp(stream->video_codec, "vp8"))
-								stream->video_is_keyframe = &janus_vp8_is_keyframe;
-							else if(!strcasecmp(stream->video_codec, "vp9"))
-								stream->video_is_keyframe = &janus_vp9_is_keyframe;
-							else if(!strcasecmp(stream->video_codec, "h264"))
-								stream->video_is_keyframe = &janus_h264_is_keyframe;
-						}
-					}
-					/* Do we need to dump this packet for debugging? */
-					if(g_atomic_int_get(&handle->dump_packets))
-						janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTP, FALSE, sbuf, pkt->length,
-							"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
-					/* If this is video, check if this is a keyframe: if so, we empty our retransmit buffer for incoming NACKs */
-					if(video && stream->video_is_keyframe) {
-						int plen = 0;
-						char *payload = janus_rtp_payload(sbuf, pkt->length, &plen);
-						if(stream->video_is_keyframe(payload, plen)) {
-							JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Keyframe sent, cleaning retransmit buffer\n", handle->handle_id);
-							janus_cleanup_nack_buffer(0, stream, FALSE, TRUE);
-						}
-					}
-					/* Encrypt SRTP */
-					int protected = pkt->length;
-					int res = srtp_protect(component->dtls->srtp_out, sbuf, &protected);
-					if(res != srtp_err_status_ok) {
-						/* We don't spam the logs for every SRTP error: just take note of this, and print a summary later */
-						handle->srtp_errors_count++;
-						handle->last_srtp_error = res;
-						/* If we're debugging, though, print every occurrence */
+					if(twcc && sent > 0)
+						janus_bwe_packet_sent(stream->bwe, transport_seq_num, protected, janus_get_monotonic_time());
+					/* If a FEC packet is due, it must immediately follow the last packet it protects */
+					if(fec)
+						janus_ice_send_fec(handle, ctx, stream, component);
+					/* Update stats */
+					if(sent > 0) {
+						/* Update the RTCP context as well */
 						janus_rtp_header *header = (janus_rtp_header *)sbuf;
 						guint32 timestamp = ntohl(header->timestamp);
-						guint16 seq = ntohs(header->seq_number);
-						JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... SRTP protect error... %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")...\n", handle->handle_id, janus_srtp_error_str(res), pkt->length, protected, timestamp, seq);
-					} else {
-						/* Shoot! */
-						int sent = nice_agent_send(handle->agent, stream->stream_id, component->component_id, protected, sbuf);
-						if(sent < protected) {
-							JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, protected);
-						}
-						/* Update stats */
-						if(sent > 0) {
-							/* Update the RTCP context as well */
-							janus_rtp_header *header = (janus_rtp_header *)sbuf;
-							guint32 timestamp = ntohl(header->timestamp);
-							if(pkt->type == JANUS_ICE_PACKET_AUDIO) {
-								component->out_stats.audio.packets++;
-								component->out_stats.audio.bytes += pkt->length;
-								/* Last second outgoing audio */
-								gint64 now = janus_get_monotonic_time();
-								if(component->out_stats.audio.updated == 0)
-									component->out_stats.audio.updated = now;
-								if(now > component->out_stats.audio.updated &&
-										now - component->out_stats.audio.updated >= G_USEC_PER_SEC) {
-									component->out_stats.audio.bytes_lastsec = component->out_stats.audio.bytes_lastsec_temp;
-									component->out_stats.audio.bytes_lastsec_temp = 0;
-									component->out_stats.audio.updated = now;
-								}
-								component->out_stats.audio.bytes_lastsec_temp += pkt->length;
-								stream->audio_last_ts = timestamp;
-								if(stream->audio_first_ntp_ts == 0) {
-									struct timeval tv;
-									gettimeofday(&tv, NULL);
-									stream->audio_first_ntp_ts = (gint64)tv.tv_sec*G_USEC_PER_SEC + tv.tv_usec;
-									stream->audio_first_rtp_ts = timestamp;
-								}
-								/* Let's check if this was G.711: in case we may need to change the timestamp base */
-								rtcp_context *rtcp_ctx = stream->audio_rtcp_ctx;
-								int pt = header->type;
-								if((pt == 0 || pt == 8) && (rtcp_ctx->tb == 48000))
-									rtcp_ctx->tb = 8000;
-							} else if(pkt->type == JANUS_ICE_PACKET_VIDEO) {
-								component->out_stats.video[0].packets++;
-								component->out_stats.video[0].bytes += pkt->length;
-								/* Last second outgoing video */
-								gint64 now = janus_get_monotonic_time();
-								if(component->out_stats.video[0].updated == 0)
-									component->out_stats.video[0].updated = now;
-								if(now > component->out_stats.video[0].updated &&
-										now - component->out_stats.video[0].updated >= G_USEC_PER_SEC) {
-									component->out_stats.video[0].bytes_lastsec = component->out_stats.video[0].bytes_lastsec_temp;
-									component->out_stats.video[0].bytes_lastsec_temp = 0;
-									component->out_stats.video[0].updated = now;
-								}
-								component->out_stats.video[0].bytes_lastsec_temp += pkt->length;
-								stream->video_last_ts = timestamp;
-								if(stream->video_first_ntp_ts[0] == 0) {
-									struct timeval tv;
-									gettimeofday(&tv, NULL);
-									stream->video_first_ntp_ts[0] = (gint64)tv.tv_sec*G_USEC_PER_SEC + tv.tv_usec;
-									stream->video_first_rtp_ts[0] = timestamp;
-								}
+						if(pkt->type == JANUS_ICE_PACKET_AUDIO) {
+							component->out_stats.audio.packets++;
+							component->out_stats.audio.bytes += pkt->length;
+							/* Last second outgoing audio */
+							gint64 now = janus_get_monotonic_time();
+							if(component->out_stats.audio.updated == 0)
+								component->out_stats.audio.updated = now;
+							if(now > component->out_stats.audio.updated &&
+									now - component->out_stats.audio.updated >= G_USEC_PER_SEC) {
+								component->out_stats.audio.bytes_lastsec = component->out_stats.audio.bytes_lastsec_temp;
+								component->out_stats.audio.bytes_lastsec_temp = 0;
+								component->out_stats.audio.updated = now;
 							}
-							/* Update sent packets counter */
-							rtcp_context *rtcp_ctx = video ? stream->video_rtcp_ctx[0] : stream->audio_rtcp_ctx;
-							g_atomic_int_inc(&rtcp_ctx->sent_packets_since_last_rr);
-						}
-						if(max_nack_queue > 0) {
-							/* Save the packet for retransmissions that may be needed later */
-							if((pkt->type == JANUS_ICE_PACKET_AUDIO && !component->do_audio_nacks) ||
-									(pkt->type == JANUS_ICE_PACKET_VIDEO && !component->do_video_nacks)) {
-								/* ... unless NACKs are disabled for this medium */
-								g_free(pkt->data);
-								pkt->data = NULL;
-								g_free(pkt);
-								pkt = NULL;
-								continue;
+							component->out_stats.audio.bytes_lastsec_temp += pkt->length;
+							stream->audio_last_ts = timestamp;
+							if(stream->audio_first_ntp_ts == 0) {
+								struct timeval tv;
+								gettimeofday(&tv, NULL);
+								stream->audio_first_ntp_ts = (gint64)tv.tv_sec*G_USEC_PER_SEC + tv.tv_usec;
+								stream->audio_first_rtp_ts = timestamp;
 							}
-							janus_rtp_packet *p = g_malloc(sizeof(janus_rtp_packet));
-							/* What to store and how depends on whether we're doing RFC4588 or not */
-							if(pkt->type == JANUS_ICE_PACKET_AUDIO || !janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX)) {
-								/* We're not: just store the SRTP packet we just encrypted */
-								p->data = g_malloc(protected);
-								memcpy(p->data, sbuf, protected);
-								p->length = protected;
-							} else {
-								/* We are: make room for two more bytes to store the original sequence number */
-								janus_rtp_header *header = (janus_rtp_header *)pkt->data;
-								guint16 original_seq = header->seq_number;
-								p->data = g_malloc(pkt->length+2);
-								p->length = pkt->length+2;
-								/* Check where the payload starts */
-								int plen = 0;
-								char *payload = janus_rtp_payload(pkt->data, pkt->length, &plen);
-								size_t hsize = payload - pkt->data;
-								/* Copy the header first */
-								memcpy(p->data, pkt->data, hsize);
-								/* Copy the original sequence number */
-								memcpy(p->data+hsize, &original_seq, 2);
-								/* Copy the payload */
-								memcpy(p->data+hsize+2, payload, pkt->length - hsize);
+							/* Let's check if this was G.711: in case we may need to change the timestamp base */
+							rtcp_context *rtcp_ctx = stream->audio_rtcp_ctx;
+							int pt = header->type;
+							if((pt == 0 || pt == 8) && (rtcp_ctx->tb == 48000))
+								rtcp_ctx->tb = 8000;
+						} else if(pkt->type == JANUS_ICE_PACKET_VIDEO) {
+							component->out_stats.video[0].packets++;
+							component->out_stats.video[0].bytes += pkt->length;
+							/* Last second outgoing video */
+							gint64 now = janus_get_monotonic_time();
+							if(component->out_stats.video[0].updated == 0)
+								component->out_stats.video[0].updated = now;
+							if(now > component->out_stats.video[0].updated &&
+									now - component->out_stats.video[0].updated >= G_USEC_PER_SEC) {
+								component->out_stats.video[0].bytes_lastsec = component->out_stats.video[0].bytes_lastsec_temp;
+								component->out_stats.video[0].bytes_lastsec_temp = 0;
+								component->out_stats.video[0].updated = now;
 							}
-							p->created = janus_get_monotonic_time();
-							p->last_retransmit = 0;
-							janus_mutex_lock(&component->mutex);
-							janus_rtp_header *header = (janus_rtp_header *)sbuf;
-							guint16 seq = ntohs(header->seq_number);
-							if(!video) {
-								if(component->audio_retransmit_buffer == NULL) {
-									component->audio_retransmit_buffer = g_queue_new();
-									component->audio_retransmit_seqs = g_hash_table_new(NULL, NULL);
-								}
-								g_queue_push_tail(component->audio_retransmit_buffer, p);
-								/* Insert in the table too, for quick lookup */
-								g_hash_table_insert(component->audio_retransmit_seqs, GUINT_TO_POINTER(seq), p);
+							component->out_stats.video[0].bytes_lastsec_temp += pkt->length;
+							stream->video_last_ts = timestamp;
+							if(stream->video_first_ntp_ts[0] == 0) {
+								struct timeval tv;
+								gettimeofday(&tv, NULL);
+								stream->video_first_ntp_ts[0] = (gint64)tv.tv_sec*G_USEC_PER_SEC + tv.tv_usec;
+								stream->video_first_rtp_ts[0] = timestamp;
+							}
+						}
+						/* Update sent packets counter */
+						rtcp_context *rtcp_ctx = video ? stream->video_rtcp_ctx[0] : stream->audio_rtcp_ctx;
+						g_atomic_int_inc(&rtcp_ctx->sent_packets_since_last_rr);
+					}
+					if(max_nack_queue > 0) {
+						/* Save the packet for retransmissions that may be needed later */
+						if((pkt->type == JANUS_ICE_PACKET_AUDIO && !component->do_audio_nacks) ||
+								(pkt->type == JANUS_ICE_PACKET_VIDEO && !component->do_video_nacks)) {
+							/* ... unless NACKs are disabled for this medium */
+							janus_ice_queued_packet_free(spkt);
+							janus_ice_queued_packet_free(pkt);
+							pkt = NULL;
+							return;
+						}
+						janus_ice_queued_packet *p = NULL;
+						/* What to store and how depends on whether we're doing RFC4588 or not */
+						if(pkt->type == JANUS_ICE_PACKET_AUDIO || !janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX)) {
+							/* We're not: just store the SRTP packet we just encrypted, which
+							 * means we can keep the packet it's in, whichever that is */
+							if(sbuf == pkt->data) {
+								p = pkt;
+								pkt = NULL;
 							} else {
-								if(component->video_retransmit_buffer == NULL) {
-									component->video_retransmit_buffer = g_queue_new();
-									component->video_retransmit_seqs = g_hash_table_new(NULL, NULL);
-								}
-								g_queue_push_tail(component->video_retransmit_buffer, p);
-								/* Insert in the table too, for quick lookup */
-								g_hash_table_insert(component->video_retransmit_seqs, GUINT_TO_POINTER(seq), p);
+								p = spkt;
+								spkt = NULL;
 							}
-							janus_mutex_unlock(&component->mutex);
+							p->length = protected;
+						} else {
+							/* We are: make room for two more bytes to store the original sequence number */
+							janus_rtp_header *header = (janus_rtp_header *)pkt->data;
+							guint16 original_seq = header->seq_number;
+							p = janus_ice_queued_packet_alloc(pkt->length+2);
+							p->length = pkt->length+2;
+							/* Check where the payload starts */
+							int plen = 0;
+							char *payload = janus_rtp_payload(pkt->data, pkt->length, &plen);
+							size_t hsize = payload - pkt->data;
+							/* Copy the header first */
+							memcpy(p->data, pkt->data, hsize);
+							/* Copy the original sequence number */
+							memcpy(p->data+hsize, &original_seq, 2);
+							/* Copy the payload */
+							memcpy(p->data+hsize+2, payload, pkt->length - hsize);
+							cache->copied += pkt->length;
+						}
+						janus_mutex_lock(&component->mutex);
+						janus_rtp_header *header = (janus_rtp_header *)sbuf;
+						guint16 seq = ntohs(header->seq_number);
+						if(!video) {
+							if(component->audio_retransmit_buffer == NULL)
+								component->audio_retransmit_buffer = janus_ice_retransmit_buffer_create(MIN(retransmit_buffer_size, AUDIO_RETRANSMIT_BUFFER_SIZE));
+							janus_ice_retransmit_buffer_store(component->audio_retransmit_buffer, seq, p, janus_get_monotonic_time());
+						} else {
+							if(component->video_retransmit_buffer == NULL)
+								component->video_retransmit_buffer = janus_ice_retransmit_buffer_create(retransmit_buffer_size);
+							janus_ice_retransmit_buffer_store(component->video_retransmit_buffer, seq, p, janus_get_monotonic_time());
 						}
+						janus_mutex_unlock(&component->mutex);
 					}
 				}
-			} else {
-				/* Data */
-				if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_DATA_CHANNELS)) {
-					g_free(pkt->data);
-					pkt->data = NULL;
-					g_free(pkt);
-					pkt = NULL;
-					continue;
-				}
+				/* Done with the copy we worked on, if any (the batch may still hold it) */
+				janus_ice_queued_packet_free(spkt);
+			}
+		} else {
+			/* Data */
+			if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_DATA_CHANNELS)) {
+				janus_ice_queued_packet_free(pkt);
+				pkt = NULL;
+				return;
+			}
 #ifdef HAVE_SCTP
-				janus_ice_stream *stream = handle->stream;
-				if(!stream) {
-					g_free(pkt->data);
-					pkt->data = NULL;
-					g_free(pkt);
-					pkt = NULL;
-					continue;
-				}
-				janus_ice_component *component = stream->component;
-				if(!component) {
-					g_free(pkt->data);
-					pkt->data = NULL;
-					g_free(pkt);
-					pkt = NULL;
-					continue;
-				}
-				if(!stream->cdone) {
-					if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT) && !stream->noerrorlog) {
-						JANUS_LOG(LOG_ERR, "[%"SCNu64"]     SCTP candidates not gathered yet for stream??\n", handle->handle_id);
-						stream->noerrorlog = TRUE;	/* Don't flood with the same error all over again */
-					}
-					g_free(pkt->data);
-					pkt->data = NULL;
-					g_free(pkt);
-					pkt = NULL;
-					continue;
+			janus_ice_stream *stream = handle->stream;
+			if(!stream) {
+				janus_ice_queued_packet_free(pkt);
+				pkt = NULL;
+				return;
+			}
+			janus_ice_component *component = stream->component;
+			if(!component) {
+				janus_ice_queued_packet_free(pkt);
+				pkt = NULL;
+				return;
+			}
+			if(!stream->cdone) {
+				if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT) && !stream->noerrorlog) {
+					JANUS_LOG(LOG_ERR, "[%"SCNu64"]     SCTP candidates not gathered yet for stream??\n", handle->handle_id);
+					stream->noerrorlog = TRUE;	/* Don't flood with the same error all over again */
 				}
-				stream->noerrorlog = FALSE;
-				if(!component->dtls) {
-					if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT) && !component->noerrorlog) {
-						JANUS_LOG(LOG_WARN, "[%"SCNu64"]     SCTP stream component has no valid DTLS session (yet?)\n", handle->handle_id);
-						component->noerrorlog = TRUE;	/* Don't flood with the same error all over again */
-					}
-					g_free(pkt->data);
-					pkt->data = NULL;
-					g_free(pkt);
-					pkt = NULL;
-					continue;
+				janus_ice_queued_packet_free(pkt);
+				pkt = NULL;
+				return;
+			}
+			stream->noerrorlog = FALSE;
+			if(!component->dtls) {
+				if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT) && !component->noerrorlog) {
+					JANUS_LOG(LOG_WARN, "[%"SCNu64"]     SCTP stream component has no valid DTLS session (yet?)\n", handle->handle_id);
+					component->noerrorlog = TRUE;	/* Don't flood with the same error all over again */
 				}
-				component->noerrorlog = FALSE;
-				janus_dtls_wrap_sctp_data(component->dtls, pkt->data, pkt->length);
+				janus_ice_queued_packet_free(pkt);
+				pkt = NULL;
+				return;
+			}
+			component->noerrorlog = FALSE;
+			if(pkt->shared_data != NULL) {
+				/* Hand the plugin's buffer to the SCTP stack as it is */
+				janus_dtls_wrap_sctp_data(component->dtls, pkt->shared_data->buffer, pkt->shared_data->length, pkt->shared_data->binary);
+			} else {
+				janus_dtls_wrap_sctp_data(component->dtls, pkt->data, pkt->length, FALSE);
+			}
 #endif
+		}
+		janus_ice_queued_packet_free(pkt);
+		pkt = NULL;
+		return;
+	}
+}
+
+/* Outbound pacer: how often the send thread drains it, how much of a burst
+ * we allow, and when we give up on packets that waited too long */
+#define JANUS_ICE_PACER_INTERVAL		5000
+#define JANUS_ICE_PACER_BURST			20000
+#define JANUS_ICE_PACER_MAX_DELAY		500000
+#define JANUS_ICE_PACER_MAX_PACKETS		1024
+/* Helper to figure out the bitrate to pace at (0 if we don't know it yet) */
+static gint64 janus_ice_pacer_rate(janus_ice_stream *stream) {
+	if(stream == NULL)
+		return 0;
+	guint32 bitrate = stream->bwe ? janus_bwe_get_estimate(stream->bwe) : 0;
+	if(bitrate == 0)
+		bitrate = stream->remb_bitrate;
+	/* Bytes per second */
+	return (gint64)(bitrate * pacing_multiplier) / 8;
+}
+
+/* Helper to send as many paced packets as the budget allows, and drop the stale ones */
+static void janus_ice_pacer_drain(janus_ice_handle *handle, janus_ice_send_context *ctx, gint64 now) {
+	if(ctx->pacer == NULL || g_queue_is_empty(ctx->pacer))
+		return;
+	janus_ice_stream *stream = handle->stream;
+	janus_ice_component *component = stream ? stream->component : NULL;
+	gint64 rate = janus_ice_pacer_rate(stream);
+	if(rate > 0) {
+		/* Refill the bucket, but don't let it accumulate more than a short burst */
+		if(ctx->pacer_updated > 0 && now > ctx->pacer_updated)
+			ctx->pacer_budget += rate * (now - ctx->pacer_updated) / G_USEC_PER_SEC;
+		gint64 burst = rate * JANUS_ICE_PACER_BURST / G_USEC_PER_SEC;
+		if(ctx->pacer_budget > burst)
+			ctx->pacer_budget = burst;
+	}
+	ctx->pacer_updated = now;
+	janus_ice_queued_packet *pkt = NULL;
+	while((pkt = g_queue_peek_head(ctx->pacer)) != NULL) {
+		gint64 delay = now - pkt->paced;
+		if(rate > 0 && delay > JANUS_ICE_PACER_MAX_DELAY) {
+			/* Too late to be of any use, the peer will ask for a keyframe anyway */
+			g_queue_pop_head(ctx->pacer);
+			janus_ice_queued_packet_free(pkt);
+			if(component)
+				component->pacer_dropped++;
+			continue;
+		}
+		/* If we don't know the rate anymore, just send everything */
+		if(rate > 0 && ctx->pacer_budget <= 0)
+			break;
+		g_queue_pop_head(ctx->pacer);
+		ctx->pacer_budget -= pkt->length;
+		if(component)
+			component->pacer_delay = delay;
+		janus_ice_send_packet(handle, ctx, pkt);
+	}
+	if(g_queue_is_empty(ctx->pacer))
+		ctx->pacer_budget = 0;
+	if(component)
+		component->pacer_queued = g_queue_get_length(ctx->pacer);
+}
+
+/* Helper to send a packet, or put it in the pacer if it's video we should pace:
+ * audio, RTCP, data and retransmissions are never delayed */
+static void janus_ice_pacer_send(janus_ice_handle *handle, janus_ice_send_context *ctx, janus_ice_queued_packet *pkt, gint64 now) {
+	if(pkt != NULL && pkt->data != NULL && pkt->type == JANUS_ICE_PACKET_VIDEO && !pkt->control && !pkt->retransmission &&
+			((ctx->pacer != NULL && !g_queue_is_empty(ctx->pacer)) ||
+				(pacing_multiplier > 0.0 && janus_ice_pacer_rate(handle->stream) > 0))) {
+		/* Video packets go through the pacer (even if it's been disabled since, if
+		 * there's anything in there already, as they must not overtake each other) */
+		if(ctx->pacer == NULL)
+			ctx->pacer = g_queue_new();
+		if(g_queue_get_length(ctx->pacer) >= JANUS_ICE_PACER_MAX_PACKETS) {
+			/* We're way behind, drop the oldest packet */
+			janus_ice_queued_packet_free(g_queue_pop_head(ctx->pacer));
+			if(handle->stream && handle->stream->component)
+				handle->stream->component->pacer_dropped++;
+		}
+		pkt->paced = now;
+		g_queue_push_tail(ctx->pacer, pkt);
+		janus_ice_pacer_drain(handle, ctx, now);
+		return;
+	}
+	janus_ice_send_packet(handle, ctx, pkt);
+}
+
+void *janus_ice_send_thread(void *data) {
+	janus_ice_handle *handle = (janus_ice_handle *)data;
+	JANUS_LOG(LOG_VERB, "[%"SCNu64"] ICE send thread started...\n", handle->handle_id);
+	janus_ice_queued_packet *pkt = NULL;
+	janus_ice_send_context ctx;
+	janus_ice_send_context_init(&ctx, handle, janus_get_monotonic_time());
+	while(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP)) {
+		if(handle->queued_packets != NULL) {
+			pkt = janus_ice_queue_pop(handle, 0);
+			if(pkt == NULL) {
+				/* Nothing else to send for now: send what we batched, if anything, and wait
+				 * (not for long, if there are paced packets waiting for their turn) */
+				janus_ice_egress_flush(handle, &ctx);
+				gboolean pacing = (ctx.pacer != NULL && !g_queue_is_empty(ctx.pacer));
+				pkt = janus_ice_queue_pop(handle, pacing ? JANUS_ICE_PACER_INTERVAL : 500000);
 			}
-			g_free(pkt->data);
-			pkt->data = NULL;
-			g_free(pkt);
+		} else {
+			g_usleep(100000);
+		}
+		if(pkt == &janus_ice_dtls_alert) {
+			janus_ice_send_alert(handle, &ctx);
+			continue;
+		}
+		if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_READY)) {
+			janus_ice_queued_packet_free(pkt);
 			pkt = NULL;
 			continue;
 		}
+		if(ctx.alert_sent)
+			ctx.alert_sent = FALSE;
+		gint64 now = janus_get_monotonic_time();
+		janus_ice_send_periodic(handle, &ctx, now);
+		/* Now let's get on with the packets, starting from the paced ones */
+		janus_ice_pacer_drain(handle, &ctx, now);
+		janus_ice_pacer_send(handle, &ctx, pkt, now);
+		pkt = NULL;
 	}
+	janus_ice_send_context_cleanup(&ctx);
 	JANUS_LOG(LOG_VERB, "[%"SCNu64"] ICE send thread leaving...\n", handle->handle_id);
 	g_thread_unref(g_thread_self());
 	handle->send_thread = NULL;
 	return NULL;
 }
 
+/* Send workers: timer wheel management */
+static void janus_ice_send_worker_release(janus_ice_send_worker *worker, janus_ice_handle *handle) {
+	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Handle leaving send worker #%d\n", handle->handle_id, worker->id);
+	janus_timer_wheel_cancel(worker->wheel, &handle->send_ctx->timer);
+	if(handle->send_ctx->pacing)
+		worker->paced = g_list_remove(worker->paced, handle->send_ctx);
+	janus_ice_send_context_cleanup(handle->send_ctx);
+	g_free(handle->send_ctx);
+	handle->send_ctx = NULL;
+	g_atomic_int_dec_and_test(&worker->handles);
+	/* After this, the handle may be freed at any time */
+	g_atomic_pointer_set(&handle->send_worker, NULL);
+}
+
+static void janus_ice_send_worker_detach(janus_ice_send_worker *worker, janus_ice_handle *handle) {
+	if(g_atomic_int_compare_and_exchange(&handle->send_scheduled, 0, 1)) {
+		/* Nobody can wake us up for this handle anymore, we can let it go */
+		janus_ice_send_worker_release(worker, handle);
+	} else {
+		/* The handle is still in the ready queue, we'll let it go when we get to it */
+		handle->send_ctx->detaching = TRUE;
+	}
+}
+
+/* Send workers: run the periodic tasks of all the handles whose timer expired */
+static void janus_ice_send_worker_tick(janus_ice_send_worker *worker, gint64 now) {
+	GList *expired = janus_timer_wheel_advance(worker->wheel, now), *l = expired;
+	while(l != NULL) {
+		janus_ice_send_context *ctx = (janus_ice_send_context *)((janus_timer_wheel_entry *)l->data)->data;
+		l = l->next;
+		janus_ice_handle *handle = ctx->handle;
+		if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP)) {
+			/* The handle is going away */
+			janus_ice_send_worker_detach(worker, handle);
+			continue;
+		}
+		gint64 next = now + 100000;
+		if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_READY))
+			next = janus_ice_send_periodic(handle, ctx, now);
+		if(next <= now)
+			next = now + JANUS_ICE_SEND_WHEEL_TICK;
+		janus_timer_wheel_schedule(worker->wheel, &ctx->timer, next);
+	}
+	g_list_free(expired);
+}
+
+/* Send workers: when shutting down, release all the handles still served
+ * by a worker, using the same path as when they leave at runtime */
+static void janus_ice_send_worker_release_all(janus_ice_send_worker *worker) {
+	/* Handles waiting in the ready queue may be waiting to be detached */
+	janus_ice_handle *handle = NULL;
+	while((handle = g_async_queue_try_pop(worker->ready)) != NULL) {
+		if(handle->send_ctx != NULL && handle->send_ctx->detaching)
+			janus_ice_send_worker_release(worker, handle);
+	}
+	/* All the other contexts are in the timer wheel */
+	GList *timers = janus_timer_wheel_clear(worker->wheel), *l = timers;
+	while(l != NULL) {
+		janus_ice_send_context *ctx = (janus_ice_send_context *)((janus_timer_wheel_entry *)l->data)->data;
+		janus_ice_send_worker_release(worker, ctx->handle);
+		l = l->next;
+	}
+	g_list_free(timers);
+}
+
+/* Send workers: send the paced packets whose turn came, for all the handles that have any */
+static void janus_ice_send_worker_pace(janus_ice_send_worker *worker) {
+	gint64 now = janus_get_monotonic_time();
+	GList *l = worker->paced;
+	while(l != NULL) {
+		janus_ice_send_context *ctx = (janus_ice_send_context *)l->data;
+		GList *next = l->next;
+		janus_ice_handle *handle = ctx->handle;
+		if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_READY)) {
+			janus_ice_pacer_drain(handle, ctx, now);
+			janus_ice_egress_flush(handle, ctx);
+		}
+		if(ctx->pacer == NULL || g_queue_is_empty(ctx->pacer) ||
+				janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP)) {
+			/* Nothing left to pace (or the handle is going away) */
+			ctx->pacing = FALSE;
+			worker->paced = g_list_delete_link(worker->paced, l);
+		}
+		l = next;
+	}
+}
+
+/* Send workers: send a batch of packets queued by a handle */
+static void janus_ice_send_worker_drain(janus_ice_send_worker *worker, janus_ice_handle *handle) {
+	janus_ice_send_context *ctx = handle->send_ctx;
+	if(ctx == NULL) {
+		/* First time we see this handle, start its timers */
+		gint64 now = janus_get_monotonic_time();
+		ctx = g_malloc0(sizeof(janus_ice_send_context));
+		janus_ice_send_context_init(ctx, handle, now);
+		handle->send_ctx = ctx;
+		janus_timer_wheel_schedule(worker->wheel, &ctx->timer, now + JANUS_ICE_SEND_WHEEL_TICK);
+	} else if(ctx->detaching) {
+		janus_ice_send_worker_release(worker, handle);
+		return;
+	}
+	g_atomic_int_set(&handle->send_scheduled, 0);
+	janus_ice_queued_packet *pkt = NULL;
+	int count = 0;
+	while(count < JANUS_ICE_SEND_BATCH && (pkt = janus_ice_queue_pop(handle, 0)) != NULL) {
+		count++;
+		if(pkt == &janus_ice_dtls_alert) {
+			janus_ice_send_alert(handle, ctx);
+			break;
+		}
+		if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_READY)) {
+			janus_ice_queued_packet_free(pkt);
+			continue;
+		}
+		if(ctx->alert_sent)
+			ctx->alert_sent = FALSE;
+		janus_ice_pacer_send(handle, ctx, pkt, janus_get_monotonic_time());
+	}
+	/* Send what we batched, if anything */
+	janus_ice_egress_flush(handle, ctx);
+	/* If some video is waiting in the pacer, we'll get back to it at the next tick */
+	if(!ctx->pacing && ctx->pacer != NULL && !g_queue_is_empty(ctx->pacer)) {
+		ctx->pacing = TRUE;
+		worker->paced = g_list_prepend(worker->paced, ctx);
+	}
+	/* Anything left? Get back in line, so that other handles get their turn too */
+	if(janus_mpsc_queue_length(handle->queued_packets) > 0 &&
+			g_atomic_int_compare_and_exchange(&handle->send_scheduled, 0, 1))
+		g_async_queue_push(worker->ready, handle);
+}
+
+static void *janus_ice_send_worker_thread(void *data) {
+	janus_ice_send_worker *worker = (janus_ice_send_worker *)data;
+	JANUS_LOG(LOG_VERB, "[worker#%d] Send worker started\n", worker->id);
+	gint64 now = 0;
+	while(!g_atomic_int_get(&worker->stop)) {
+		/* Wait for handles with packets to send, but no longer than the next tick */
+		now = janus_get_monotonic_time();
+		gint64 wait = worker->wheel->current * JANUS_ICE_SEND_WHEEL_TICK - now;
+		janus_ice_handle *handle = (wait > 0) ?
+			g_async_queue_timeout_pop(worker->ready, wait) : g_async_queue_try_pop(worker->ready);
+		if(handle != NULL)
+			janus_ice_send_worker_drain(worker, handle);
+		/* Now check if any timer expired in the meanwhile */
+		now = janus_get_monotonic_time();
+		if(now >= worker->wheel->current * JANUS_ICE_SEND_WHEEL_TICK) {
+			if(worker->paced != NULL)
+				janus_ice_send_worker_pace(worker);
+			janus_ice_send_worker_tick(worker, now);
+		}
+	}
+	JANUS_LOG(LOG_VERB, "[worker#%d] Send worker ended!\n", worker->id);
+	return NULL;
+}
+
+static void janus_ice_queue_packet(janus_ice_handle *handle, janus_ice_queued_packet *pkt, gboolean priority) {
+	if(handle->queued_packets == NULL) {
+		janus_ice_queued_packet_free(pkt);
+		return;
+	}
+	if(!janus_mpsc_queue_push(handle->queued_packets, pkt, priority)) {
+		if(pkt == &janus_ice_dtls_alert) {
+			/* We can't lose this one, give the consumer some time to make room */
+			int retries = 0;
+			while(!janus_mpsc_queue_push(handle->queued_packets, pkt, priority) && retries < 100) {
+				g_usleep(1000);
+				retries++;
+			}
+		} else {
+			/* The queue is full, drop the packet, and if so configured
+			 * have the consumer get rid of the oldest packets too */
+			g_atomic_int_inc(&handle->queue_dropped);
+			if(send_queue_drop_oldest)
+				g_atomic_int_compare_and_exchange(&handle->queue_flush_pending, JANUS_ICE_QUEUE_FLUSH_NONE, JANUS_ICE_QUEUE_FLUSH_OLDEST);
+			janus_ice_queued_packet_free(pkt);
+		}
+	}
+	/* If a send worker is in charge of this handle, make sure it knows we have something */
+	janus_ice_send_worker *worker = g_atomic_pointer_get(&handle->send_worker);
+	if(worker != NULL && g_atomic_int_compare_and_exchange(&handle->send_scheduled, 0, 1))
+		g_async_queue_push(worker->ready, handle);
+}
+
 void janus_ice_relay_rtp(janus_ice_handle *handle, int video, char *buf, int len) {
 	if(!handle || buf == NULL || len < 1)
 		return;
@@ -4080,16 +5531,37 @@ void janus_ice_relay_rtp(janus_ice_handle *handle, int video, char *buf, int len
 			|| (video && !janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_HAS_VIDEO)))
 		return;
 	/* Queue this packet */
-	janus_ice_queued_packet *pkt = g_malloc(sizeof(janus_ice_queued_packet));
-	pkt->data = g_malloc(len);
+	janus_ice_queued_packet *pkt = janus_ice_queued_packet_alloc(len);
 	memcpy(pkt->data, buf, len);
 	pkt->length = len;
 	pkt->type = video ? JANUS_ICE_PACKET_VIDEO : JANUS_ICE_PACKET_AUDIO;
 	pkt->control = FALSE;
 	pkt->encrypted = FALSE;
 	pkt->retransmission = FALSE;
-	if(handle->queued_packets != NULL)
-		g_async_queue_push(handle->queued_packets, pkt);
+	janus_ice_packet_cache *cache = janus_ice_packet_cache_get();
+	cache->relayed++;
+	cache->copied += len;
+	janus_ice_queue_packet(handle, pkt, FALSE);
+}
+
+void janus_ice_relay_rtp_shared(janus_ice_handle *handle, int video, janus_rtp_shared_packet *packet, janus_rtp_header_override *override) {
+	if(!handle || packet == NULL || packet->buffer == NULL || packet->length < RTP_HEADER_SIZE || override == NULL)
+		return;
+	if((!video && !janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_HAS_AUDIO))
+			|| (video && !janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_HAS_VIDEO)))
+		return;
+	/* Queue a reference to this packet: we'll only copy it when it's time to encrypt it */
+	janus_ice_queued_packet *pkt = janus_ice_queued_packet_alloc(packet->length);
+	janus_rtp_shared_packet_ref(packet);
+	pkt->shared = packet;
+	pkt->override = *override;
+	pkt->length = packet->length;
+	pkt->type = video ? JANUS_ICE_PACKET_VIDEO : JANUS_ICE_PACKET_AUDIO;
+	pkt->control = FALSE;
+	pkt->encrypted = FALSE;
+	pkt->retransmission = FALSE;
+	janus_ice_packet_cache_get()->relayed++;
+	janus_ice_queue_packet(handle, pkt, FALSE);
 }
 
 void janus_ice_relay_rtcp_internal(janus_ice_handle *handle, int video, char *buf, int len, gboolean filter_rtcp) {
@@ -4119,16 +5591,14 @@ void janus_ice_relay_rtcp_internal(janus_ice_handle *handle, int video, char *bu
 			video ? stream->video_ssrc_peer[0] : stream->audio_ssrc_peer);
 	}
 	/* Queue this packet */
-	janus_ice_queued_packet *pkt = g_malloc(sizeof(janus_ice_queued_packet));
-	pkt->data = g_malloc(len);
+	janus_ice_queued_packet *pkt = janus_ice_queued_packet_alloc(rtcp_len);
 	memcpy(pkt->data, rtcp_buf, rtcp_len);
 	pkt->length = rtcp_len;
 	pkt->type = video ? JANUS_ICE_PACKET_VIDEO : JANUS_ICE_PACKET_AUDIO;
 	pkt->control = TRUE;
 	pkt->encrypted = FALSE;
 	pkt->retransmission = FALSE;
-	if(handle->queued_packets != NULL)
-		g_async_queue_push(handle->queued_packets, pkt);
+	janus_ice_queue_packet(handle, pkt, FALSE);
 	if(rtcp_buf != buf) {
 		/* We filtered the original packet, deallocate it */
 		g_free(rtcp_buf);
@@ -4144,16 +5614,29 @@ void janus_ice_relay_data(janus_ice_handle *handle, char *buf, int len) {
 	if(!handle || buf == NULL || len < 1)
 		return;
 	/* Queue this packet */
-	janus_ice_queued_packet *pkt = g_malloc(sizeof(janus_ice_queued_packet));
-	pkt->data = g_malloc(len);
+	janus_ice_queued_packet *pkt = janus_ice_queued_packet_alloc(len);
 	memcpy(pkt->data, buf, len);
 	pkt->length = len;
 	pkt->type = JANUS_ICE_PACKET_DATA;
 	pkt->control = FALSE;
 	pkt->encrypted = FALSE;
 	pkt->retransmission = FALSE;
-	if(handle->queued_packets != NULL)
-		g_async_queue_push(handle->queued_packets, pkt);
+	janus_ice_queue_packet(handle, pkt, FALSE);
+}
+
+void janus_ice_relay_data_shared(janus_ice_handle *handle, janus_plugin_data *data) {
+	if(!handle || data == NULL || data->buffer == NULL || data->length < 1)
+		return;
+	/* Queue a reference to this message: the packet itself only carries the metadata */
+	janus_ice_queued_packet *pkt = janus_ice_queued_packet_alloc(0);
+	janus_plugin_data_ref(data);
+	pkt->shared_data = data;
+	pkt->length = data->length;
+	pkt->type = JANUS_ICE_PACKET_DATA;
+	pkt->control = FALSE;
+	pkt->encrypted = FALSE;
+	pkt->retransmission = FALSE;
+	janus_ice_queue_packet(handle, pkt, FALSE);
 }
 #endif
 
@@ -4172,15 +5655,8 @@ void janus_ice_dtls_handshake_done(janus_ice_handle *handle, janus_ice_component
 			return;
 		}
 	}
-	/* Clear the queue before we wake the send thread */
-	janus_ice_queued_packet *pkt = NULL;
-	while(g_async_queue_length(handle->queued_packets) > 0) {
-		pkt = g_async_queue_try_pop(handle->queued_packets);
-		if(pkt != NULL && pkt != &janus_ice_dtls_alert) {
-			g_free(pkt->data);
-			g_free(pkt);
-		}
-	}
+	/* Have the send thread clear the queue before it starts sending */
+	g_atomic_int_set(&handle->queue_flush_pending, JANUS_ICE_QUEUE_FLUSH_ALL);
 	if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_READY)) {
 		/* Already notified */
 		janus_mutex_unlock(&handle->mutex);
@@ -25,6 +25,11 @@
 #include "sctp.h"
 #include "rtcp.h"
 #include "text2pcap.h"
+#include "mpscqueue.h"
+#include "bwe.h"
+#include "fec.h"
+#include "ssrctable.h"
+#include "timerwheel.h"
 #include "utils.h"
 #include "plugins/plugin.h"
 
@@ -118,6 +123,14 @@ void janus_set_max_nack_queue(uint mnq);
 /*! \brief Method to get the current max NACK value (i.e., the number of packets per handle to store for retransmissions)
  * @returns The current max NACK value */
 uint janus_get_max_nack_queue(void);
+/*! \brief Method to modify the size of the video retransmission rings (i.e., how many sent packets per handle can be indexed for NACKs)
+ * \note The size is rounded up to the next power of two: the max NACK value still
+ * limits how long packets are kept, this only puts a cap on how many can be stored
+ * @param[in] size The new size, between 64 and 65536 */
+void janus_set_retransmit_buffer_size(guint size);
+/*! \brief Method to get the current size of the video retransmission rings
+ * @returns The current size of the rings */
+guint janus_get_retransmit_buffer_size(void);
 /*! \brief Method to modify the no-media event timer (i.e., the number of seconds where no media arrives before Janus notifies this)
  * @param[in] timer The new timer value, in seconds */
 void janus_set_no_media_timer(uint timer);
@@ -130,12 +143,102 @@ void janus_set_rfc4588_enabled(gboolean enabled);
 /*! \brief Method to check whether the RFC4588 support is enabled
  * @returns TRUE if it's enabled, FALSE otherwise */
 gboolean janus_is_rfc4588_enabled(void);
+/*! \brief Method to configure the generation of forward error correction for outgoing video
+ * \note When enabled (an overhead higher than 0), the core offers RED and ULPFEC to peers
+ * that only receive video from Janus (e.g., subscribers), and if they're accepted, generates
+ * a FEC packet for every group of video packets it sends, so that the peer can recover
+ * losses without waiting for retransmissions
+ * @param[in] overhead The FEC overhead, as a percentage of the video packets (0 to disable, up to 100) */
+void janus_ice_set_fec_overhead(guint overhead);
+/*! \brief Method to get the current FEC overhead
+ * @returns The FEC overhead, or 0 if FEC generation is disabled */
+guint janus_ice_get_fec_overhead(void);
 /*! \brief Method to modify the event handler statistics period (i.e., the number of seconds that should pass before Janus notifies event handlers about media statistics for a PeerConnection)
  * @param[in] timer The new timer value, in seconds */
 void janus_ice_set_event_stats_period(int period);
 /*! \brief Method to get the current event handler statistics period (see above)
  * @returns The current event handler stats period */
 int janus_ice_get_event_stats_period(void);
+/*! \brief Method to configure the number of static event loops to use for handles (must be called before janus_ice_init)
+ * \note By default, as many loops as the available cores are spawned: passing 0 restores
+ * the legacy behaviour, where each handle spawns its own thread and GMainLoop for libnice
+ * @param[in] loops The number of static event loops to spawn */
+void janus_ice_set_static_event_loops(int loops);
+/*! \brief Method to get the number of static event loops in use
+ * @returns The number of static event loops, or 0 if each handle uses its own thread */
+int janus_ice_get_static_event_loops(void);
+/*! \brief Helper method to get a summary of the static event loops and how handles are distributed among them (for the Admin API)
+ * @returns A JSON array describing the static event loops */
+json_t *janus_ice_static_event_loops_info(void);
+/*! \brief Method to configure the number of send workers to use for outgoing media (must be called before janus_ice_init)
+ * \note By default no worker is used, and each handle spawns its own send thread instead
+ * @param[in] workers The number of send workers to spawn */
+void janus_ice_set_send_workers(int workers);
+/*! \brief Method to get the number of send workers in use
+ * @returns The number of send workers, or 0 if each handle uses its own send thread */
+int janus_ice_get_send_workers(void);
+/*! \brief Helper method to get a summary of the send workers and how handles are distributed among them (for the Admin API)
+ * @returns A JSON array describing the send workers */
+json_t *janus_ice_send_workers_info(void);
+/*! \brief Method to configure the size of the queue of outgoing packets of each handle
+ * @param[in] size The number of packets a queue can contain (rounded up to a power of two) */
+void janus_ice_set_send_queue_size(guint size);
+/*! \brief Method to get the size of the queue of outgoing packets of each handle
+ * @returns The size of the queues */
+guint janus_ice_get_send_queue_size(void);
+/*! \brief Method to configure what to do when a queue of outgoing packets is full
+ * \note New packets are always dropped when there's no room for them: when
+ * this is enabled, the oldest half of the queue is flushed as well, so that
+ * fresher media can get through
+ * @param[in] enabled Whether the oldest packets should be flushed too */
+void janus_ice_set_send_queue_drop_oldest(gboolean enabled);
+/*! \brief Method to check whether the oldest packets are flushed when a queue of outgoing packets is full
+ * @returns TRUE if the oldest packets are flushed, FALSE otherwise */
+gboolean janus_ice_is_send_queue_drop_oldest(void);
+/*! \brief Method to enable or disable batched egress
+ * \note When enabled, once ICE has selected a direct UDP pair for a handle, its outgoing
+ * media is sent on the underlying socket directly, in batches, using \c sendmmsg (and
+ * UDP GSO, where supported), rather than with a \c nice_agent_send call per packet
+ * @param[in] enabled Whether batched egress should be enabled */
+void janus_ice_set_egress_batching(gboolean enabled);
+/*! \brief Method to check whether batched egress is enabled
+ * @returns TRUE if batched egress is enabled, FALSE otherwise */
+gboolean janus_ice_is_egress_batching_enabled(void);
+/*! \brief Method to enable or disable send-side bandwidth estimation
+ * \note When enabled, outgoing RTP packets are stamped with a transport wide sequence
+ * number, for PeerConnections that negotiated the transport-wide-cc extension, and the
+ * feedback the peer sends back is used to estimate the available bandwidth, which plugins
+ * are notified about via the \c estimated_bandwidth callback
+ * @param[in] enabled Whether send-side bandwidth estimation should be enabled */
+void janus_ice_set_send_side_bwe(gboolean enabled);
+/*! \brief Method to check whether send-side bandwidth estimation is enabled
+ * @returns TRUE if send-side bandwidth estimation is enabled, FALSE otherwise */
+gboolean janus_ice_is_send_side_bwe_enabled(void);
+/*! \brief Method to configure outbound pacing of video
+ * \note When enabled (a multiplier higher than 0), outgoing video packets are not sent
+ * all at once when they come in bursts (e.g., keyframes), but spread at the specified
+ * multiple of the bitrate the peer can receive, as estimated by the core (send-side BWE)
+ * or reported by the peer (REMB). Audio, RTCP, data and retransmissions are never paced
+ * @param[in] multiplier The pacing multiplier (0 to disable pacing, otherwise at least 1.0) */
+void janus_ice_set_pacing_multiplier(gdouble multiplier);
+/*! \brief Method to get the current pacing multiplier
+ * @returns The pacing multiplier, or 0 if pacing is disabled */
+gdouble janus_ice_get_pacing_multiplier(void);
+/*! \brief Method to enable or disable batched ingress
+ * \note When enabled, once ICE is done with a direct UDP pair, rather than having libnice
+ * notify each incoming datagram separately, the core waits for the socket of the selected
+ * pair to be readable, and processes all the datagrams available (up to a limit) in a batch
+ * @param[in] enabled Whether batched ingress should be enabled */
+void janus_ice_set_ingress_batching(gboolean enabled);
+/*! \brief Method to check whether batched ingress is enabled
+ * @returns TRUE if batched ingress is enabled, FALSE otherwise */
+gboolean janus_ice_is_ingress_batching_enabled(void);
+/*! \brief Helper method to get the statistics of the pool of outgoing packets (for the Admin API)
+ * @returns A JSON object with the pool hits/misses, bytes currently in use and cached packets */
+json_t *janus_ice_packet_pool_info(void);
+/*! \brief Helper method to get the occupancy of the timer wheel of the handles watchdog (for the Admin API)
+ * @returns A JSON object with the tick, and the number of timers overall and in each level of the wheel */
+json_t *janus_ice_handles_watchdog_info(void);
 /*! \brief Method to check whether libnice debugging has been enabled (http://nice.freedesktop.org/libnice/libnice-Debug-messages.html)
  * @returns True if libnice debugging is enabled, FALSE otherwise */
 gboolean janus_ice_is_ice_debugging_enabled(void);
@@ -159,6 +262,12 @@ typedef struct janus_ice_stream janus_ice_stream;
 typedef struct janus_ice_component janus_ice_component;
 /*! \brief Helper to handle pending trickle candidates (e.g., when we're still waiting for an offer) */
 typedef struct janus_ice_trickle janus_ice_trickle;
+/*! \brief Static event loop, shared by several handles */
+typedef struct janus_ice_static_event_loop janus_ice_static_event_loop;
+/*! \brief Send worker, in charge of the outgoing media of several handles */
+typedef struct janus_ice_send_worker janus_ice_send_worker;
+/*! \brief Per-handle state of the outgoing media path (private to the ICE stack) */
+typedef struct janus_ice_send_context janus_ice_send_context;
 
 #define JANUS_ICE_HANDLE_WEBRTC_PROCESSING_OFFER	(1 << 0)
 #define JANUS_ICE_HANDLE_WEBRTC_START				(1 << 1)
@@ -178,6 +287,14 @@ typedef struct janus_ice_trickle janus_ice_trickle;
 #define JANUS_ICE_HANDLE_WEBRTC_ICE_RESTART			(1 << 17)
 #define JANUS_ICE_HANDLE_WEBRTC_RESEND_TRICKLES		(1 << 18)
 #define JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX			(1 << 19)
+#define JANUS_ICE_HANDLE_WEBRTC_ULPFEC				(1 << 20)
+
+/*! \brief No cleanup is scheduled on the static event loop */
+#define JANUS_ICE_STATIC_LOOP_CLEANUP_NONE		0
+/*! \brief A cleanup is scheduled on the static event loop, and holds the handle until it's done */
+#define JANUS_ICE_STATIC_LOOP_CLEANUP_PENDING	1
+/*! \brief The cleanup on the static event loop is done, the handle is not held anymore */
+#define JANUS_ICE_STATIC_LOOP_CLEANUP_DONE		2
 
 
 /*! \brief Janus media statistics
@@ -226,22 +343,80 @@ void janus_ice_notify_hangup(janus_ice_handle *handle, const char *reason);
 gboolean janus_plugin_session_is_alive(janus_plugin_session *plugin_session);
 
 
-/*! \brief A helper struct for determining when to send NACKs */
-typedef struct janus_seq_info {
-	gint64 ts;
-	guint16 seq;
-	guint16 state;
-	struct janus_seq_info *next;
-	struct janus_seq_info *prev;
-} janus_seq_info;
-void janus_seq_list_free(janus_seq_info **head);
-enum {
-	SEQ_MISSING,
-	SEQ_NACKED,
-	SEQ_GIVEUP,
-	SEQ_RECVED
+/*! \brief Number of recent sequence numbers tracked for NACK generation (must be a power of two, at least 32) */
+#define JANUS_SEQ_WINDOW_SIZE 256
+/*! \brief A helper struct for determining when to send NACKs
+ * \details Sliding window of the most recent sequence numbers of an SSRC:
+ * the state of each sequence number is tracked in bitmaps, whose bits are
+ * recycled as the highest sequence number we received moves forward */
+typedef struct janus_seq_window {
+	/*! \brief Bitmap of the sequence numbers we received */
+	guint32 received[JANUS_SEQ_WINDOW_SIZE/32];
+	/*! \brief Bitmap of the sequence numbers we sent a NACK for */
+	guint32 nacked[JANUS_SEQ_WINDOW_SIZE/32];
+	/*! \brief Bitmap of the sequence numbers we gave up on (after a second NACK) */
+	guint32 giveup[JANUS_SEQ_WINDOW_SIZE/32];
+	/*! \brief NACK round in which each sequence number was found missing, or was NACKed */
+	guint8 round[JANUS_SEQ_WINDOW_SIZE];
+	/*! \brief Highest sequence number received so far */
+	guint16 highest;
+	/*! \brief How many sequence numbers the window currently covers (0 means we have to start fresh) */
+	guint16 tracked;
+	/*! \brief Current NACK round */
+	guint8 current_round;
+	/*! \brief Monotonic time of when the current NACK round started */
+	gint64 round_started;
+} janus_seq_window;
+/*! \brief Helper method to have a window start fresh from the next packet (e.g., when the SSRC changes)
+ * @param[in] win The janus_seq_window instance to reset (can be NULL) */
+void janus_seq_window_reset(janus_seq_window *win);
+
+/*! \brief Method to rebuild the table used to route incoming packets by SSRC
+ * \note This must be called any time the SSRCs of the peer change (e.g., after
+ * the SDP was processed, or when we learn them from the packets themselves)
+ * @param[in] stream The janus_ice_stream instance whose table should be updated */
+void janus_ice_stream_update_ssrc_table(janus_ice_stream *stream);
+
+
+/*! \brief Static event loop, shared by several handles
+ * \details Rather than having each handle spawn its own GMainLoop thread for libnice,
+ * DTLS timers and other per-handle sources, handles are pinned to one of these for
+ * their whole lifetime: this keeps the number of threads independent of the number
+ * of PeerConnections. */
+struct janus_ice_static_event_loop {
+	/*! \brief Index of this loop in the pool */
+	int id;
+	/*! \brief GLib context shared by all the handles assigned to this loop */
+	GMainContext *mainctx;
+	/*! \brief GLib loop shared by all the handles assigned to this loop */
+	GMainLoop *mainloop;
+	/*! \brief GLib thread running the loop */
+	GThread *thread;
+	/*! \brief Number of handles currently pinned to this loop */
+	volatile gint handles;
 };
 
+/*! \brief Send worker, in charge of the outgoing media of several handles
+ * \details Rather than having a thread per handle blocking on its queue of
+ * outgoing packets, workers are notified when a handle has something to
+ * send, and drain its queue in batches; periodic tasks (RTCP reports,
+ * NACK buffer cleanup, stats events) are scheduled on a timer wheel. */
+struct janus_ice_send_worker {
+	/*! \brief Index of this worker in the pool */
+	int id;
+	/*! \brief GLib thread running the worker */
+	GThread *thread;
+	/*! \brief Queue of handles that have packets to send */
+	GAsyncQueue *ready;
+	/*! \brief Timer wheel with the periodic tasks of the janus_ice_send_context instances served by this worker */
+	janus_timer_wheel *wheel;
+	/*! \brief Send contexts with video waiting in their pacer, served at every tick */
+	GList *paced;
+	/*! \brief Number of handles currently served by this worker */
+	volatile gint handles;
+	/*! \brief Whether this worker should stop */
+	volatile gint stop;
+};
 
 /*! \brief Janus ICE handle */
 struct janus_ice_handle {
@@ -267,6 +442,11 @@ struct janus_ice_handle {
 	GMainLoop *iceloop;
 	/*! \brief GLib thread for libnice */
 	GThread *icethread;
+	/*! \brief Static event loop this handle is pinned to, if any (NULL if it uses a dedicated thread) */
+	janus_ice_static_event_loop *static_event_loop;
+	/*! \brief State of the cleanup on the static event loop (one of the JANUS_ICE_STATIC_LOOP_CLEANUP_* values):
+	 * while it's pending, the scheduled cleanup holds the handle, and the watchdog won't free it */
+	volatile gint static_loop_cleanup;
 	/*! \brief libnice ICE agent */
 	NiceAgent *agent;
 	/*! \brief Monotonic time of when the ICE agent has been created */
@@ -296,11 +476,33 @@ struct janus_ice_handle {
 	/*! \brief List of pending trickle candidates (those we received before getting the JSEP offer) */
 	GList *pending_trickles;
 	/*! \brief Queue of outgoing packets to send */
-	GAsyncQueue *queued_packets;
+	janus_mpsc_queue *queued_packets;
+	/*! \brief Number of outgoing packets dropped because the queue was full */
+	volatile gint queue_dropped;
+	/*! \brief Number of outgoing packets flushed from the queue to make room for new ones */
+	volatile gint queue_flushed;
+	/*! \brief Whether the consumer of the queue has been asked to flush it */
+	volatile gint queue_flush_pending;
 	/*! \brief GLib thread for sending outgoing packets */
 	GThread *send_thread;
 	/*! \brief Atomic flag to make sure we only create the thread once */
 	volatile gint send_thread_created;
+	/*! \brief Send worker serving this handle, if any (NULL if it uses a dedicated send thread) */
+	janus_ice_send_worker *send_worker;
+	/*! \brief State of the outgoing media path, when served by a send worker */
+	janus_ice_send_context *send_ctx;
+	/*! \brief Atomic flag to check whether this handle is already in the ready queue of its send worker */
+	volatile gint send_scheduled;
+	/*! \brief Whether a new pair was selected, and the send path should check if it can send on it directly */
+	volatile gint egress_refresh;
+	/*! \brief Whether outgoing media is currently sent in batches on the socket of the selected pair */
+	volatile gint egress_fast_path;
+	/*! \brief Number of outgoing packets sent on the wire (RTP and RTCP) */
+	guint64 egress_packets;
+	/*! \brief Number of system calls used to send them */
+	guint64 egress_syscalls;
+	/*! \brief Number of outgoing packets of a batch the socket refused (e.g., because its buffer was full) */
+	guint64 egress_dropped;
 	/*! \brief Count of the recent SRTP replay errors, in order to avoid spamming the logs */
 	guint srtp_errors_count;
 	/*! \brief Count of the recent SRTP replay errors, in order to avoid spamming the logs */
@@ -309,6 +511,10 @@ struct janus_ice_handle {
 	volatile gint dump_packets;
 	/*! \brief In case this session must be saved to text2pcap, the instance to dump packets to */
 	janus_text2pcap *text2pcap;
+	/*! \brief Timer of the handles watchdog, once the handle has been detached */
+	janus_timer_wheel_entry cleanup_timer;
+	/*! \brief Whether the handle is ready to be freed, when cleanup_timer expires */
+	gboolean cleanup_ready;
 	/*! \brief Mutex to lock/unlock the ICE session */
 	janus_mutex mutex;
 };
@@ -333,6 +539,8 @@ struct janus_ice_stream {
 	guint32 video_ssrc_peer[3], video_ssrc_peer_new[3], video_ssrc_peer_orig[3];
 	/*! \brief Video retransmissions SSRC(s) of the peer for this stream */
 	guint32 video_ssrc_peer_rtx[3], video_ssrc_peer_rtx_new[3], video_ssrc_peer_rtx_orig[3];
+	/*! \brief Table to route incoming packets by the SSRC of the peer (see janus_ice_stream_update_ssrc_table) */
+	janus_ssrc_table ssrc_table;
 	/*! \brief Array of RTP Stream IDs (for Firefox simulcasting, if enabled) */
 	char *rid[3];
 	/*! \brief RTP switching context(s) in case of renegotiations (audio+video and/or simulcast) */
@@ -345,6 +553,10 @@ struct janus_ice_stream {
 	GHashTable *rtx_payload_types;
 	/*! \brief RTP payload types of this stream */
 	gint audio_payload_type, video_payload_type, video_rtx_payload_type;
+	/*! \brief RED and ULPFEC payload types we offered for video, if we did */
+	gint video_red_payload_type, video_ulpfec_payload_type;
+	/*! \brief ULPFEC generator, if the peer accepted the RED and ULPFEC we offered */
+	janus_fec_context *fec;
 	/*! \brief Codecs used by this stream */
 	char *audio_codec, *video_codec;
 	/*! \brief Pointer to function to check if a packet is a keyframe (depends on negotiated codec) */
@@ -355,8 +567,6 @@ struct janus_ice_stream {
 	janus_rtcp_context *audio_rtcp_ctx;
 	/*! \brief RTCP context(s) for the video stream (may be simulcasting) */
 	janus_rtcp_context *video_rtcp_ctx[3];
-	/*! \brief Map(s) of the NACKed packets (to track retransmissions and avoid duplicates) */
-	GHashTable *rtx_nacked[3];
 	/*! \brief First received audio NTP timestamp */
 	gint64 audio_first_ntp_ts;
 	/*! \brief First received audio RTP timestamp */
@@ -373,6 +583,8 @@ struct janus_ice_stream {
 	gboolean do_transport_wide_cc;
 	/*! \brief Transport wide cc rtp ext ID */
 	guint transport_wide_cc_ext_id;
+	/*! \brief IDs of the RTP extensions negotiated for this stream, parsed once per incoming packet */
+	janus_rtp_extmap rtp_extmap;
 	/*! \brief Last received transport wide seq num */
 	guint32 transport_wide_cc_last_seq_num;
 	/*! \brief Last transport wide seq num sent on feedback */
@@ -383,6 +595,14 @@ struct janus_ice_stream {
 	guint transport_wide_cc_feedback_count;
 	/*! \brief GLib list of transport wide cc stats in reverse received order */
 	GSList *transport_wide_received_seq_nums;
+	/*! \brief Send-side bandwidth estimator, if enabled and transport wide cc was negotiated */
+	janus_bwe_context *bwe;
+	/*! \brief Last estimate the plugin was notified about */
+	guint32 bwe_notified;
+	/*! \brief When the plugin was last notified about the estimate */
+	gint64 bwe_notified_time;
+	/*! \brief Last bitrate the peer reported via REMB, if any */
+	guint32 remb_bitrate;
 	/*! \brief DTLS role of the gateway for this stream */
 	janus_dtls_role dtls_role;
 	/*! \brief Hashing algorhitm used by the peer for the DTLS certificate (e.g., "SHA-256") */
@@ -403,7 +623,30 @@ struct janus_ice_stream {
 	janus_mutex mutex;
 };
 
-#define LAST_SEQS_MAX_LEN 160
+/*! \brief Slot of a ring of previously sent RTP packets */
+typedef struct janus_ice_retransmit_slot {
+	/*! \brief The stored packet, if any */
+	struct janus_ice_queued_packet *packet;
+	/*! \brief Sequence number of the stored packet */
+	guint16 seq;
+	/*! \brief Monotonic time of when the packet was stored */
+	gint64 created;
+	/*! \brief Monotonic time of when the packet was last retransmitted */
+	gint64 last_retransmit;
+} janus_ice_retransmit_slot;
+
+/*! \brief Ring of previously sent RTP packets, indexed by sequence number, in case we receive NACKs */
+typedef struct janus_ice_retransmit_buffer {
+	/*! \brief Array of slots (as many as a power of two) */
+	janus_ice_retransmit_slot *slots;
+	/*! \brief Mask to apply to sequence numbers to get the index of a slot (size-1) */
+	guint16 mask;
+	/*! \brief Number of packets currently stored */
+	guint count;
+	/*! \brief Oldest and newest sequence numbers in the window covered by the ring */
+	guint16 oldest, newest;
+} janus_ice_retransmit_buffer;
+
 /*! \brief Janus ICE component */
 struct janus_ice_component {
 	/*! \brief Janus ICE stream this component belongs to */
@@ -432,16 +675,20 @@ struct janus_ice_component {
 	gint64 icefailed_detected;
 	/*! \brief Re-transmission timer for DTLS */
 	GSource *dtlsrt_source;
+	/*! \brief Source reading batches of incoming packets on the socket of the selected pair, when batched ingress is in use */
+	GSource *ingress_source;
+	/*! \brief Number of times the ingress source woke up to read a batch of packets */
+	guint64 ingress_wakeups;
+	/*! \brief Number of packets received in batches */
+	guint64 ingress_packets;
 	/*! \brief DTLS-SRTP stack */
 	janus_dtls_srtp *dtls;
 	/*! \brief Whether we should do NACKs (in or out) for audio */
 	gboolean do_audio_nacks;
 	/*! \brief Whether we should do NACKs (in or out) for video */
 	gboolean do_video_nacks;
-	/*! \brief List of previously sent janus_rtp_packet RTP packets, in case we receive NACKs */
-	GQueue *audio_retransmit_buffer, *video_retransmit_buffer;
-	/*! \brief HashTable of retransmittable sequence numbers, in case we receive NACKs */
-	GHashTable *audio_retransmit_seqs, *video_retransmit_seqs;
+	/*! \brief Rings of previously sent RTP packets, in case we receive NACKs */
+	janus_ice_retransmit_buffer *audio_retransmit_buffer, *video_retransmit_buffer;
 	/*! \brief Current sequence number for the RFC4588 rtx SSRC session */
 	guint16 rtx_seq_number;
 	/*! \brief Last time a log message about sending retransmits was printed */
@@ -452,14 +699,20 @@ struct janus_ice_component {
 	gint64 nack_sent_log_ts;
 	/*! \brief Number of NACKs sent since last log message */
 	guint nack_sent_recent_cnt;
-	/*! \brief List of recently received audio sequence numbers (as a support to NACK generation) */
-	janus_seq_info *last_seqs_audio;
-	/*! \brief List of recently received video sequence numbers (as a support to NACK generation, for each simulcast SSRC) */
-	janus_seq_info *last_seqs_video[3];
+	/*! \brief Window of recently received audio sequence numbers (as a support to NACK generation) */
+	janus_seq_window *audio_seq_window;
+	/*! \brief Windows of recently received video sequence numbers (as a support to NACK generation, for each simulcast SSRC) */
+	janus_seq_window *video_seq_window[3];
 	/*! \brief Stats for incoming data (audio/video/data) */
 	janus_ice_stats in_stats;
 	/*! \brief Stats for outgoing data (audio/video/data) */
 	janus_ice_stats out_stats;
+	/*! \brief Number of video packets currently waiting in the pacer */
+	guint pacer_queued;
+	/*! \brief How long the last paced packet waited before being sent, in microseconds */
+	gint64 pacer_delay;
+	/*! \brief Number of video packets the pacer dropped, as they waited for too long */
+	guint32 pacer_dropped;
 	/*! \brief Helper flag to avoid flooding the console with the same error all over again */
 	gboolean noerrorlog;
 	/*! \brief Mutex to lock/unlock this component */
@@ -552,6 +805,13 @@ void janus_ice_component_free(janus_ice_component *component);
  * @param[in] buf The packet data (buffer)
  * @param[in] len The buffer lenght */
 void janus_ice_relay_rtp(janus_ice_handle *handle, int video, char *buf, int len);
+/*! \brief Gateway RTP callback, called when a plugin has an RTP packet shared with other peers to send to a peer
+ * \note The packet is only copied (and the header override applied) right before it's encrypted
+ * @param[in] handle The Janus ICE handle associated with the peer
+ * @param[in] video Whether this is an audio or a video frame
+ * @param[in] packet The shared RTP packet (the core takes its own reference)
+ * @param[in] override The changes to the RTP header for this peer */
+void janus_ice_relay_rtp_shared(janus_ice_handle *handle, int video, janus_rtp_shared_packet *packet, janus_rtp_header_override *override);
 /*! \brief Gateway RTCP callback, called when a plugin has an RTCP message to send to a peer
  * @param[in] handle The Janus ICE handle associated with the peer
  * @param[in] video Whether this is related to an audio or a video stream
@@ -563,11 +823,17 @@ void janus_ice_relay_rtcp(janus_ice_handle *handle, int video, char *buf, int le
  * @param[in] buf The message data (buffer)
  * @param[in] len The buffer lenght */
 void janus_ice_relay_data(janus_ice_handle *handle, char *buf, int len);
+/*! \brief Gateway SCTP/DataChannel callback, called when a plugin has a shared (text or binary) message to send to a peer
+ * \note The message is not copied: the send thread hands it to the SCTP stack as it is
+ * @param[in] handle The Janus ICE handle associated with the peer
+ * @param[in] data The shared message (the core takes its own reference) */
+void janus_ice_relay_data_shared(janus_ice_handle *handle, janus_plugin_data *data);
 /*! \brief Plugin SCTP/DataChannel callback, called by the SCTP stack when when there's data for a plugin
  * @param[in] handle The Janus ICE handle associated with the peer
  * @param[in] buffer The message data (buffer)
- * @param[in] length The buffer lenght */
-void janus_ice_incoming_data(janus_ice_handle *handle, char *buffer, int length);
+ * @param[in] length The buffer lenght
+ * @param[in] binary Whether this is a binary message (text otherwise) */
+void janus_ice_incoming_data(janus_ice_handle *handle, char *buffer, int length, gboolean binary);
 ///@}
 
 
@@ -37,6 +37,7 @@
 #include "auth.h"
 #include "record.h"
 #include "events.h"
+#include "shardedmap.h"
 
 
 #define JANUS_NAME				"Janus WebRTC Gateway"
@@ -373,6 +374,32 @@ static GAsyncQueue *requests = NULL;
 static janus_request exit_message;
 static GThreadPool *tasks = NULL;
 void janus_transport_task(gpointer data, gpointer user_data);
+
+/* Optionally, rather than going through a single thread (and the thread
+ * pool for plugin messages), requests can be dispatched to a set of workers:
+ * requests are hashed by session ID, so that the requests of each session
+ * are handled in order, while different sessions are handled in parallel */
+typedef struct janus_request_worker {
+	guint id;
+	GThread *thread;
+	GAsyncQueue *queue;
+	volatile gint processed;
+} janus_request_worker;
+static janus_request_worker *request_workers = NULL;
+static guint request_workers_num = 0;
+static volatile gint request_workers_next = 0;
+
+/* Latency of requests (from when transports handed them to us to when we
+ * processed them), as histograms per request type: buckets are in ms */
+static const char *janus_request_stats_types[] = {
+	"create", "attach", "message", "trickle", "keepalive", "detach",
+	"destroy", "hangup", "claim", "info", "ping", "other", "admin"
+};
+#define JANUS_REQUEST_STATS_TYPES	G_N_ELEMENTS(janus_request_stats_types)
+static const gint64 janus_request_stats_buckets[] = { 1, 5, 10, 50, 100, 500, 1000 };
+#define JANUS_REQUEST_STATS_BUCKETS	(G_N_ELEMENTS(janus_request_stats_buckets)+1)
+static volatile gint janus_request_stats[JANUS_REQUEST_STATS_TYPES][JANUS_REQUEST_STATS_BUCKETS];
+static json_t *janus_request_stats_info(void);
 ///@}
 
 
@@ -385,8 +412,10 @@ void janus_transport_task(gpointer data, gpointer user_data);
 int janus_plugin_push_event(janus_plugin_session *plugin_session, janus_plugin *plugin, const char *transaction, json_t *message, json_t *jsep);
 json_t *janus_plugin_handle_sdp(janus_plugin_session *plugin_session, janus_plugin *plugin, const char *sdp_type, const char *sdp, gboolean restart);
 void janus_plugin_relay_rtp(janus_plugin_session *plugin_session, int video, char *buf, int len);
+void janus_plugin_relay_rtp_shared(janus_plugin_session *plugin_session, int video, janus_rtp_shared_packet *packet, janus_rtp_header_override *override);
 void janus_plugin_relay_rtcp(janus_plugin_session *plugin_session, int video, char *buf, int len);
 void janus_plugin_relay_data(janus_plugin_session *plugin_session, char *buf, int len);
+void janus_plugin_relay_data_shared(janus_plugin_session *plugin_session, janus_plugin_data *data);
 void janus_plugin_close_pc(janus_plugin_session *plugin_session);
 void janus_plugin_end_session(janus_plugin_session *plugin_session);
 void janus_plugin_notify_event(janus_plugin *plugin, janus_plugin_session *plugin_session, json_t *event);
@@ -396,10 +425,13 @@ static janus_callbacks janus_handler_plugin =
 	{
 		.push_event = janus_plugin_push_event,
 		.relay_rtp = janus_plugin_relay_rtp,
+		.relay_rtp_shared = janus_plugin_relay_rtp_shared,
 		.relay_rtcp = janus_plugin_relay_rtcp,
 		.relay_data = janus_plugin_relay_data,
+		.relay_data_shared = janus_plugin_relay_data_shared,
 		.close_pc = janus_plugin_close_pc,
 		.end_session = janus_plugin_end_session,
+		.send_side_bwe_is_enabled = janus_ice_is_send_side_bwe_enabled,
 		.events_is_enabled = janus_events_is_enabled,
 		.notify_event = janus_plugin_notify_event,
 		.auth_is_signature_valid = janus_plugin_auth_is_signature_valid,
@@ -408,10 +440,38 @@ static janus_callbacks janus_handler_plugin =
 ///@}
 
 
-/* Gateway Sessions */
+/* Gateway Sessions: the map is split in shards, each with its own lock, so
+ * that lookups from different transport threads don't serialize on a single
+ * mutex. sessions_mutex still serializes session creation and destruction,
+ * the watchdog and old_sessions: when both are needed, it's locked first */
+#define JANUS_SESSIONS_SHARDS_BITS	4
+static janus_sharded_map *sessions = NULL;
 static janus_mutex sessions_mutex;
-static GHashTable *sessions = NULL, *old_sessions = NULL;
+static GHashTable *old_sessions = NULL;
+
+/* Filter for janus_sharded_map_list, to get the sessions originated by a transport instance */
+static gboolean janus_sessions_from_transport(gpointer value, gpointer user_data) {
+	janus_session *session = (janus_session *)value;
+	if(g_atomic_int_get(&session->destroy) || g_atomic_int_get(&session->timeout) || session->last_activity == 0)
+		return FALSE;
+	return (session->source != NULL && session->source->instance == user_data);
+}
 static GMainContext *sessions_watchdog_context = NULL;
+/* Sessions are put on a timer wheel (protected by sessions_mutex), so that
+ * the watchdog only checks the ones that may have timed out in each tick */
+static janus_timer_wheel *sessions_wheel = NULL;
+#define JANUS_SESSIONS_CHECK_INTERVAL	G_USEC_PER_SEC
+
+/* Helper to (re)schedule the timeout timer of a session: must be called with sessions_mutex locked */
+static void janus_session_schedule_timeout(janus_session *session) {
+	if(session_timeout < 1) {
+		/* Session timeouts are disabled */
+		janus_timer_wheel_cancel(sessions_wheel, &session->timer);
+		return;
+	}
+	janus_timer_wheel_schedule(sessions_wheel, &session->timer,
+		session->last_activity + (gint64)session_timeout * G_USEC_PER_SEC);
+}
 
 
 static gboolean janus_cleanup_session(gpointer user_data) {
@@ -431,23 +491,35 @@ static void janus_session_schedule_destruction(janus_session *session,
 		janus_mutex_lock(&sessions_mutex);
 	/* Schedule the session for deletion */
 	janus_mutex_lock(&session->mutex);
-	/* Remove all handles */
-	if(session->ice_handles != NULL && g_hash_table_size(session->ice_handles) > 0) {
+	/* Remove all handles (janus_ice_handle_destroy looks them up, so we
+	 * can't hold handles_mutex while destroying them) */
+	GList *handles = NULL;
+	janus_mutex_lock(&session->handles_mutex);
+	if(session->ice_handles != NULL && g_hash_table_size(session->ice_handles) > 0 && !g_atomic_int_get(&stop)) {
 		GHashTableIter iter;
 		gpointer value;
 		g_hash_table_iter_init(&iter, session->ice_handles);
 		while(g_hash_table_iter_next(&iter, NULL, &value)) {
 			janus_ice_handle *h = value;
-			if(!h || g_atomic_int_get(&stop)) {
-				continue;
-			}
-			janus_ice_handle_destroy(session, h->handle_id);
-			g_hash_table_iter_remove(&iter);
+			if(h != NULL)
+				handles = g_list_prepend(handles, janus_uint64_dup(h->handle_id));
 		}
 	}
+	janus_mutex_unlock(&session->handles_mutex);
+	GList *l = handles;
+	while(l != NULL) {
+		guint64 *handle_id = (guint64 *)l->data;
+		janus_ice_handle_destroy(session, *handle_id);
+		janus_mutex_lock(&session->handles_mutex);
+		g_hash_table_remove(session->ice_handles, handle_id);
+		janus_mutex_unlock(&session->handles_mutex);
+		l = l->next;
+	}
+	g_list_free_full(handles, (GDestroyNotify)g_free);
 	janus_mutex_unlock(&session->mutex);
+	janus_timer_wheel_cancel(sessions_wheel, &session->timer);
 	if(remove_key)
-		g_hash_table_remove(sessions, &session->session_id);
+		janus_sharded_map_remove(sessions, session->session_id);
 	g_hash_table_replace(old_sessions, janus_uint64_dup(session->session_id), session);
 	GSource *timeout_source = g_timeout_source_new_seconds(3);
 	g_source_set_callback(timeout_source, janus_cleanup_session, session, NULL);
@@ -461,55 +533,71 @@ static void janus_session_schedule_destruction(janus_session *session,
 }
 
 static gboolean janus_check_sessions(gpointer user_data) {
-	if(session_timeout < 1)		/* Session timeouts are disabled */
-		return G_SOURCE_CONTINUE;
 	janus_mutex_lock(&sessions_mutex);
-	if(sessions && g_hash_table_size(sessions) > 0) {
-		GHashTableIter iter;
-		gpointer value;
-		g_hash_table_iter_init(&iter, sessions);
-		while (g_hash_table_iter_next(&iter, NULL, &value)) {
-			janus_session *session = (janus_session *) value;
-			if (!session || g_atomic_int_get(&session->destroy)) {
-				continue;
-			}
-			gint64 now = janus_get_monotonic_time();
-			if (now - session->last_activity >= (gint64)session_timeout * G_USEC_PER_SEC &&
-					!g_atomic_int_compare_and_exchange(&session->timeout, 0, 1)) {
-				JANUS_LOG(LOG_INFO, "Timeout expired for session %"SCNu64"...\n", session->session_id);
-				/* Mark the session as over, we'll deal with it later */
-				janus_session_schedule_destruction(session, FALSE, FALSE, FALSE);
-				/* Notify the transport */
-				if(session->source) {
-					json_t *event = json_object();
-					json_object_set_new(event, "janus", json_string("timeout"));
-					json_object_set_new(event, "session_id", json_integer(session->session_id));
-					/* Send this to the transport client */
-					session->source->transport->send_message(session->source->instance, NULL, FALSE, event);
-					/* Notify the transport plugin about the session timeout */
-					session->source->transport->session_over(session->source->instance, session->session_id, TRUE);
-				}
-				/* Notify event handlers as well */
-				if(janus_events_is_enabled())
-					janus_events_notify_handlers(JANUS_EVENT_TYPE_SESSION, session->session_id, "timeout", NULL);
-
-				/* FIXME Is this safe? apparently it causes hash table errors on the console */
-				g_hash_table_iter_remove(&iter);
-				g_hash_table_replace(old_sessions, janus_uint64_dup(session->session_id), session);
-			}
+	gint64 now = janus_get_monotonic_time();
+	GList *expired = janus_timer_wheel_advance(sessions_wheel, now), *l = expired;
+	while(l != NULL) {
+		janus_timer_wheel_entry *timer = (janus_timer_wheel_entry *)l->data;
+		janus_session *session = (janus_session *)timer->data;
+		l = l->next;
+		if(g_atomic_int_get(&session->destroy) || session_timeout < 1)
+			continue;
+		if(now - session->last_activity < (gint64)session_timeout * G_USEC_PER_SEC) {
+			/* There's been some activity since the timer was scheduled, check again later */
+			janus_session_schedule_timeout(session);
+			continue;
+		}
+		if(!g_atomic_int_compare_and_exchange(&session->timeout, 0, 1))
+			continue;
+		JANUS_LOG(LOG_INFO, "Timeout expired for session %"SCNu64"...\n", session->session_id);
+		/* Mark the session as over, we'll deal with it later */
+		janus_session_schedule_destruction(session, FALSE, FALSE, FALSE);
+		/* Notify the transport */
+		if(session->source) {
+			json_t *event = json_object();
+			json_object_set_new(event, "janus", json_string("timeout"));
+			json_object_set_new(event, "session_id", json_integer(session->session_id));
+			/* Send this to the transport client */
+			session->source->transport->send_message(session->source->instance, NULL, FALSE, event);
+			/* Notify the transport plugin about the session timeout */
+			session->source->transport->session_over(session->source->instance, session->session_id, TRUE);
 		}
+		/* Notify event handlers as well */
+		if(janus_events_is_enabled())
+			janus_events_notify_handlers(JANUS_EVENT_TYPE_SESSION, session->session_id, "timeout", NULL);
+
+		janus_sharded_map_remove(sessions, session->session_id);
+		g_hash_table_replace(old_sessions, janus_uint64_dup(session->session_id), session);
 	}
+	g_list_free(expired);
 	janus_mutex_unlock(&sessions_mutex);
 
 	return G_SOURCE_CONTINUE;
 }
 
+/* Helper to get the occupancy of the sessions timer wheel, for the Admin API */
+static json_t *janus_sessions_watchdog_info(void) {
+	json_t *info = json_object();
+	json_t *levels = json_array();
+	guint occupancy[JANUS_TIMER_WHEEL_LEVELS];
+	janus_mutex_lock(&sessions_mutex);
+	guint count = janus_timer_wheel_occupancy(sessions_wheel, occupancy);
+	janus_mutex_unlock(&sessions_mutex);
+	int i = 0;
+	for(i=0; i<JANUS_TIMER_WHEEL_LEVELS; i++)
+		json_array_append_new(levels, json_integer(occupancy[i]));
+	json_object_set_new(info, "tick", json_integer(JANUS_SESSIONS_CHECK_INTERVAL/1000));
+	json_object_set_new(info, "timers", json_integer(count));
+	json_object_set_new(info, "levels", levels);
+	return info;
+}
+
 static gpointer janus_sessions_watchdog(gpointer user_data) {
 	GMainLoop *loop = (GMainLoop *) user_data;
 	GMainContext *watchdog_context = g_main_loop_get_context(loop);
 	GSource *timeout_source;
 
-	timeout_source = g_timeout_source_new_seconds(2);
+	timeout_source = g_timeout_source_new(JANUS_SESSIONS_CHECK_INTERVAL/1000);
 	g_source_set_callback(timeout_source, janus_check_sessions, watchdog_context, NULL);
 	g_source_attach(timeout_source, watchdog_context);
 	g_source_unref(timeout_source);
@@ -539,18 +627,18 @@ janus_session *janus_session_create(guint64 session_id) {
 	g_atomic_int_set(&session->timeout, 0);
 	session->last_activity = janus_get_monotonic_time();
 	session->ice_handles = NULL;
+	janus_timer_wheel_entry_init(&session->timer, session);
 	janus_mutex_init(&session->mutex);
+	janus_mutex_init(&session->handles_mutex);
 	janus_mutex_lock(&sessions_mutex);
-	g_hash_table_insert(sessions, janus_uint64_dup(session->session_id), session);
+	janus_sharded_map_insert(sessions, session->session_id, session);
+	janus_session_schedule_timeout(session);
 	janus_mutex_unlock(&sessions_mutex);
 	return session;
 }
 
 janus_session *janus_session_find(guint64 session_id) {
-	janus_mutex_lock(&sessions_mutex);
-	janus_session *session = g_hash_table_lookup(sessions, &session_id);
-	janus_mutex_unlock(&sessions_mutex);
-	return session;
+	return (janus_session *)janus_sharded_map_lookup(sessions, session_id);
 }
 
 janus_session *janus_session_find_destroyed(guint64 session_id) {
@@ -592,10 +680,12 @@ void janus_session_free(janus_session *session) {
 	if(session == NULL)
 		return;
 	janus_mutex_lock(&session->mutex);
+	janus_mutex_lock(&session->handles_mutex);
 	if(session->ice_handles != NULL) {
 		g_hash_table_destroy(session->ice_handles);
 		session->ice_handles = NULL;
 	}
+	janus_mutex_unlock(&session->handles_mutex);
 	if(session->source != NULL) {
 		janus_request_destroy(session->source);
 		session->source = NULL;
@@ -614,6 +704,7 @@ janus_request *janus_request_new(janus_transport *transport, void *instance, voi
 	request->request_id = request_id;
 	request->admin = admin;
 	request->message = message;
+	request->received = janus_get_monotonic_time();
 	return request;
 }
 
@@ -867,7 +958,9 @@ int janus_process_incoming_request(janus_request *request) {
 		if((error = janus_ice_handle_attach_plugin(session, handle_id, plugin_t)) != 0) {
 			/* TODO Make error struct to pass verbose information */
 			janus_ice_handle_destroy(session, handle_id);
+			janus_mutex_lock(&session->handles_mutex);
 			g_hash_table_remove(session->ice_handles, &handle_id);
+			janus_mutex_unlock(&session->handles_mutex);
 			janus_mutex_unlock(&session->mutex);
 			JANUS_LOG(LOG_ERR, "Couldn't attach to plugin '%s', error '%d'\n", plugin_text, error);
 			ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_PLUGIN_ATTACH, "Couldn't attach to plugin: error '%d'", error);
@@ -915,7 +1008,9 @@ int janus_process_incoming_request(janus_request *request) {
 		}
 		janus_mutex_lock(&session->mutex);
 		int error = janus_ice_handle_destroy(session, handle_id);
+		janus_mutex_lock(&session->handles_mutex);
 		g_hash_table_remove(session->ice_handles, &handle_id);
+		janus_mutex_unlock(&session->handles_mutex);
 		janus_mutex_unlock(&session->mutex);
 
 		if(error != 0) {
@@ -1169,6 +1264,11 @@ int janus_process_incoming_request(janus_request *request) {
 					int transport_wide_cc_ext_id = janus_rtp_header_extension_get_id(jsep_sdp, JANUS_RTP_EXTMAP_TRANSPORT_WIDE_CC);
 					handle->stream->do_transport_wide_cc = TRUE;
 					handle->stream->transport_wide_cc_ext_id = transport_wide_cc_ext_id;
+					/* Take note of the other RTP extensions we'll parse for plugins too */
+					janus_rtp_extmap_from_sdp(jsep_sdp, &handle->stream->rtp_extmap);
+					/* If we estimate the bandwidth ourselves, we'll stamp outgoing packets too */
+					if(janus_ice_is_send_side_bwe_enabled() && handle->stream->rtp_extmap.transport_wide_cc > 0 && handle->stream->bwe == NULL)
+						handle->stream->bwe = janus_bwe_context_create(JANUS_BWE_START_BITRATE, JANUS_BWE_MIN_BITRATE, JANUS_BWE_MAX_BITRATE);
 				}
 			} else {
 				/* FIXME This is a renegotiation: we can currently only handle simple changes in media
@@ -1491,7 +1591,33 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			json_object_set_new(status, "locking_debug", lock_debug ? json_true() : json_false());
 			json_object_set_new(status, "libnice_debug", janus_ice_is_ice_debugging_enabled() ? json_true() : json_false());
 			json_object_set_new(status, "max_nack_queue", json_integer(janus_get_max_nack_queue()));
+			json_object_set_new(status, "retransmit_buffer_size", json_integer(janus_get_retransmit_buffer_size()));
 			json_object_set_new(status, "no_media_timer", json_integer(janus_get_no_media_timer()));
+			json_object_set_new(status, "static_event_loops", json_integer(janus_ice_get_static_event_loops()));
+			if(janus_ice_get_static_event_loops() > 0)
+				json_object_set_new(status, "event_loops", janus_ice_static_event_loops_info());
+			json_object_set_new(status, "send_workers", json_integer(janus_ice_get_send_workers()));
+			if(janus_ice_get_send_workers() > 0)
+				json_object_set_new(status, "send_workers_load", janus_ice_send_workers_info());
+			json_object_set_new(status, "dtls_workers", json_integer(janus_dtls_get_handshake_workers()));
+			if(janus_dtls_get_handshake_workers() > 0)
+				json_object_set_new(status, "dtls_handshakes", janus_dtls_handshake_workers_info());
+#ifdef HAVE_SCTP
+			json_object_set_new(status, "sctp_workers", json_integer(janus_sctp_get_workers()));
+#endif
+			json_object_set_new(status, "packet_pool", janus_ice_packet_pool_info());
+			json_object_set_new(status, "send_queue_size", json_integer(janus_ice_get_send_queue_size()));
+			json_object_set_new(status, "send_queue_drop", json_string(janus_ice_is_send_queue_drop_oldest() ? "oldest" : "newest"));
+			json_object_set_new(status, "egress_batching", janus_ice_is_egress_batching_enabled() ? json_true() : json_false());
+			json_object_set_new(status, "ingress_batching", janus_ice_is_ingress_batching_enabled() ? json_true() : json_false());
+			json_object_set_new(status, "send_side_bwe", janus_ice_is_send_side_bwe_enabled() ? json_true() : json_false());
+			json_object_set_new(status, "pacing_multiplier", json_real(janus_ice_get_pacing_multiplier()));
+			json_object_set_new(status, "fec_overhead", json_integer(janus_ice_get_fec_overhead()));
+			json_t *wheels = json_object();
+			json_object_set_new(wheels, "sessions", janus_sessions_watchdog_info());
+			json_object_set_new(wheels, "handles", janus_ice_handles_watchdog_info());
+			json_object_set_new(status, "timer_wheels", wheels);
+			json_object_set_new(status, "requests", janus_request_stats_info());
 			json_object_set_new(reply, "status", status);
 			/* Send the success reply */
 			ret = janus_process_success(request, reply);
@@ -1511,7 +1637,18 @@ int janus_process_incoming_admin_request(janus_request *request) {
 				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_INVALID_ELEMENT_TYPE, "Invalid element type (timeout should be a positive integer)");
 				goto jsondone;
 			}
+			janus_mutex_lock(&sessions_mutex);
 			session_timeout = timeout_num;
+			/* Reschedule (or cancel) the timers of all sessions accordingly */
+			GList *list = janus_sharded_map_list(sessions, NULL, NULL, FALSE), *l = list;
+			while(l != NULL) {
+				janus_session *timed_session = (janus_session *)l->data;
+				if(!g_atomic_int_get(&timed_session->destroy))
+					janus_session_schedule_timeout(timed_session);
+				l = l->next;
+			}
+			g_list_free(list);
+			janus_mutex_unlock(&sessions_mutex);
 			/* Prepare JSON reply */
 			json_t *reply = json_object();
 			json_object_set_new(reply, "janus", json_string("success"));
@@ -1706,20 +1843,15 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			/* List sessions */
 			session_id = 0;
 			json_t *list = json_array();
-			if(sessions != NULL && g_hash_table_size(sessions) > 0) {
-				janus_mutex_lock(&sessions_mutex);
-				GHashTableIter iter;
-				gpointer value;
-				g_hash_table_iter_init(&iter, sessions);
-				while (g_hash_table_iter_next(&iter, NULL, &value)) {
-					janus_session *session = value;
-					if(session == NULL) {
-						continue;
-					}
-					json_array_append_new(list, json_integer(session->session_id));
-				}
-				janus_mutex_unlock(&sessions_mutex);
+			janus_mutex_lock(&sessions_mutex);
+			GList *sessions_list = janus_sharded_map_list(sessions, NULL, NULL, FALSE), *l = sessions_list;
+			while(l != NULL) {
+				janus_session *session = (janus_session *)l->data;
+				json_array_append_new(list, json_integer(session->session_id));
+				l = l->next;
 			}
+			g_list_free(sessions_list);
+			janus_mutex_unlock(&sessions_mutex);
 			/* Prepare JSON reply */
 			json_t *reply = json_object();
 			json_object_set_new(reply, "janus", json_string("success"));
@@ -2102,7 +2234,7 @@ int janus_process_incoming_admin_request(janus_request *request) {
 		}
 		/* List handles */
 		json_t *list = json_array();
-		janus_mutex_lock(&session->mutex);
+		janus_mutex_lock(&session->handles_mutex);
 		if(session->ice_handles != NULL && g_hash_table_size(session->ice_handles) > 0) {
 			GHashTableIter iter;
 			gpointer value;
@@ -2115,7 +2247,7 @@ int janus_process_incoming_admin_request(janus_request *request) {
 				json_array_append_new(list, json_integer(handle->handle_id));
 			}
 		}
-		janus_mutex_unlock(&session->mutex);
+		janus_mutex_unlock(&session->handles_mutex);
 		/* Prepare JSON reply */
 		json_t *reply = json_object();
 		json_object_set_new(reply, "janus", json_string("success"));
@@ -2227,6 +2359,7 @@ int janus_process_incoming_admin_request(janus_request *request) {
 		json_object_set_new(flags, "has-audio", janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_HAS_AUDIO) ? json_true() : json_false());
 		json_object_set_new(flags, "has-video", janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_HAS_VIDEO) ? json_true() : json_false());
 		json_object_set_new(flags, "rfc4588-rtx", janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX) ? json_true() : json_false());
+		json_object_set_new(flags, "ulpfec", janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ULPFEC) ? json_true() : json_false());
 		json_object_set_new(flags, "cleaning", janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_CLEANING) ? json_true() : json_false());
 		json_object_set_new(info, "flags", flags);
 		if(handle->agent) {
@@ -2245,7 +2378,31 @@ int janus_process_incoming_admin_request(janus_request *request) {
 		if(handle->pending_trickles)
 			json_object_set_new(info, "pending-trickles", json_integer(g_list_length(handle->pending_trickles)));
 		if(handle->queued_packets)
-			json_object_set_new(info, "queued-packets", json_integer(g_async_queue_length(handle->queued_packets)));
+			json_object_set_new(info, "queued-packets", json_integer(janus_mpsc_queue_length(handle->queued_packets)));
+		json_object_set_new(info, "dropped-packets", json_integer(g_atomic_int_get(&handle->queue_dropped)));
+		json_object_set_new(info, "flushed-packets", json_integer(g_atomic_int_get(&handle->queue_flushed)));
+		if(handle->static_event_loop)
+			json_object_set_new(info, "event-loop", json_integer(handle->static_event_loop->id));
+		if(handle->send_worker)
+			json_object_set_new(info, "send-worker", json_integer(handle->send_worker->id));
+		json_t *egress = json_object();
+		json_object_set_new(egress, "batched", g_atomic_int_get(&handle->egress_fast_path) ? json_true() : json_false());
+		json_object_set_new(egress, "packets", json_integer(handle->egress_packets));
+		json_object_set_new(egress, "syscalls", json_integer(handle->egress_syscalls));
+		json_object_set_new(egress, "dropped", json_integer(handle->egress_dropped));
+		if(handle->egress_packets > 0)
+			json_object_set_new(egress, "syscalls-per-packet", json_real((double)handle->egress_syscalls/(double)handle->egress_packets));
+		json_object_set_new(info, "egress", egress);
+		if(handle->stream && handle->stream->component) {
+			janus_ice_component *component = handle->stream->component;
+			json_t *ingress = json_object();
+			json_object_set_new(ingress, "batched", g_atomic_pointer_get(&component->ingress_source) ? json_true() : json_false());
+			json_object_set_new(ingress, "packets", json_integer(component->ingress_packets));
+			json_object_set_new(ingress, "wakeups", json_integer(component->ingress_wakeups));
+			if(component->ingress_wakeups > 0)
+				json_object_set_new(ingress, "packets-per-wakeup", json_real((double)component->ingress_packets/(double)component->ingress_wakeups));
+			json_object_set_new(info, "ingress", ingress);
+		}
 		if(g_atomic_int_get(&handle->dump_packets)) {
 			json_object_set_new(info, "dump-to-text2pcap", json_true());
 			if(handle->text2pcap && handle->text2pcap->filename)
@@ -2380,6 +2537,10 @@ json_t *janus_admin_stream_summary(janus_ice_stream *stream) {
 			json_object_set_new(sc, "video-pt", json_integer(stream->video_payload_type));
 		if(stream->video_rtx_payload_type > -1)
 			json_object_set_new(sc, "video-rtx-pt", json_integer(stream->video_rtx_payload_type));
+		if(stream->fec != NULL) {
+			json_object_set_new(sc, "video-red-pt", json_integer(stream->video_red_payload_type));
+			json_object_set_new(sc, "video-ulpfec-pt", json_integer(stream->video_ulpfec_payload_type));
+		}
 		if(stream->video_codec != NULL)
 			json_object_set_new(sc, "video-codec", json_string(stream->video_codec));
 		json_object_set_new(s, "codecs", sc);
@@ -2431,6 +2592,26 @@ json_t *janus_admin_stream_summary(janus_ice_stream *stream) {
 				json_object_set_new(rtcp_stats, "video-sim2", video_rtcp_stats);
 		}
 	}
+	if(stream->bwe != NULL) {
+		guint32 acked_bitrate = 0;
+		guint8 loss_fraction = 0;
+		janus_bwe_usage usage = janus_bwe_usage_normal;
+		guint32 estimate = janus_bwe_get_status(stream->bwe, &acked_bitrate, &loss_fraction, &usage);
+		json_t *bwe = json_object();
+		json_object_set_new(bwe, "estimate", json_integer(estimate));
+		json_object_set_new(bwe, "acked-bitrate", json_integer(acked_bitrate));
+		json_object_set_new(bwe, "loss-fraction", json_integer(loss_fraction));
+		json_object_set_new(bwe, "usage", json_string(janus_bwe_usage_str(usage)));
+		json_object_set_new(s, "bwe", bwe);
+	}
+	if(stream->fec != NULL) {
+		json_t *fec = json_object();
+		json_object_set_new(fec, "active", janus_flags_is_set(&stream->handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ULPFEC) ? json_true() : json_false());
+		json_object_set_new(fec, "group-size", json_integer(stream->fec->group_size));
+		json_object_set_new(fec, "media-packets", json_integer(stream->fec->media_packets));
+		json_object_set_new(fec, "fec-packets", json_integer(stream->fec->fec_packets));
+		json_object_set_new(s, "fec", fec);
+	}
 	if(rtcp_stats != NULL)
 		json_object_set_new(s, "rtcp_stats", rtcp_stats);
 	json_object_set_new(s, "components", components);
@@ -2542,6 +2723,13 @@ json_t *janus_admin_component_summary(janus_ice_component *component) {
 		json_object_set_new(d, "sctp-association", dtls->sctp ? json_true() : json_false());
 #endif
 	}
+	if(janus_ice_get_pacing_multiplier() > 0.0 || component->pacer_queued > 0 || component->pacer_dropped > 0) {
+		json_t *p = json_object();
+		json_object_set_new(p, "queued", json_integer(component->pacer_queued));
+		json_object_set_new(p, "queue-delay", json_integer(component->pacer_delay/1000));
+		json_object_set_new(p, "dropped", json_integer(component->pacer_dropped));
+		json_object_set_new(c, "pacer", p);
+	}
 	json_object_set_new(c, "dtls", d);
 	json_object_set_new(c, "in_stats", in_stats);
 	json_object_set_new(c, "out_stats", out_stats);
@@ -2570,6 +2758,20 @@ void janus_transport_incoming_request(janus_transport *plugin, void *transport,
 	JANUS_LOG(LOG_VERB, "Got %s API request from %s (%p)\n", admin ? "an admin" : "a Janus", plugin->get_package(), transport);
 	/* Create a janus_request instance to handle the request */
 	janus_request *request = janus_request_new(plugin, transport, request_id, admin, message);
+	if(request_workers_num > 0) {
+		/* Hash the request on a worker by session ID, requests with no session go round robin */
+		guint64 session_id = 0;
+		json_t *s = json_object_get(message, "session_id");
+		if(s && json_is_integer(s))
+			session_id = json_integer_value(s);
+		guint index = 0;
+		if(session_id > 0)
+			index = (guint)((session_id * G_GUINT64_CONSTANT(0x9E3779B97F4A7C15)) >> 32) % request_workers_num;
+		else
+			index = (guint)g_atomic_int_add(&request_workers_next, 1) % request_workers_num;
+		g_async_queue_push(request_workers[index].queue, request);
+		return;
+	}
 	/* Enqueue the request, the thread will pick it up */
 	g_async_queue_push(requests, request);
 }
@@ -2578,22 +2780,15 @@ void janus_transport_gone(janus_transport *plugin, void *transport) {
 	/* Get rid of sessions this transport was handling */
 	JANUS_LOG(LOG_VERB, "A %s transport instance has gone away (%p)\n", plugin->get_package(), transport);
 	janus_mutex_lock(&sessions_mutex);
-	if(sessions && g_hash_table_size(sessions) > 0) {
-		GHashTableIter iter;
-		gpointer value;
-		g_hash_table_iter_init(&iter, sessions);
-		while(g_hash_table_iter_next(&iter, NULL, &value)) {
-			janus_session *session = (janus_session *) value;
-			if(!session || g_atomic_int_get(&session->destroy) || g_atomic_int_get(&session->timeout) || session->last_activity == 0)
-				continue;
-			if(session->source && session->source->instance == transport) {
-				JANUS_LOG(LOG_VERB, "  -- Marking Session %"SCNu64" as over\n", session->session_id);
-				/* Mark the session as destroyed */
-				janus_session_schedule_destruction(session, FALSE, FALSE, FALSE);
-				g_hash_table_iter_remove(&iter);
-			}
-		}
+	GList *list = janus_sharded_map_list(sessions, janus_sessions_from_transport, transport, TRUE), *l = list;
+	while(l != NULL) {
+		janus_session *session = (janus_session *)l->data;
+		JANUS_LOG(LOG_VERB, "  -- Marking Session %"SCNu64" as over\n", session->session_id);
+		/* Mark the session as destroyed */
+		janus_session_schedule_destruction(session, FALSE, FALSE, FALSE);
+		l = l->next;
 	}
+	g_list_free(list);
 	janus_mutex_unlock(&sessions_mutex);
 }
 
@@ -2630,6 +2825,74 @@ void janus_transport_notify_event(janus_transport *plugin, void *transport, json
 	}
 }
 
+/* Helper to process a request, and update the latency statistics accordingly */
+static void janus_request_process(janus_request *request) {
+	/* Find out the type before processing, as the request may be modified in the process */
+	guint type = JANUS_REQUEST_STATS_TYPES-1;
+	if(!request->admin) {
+		const char *message_text = json_string_value(json_object_get(request->message, "janus"));
+		for(type=0; type<JANUS_REQUEST_STATS_TYPES-2; type++) {
+			if(message_text && !strcasecmp(message_text, janus_request_stats_types[type]))
+				break;
+		}
+		janus_process_incoming_request(request);
+	} else {
+		janus_process_incoming_admin_request(request);
+	}
+	gint64 latency = (janus_get_monotonic_time() - request->received)/1000;
+	guint bucket = 0;
+	while(bucket < JANUS_REQUEST_STATS_BUCKETS-1 && latency >= janus_request_stats_buckets[bucket])
+		bucket++;
+	g_atomic_int_inc(&janus_request_stats[type][bucket]);
+}
+
+/* Helper to get the request queues and latency statistics, for the Admin API */
+static json_t *janus_request_stats_info(void) {
+	json_t *info = json_object();
+	json_object_set_new(info, "workers", json_integer(request_workers_num));
+	if(request_workers_num > 0) {
+		json_t *queues = json_array();
+		guint i = 0;
+		for(i=0; i<request_workers_num; i++) {
+			json_t *queue = json_object();
+			json_object_set_new(queue, "id", json_integer(request_workers[i].id));
+			json_object_set_new(queue, "queued", json_integer(g_async_queue_length(request_workers[i].queue)));
+			json_object_set_new(queue, "processed", json_integer((guint)g_atomic_int_get(&request_workers[i].processed)));
+			json_array_append_new(queues, queue);
+		}
+		json_object_set_new(info, "queues", queues);
+	} else {
+		json_object_set_new(info, "queued", json_integer(g_async_queue_length(requests)));
+		json_object_set_new(info, "tasks", json_integer(g_thread_pool_unprocessed(tasks)));
+	}
+	json_t *latency = json_object();
+	guint type = 0, bucket = 0;
+	for(type=0; type<JANUS_REQUEST_STATS_TYPES; type++) {
+		json_t *histogram = json_object();
+		guint count = 0;
+		for(bucket=0; bucket<JANUS_REQUEST_STATS_BUCKETS; bucket++) {
+			guint value = (guint)g_atomic_int_get(&janus_request_stats[type][bucket]);
+			char name[20];
+			if(bucket < JANUS_REQUEST_STATS_BUCKETS-1)
+				g_snprintf(name, sizeof(name), "<%dms", (int)janus_request_stats_buckets[bucket]);
+			else
+				g_snprintf(name, sizeof(name), ">=%dms", (int)janus_request_stats_buckets[bucket-1]);
+			json_object_set_new(histogram, name, json_integer(value));
+			count += value;
+		}
+		if(count == 0) {
+			json_decref(histogram);
+			continue;
+		}
+		json_t *stats = json_object();
+		json_object_set_new(stats, "count", json_integer(count));
+		json_object_set_new(stats, "histogram", histogram);
+		json_object_set_new(latency, janus_request_stats_types[type], stats);
+	}
+	json_object_set_new(info, "latency", latency);
+	return info;
+}
+
 void janus_transport_task(gpointer data, gpointer user_data) {
 	JANUS_LOG(LOG_VERB, "Transport task pool, serving request\n");
 	janus_request *request = (janus_request *)data;
@@ -2637,14 +2900,29 @@ void janus_transport_task(gpointer data, gpointer user_data) {
 		JANUS_LOG(LOG_ERR, "Missing request\n");
 		return;
 	}
-	if(!request->admin)
-		janus_process_incoming_request(request);
-	else
-		janus_process_incoming_admin_request(request);
+	janus_request_process(request);
 	/* Done */
 	janus_request_destroy(request);
 }
 
+/* Thread to handle the requests hashed to a worker: everything, including
+ * plugin messages, is processed here in order */
+static void *janus_request_worker_thread(void *data) {
+	janus_request_worker *worker = (janus_request_worker *)data;
+	JANUS_LOG(LOG_INFO, "Joining Janus request worker #%u\n", worker->id);
+	janus_request *request = NULL;
+	while(!g_atomic_int_get(&stop)) {
+		request = g_async_queue_pop(worker->queue);
+		if(request == &exit_message)
+			break;
+		janus_request_process(request);
+		janus_request_destroy(request);
+		g_atomic_int_inc(&worker->processed);
+	}
+	JANUS_LOG(LOG_INFO, "Leaving Janus request worker #%u\n", worker->id);
+	return NULL;
+}
+
 
 /* Thread to handle incoming requests: may involve an asynchronous task for plugin messaging */
 static void *janus_transport_requests(void *data) {
@@ -2676,11 +2954,11 @@ static void *janus_transport_requests(void *data) {
 					destroy = FALSE;
 				}
 			} else {
-				janus_process_incoming_request(request);
+				janus_request_process(request);
 			}
 		} else {
 			/* Admin requests are always handled synchronously */
-			janus_process_incoming_admin_request(request);
+			janus_request_process(request);
 		}
 		/* Done */
 		if(destroy)
@@ -2891,6 +3169,11 @@ json_t *janus_plugin_handle_sdp(janus_plugin_session *plugin_session, janus_plug
 		int transport_wide_cc_ext_id = janus_rtp_header_extension_get_id(sdp, JANUS_RTP_EXTMAP_TRANSPORT_WIDE_CC);
 		ice_handle->stream->do_transport_wide_cc = TRUE;
 		ice_handle->stream->transport_wide_cc_ext_id = transport_wide_cc_ext_id;
+		/* Take note of the other RTP extensions we'll parse for plugins too */
+		janus_rtp_extmap_from_sdp(sdp, &ice_handle->stream->rtp_extmap);
+		/* If we estimate the bandwidth ourselves, we'll stamp outgoing packets too */
+		if(janus_ice_is_send_side_bwe_enabled() && ice_handle->stream->rtp_extmap.transport_wide_cc > 0 && ice_handle->stream->bwe == NULL)
+			ice_handle->stream->bwe = janus_bwe_context_create(JANUS_BWE_START_BITRATE, JANUS_BWE_MIN_BITRATE, JANUS_BWE_MAX_BITRATE);
 	}
 	if(!updating) {
 		/* Wait for candidates-done callback */
@@ -2954,6 +3237,27 @@ json_t *janus_plugin_handle_sdp(janus_plugin_session *plugin_session, janus_plug
 			g_list_free(rtx_ptypes);
 		}
 	}
+	if(offer && janus_ice_get_fec_overhead() > 0 && stream && stream->video_red_payload_type < 0) {
+		/* We'll offer RED and ULPFEC too, if we're only sending video: pick their payload types */
+		janus_sdp_mline *m = janus_sdp_mline_find(parsed_sdp, JANUS_SDP_VIDEO);
+		if(m && m->ptypes && m->port > 0 && m->direction == JANUS_SDP_SENDONLY) {
+			GList *rtx_ptypes = stream->rtx_payload_types ? g_hash_table_get_values(stream->rtx_payload_types) : NULL;
+			int fec_ptypes[2] = { -1, -1 };
+			int ptype = 127, found = 0;
+			for(ptype = 127; ptype >= 96 && found < 2; ptype--) {
+				if(g_list_find(m->ptypes, GINT_TO_POINTER(ptype)) || g_list_find(rtx_ptypes, GINT_TO_POINTER(ptype)))
+					continue;
+				fec_ptypes[found] = ptype;
+				found++;
+			}
+			g_list_free(rtx_ptypes);
+			if(found == 2) {
+				stream->video_red_payload_type = fec_ptypes[0];
+				stream->video_ulpfec_payload_type = fec_ptypes[1];
+				janus_flags_set(&ice_handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ULPFEC);
+			}
+		}
+	}
 	/* Enrich the SDP the plugin gave us with all the WebRTC related stuff */
 	char *sdp_merged = janus_sdp_merge(ice_handle, parsed_sdp, offer ? TRUE : FALSE);
 	if(sdp_merged == NULL) {
@@ -3068,6 +3372,16 @@ void janus_plugin_relay_rtp(janus_plugin_session *plugin_session, int video, cha
 	janus_ice_relay_rtp(handle, video, buf, len);
 }
 
+void janus_plugin_relay_rtp_shared(janus_plugin_session *plugin_session, int video, janus_rtp_shared_packet *packet, janus_rtp_header_override *override) {
+	if((plugin_session < (janus_plugin_session *)0x1000) || plugin_session->stopped || packet == NULL || override == NULL)
+		return;
+	janus_ice_handle *handle = (janus_ice_handle *)plugin_session->gateway_handle;
+	if(!handle || janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP)
+			|| janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT))
+		return;
+	janus_ice_relay_rtp_shared(handle, video, packet, override);
+}
+
 void janus_plugin_relay_rtcp(janus_plugin_session *plugin_session, int video, char *buf, int len) {
 	if((plugin_session < (janus_plugin_session *)0x1000) || plugin_session->stopped || buf == NULL || len < 1)
 		return;
@@ -3092,6 +3406,20 @@ void janus_plugin_relay_data(janus_plugin_session *plugin_session, char *buf, in
 #endif
 }
 
+void janus_plugin_relay_data_shared(janus_plugin_session *plugin_session, janus_plugin_data *data) {
+	if((plugin_session < (janus_plugin_session *)0x1000) || plugin_session->stopped || data == NULL || data->buffer == NULL || data->length < 1)
+		return;
+	janus_ice_handle *handle = (janus_ice_handle *)plugin_session->gateway_handle;
+	if(!handle || janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP)
+			|| janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT))
+		return;
+#ifdef HAVE_SCTP
+	janus_ice_relay_data_shared(handle, data);
+#else
+	JANUS_LOG(LOG_WARN, "Asked to relay data, but Data Channels support has not been compiled...\n");
+#endif
+}
+
 static gboolean janus_plugin_close_pc_internal(gpointer user_data) {
 	/* We actually enforce the close_pc here */
 	janus_plugin_session *plugin_session = (janus_plugin_session *) user_data;
@@ -3136,7 +3464,9 @@ static gboolean janus_plugin_end_session_internal(gpointer user_data) {
 	/* Destroy the handle */
 	janus_mutex_lock(&session->mutex);
 	janus_ice_handle_destroy(session, ice_handle->handle_id);
+	janus_mutex_lock(&session->handles_mutex);
 	g_hash_table_remove(session->ice_handles, &ice_handle->handle_id);
+	janus_mutex_unlock(&session->handles_mutex);
 	janus_mutex_unlock(&session->mutex);
 
 	return G_SOURCE_REMOVE;
@@ -3603,6 +3933,16 @@ gint main(int argc, char *argv[])
 			session_timeout = st;
 		}
 	}
+	/* Should requests be dispatched to a set of workers, rather than a single thread? */
+	item = janus_config_get_item_drilldown(config, "general", "request_workers");
+	if(item && item->value) {
+		int rw = atoi(item->value);
+		if(rw < 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring request_workers value as it's not a positive integer\n");
+		} else {
+			request_workers_num = rw;
+		}
+	}
 
 	/* Is there any API secret to consider? */
 	api_secret = NULL;
@@ -3723,6 +4063,72 @@ gint main(int argc, char *argv[])
 	if(item && item->value)
 		turn_rest_api_method = (char *)item->value;
 #endif
+	/* Number of static event loops to share among handles */
+	item = janus_config_get_item_drilldown(config, "media", "event_loops");
+	if(item && item->value) {
+		int el = atoi(item->value);
+		if(el < 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring event_loops value as it's not a positive integer\n");
+		} else {
+			janus_ice_set_static_event_loops(el);
+		}
+	}
+	/* Number of send workers to share among handles */
+	item = janus_config_get_item_drilldown(config, "media", "send_workers");
+	if(item && item->value) {
+		int sw = atoi(item->value);
+		if(sw < 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring send_workers value as it's not a positive integer\n");
+		} else {
+			janus_ice_set_send_workers(sw);
+		}
+	}
+	/* Size of the queues of outgoing packets, and what to do when they're full */
+	item = janus_config_get_item_drilldown(config, "media", "send_queue_size");
+	if(item && item->value) {
+		int sqs = atoi(item->value);
+		if(sqs <= 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring send_queue_size value as it's not a positive integer\n");
+		} else {
+			janus_ice_set_send_queue_size(sqs);
+		}
+	}
+	item = janus_config_get_item_drilldown(config, "media", "send_queue_drop");
+	if(item && item->value) {
+		if(!strcasecmp(item->value, "oldest")) {
+			janus_ice_set_send_queue_drop_oldest(TRUE);
+		} else if(!strcasecmp(item->value, "newest")) {
+			janus_ice_set_send_queue_drop_oldest(FALSE);
+		} else {
+			JANUS_LOG(LOG_WARN, "Unsupported send_queue_drop value '%s', dropping newest packets\n", item->value);
+		}
+	}
+	/* Batched egress on the selected pair */
+	item = janus_config_get_item_drilldown(config, "media", "egress_batching");
+	if(item && item->value)
+		janus_ice_set_egress_batching(janus_is_true(item->value));
+	/* Batched ingress on the selected pair */
+	item = janus_config_get_item_drilldown(config, "media", "ingress_batching");
+	if(item && item->value)
+		janus_ice_set_ingress_batching(janus_is_true(item->value));
+	/* Send-side bandwidth estimation (transport wide CC) */
+	item = janus_config_get_item_drilldown(config, "media", "send_side_bwe");
+	if(item && item->value)
+		janus_ice_set_send_side_bwe(janus_is_true(item->value));
+	/* Outbound pacing of video */
+	item = janus_config_get_item_drilldown(config, "media", "pacing_multiplier");
+	if(item && item->value)
+		janus_ice_set_pacing_multiplier(atof(item->value));
+	/* Forward error correction for outgoing video */
+	item = janus_config_get_item_drilldown(config, "media", "fec_overhead");
+	if(item && item->value) {
+		int overhead = atoi(item->value);
+		if(overhead < 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring fec_overhead value as it's not a positive integer\n");
+		} else {
+			janus_ice_set_fec_overhead(overhead);
+		}
+	}
 	/* Initialize the ICE stack now */
 	janus_ice_init(ice_lite, ice_tcp, full_trickle, ipv6, rtp_min_port, rtp_max_port);
 	if(janus_ice_set_stun_server(stun_server, stun_port) < 0) {
@@ -3790,6 +4196,15 @@ gint main(int argc, char *argv[])
 			janus_set_max_nack_queue(mnq);
 		}
 	}
+	item = janus_config_get_item_drilldown(config, "media", "retransmit_buffer_size");
+	if(item && item->value) {
+		int rbs = atoi(item->value);
+		if(rbs <= 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring retransmit_buffer_size value as it's not a positive integer\n");
+		} else {
+			janus_set_retransmit_buffer_size(rbs);
+		}
+	}
 	/* no-media timer */
 	item = janus_config_get_item_drilldown(config, "media", "no_media_timer");
 	if(item && item->value) {
@@ -3828,23 +4243,67 @@ gint main(int argc, char *argv[])
 	} else {
 		password = item->value;
 	}
+	/* If we need to generate a certificate, which key type to use and where to cache it */
+	gboolean autocert_ecdsa = FALSE;
+	item = janus_config_get_item_drilldown(config, "certificates", "autocert_type");
+	if(item && item->value) {
+		if(!strcasecmp(item->value, "ecdsa")) {
+			autocert_ecdsa = TRUE;
+		} else if(strcasecmp(item->value, "rsa")) {
+			JANUS_LOG(LOG_WARN, "Unsupported key type '%s' for autogenerated certificates, using RSA\n", item->value);
+		}
+	}
+	const char *autocert_cache = NULL;
+	item = janus_config_get_item_drilldown(config, "certificates", "autocert_cache");
+	if(item && item->value)
+		autocert_cache = item->value;
 	JANUS_LOG(LOG_VERB, "Using certificates:\n\t%s\n\t%s\n", server_pem, server_key);
 
 	SSL_library_init();
 	SSL_load_error_strings();
 	OpenSSL_add_all_algorithms();
 	/* ... and DTLS-SRTP in particular */
-	if(janus_dtls_srtp_init(server_pem, server_key, password) < 0) {
+	if(janus_dtls_srtp_init(server_pem, server_key, password, autocert_ecdsa, autocert_cache) < 0) {
 		exit(1);
 	}
 	/* Check if there's any custom value for the starting MTU to use in the BIO filter */
 	item = janus_config_get_item_drilldown(config, "media", "dtls_mtu");
 	if(item && item->value)
 		janus_dtls_bio_filter_set_mtu(atoi(item->value));
+	/* Check if DTLS handshakes should be done by a pool of workers, and how many at the same time */
+	int dtls_workers = 0, dtls_max_handshakes = 0;
+	item = janus_config_get_item_drilldown(config, "media", "dtls_workers");
+	if(item && item->value) {
+		dtls_workers = atoi(item->value);
+		if(dtls_workers < 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring dtls_workers value as it's not a positive integer\n");
+			dtls_workers = 0;
+		}
+	}
+	item = janus_config_get_item_drilldown(config, "media", "dtls_max_handshakes");
+	if(item && item->value) {
+		dtls_max_handshakes = atoi(item->value);
+		if(dtls_max_handshakes < 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring dtls_max_handshakes value as it's not a positive integer\n");
+			dtls_max_handshakes = 0;
+		}
+	}
+	if(janus_dtls_handshake_workers_init(dtls_workers, dtls_max_handshakes) < 0) {
+		exit(1);
+	}
 
 #ifdef HAVE_SCTP
-	/* Initialize SCTP for DataChannels */
-	if(janus_sctp_init() < 0) {
+	/* Initialize SCTP for DataChannels, possibly on a few shared workers */
+	int sctp_workers = 0;
+	item = janus_config_get_item_drilldown(config, "media", "sctp_workers");
+	if(item && item->value) {
+		sctp_workers = atoi(item->value);
+		if(sctp_workers < 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring sctp_workers value as it's not a positive integer\n");
+			sctp_workers = 0;
+		}
+	}
+	if(janus_sctp_init(sctp_workers) < 0) {
 		exit(1);
 	}
 #else
@@ -3852,8 +4311,9 @@ gint main(int argc, char *argv[])
 #endif
 
 	/* Sessions */
-	sessions = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, NULL);
+	sessions = janus_sharded_map_create(JANUS_SESSIONS_SHARDS_BITS);
 	old_sessions = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, NULL);
+	sessions_wheel = janus_timer_wheel_create(JANUS_SESSIONS_CHECK_INTERVAL, janus_get_monotonic_time());
 	janus_mutex_init(&sessions_mutex);
 	/* Start the sessions watchdog */
 	sessions_watchdog_context = g_main_context_new();
@@ -3879,6 +4339,23 @@ gint main(int argc, char *argv[])
 		JANUS_LOG(LOG_FATAL, "Got error %d (%s) trying to launch the request pool task thread...\n", error->code, error->message ? error->message : "??");
 		exit(1);
 	}
+	/* Start the request workers, if we've been asked to use them */
+	if(request_workers_num > 0) {
+		request_workers = g_malloc0(request_workers_num * sizeof(janus_request_worker));
+		guint w = 0;
+		for(w=0; w<request_workers_num; w++) {
+			request_workers[w].id = w+1;
+			request_workers[w].queue = g_async_queue_new_full((GDestroyNotify) janus_request_destroy);
+			char tname[16];
+			g_snprintf(tname, sizeof(tname), "request %u", w+1);
+			request_workers[w].thread = g_thread_try_new(tname, &janus_request_worker_thread, &request_workers[w], &error);
+			if(error != NULL) {
+				JANUS_LOG(LOG_FATAL, "Got error %d (%s) trying to start request worker #%u...\n", error->code, error->message ? error->message : "??", w+1);
+				exit(1);
+			}
+		}
+		JANUS_LOG(LOG_INFO, "Dispatching requests to %u workers\n", request_workers_num);
+	}
 
 	/* Load event handlers */
 	const char *path = NULL;
@@ -4312,6 +4789,8 @@ gint main(int argc, char *argv[])
 	g_main_loop_unref(watchdog_loop);
 	g_main_context_unref(sessions_watchdog_context);
 	sessions_watchdog_context = NULL;
+	janus_timer_wheel_destroy(sessions_wheel);
+	sessions_wheel = NULL;
 
 	if(config)
 		janus_config_destroy(config);
@@ -4332,9 +4811,22 @@ gint main(int argc, char *argv[])
 	g_thread_join(requests_thread);
 	requests_thread = NULL;
 	g_async_queue_unref(requests);
+	if(request_workers != NULL) {
+		JANUS_LOG(LOG_INFO, "Ending request workers...\n");
+		guint w = 0;
+		for(w=0; w<request_workers_num; w++)
+			g_async_queue_push(request_workers[w].queue, &exit_message);
+		for(w=0; w<request_workers_num; w++) {
+			g_thread_join(request_workers[w].thread);
+			g_async_queue_unref(request_workers[w].queue);
+		}
+		g_free(request_workers);
+		request_workers = NULL;
+	}
 
 	JANUS_LOG(LOG_INFO, "Destroying sessions...\n");
-	g_clear_pointer(&sessions, g_hash_table_destroy);
+	janus_sharded_map_destroy(sessions);
+	sessions = NULL;
 	g_clear_pointer(&old_sessions, g_hash_table_destroy);
 	JANUS_LOG(LOG_INFO, "Freeing crypto resources...\n");
 	janus_dtls_srtp_cleanup();
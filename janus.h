@@ -48,6 +48,8 @@ typedef struct janus_session {
 	guint64 session_id;
 	/*! \brief Map of handles this session is managing */
 	GHashTable *ice_handles;
+	/*! \brief Mutex to lock/unlock the map of handles (only held while accessing the map, so that lookups don't wait for handles being created or destroyed) */
+	janus_mutex handles_mutex;
 	/*! \brief Time of the last activity on the session */
 	gint64 last_activity;
 	/*! \brief Pointer to the request instance (and the transport that originated the session) */
@@ -56,6 +58,8 @@ typedef struct janus_session {
 	volatile gint destroy;
 	/*! \brief Flag to notify there's been a session timeout */
 	volatile gint timeout;
+	/*! \brief Timer of the sessions watchdog, to check whether the session timed out */
+	janus_timer_wheel_entry timer;
 	/*! \brief Mutex to lock/unlock this session */
 	janus_mutex mutex;
 } janus_session;
@@ -109,6 +113,8 @@ struct janus_request {
 	gboolean admin;
 	/*! \brief Pointer to the original request, if available */
 	json_t *message;
+	/*! \brief Monotonic time of when the request was received (for the latency statistics) */
+	gint64 received;
 };
 /*! \brief Helper to allocate a janus_request instance
  * @param[in] transport Pointer to the transport
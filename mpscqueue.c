@@ -0,0 +1,170 @@
+/*! \file    mpscqueue.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Bounded lock-free multi-producer/single-consumer queue
+ * \details  Implementation of a bounded queue that many threads can push
+ * to, and a single thread pops from, without taking any lock. Each lane
+ * is a ring of slots with their own sequence number, which tells producers
+ * whether a slot is free for the current round, and the consumer whether
+ * the item in it has been published already: producers only contend on
+ * the atomic increment of the head of the ring, and the consumer never
+ * contends with anybody. A mutex and a condition are only used to wake
+ * up the consumer when it's actually waiting for items.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <sys/time.h>
+
+#include "mpscqueue.h"
+#include "debug.h"
+
+static void janus_mpsc_ring_init(janus_mpsc_ring *ring, guint size) {
+	ring->cells = g_malloc0(size * sizeof(janus_mpsc_cell));
+	ring->mask = size-1;
+	guint i = 0;
+	for(i=0; i<size; i++)
+		ring->cells[i].sequence = i;
+	ring->head = 0;
+	ring->tail = 0;
+}
+
+static gboolean janus_mpsc_ring_push(janus_mpsc_ring *ring, gpointer item) {
+	janus_mpsc_cell *cell = NULL;
+	guint pos = g_atomic_int_get(&ring->head);
+	while(TRUE) {
+		cell = &ring->cells[pos & ring->mask];
+		guint seq = g_atomic_int_get(&cell->sequence);
+		gint diff = (gint)(seq - pos);
+		if(diff == 0) {
+			/* The slot is free, try to claim it */
+			if(g_atomic_int_compare_and_exchange(&ring->head, pos, pos+1))
+				break;
+		} else if(diff < 0) {
+			/* The slot still contains an item from the previous round: we're full */
+			return FALSE;
+		}
+		/* Somebody else got there first, try again */
+		pos = g_atomic_int_get(&ring->head);
+	}
+	cell->data = item;
+	/* Publish the item */
+	g_atomic_int_set(&cell->sequence, pos+1);
+	return TRUE;
+}
+
+static gpointer janus_mpsc_ring_pop(janus_mpsc_ring *ring) {
+	guint pos = ring->tail;
+	janus_mpsc_cell *cell = &ring->cells[pos & ring->mask];
+	guint seq = g_atomic_int_get(&cell->sequence);
+	if((gint)(seq - (pos+1)) < 0) {
+		/* Empty, or the producer didn't publish the item yet */
+		return NULL;
+	}
+	gpointer item = cell->data;
+	cell->data = NULL;
+	g_atomic_int_set(&ring->tail, pos+1);
+	/* Make the slot available for the next round */
+	g_atomic_int_set(&cell->sequence, pos + ring->mask + 1);
+	return item;
+}
+
+static guint janus_mpsc_ring_length(janus_mpsc_ring *ring) {
+	guint head = g_atomic_int_get(&ring->head), tail = g_atomic_int_get(&ring->tail);
+	return head - tail;
+}
+
+janus_mpsc_queue *janus_mpsc_queue_create(guint size) {
+	/* Round to the next power of two */
+	guint ring_size = 2;
+	while(ring_size < size && ring_size < (1U << 30))
+		ring_size <<= 1;
+	janus_mpsc_queue *queue = g_malloc0(sizeof(janus_mpsc_queue));
+	janus_mpsc_ring_init(&queue->priority, ring_size);
+	janus_mpsc_ring_init(&queue->normal, ring_size);
+	queue->waiting = 0;
+	janus_mutex_init(&queue->mutex);
+	janus_condition_init(&queue->cond);
+	return queue;
+}
+
+void janus_mpsc_queue_destroy(janus_mpsc_queue *queue) {
+	if(queue == NULL)
+		return;
+	g_free(queue->priority.cells);
+	g_free(queue->normal.cells);
+	janus_mutex_destroy(&queue->mutex);
+	janus_condition_destroy(&queue->cond);
+	g_free(queue);
+}
+
+gboolean janus_mpsc_queue_push(janus_mpsc_queue *queue, gpointer item, gboolean priority) {
+	if(queue == NULL || item == NULL)
+		return FALSE;
+	if(!janus_mpsc_ring_push(priority ? &queue->priority : &queue->normal, item))
+		return FALSE;
+	/* Only wake up the consumer if it's sleeping */
+	if(g_atomic_int_get(&queue->waiting)) {
+		janus_mutex_lock_nodebug(&queue->mutex);
+		janus_condition_signal(&queue->cond);
+		janus_mutex_unlock_nodebug(&queue->mutex);
+	}
+	return TRUE;
+}
+
+gpointer janus_mpsc_queue_try_pop(janus_mpsc_queue *queue) {
+	if(queue == NULL)
+		return NULL;
+	gpointer item = janus_mpsc_ring_pop(&queue->priority);
+	if(item == NULL)
+		item = janus_mpsc_ring_pop(&queue->normal);
+	return item;
+}
+
+gpointer janus_mpsc_queue_timeout_pop(janus_mpsc_queue *queue, gint64 timeout) {
+	if(queue == NULL)
+		return NULL;
+	gpointer item = janus_mpsc_queue_try_pop(queue);
+	if(item != NULL || timeout <= 0)
+		return item;
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	gint64 until = (gint64)now.tv_sec*G_USEC_PER_SEC + now.tv_usec + timeout;
+	struct timespec ts;
+	ts.tv_sec = until/G_USEC_PER_SEC;
+	ts.tv_nsec = (until%G_USEC_PER_SEC)*1000;
+	janus_mutex_lock_nodebug(&queue->mutex);
+	/* Let producers know they need to wake us up, and check again
+	 * before waiting, in case something was pushed in the meanwhile */
+	g_atomic_int_set(&queue->waiting, 1);
+	while((item = janus_mpsc_queue_try_pop(queue)) == NULL) {
+		int res = janus_condition_timedwait(&queue->cond, &queue->mutex, &ts);
+		if(res == ETIMEDOUT) {
+			item = janus_mpsc_queue_try_pop(queue);
+			break;
+		}
+	}
+	g_atomic_int_set(&queue->waiting, 0);
+	janus_mutex_unlock_nodebug(&queue->mutex);
+	return item;
+}
+
+guint janus_mpsc_queue_drop(janus_mpsc_queue *queue, guint count, GDestroyNotify free_func) {
+	if(queue == NULL)
+		return 0;
+	guint dropped = 0;
+	gpointer item = NULL;
+	while(dropped < count && (item = janus_mpsc_ring_pop(&queue->normal)) != NULL) {
+		if(free_func)
+			free_func(item);
+		dropped++;
+	}
+	return dropped;
+}
+
+guint janus_mpsc_queue_length(janus_mpsc_queue *queue) {
+	if(queue == NULL)
+		return 0;
+	return janus_mpsc_ring_length(&queue->priority) + janus_mpsc_ring_length(&queue->normal);
+}
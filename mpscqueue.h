@@ -0,0 +1,94 @@
+/*! \file    mpscqueue.h
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Bounded lock-free multi-producer/single-consumer queue (headers)
+ * \details  Implementation of a bounded queue that many threads can push
+ * to, and a single thread pops from, without taking any lock. This is
+ * used by the core for the outgoing packets of each handle, which plugin
+ * threads (possibly many of them, e.g., in a videoroom) enqueue and a
+ * single send thread or worker dequeues. Each queue has two lanes: items
+ * pushed on the priority lane (e.g., retransmissions) are always popped
+ * before the ones on the normal lane. Waking up a consumer that's waiting
+ * only costs a syscall when the consumer is actually sleeping.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef _JANUS_MPSCQUEUE_H
+#define _JANUS_MPSCQUEUE_H
+
+#include <glib.h>
+
+#include "mutex.h"
+
+/*! \brief Slot of a ring */
+typedef struct janus_mpsc_cell {
+	/*! \brief Sequence number, used to figure out if the slot is free or busy */
+	volatile guint sequence;
+	/*! \brief Item stored in the slot */
+	gpointer data;
+} janus_mpsc_cell;
+
+/*! \brief Bounded ring (one per lane) */
+typedef struct janus_mpsc_ring {
+	/*! \brief Array of slots */
+	janus_mpsc_cell *cells;
+	/*! \brief Mask to apply to positions to get the index of a slot (size-1) */
+	guint mask;
+	/*! \brief Next position producers will write to */
+	volatile guint head;
+	/*! \brief Next position the consumer will read from */
+	volatile guint tail;
+} janus_mpsc_ring;
+
+/*! \brief Bounded multi-producer/single-consumer queue */
+typedef struct janus_mpsc_queue {
+	/*! \brief Priority lane */
+	janus_mpsc_ring priority;
+	/*! \brief Normal lane */
+	janus_mpsc_ring normal;
+	/*! \brief Whether the consumer is sleeping, waiting for items */
+	volatile gint waiting;
+	/*! \brief Mutex for the wakeup of the consumer */
+	janus_mutex mutex;
+	/*! \brief Condition for the wakeup of the consumer */
+	janus_condition cond;
+} janus_mpsc_queue;
+
+/*! \brief Create a new queue
+ * \note The size is rounded up to the next power of two
+ * @param[in] size The number of items each lane can hold
+ * @returns A new janus_mpsc_queue instance */
+janus_mpsc_queue *janus_mpsc_queue_create(guint size);
+/*! \brief Destroy a queue
+ * \note Items still in the queue are not freed: pop them first, if needed
+ * @param[in] queue The janus_mpsc_queue instance to destroy */
+void janus_mpsc_queue_destroy(janus_mpsc_queue *queue);
+/*! \brief Push an item to a queue (can be called by any thread)
+ * @param[in] queue The janus_mpsc_queue instance to push the item to
+ * @param[in] item The item to push (can't be NULL)
+ * @param[in] priority Whether the item should go in the priority lane
+ * @returns TRUE if the item was pushed, FALSE if the lane was full */
+gboolean janus_mpsc_queue_push(janus_mpsc_queue *queue, gpointer item, gboolean priority);
+/*! \brief Pop an item from a queue, if available (must only be called by the consumer)
+ * @param[in] queue The janus_mpsc_queue instance to pop the item from
+ * @returns The first item in the priority lane if any, the first in the normal lane otherwise, or NULL if the queue is empty */
+gpointer janus_mpsc_queue_try_pop(janus_mpsc_queue *queue);
+/*! \brief Pop an item from a queue, waiting for one if the queue is empty (must only be called by the consumer)
+ * @param[in] queue The janus_mpsc_queue instance to pop the item from
+ * @param[in] timeout How long to wait for an item, in microseconds
+ * @returns The first item available, or NULL if the timeout fired */
+gpointer janus_mpsc_queue_timeout_pop(janus_mpsc_queue *queue, gint64 timeout);
+/*! \brief Pop and discard the oldest items in the normal lane (must only be called by the consumer)
+ * @param[in] queue The janus_mpsc_queue instance to drop items from
+ * @param[in] count How many items to drop, at most
+ * @param[in] free_func Function to invoke on each dropped item, if any
+ * @returns The number of dropped items */
+guint janus_mpsc_queue_drop(janus_mpsc_queue *queue, guint count, GDestroyNotify free_func);
+/*! \brief Get the (approximate) number of items in a queue
+ * @param[in] queue The janus_mpsc_queue instance to check
+ * @returns The number of items in both lanes */
+guint janus_mpsc_queue_length(janus_mpsc_queue *queue);
+
+#endif
@@ -0,0 +1,363 @@
+/*! \file    msgpack-utils.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    MessagePack utilities
+ * \details  Implementation of a MessagePack encoder and decoder for
+ * Jansson objects. Integers always use the most compact representation
+ * available, while reals are always encoded as 64-bit floats, so that
+ * no precision is lost in the process.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <string.h>
+
+#include "msgpack-utils.h"
+
+/* Helper to append a type byte, optionally followed by a big endian value of size bytes */
+static void janus_msgpack_append(GByteArray *buf, guint8 type, guint64 value, int size) {
+	guint8 data[9];
+	data[0] = type;
+	int i = 0;
+	for(i=0; i<size; i++)
+		data[1+i] = (value >> (8*(size-1-i))) & 0xFF;
+	g_byte_array_append(buf, data, size+1);
+}
+
+/* Helper to append the header of a string, array or map */
+static void janus_msgpack_append_length(GByteArray *buf, guint32 len,
+		guint8 fixtype, guint32 fixmax, guint8 type8, guint8 type16, guint8 type32) {
+	if(len <= fixmax)
+		janus_msgpack_append(buf, fixtype | len, 0, 0);
+	else if(type8 && len <= 0xFF)
+		janus_msgpack_append(buf, type8, len, 1);
+	else if(len <= 0xFFFF)
+		janus_msgpack_append(buf, type16, len, 2);
+	else
+		janus_msgpack_append(buf, type32, len, 4);
+}
+
+static void janus_msgpack_append_string(GByteArray *buf, const char *str) {
+	size_t len = strlen(str);
+	janus_msgpack_append_length(buf, len, 0xa0, 31, 0xd9, 0xda, 0xdb);
+	g_byte_array_append(buf, (const guint8 *)str, len);
+}
+
+static gboolean janus_msgpack_encode_value(GByteArray *buf, json_t *json) {
+	switch(json_typeof(json)) {
+		case JSON_NULL:
+			janus_msgpack_append(buf, 0xc0, 0, 0);
+			break;
+		case JSON_FALSE:
+			janus_msgpack_append(buf, 0xc2, 0, 0);
+			break;
+		case JSON_TRUE:
+			janus_msgpack_append(buf, 0xc3, 0, 0);
+			break;
+		case JSON_INTEGER: {
+			json_int_t value = json_integer_value(json);
+			if(value >= 0) {
+				if(value <= 0x7F)
+					janus_msgpack_append(buf, (guint8)value, 0, 0);
+				else if(value <= 0xFF)
+					janus_msgpack_append(buf, 0xcc, value, 1);
+				else if(value <= 0xFFFF)
+					janus_msgpack_append(buf, 0xcd, value, 2);
+				else if(value <= 0xFFFFFFFFLL)
+					janus_msgpack_append(buf, 0xce, value, 4);
+				else
+					janus_msgpack_append(buf, 0xcf, value, 8);
+			} else {
+				if(value >= -32)
+					janus_msgpack_append(buf, (guint8)(gint8)value, 0, 0);
+				else if(value >= G_MININT8)
+					janus_msgpack_append(buf, 0xd0, (guint64)value, 1);
+				else if(value >= G_MININT16)
+					janus_msgpack_append(buf, 0xd1, (guint64)value, 2);
+				else if(value >= G_MININT32)
+					janus_msgpack_append(buf, 0xd2, (guint64)value, 4);
+				else
+					janus_msgpack_append(buf, 0xd3, (guint64)value, 8);
+			}
+			break;
+		}
+		case JSON_REAL: {
+			double value = json_real_value(json);
+			guint64 bits = 0;
+			memcpy(&bits, &value, sizeof(bits));
+			janus_msgpack_append(buf, 0xcb, bits, 8);
+			break;
+		}
+		case JSON_STRING:
+			janus_msgpack_append_string(buf, json_string_value(json));
+			break;
+		case JSON_ARRAY: {
+			size_t i = 0, size = json_array_size(json);
+			janus_msgpack_append_length(buf, size, 0x90, 15, 0, 0xdc, 0xdd);
+			for(i=0; i<size; i++) {
+				if(!janus_msgpack_encode_value(buf, json_array_get(json, i)))
+					return FALSE;
+			}
+			break;
+		}
+		case JSON_OBJECT: {
+			const char *key = NULL;
+			json_t *value = NULL;
+			janus_msgpack_append_length(buf, json_object_size(json), 0x80, 15, 0, 0xde, 0xdf);
+			json_object_foreach(json, key, value) {
+				janus_msgpack_append_string(buf, key);
+				if(!janus_msgpack_encode_value(buf, value))
+					return FALSE;
+			}
+			break;
+		}
+		default:
+			return FALSE;
+	}
+	return TRUE;
+}
+
+char *janus_msgpack_encode(json_t *json, size_t *len) {
+	if(json == NULL || len == NULL)
+		return NULL;
+	GByteArray *buf = g_byte_array_sized_new(256);
+	if(!janus_msgpack_encode_value(buf, json)) {
+		g_byte_array_free(buf, TRUE);
+		return NULL;
+	}
+	*len = buf->len;
+	return (char *)g_byte_array_free(buf, FALSE);
+}
+
+
+/* Decoder state */
+typedef struct janus_msgpack_reader {
+	const guint8 *data;
+	size_t len, offset;
+	json_error_t *error;
+} janus_msgpack_reader;
+
+static void janus_msgpack_error(janus_msgpack_reader *r, const char *reason) {
+	if(r->error == NULL || r->error->text[0] != '\0')
+		return;
+	r->error->line = -1;
+	r->error->column = -1;
+	r->error->position = r->offset;
+	g_snprintf(r->error->source, sizeof(r->error->source), "<msgpack>");
+	g_snprintf(r->error->text, sizeof(r->error->text), "%s", reason);
+}
+
+/* Helper to read a big endian value of size bytes */
+static gboolean janus_msgpack_read(janus_msgpack_reader *r, int size, guint64 *value) {
+	if(r->len - r->offset < (size_t)size) {
+		janus_msgpack_error(r, "Unexpected end of data");
+		return FALSE;
+	}
+	*value = 0;
+	int i = 0;
+	for(i=0; i<size; i++)
+		*value = (*value << 8) | r->data[r->offset+i];
+	r->offset += size;
+	return TRUE;
+}
+
+/* Helper to read a string of len bytes (returned as a NUL-terminated copy) */
+static char *janus_msgpack_read_string(janus_msgpack_reader *r, guint64 len) {
+	if(r->len - r->offset < len) {
+		janus_msgpack_error(r, "Unexpected end of data");
+		return NULL;
+	}
+	const char *str = (const char *)r->data + r->offset;
+	if(memchr(str, '\0', len) != NULL) {
+		janus_msgpack_error(r, "NUL byte in string");
+		return NULL;
+	}
+	r->offset += len;
+	return g_strndup(str, len);
+}
+
+static json_t *janus_msgpack_decode_value(janus_msgpack_reader *r, int depth) {
+	if(depth > JANUS_MSGPACK_MAX_DEPTH) {
+		janus_msgpack_error(r, "Maximum nesting depth exceeded");
+		return NULL;
+	}
+	guint64 type = 0, value = 0;
+	if(!janus_msgpack_read(r, 1, &type))
+		return NULL;
+	/* Fixed size types first */
+	if(type <= 0x7f)
+		return json_integer(type);
+	if(type >= 0xe0)
+		return json_integer((gint8)type);
+	guint64 len = 0;
+	int size = 0;
+	if((type & 0xe0) == 0xa0) {
+		len = type & 0x1f;
+		goto string;
+	} else if((type & 0xf0) == 0x90) {
+		len = type & 0x0f;
+		goto array;
+	} else if((type & 0xf0) == 0x80) {
+		len = type & 0x0f;
+		goto map;
+	}
+	switch(type) {
+		case 0xc0:
+			return json_null();
+		case 0xc2:
+			return json_false();
+		case 0xc3:
+			return json_true();
+		case 0xcc: case 0xcd: case 0xce: case 0xcf:
+			size = 1 << (type - 0xcc);
+			if(!janus_msgpack_read(r, size, &value))
+				return NULL;
+			if(value > (guint64)JSON_INTEGER_MAX) {
+				janus_msgpack_error(r, "Integer out of range");
+				return NULL;
+			}
+			return json_integer((json_int_t)value);
+		case 0xd0:
+			if(!janus_msgpack_read(r, 1, &value))
+				return NULL;
+			return json_integer((gint8)value);
+		case 0xd1:
+			if(!janus_msgpack_read(r, 2, &value))
+				return NULL;
+			return json_integer((gint16)value);
+		case 0xd2:
+			if(!janus_msgpack_read(r, 4, &value))
+				return NULL;
+			return json_integer((gint32)value);
+		case 0xd3:
+			if(!janus_msgpack_read(r, 8, &value))
+				return NULL;
+			return json_integer((json_int_t)(gint64)value);
+		case 0xca: {
+			if(!janus_msgpack_read(r, 4, &value))
+				return NULL;
+			guint32 bits = value;
+			float real = 0;
+			memcpy(&real, &bits, sizeof(real));
+			return json_real(real);
+		}
+		case 0xcb: {
+			if(!janus_msgpack_read(r, 8, &value))
+				return NULL;
+			double real = 0;
+			memcpy(&real, &value, sizeof(real));
+			return json_real(real);
+		}
+		case 0xd9: case 0xda: case 0xdb:
+			if(!janus_msgpack_read(r, 1 << (type - 0xd9), &len))
+				return NULL;
+			goto string;
+		case 0xdc: case 0xdd:
+			if(!janus_msgpack_read(r, type == 0xdc ? 2 : 4, &len))
+				return NULL;
+			goto array;
+		case 0xde: case 0xdf:
+			if(!janus_msgpack_read(r, type == 0xde ? 2 : 4, &len))
+				return NULL;
+			goto map;
+		default:
+			/* Binary, extensions and reserved types have no JSON equivalent */
+			janus_msgpack_error(r, "Unsupported type");
+			return NULL;
+	}
+
+string:
+	{
+		char *str = janus_msgpack_read_string(r, len);
+		if(str == NULL)
+			return NULL;
+		json_t *json = json_string(str);
+		g_free(str);
+		if(json == NULL)
+			janus_msgpack_error(r, "Invalid UTF-8 string");
+		return json;
+	}
+array:
+	{
+		/* Each element takes at least a byte, don't trust larger lengths */
+		if(len > r->len - r->offset) {
+			janus_msgpack_error(r, "Unexpected end of data");
+			return NULL;
+		}
+		json_t *json = json_array();
+		guint64 i = 0;
+		for(i=0; i<len; i++) {
+			json_t *item = janus_msgpack_decode_value(r, depth+1);
+			if(item == NULL) {
+				json_decref(json);
+				return NULL;
+			}
+			json_array_append_new(json, item);
+		}
+		return json;
+	}
+map:
+	{
+		if(len > r->len - r->offset) {
+			janus_msgpack_error(r, "Unexpected end of data");
+			return NULL;
+		}
+		json_t *json = json_object();
+		guint64 i = 0;
+		for(i=0; i<len; i++) {
+			/* Keys must be strings */
+			guint64 ktype = 0, klen = 0;
+			if(!janus_msgpack_read(r, 1, &ktype)) {
+				json_decref(json);
+				return NULL;
+			}
+			if((ktype & 0xe0) == 0xa0) {
+				klen = ktype & 0x1f;
+			} else if(ktype >= 0xd9 && ktype <= 0xdb) {
+				if(!janus_msgpack_read(r, 1 << (ktype - 0xd9), &klen)) {
+					json_decref(json);
+					return NULL;
+				}
+			} else {
+				janus_msgpack_error(r, "Map keys must be strings");
+				json_decref(json);
+				return NULL;
+			}
+			char *key = janus_msgpack_read_string(r, klen);
+			if(key == NULL) {
+				json_decref(json);
+				return NULL;
+			}
+			json_t *item = janus_msgpack_decode_value(r, depth+1);
+			if(item == NULL || json_object_set_new(json, key, item) < 0) {
+				if(item == NULL)
+					janus_msgpack_error(r, "Invalid value");
+				else
+					janus_msgpack_error(r, "Invalid UTF-8 key");
+				g_free(key);
+				json_decref(json);
+				return NULL;
+			}
+			g_free(key);
+		}
+		return json;
+	}
+}
+
+json_t *janus_msgpack_decode(const char *buf, size_t len, json_error_t *error) {
+	if(error != NULL)
+		memset(error, 0, sizeof(*error));
+	janus_msgpack_reader r = { .data = (const guint8 *)buf, .len = len, .offset = 0, .error = error };
+	if(buf == NULL || len == 0) {
+		janus_msgpack_error(&r, "No data");
+		return NULL;
+	}
+	json_t *json = janus_msgpack_decode_value(&r, 0);
+	if(json != NULL && r.offset < r.len) {
+		janus_msgpack_error(&r, "Trailing data after the value");
+		json_decref(json);
+		return NULL;
+	}
+	return json;
+}
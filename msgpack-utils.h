@@ -0,0 +1,41 @@
+/*! \file    msgpack-utils.h
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    MessagePack utilities (headers)
+ * \details  Implementation of a MessagePack (https://msgpack.org) encoder
+ * and decoder for Jansson objects, that transports can use to offer a
+ * binary wire encoding of the Janus and Admin API as an alternative to
+ * JSON. The mapping is 1:1 (objects become maps with string keys, arrays
+ * become arrays, and so on), which means the core and plugins keep on
+ * dealing with JSON objects as usual, and only the transport needs to
+ * know about the encoding. Since they don't have any core dependencies,
+ * these utilities can be used by plugins as well.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef _JANUS_MSGPACK_UTILS_H
+#define _JANUS_MSGPACK_UTILS_H
+
+#include <glib.h>
+#include <jansson.h>
+
+/*! \brief Maximum nesting of arrays and maps we accept when decoding */
+#define JANUS_MSGPACK_MAX_DEPTH	64
+
+/*! \brief Encode a Jansson object to MessagePack
+ * @param[in] json The Jansson object to encode
+ * @param[out] len The length of the encoded buffer
+ * @returns A buffer containing the MessagePack encoding (to free with g_free), or NULL in case of errors */
+char *janus_msgpack_encode(json_t *json, size_t *len);
+/*! \brief Decode a MessagePack buffer to a Jansson object
+ * \note Only what can be represented in JSON is accepted: map keys must
+ * be strings, and binary and extension types are rejected
+ * @param[in] buf The buffer to decode
+ * @param[in] len The length of the buffer
+ * @param[out] error If not NULL, where to write the reason of the failure, if any (in the same way json_loads does)
+ * @returns The decoded Jansson object, or NULL in case of errors */
+json_t *janus_msgpack_decode(const char *buf, size_t len, json_error_t *error);
+
+#endif
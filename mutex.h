@@ -37,6 +37,8 @@ typedef pthread_mutex_t janus_mutex;
 #define janus_mutex_unlock_debug(a) { JANUS_PRINT("[%s:%s:%d:] ", __FILE__, __FUNCTION__, __LINE__); JANUS_PRINT("UNLOCK %p\n", a); pthread_mutex_unlock(a); };
 /*! \brief Janus mutex unlock wrapper (selective locking debug) */
 #define janus_mutex_unlock(a) { if(!lock_debug) { janus_mutex_unlock_nodebug(a); } else { janus_mutex_unlock_debug(a); } };
+/*! \brief Janus mutex try lock (returns 0 if the mutex was locked, without ever waiting for it) */
+#define janus_mutex_trylock(a) pthread_mutex_trylock(a)
 
 /*! \brief Janus condition implementation */
 typedef pthread_cond_t janus_condition;
@@ -623,8 +623,8 @@ const char *janus_audiobridge_get_package(void);
 void janus_audiobridge_create_session(janus_plugin_session *handle, int *error);
 struct janus_plugin_result *janus_audiobridge_handle_message(janus_plugin_session *handle, char *transaction, json_t *message, json_t *jsep);
 void janus_audiobridge_setup_media(janus_plugin_session *handle);
-void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len);
-void janus_audiobridge_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len);
+void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtp_extensions *extensions);
+void janus_audiobridge_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtcp_summary *summary);
 void janus_audiobridge_hangup_media(janus_plugin_session *handle);
 void janus_audiobridge_destroy_session(janus_plugin_session *handle, int *error);
 json_t *janus_audiobridge_query_session(janus_plugin_session *handle);
@@ -2676,7 +2676,7 @@ void janus_audiobridge_setup_media(janus_plugin_session *handle) {
 	janus_mutex_unlock(&rooms_mutex);
 }
 
-void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len) {
+void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtp_extensions *extensions) {
 	if(handle == NULL || handle->stopped || g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
 		return;
 	janus_audiobridge_session *session = (janus_audiobridge_session *)handle->plugin_handle;
@@ -2714,10 +2714,10 @@ void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, int video, cha
 		pkt->silence = FALSE;
 		pkt->length = 0;
 
-		if(participant->extmap_id > 0) {
+		if(participant->extmap_id > 0 && extensions != NULL) {
 			/* Check the audio levels, in case we need to notify participants about who's talking */
-			int level = 0;
-			if(janus_rtp_header_extension_parse_audio_level(buf, len, participant->extmap_id, &level) == 0) {
+			int level = extensions->audio_level;
+			if(level >= 0) {
 				/* Is this silence? */
 				pkt->silence = (level == 127);
 				if(participant->room->audiolevel_event) {
@@ -2823,7 +2823,7 @@ void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, int video, cha
 	}
 }
 
-void janus_audiobridge_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len) {
+void janus_audiobridge_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtcp_summary *summary) {
 	if(handle == NULL || handle->stopped || g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
 		return;
 	/* FIXME Should we care? */
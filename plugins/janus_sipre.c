@@ -103,8 +103,8 @@ const char *janus_sipre_get_package(void);
 void janus_sipre_create_session(janus_plugin_session *handle, int *error);
 struct janus_plugin_result *janus_sipre_handle_message(janus_plugin_session *handle, char *transaction, json_t *message, json_t *jsep);
 void janus_sipre_setup_media(janus_plugin_session *handle);
-void janus_sipre_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len);
-void janus_sipre_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len);
+void janus_sipre_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtp_extensions *extensions);
+void janus_sipre_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtcp_summary *summary);
 void janus_sipre_hangup_media(janus_plugin_session *handle);
 void janus_sipre_destroy_session(janus_plugin_session *handle, int *error);
 json_t *janus_sipre_query_session(janus_plugin_session *handle);
@@ -1327,7 +1327,7 @@ void janus_sipre_setup_media(janus_plugin_session *handle) {
 	/* TODO Only relay RTP/RTCP when we get this event */
 }
 
-void janus_sipre_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len) {
+void janus_sipre_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtp_extensions *extensions) {
 	if(handle == NULL || handle->stopped || g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
 		return;
 	if(gateway) {
@@ -1399,7 +1399,7 @@ void janus_sipre_incoming_rtp(janus_plugin_session *handle, int video, char *buf
 	}
 }
 
-void janus_sipre_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len) {
+void janus_sipre_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtcp_summary *summary) {
 	if(handle == NULL || handle->stopped || g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
 		return;
 	if(gateway) {
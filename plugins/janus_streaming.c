@@ -183,6 +183,9 @@ rtspiface = network interface IP address or device name to listen on when receiv
 #define JANUS_STREAMING_AUTHOR			"Meetecho s.r.l."
 #define JANUS_STREAMING_PACKAGE			"janus.plugin.streaming"
 
+/* ID we use for the transport wide CC extension, when the core estimates the bandwidth */
+#define JANUS_STREAMING_TRANSPORT_WIDE_CC_EXTMAP_ID	5
+
 /* Plugin methods */
 janus_plugin *create(void);
 int janus_streaming_init(janus_callbacks *callback, const char *config_path);
@@ -197,8 +200,9 @@ const char *janus_streaming_get_package(void);
 void janus_streaming_create_session(janus_plugin_session *handle, int *error);
 struct janus_plugin_result *janus_streaming_handle_message(janus_plugin_session *handle, char *transaction, json_t *message, json_t *jsep);
 void janus_streaming_setup_media(janus_plugin_session *handle);
-void janus_streaming_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len);
-void janus_streaming_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len);
+void janus_streaming_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtp_extensions *extensions);
+void janus_streaming_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtcp_summary *summary);
+void janus_streaming_estimated_bandwidth(janus_plugin_session *handle, uint32_t bitrate);
 void janus_streaming_hangup_media(janus_plugin_session *handle);
 void janus_streaming_destroy_session(janus_plugin_session *handle, int *error);
 json_t *janus_streaming_query_session(janus_plugin_session *handle);
@@ -223,6 +227,7 @@ static janus_plugin janus_streaming_plugin =
 		.setup_media = janus_streaming_setup_media,
 		.incoming_rtp = janus_streaming_incoming_rtp,
 		.incoming_rtcp = janus_streaming_incoming_rtcp,
+		.estimated_bandwidth = janus_streaming_estimated_bandwidth,
 		.hangup_media = janus_streaming_hangup_media,
 		.destroy_session = janus_streaming_destroy_session,
 		.query_session = janus_streaming_query_session,
@@ -426,6 +431,7 @@ typedef struct janus_streaming_rtp_source {
 	int video_fd[3];
 	int data_fd;
 	gboolean simulcast;
+	janus_rtp_simulcast_bitrates substream_bitrates;	/* Bitrate of each simulcast substream, in case viewers pick them by bandwidth */
 	gboolean askew, vskew;
 	gint64 last_received_audio;
 	gint64 last_received_video;
@@ -566,6 +572,8 @@ typedef struct janus_streaming_session {
 	janus_rtp_switching_context context;
 	int substream;			/* Which simulcast substream we should forward, in case the mountpoint is simulcasting */
 	int substream_target;	/* As above, but to handle transitions (e.g., wait for keyframe) */
+	gboolean substream_auto;	/* Whether the substream is chosen automatically, using the bandwidth the core estimated */
+	uint32_t estimated_bitrate;	/* Latest bandwidth estimate from the core, if any */
 	int templayer;			/* Which simulcast temporal layer we should forward, in case the mountpoint is simulcasting */
 	int templayer_target;	/* As above, but to handle transitions (e.g., wait for keyframe) */
 	gint64 last_relayed;	/* When we relayed the last packet (used to detect when substreams become unavailable) */
@@ -2606,17 +2614,17 @@ void janus_streaming_setup_media(janus_plugin_session *handle) {
 	janus_mutex_unlock(&sessions_mutex);
 }
 
-void janus_streaming_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len) {
+void janus_streaming_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtp_extensions *extensions) {
 	if(handle == NULL || handle->stopped || g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
 		return;
 	/* FIXME We don't care about what the browser sends us, we're sendonly */
 }
 
-void janus_streaming_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len) {
+void janus_streaming_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtcp_summary *summary) {
 	if(handle == NULL || handle->stopped || g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
 		return;
 	/* We might interested in the available bandwidth that the user advertizes */
-	uint64_t bw = janus_rtcp_get_remb(buf, len);
+	uint64_t bw = summary ? summary->remb : janus_rtcp_get_remb(buf, len);
 	if(bw > 0) {
 		JANUS_LOG(LOG_HUGE, "REMB for this PeerConnection: %"SCNu64"\n", bw);
 		/* TODO Use this somehow (e.g., notification towards application?) */
@@ -2624,6 +2632,44 @@ void janus_streaming_incoming_rtcp(janus_plugin_session *handle, int video, char
 	/* FIXME Maybe we should care about RTCP, but not now */
 }
 
+void janus_streaming_estimated_bandwidth(janus_plugin_session *handle, uint32_t bitrate) {
+	/* The core is telling us how much bandwidth is available towards this viewer:
+	 * if the mountpoint is simulcasting, we can use it to pick the right substream */
+	if(handle == NULL || handle->stopped || g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
+		return;
+	janus_mutex_lock(&sessions_mutex);
+	janus_streaming_session *session = janus_streaming_lookup_session(handle);
+	if(!session || session->destroyed) {
+		janus_mutex_unlock(&sessions_mutex);
+		return;
+	}
+	session->estimated_bitrate = bitrate;
+	janus_streaming_mountpoint *mp = session->mountpoint;
+	if(!session->substream_auto || mp == NULL || mp->streaming_source != janus_streaming_source_rtp) {
+		janus_mutex_unlock(&sessions_mutex);
+		return;
+	}
+	janus_mutex_lock(&mp->mutex);
+	janus_streaming_rtp_source *source = (janus_streaming_rtp_source *)mp->source;
+	int target = -1;
+	if(source != NULL && source->simulcast)
+		target = janus_rtp_simulcast_pick_substream(&source->substream_bitrates, session->substream_target, bitrate);
+	if(target < 0) {
+		/* Not simulcast, or we don't know enough about the substreams yet */
+		janus_mutex_unlock(&mp->mutex);
+		janus_mutex_unlock(&sessions_mutex);
+		return;
+	}
+	if(target != session->substream_target) {
+		/* The switch will happen as soon as a keyframe is received on the new substream */
+		JANUS_LOG(LOG_VERB, "Estimated bandwidth is %"SCNu32", switching to simulcast substream %d (was %d)\n",
+			bitrate, target, session->substream_target);
+		session->substream_target = target;
+	}
+	janus_mutex_unlock(&mp->mutex);
+	janus_mutex_unlock(&sessions_mutex);
+}
+
 void janus_streaming_hangup_media(janus_plugin_session *handle) {
 	janus_mutex_lock(&sessions_mutex);
 	janus_streaming_hangup_media_internal(handle);
@@ -2831,10 +2877,12 @@ static void *janus_streaming_handler(void *data) {
 					session->templayer = -1;
 					session->templayer_target = 2;
 					janus_vp8_simulcast_context_reset(&session->simulcast_context);
-					/* Unless the request contains a target */
+					/* Unless the request contains a target (or we're told what we can send) */
+					session->substream_auto = TRUE;
 					json_t *substream = json_object_get(root, "substream");
 					if(substream) {
 						session->substream_target = json_integer_value(substream);
+						session->substream_auto = FALSE;
 						JANUS_LOG(LOG_VERB, "Setting video substream to let through (simulcast): %d (was %d)\n",
 							session->substream_target, session->substream);
 					}
@@ -2869,6 +2917,13 @@ done:
 					"c=IN IP4 1.1.1.1\r\n",
 					mp->codecs.audio_pt);
 				g_strlcat(sdptemp, buffer, 2048);
+				if(gateway->send_side_bwe_is_enabled()) {
+					/* The core will estimate the bandwidth towards this viewer */
+					g_snprintf(buffer, 512,
+						"a=extmap:%d %s\r\n",
+						JANUS_STREAMING_TRANSPORT_WIDE_CC_EXTMAP_ID, JANUS_RTP_EXTMAP_TRANSPORT_WIDE_CC);
+					g_strlcat(sdptemp, buffer, 2048);
+				}
 				if(mp->codecs.audio_rtpmap) {
 					g_snprintf(buffer, 512,
 						"a=rtpmap:%d %s\r\n",
@@ -2890,6 +2945,13 @@ done:
 					"c=IN IP4 1.1.1.1\r\n",
 					mp->codecs.video_pt);
 				g_strlcat(sdptemp, buffer, 2048);
+				if(gateway->send_side_bwe_is_enabled()) {
+					/* The core will estimate the bandwidth towards this viewer */
+					g_snprintf(buffer, 512,
+						"a=extmap:%d %s\r\n",
+						JANUS_STREAMING_TRANSPORT_WIDE_CC_EXTMAP_ID, JANUS_RTP_EXTMAP_TRANSPORT_WIDE_CC);
+					g_strlcat(sdptemp, buffer, 2048);
+				}
 				if(mp->codecs.video_rtpmap) {
 					g_snprintf(buffer, 512,
 						"a=rtpmap:%d %s\r\n",
@@ -2910,6 +2972,12 @@ done:
 					"a=rtcp-fb:%d goog-remb\r\n",
 					mp->codecs.video_pt);
 				g_strlcat(sdptemp, buffer, 2048);
+				if(gateway->send_side_bwe_is_enabled()) {
+					g_snprintf(buffer, 512,
+						"a=rtcp-fb:%d transport-cc\r\n",
+						mp->codecs.video_pt);
+					g_strlcat(sdptemp, buffer, 2048);
+				}
 				g_strlcat(sdptemp, "a=sendonly\r\n", 2048);
 			}
 #ifdef HAVE_SCTP
@@ -2995,10 +3063,12 @@ done:
 					session->templayer = -1;
 					session->templayer_target = 2;
 					janus_vp8_simulcast_context_reset(&session->simulcast_context);
-					/* Unless the request contains a target */
+					/* Unless the request contains a target (or we're told what we can send) */
+					session->substream_auto = TRUE;
 					json_t *substream = json_object_get(root, "substream");
 					if(substream) {
 						session->substream_target = json_integer_value(substream);
+						session->substream_auto = FALSE;
 						JANUS_LOG(LOG_VERB, "Setting video substream to let through (simulcast): %d (was %d)\n",
 							session->substream_target, session->substream);
 						if(session->substream_target == session->substream) {
@@ -4813,6 +4883,10 @@ static void *janus_streaming_relay_thread(void *data) {
 					packet.is_keyframe = FALSE;
 					packet.simulcast = source->simulcast;
 					packet.substream = index;
+					if(source->simulcast) {
+						/* Keep track of how much each substream needs, in case viewers pick them by bandwidth */
+						janus_rtp_simulcast_bitrates_update(&source->substream_bitrates, index, bytes, now);
+					}
 					packet.codec = mountpoint->codecs.video_codec;
 					/* Do we have a new stream? */
 					if(ssrc != v_last_ssrc[index]) {
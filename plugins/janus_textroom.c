@@ -86,8 +86,8 @@ const char *janus_textroom_get_package(void);
 void janus_textroom_create_session(janus_plugin_session *handle, int *error);
 struct janus_plugin_result *janus_textroom_handle_message(janus_plugin_session *handle, char *transaction, json_t *message, json_t *jsep);
 void janus_textroom_setup_media(janus_plugin_session *handle);
-void janus_textroom_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len);
-void janus_textroom_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len);
+void janus_textroom_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtp_extensions *extensions);
+void janus_textroom_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtcp_summary *summary);
 void janus_textroom_incoming_data(janus_plugin_session *handle, char *buf, int len);
 void janus_textroom_slow_link(janus_plugin_session *handle, int uplink, int video);
 void janus_textroom_hangup_media(janus_plugin_session *handle);
@@ -812,11 +812,11 @@ void janus_textroom_setup_media(janus_plugin_session *handle) {
 	janus_mutex_unlock(&sessions_mutex);
 }
 
-void janus_textroom_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len) {
+void janus_textroom_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtp_extensions *extensions) {
 	/* We don't do audio/video */
 }
 
-void janus_textroom_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len) {
+void janus_textroom_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtcp_summary *summary) {
 	/* We don't do audio/video */
 }
 
@@ -959,14 +959,17 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			/* Everybody in the room */
 			JANUS_LOG(LOG_VERB, "To everybody in %"SCNu64": %s\n", room_id, message);
 			if(textroom->participants) {
+				/* The same message goes to all participants, so have the core share it rather than copy it */
+				janus_plugin_data *data = janus_plugin_data_new(msg_text, strlen(msg_text), FALSE);
 				GHashTableIter iter;
 				gpointer value;
 				g_hash_table_iter_init(&iter, textroom->participants);
 				while(g_hash_table_iter_next(&iter, NULL, &value)) {
 					janus_textroom_participant *top = value;
 					JANUS_LOG(LOG_VERB, "  >> To %s in %"SCNu64": %s\n", top->username, room_id, message);
-					gateway->relay_data(top->session->handle, msg_text, strlen(msg_text));
+					gateway->relay_data_shared(top->session->handle, data);
 				}
+				janus_plugin_data_unref(data);
 			}
 #ifdef HAVE_LIBCURL
 			/* Is there a backend waiting for this message too? */
@@ -172,10 +172,11 @@ const char *janus_videoroom_get_package(void);
 void janus_videoroom_create_session(janus_plugin_session *handle, int *error);
 struct janus_plugin_result *janus_videoroom_handle_message(janus_plugin_session *handle, char *transaction, json_t *message, json_t *jsep);
 void janus_videoroom_setup_media(janus_plugin_session *handle);
-void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len);
-void janus_videoroom_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len);
+void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtp_extensions *extensions);
+void janus_videoroom_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtcp_summary *summary);
 void janus_videoroom_incoming_data(janus_plugin_session *handle, char *buf, int len);
 void janus_videoroom_slow_link(janus_plugin_session *handle, int uplink, int video);
+void janus_videoroom_estimated_bandwidth(janus_plugin_session *handle, uint32_t bitrate);
 void janus_videoroom_hangup_media(janus_plugin_session *handle);
 void janus_videoroom_destroy_session(janus_plugin_session *handle, int *error);
 json_t *janus_videoroom_query_session(janus_plugin_session *handle);
@@ -201,6 +202,7 @@ static janus_plugin janus_videoroom_plugin =
 		.incoming_rtcp = janus_videoroom_incoming_rtcp,
 		.incoming_data = janus_videoroom_incoming_data,
 		.slow_link = janus_videoroom_slow_link,
+		.estimated_bandwidth = janus_videoroom_estimated_bandwidth,
 		.hangup_media = janus_videoroom_hangup_media,
 		.destroy_session = janus_videoroom_destroy_session,
 		.query_session = janus_videoroom_query_session,
@@ -626,6 +628,7 @@ typedef struct janus_videoroom_participant {
 	guint32 audio_ssrc;		/* Audio SSRC of this publisher */
 	guint32 video_ssrc;		/* Video SSRC of this publisher */
 	uint32_t ssrc[3];		/* Only needed in case VP8 simulcasting is involved */
+	janus_rtp_simulcast_bitrates substream_bitrates;	/* Bitrate of each simulcast substream, in case subscribers pick them by bandwidth */
 	int rtpmapid_extmap_id;	/* Only needed in case Firefox's RID-based simulcasting is involved */
 	char *rid[3];			/* Only needed in case Firefox's RID-based simulcasting is involved */
 	guint8 audio_level_extmap_id;		/* Audio level extmap ID */
@@ -677,6 +680,8 @@ typedef struct janus_videoroom_listener {
 	janus_rtp_switching_context context;	/* Needed in case there are publisher switches on this listener */
 	int substream;			/* Which VP8 simulcast substream we should forward, in case the publisher is simulcasting */
 	int substream_target;	/* As above, but to handle transitions (e.g., wait for keyframe) */
+	gboolean substream_auto;	/* Whether the substream is chosen automatically, using the bandwidth the core estimated */
+	uint32_t estimated_bitrate;	/* Latest bandwidth estimate from the core, if any */
 	int templayer;			/* Which VP8 simulcast temporal layer we should forward, in case the publisher is simulcasting */
 	int templayer_target;	/* As above, but to handle transitions (e.g., wait for keyframe) */
 	gint64 last_relayed;	/* When we relayed the last packet (used to detect when substreams become unavailable) */
@@ -705,6 +710,8 @@ typedef struct janus_videoroom_rtp_relay_packet {
 	int spatial_layer;
 	int temporal_layer;
 	uint8_t pbit, dbit, ubit, bbit, ebit;
+	/* Copy of the packet all listeners share, created the first time it's needed */
+	janus_rtp_shared_packet *shared;
 } janus_videoroom_rtp_relay_packet;
 
 
@@ -1537,6 +1544,9 @@ json_t *janus_videoroom_query_session(janus_plugin_session *handle) {
 					json_object_set_new(info, "simulcast", json_true());
 					json_object_set_new(info, "substream", json_integer(participant->substream));
 					json_object_set_new(info, "substream-target", json_integer(participant->substream_target));
+					json_object_set_new(info, "substream-auto", participant->substream_auto ? json_true() : json_false());
+					if(participant->estimated_bitrate > 0)
+						json_object_set_new(info, "estimated-bitrate", json_integer(participant->estimated_bitrate));
 					json_object_set_new(info, "temporal-layer", json_integer(participant->templayer));
 					json_object_set_new(info, "temporal-layer-target", json_integer(participant->templayer_target));
 				}
@@ -3047,7 +3057,7 @@ void janus_videoroom_setup_media(janus_plugin_session *handle) {
 	janus_mutex_unlock(&sessions_mutex);
 }
 
-void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len) {
+void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtp_extensions *extensions) {
 	if(handle == NULL || handle->stopped || g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized) || !gateway)
 		return;
 	janus_videoroom_session *session = (janus_videoroom_session *)handle->plugin_handle;
@@ -3059,9 +3069,9 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 	if(participant->kicked || videoroom == NULL)
 		return;
 	/* In case this is an audio packet and we're doing talk detection, check the audio level extension */
-	if(!video && videoroom->audiolevel_event && participant->audio_active) {
-		int level = 0;
-		if(janus_rtp_header_extension_parse_audio_level(buf, len, participant->audio_level_extmap_id, &level) == 0) {
+	if(!video && videoroom->audiolevel_event && participant->audio_active && extensions != NULL) {
+		int level = extensions->audio_level;
+		if(participant->audio_level_extmap_id > 0 && level >= 0) {
 			participant->audio_dBov_sum += level;
 			participant->audio_active_packets++;
 			participant->audio_dBov_level = level;
@@ -3115,6 +3125,9 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 				sc = 1;
 			else if(ssrc == participant->ssrc[2])
 				sc = 2;
+			/* Keep track of how much each substream needs, in case subscribers pick them by bandwidth */
+			if(sc >= 0)
+				janus_rtp_simulcast_bitrates_update(&participant->substream_bitrates, sc, len, janus_get_monotonic_time());
 		} else {
 			/* Set the SSRC of the publisher */
 			rtp->ssrc = htonl(video ? participant->video_ssrc : participant->audio_ssrc);
@@ -3191,6 +3204,7 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 		packet.length = len;
 		packet.is_video = video;
 		packet.svc = FALSE;
+		packet.shared = NULL;
 		if(video && videoroom->do_svc) {
 			/* We're doing SVC: let's parse this packet to see which layers are there */
 			int plen = 0;
@@ -3222,6 +3236,7 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 		janus_mutex_lock_nodebug(&participant->listeners_mutex);
 		g_slist_foreach(participant->listeners, janus_videoroom_relay_rtp_packet, &packet);
 		janus_mutex_unlock_nodebug(&participant->listeners_mutex);
+		janus_rtp_shared_packet_unref(packet.shared);
 
 		/* Check if we need to send any REMB, FIR or PLI back to this publisher */
 		if(video && participant->video_active) {
@@ -3285,7 +3300,7 @@ void janus_videoroom_incoming_rtp(janus_plugin_session *handle, int video, char
 	}
 }
 
-void janus_videoroom_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len) {
+void janus_videoroom_incoming_rtcp(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtcp_summary *summary) {
 	if(g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
 		return;
 	janus_videoroom_session *session = (janus_videoroom_session *)handle->plugin_handle;	
@@ -3300,7 +3315,7 @@ void janus_videoroom_incoming_rtcp(janus_plugin_session *handle, int video, char
 		janus_videoroom_listener *l = (janus_videoroom_listener *)session->participant;
 		if(!l || !l->video)
 			return;	/* The only feedback we handle is video related anyway... */
-		if(janus_rtcp_has_fir(buf, len)) {
+		if(summary ? summary->has_fir : janus_rtcp_has_fir(buf, len)) {
 			/* We got a FIR, forward it to the publisher */
 			if(l->feed) {
 				janus_videoroom_participant *p = l->feed;
@@ -3314,7 +3329,7 @@ void janus_videoroom_incoming_rtcp(janus_plugin_session *handle, int video, char
 				}
 			}
 		}
-		if(janus_rtcp_has_pli(buf, len)) {
+		if(summary ? summary->has_pli : janus_rtcp_has_pli(buf, len)) {
 			/* We got a PLI, forward it to the publisher */
 			if(l->feed) {
 				janus_videoroom_participant *p = l->feed;
@@ -3328,7 +3343,7 @@ void janus_videoroom_incoming_rtcp(janus_plugin_session *handle, int video, char
 				}
 			}
 		}
-		uint32_t bitrate = janus_rtcp_get_remb(buf, len);
+		uint32_t bitrate = summary ? summary->remb : janus_rtcp_get_remb(buf, len);
 		if(bitrate > 0) {
 			/* FIXME We got a REMB from this listener, should we do something about it? */
 		}
@@ -3422,6 +3437,52 @@ void janus_videoroom_slow_link(janus_plugin_session *handle, int uplink, int vid
 	janus_mutex_unlock(&sessions_mutex);
 }
 
+void janus_videoroom_estimated_bandwidth(janus_plugin_session *handle, uint32_t bitrate) {
+	/* The core is telling us how much bandwidth is available towards this peer: if it's
+	 * a subscriber to a simulcast publisher, we can use it to pick the right substream */
+	if(handle == NULL || handle->stopped || g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized) || !gateway)
+		return;
+	janus_mutex_lock(&sessions_mutex);
+	janus_videoroom_session *session = janus_videoroom_lookup_session(handle);
+	if(!session || session->destroyed || !session->participant || session->participant_type != janus_videoroom_p_type_subscriber) {
+		janus_mutex_unlock(&sessions_mutex);
+		return;
+	}
+	janus_videoroom_listener *listener = (janus_videoroom_listener *)session->participant;
+	listener->estimated_bitrate = bitrate;
+	janus_videoroom_participant *publisher = listener->feed;
+	if(!listener->substream_auto || !listener->video || publisher == NULL || publisher->ssrc[0] == 0) {
+		/* Not simulcast */
+		janus_mutex_unlock(&sessions_mutex);
+		return;
+	}
+	int target = janus_rtp_simulcast_pick_substream(&publisher->substream_bitrates, listener->substream_target, bitrate);
+	if(target < 0) {
+		/* We don't know enough about the substreams yet */
+		janus_mutex_unlock(&sessions_mutex);
+		return;
+	}
+	if(target != listener->substream_target) {
+		JANUS_LOG(LOG_VERB, "Estimated bandwidth is %"SCNu32", switching to simulcast substream %d (was %d)\n",
+			bitrate, target, listener->substream_target);
+		listener->substream_target = target;
+		if(listener->substream_target != listener->substream) {
+			/* Send a FIR */
+			char buf[20];
+			janus_rtcp_fir((char *)&buf, 20, &publisher->fir_seq);
+			JANUS_LOG(LOG_VERB, "Simulcasting substream change, sending FIR to %"SCNu64" (%s)\n", publisher->user_id, publisher->display ? publisher->display : "??");
+			gateway->relay_rtcp(publisher->session->handle, 1, buf, 20);
+			/* Send a PLI too, just in case... */
+			janus_rtcp_pli((char *)&buf, 12);
+			JANUS_LOG(LOG_VERB, "Simulcasting substream change, sending PLI to %"SCNu64" (%s)\n", publisher->user_id, publisher->display ? publisher->display : "??");
+			gateway->relay_rtcp(publisher->session->handle, 1, buf, 12);
+			/* Update the time of when we last sent a keyframe request */
+			publisher->fir_latest = janus_get_monotonic_time();
+		}
+	}
+	janus_mutex_unlock(&sessions_mutex);
+}
+
 static void janus_videoroom_recorder_create(janus_videoroom_participant *participant, gboolean audio, gboolean video, gboolean data) {
 	char filename[255];
 	gint64 now = janus_get_real_time();
@@ -3938,6 +3999,7 @@ static void *janus_videoroom_handler(void *data) {
 					listener->paused = TRUE;	/* We need an explicit start from the listener */
 					listener->substream = -1;
 					listener->substream_target = 2;
+					listener->substream_auto = TRUE;	/* Unless a specific substream is requested */
 					listener->templayer = -1;
 					listener->templayer_target = 2;
 					listener->last_relayed = 0;
@@ -4360,6 +4422,8 @@ static void *janus_videoroom_handler(void *data) {
 					/* Check if a simulcasting-related request is involved */
 					if(sc_substream && publisher->ssrc[0] != 0) {
 						listener->substream_target = json_integer_value(sc_substream);
+						/* The user chose a substream explicitly, stop picking it ourselves */
+						listener->substream_auto = FALSE;
 						JANUS_LOG(LOG_VERB, "Setting video SSRC to let through (simulcast): %"SCNu32" (index %d, was %d)\n",
 							publisher->ssrc[listener->substream], listener->substream_target, listener->substream);
 						if(listener->substream_target == listener->substream) {
@@ -5016,7 +5080,18 @@ static void *janus_videoroom_handler(void *data) {
 						janus_sdp_attribute_add_to_mline(m, a);
 					}
 				}
-				/* DO not send transport wide CC to subscribers */
+				/* Only offer transport wide CC to subscribers if the core is going to stamp
+				 * the packets itself: the ones we relay carry the publisher's sequence numbers */
+				if(transport_wide_cc_extmap && gateway->send_side_bwe_is_enabled()) {
+					janus_sdp_mline *m = janus_sdp_mline_find(offer, JANUS_SDP_VIDEO);
+					if(m == NULL)
+						m = janus_sdp_mline_find(offer, JANUS_SDP_AUDIO);
+					if(m != NULL) {
+						janus_sdp_attribute *a = janus_sdp_attribute_create("extmap",
+							"%d %s\r\n", participant->transport_wide_cc_extmap_id, JANUS_RTP_EXTMAP_TRANSPORT_WIDE_CC);
+						janus_sdp_attribute_add_to_mline(m, a);
+					}
+				}
 				/* Generate an SDP string we can offer subscribers later on */
 				char *offer_sdp = janus_sdp_write(offer);
 				if(!sdp_update) {
@@ -5111,6 +5186,23 @@ error:
 }
 
 /* Helper to quickly relay RTP packets from publishers to subscribers */
+/* Helper to relay a packet whose header we just updated for a listener: rather
+ * than having the core copy the whole packet for each of them, all listeners
+ * share the same copy, and the core only gets the header they should see */
+static void janus_videoroom_relay_rtp_shared(janus_videoroom_session *session, janus_videoroom_rtp_relay_packet *packet) {
+	if(gateway == NULL)
+		return;
+	if(packet->shared == NULL) {
+		packet->shared = janus_rtp_shared_packet_new((char *)packet->data, packet->length);
+		if(packet->shared == NULL)
+			return;
+	}
+	janus_rtp_header_override override;
+	janus_rtp_header_override_init(&override, packet->data);
+	override.markerbit = packet->data->markerbit;
+	gateway->relay_rtp_shared(session->handle, packet->is_video, packet->shared, &override);
+}
+
 static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data) {
 	janus_videoroom_rtp_relay_packet *packet = (janus_videoroom_rtp_relay_packet *)user_data;
 	if(!packet || !packet->data || packet->length < 1) {
@@ -5239,8 +5331,7 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 			if(override_mark_bit && !has_marker_bit) {
 				packet->data->markerbit = 1;
 			}
-			if(gateway != NULL)
-				gateway->relay_rtp(session->handle, packet->is_video, (char *)packet->data, packet->length);
+			janus_videoroom_relay_rtp_shared(session, packet);
 			if(override_mark_bit && !has_marker_bit) {
 				packet->data->markerbit = 0;
 			}
@@ -5352,7 +5443,7 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 			char vp8pd[6];
 			memcpy(vp8pd, payload, sizeof(vp8pd));
 			janus_vp8_simulcast_descriptor_update(payload, plen, &listener->simulcast_context, switched);
-			/* Send the packet */
+			/* Send the packet (this one can't be shared, as the payload descriptor is specific to this viewer) */
 			if(gateway != NULL)
 				gateway->relay_rtp(session->handle, packet->is_video, (char *)packet->data, packet->length);
 			/* Restore the timestamp and sequence number to what the publisher set them to */
@@ -5364,8 +5455,7 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 			/* Fix sequence number and timestamp (publisher switching may be involved) */
 			janus_rtp_header_update(packet->data, &listener->context, TRUE, 4500);
 			/* Send the packet */
-			if(gateway != NULL)
-				gateway->relay_rtp(session->handle, packet->is_video, (char *)packet->data, packet->length);
+			janus_videoroom_relay_rtp_shared(session, packet);
 			/* Restore the timestamp and sequence number to what the publisher set them to */
 			packet->data->timestamp = htonl(packet->timestamp);
 			packet->data->seq_number = htons(packet->seq_number);
@@ -5379,8 +5469,7 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 		/* Fix sequence number and timestamp (publisher switching may be involved) */
 		janus_rtp_header_update(packet->data, &listener->context, FALSE, 960);
 		/* Send the packet */
-		if(gateway != NULL)
-			gateway->relay_rtp(session->handle, packet->is_video, (char *)packet->data, packet->length);
+		janus_videoroom_relay_rtp_shared(session, packet);
 		/* Restore the timestamp and sequence number to what the publisher set them to */
 		packet->data->timestamp = htonl(packet->timestamp);
 		packet->data->seq_number = htons(packet->seq_number);
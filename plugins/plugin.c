@@ -2,8 +2,8 @@
  * \author Lorenzo Miniero <lorenzo@meetecho.com>
  * \copyright GNU General Public License v3
  * \brief  Plugin-Gateway communication (implementation)
- * \details  Implementation of the janus_plugin_result stuff: all the
- * important things related to the actual plugin API is in plugin.h.
+ * \details  Implementation of the janus_plugin_result and janus_plugin_data
+ * stuff: all the important things related to the actual plugin API is in plugin.h.
  *
  * \ingroup pluginapi
  * \ref pluginapi
@@ -38,3 +38,29 @@ void janus_plugin_result_destroy(janus_plugin_result *result) {
 	g_free(result);
 }
 
+
+janus_plugin_data *janus_plugin_data_new(char *buf, int len, gboolean binary) {
+	if(buf == NULL || len < 1)
+		return NULL;
+	/* The message and its buffer are a single allocation */
+	janus_plugin_data *data = g_malloc(sizeof(janus_plugin_data) + len);
+	data->ref = 1;
+	data->binary = binary;
+	data->buffer = (char *)data + sizeof(janus_plugin_data);
+	data->length = len;
+	memcpy(data->buffer, buf, len);
+	return data;
+}
+
+void janus_plugin_data_ref(janus_plugin_data *data) {
+	if(data == NULL)
+		return;
+	g_atomic_int_inc(&data->ref);
+}
+
+void janus_plugin_data_unref(janus_plugin_data *data) {
+	if(data == NULL)
+		return;
+	if(g_atomic_int_dec_and_test(&data->ref))
+		g_free(data);
+}
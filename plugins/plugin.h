@@ -19,8 +19,12 @@
  * important thing is that it MUST be a JSON object, as it will be included
  * as such within the Janus session/handle protocol;
  * - \c relay_rtp(): to send/relay the peer an RTP packet;
+ * - \c relay_rtp_shared(): to send/relay the peer an RTP packet that is
+ * being sent to other peers as well, without copying it for each of them;
  * - \c relay_rtcp(): to send/relay the peer an RTCP message.
  * - \c relay_data(): to send/relay the peer a SCTP DataChannel message.
+ * - \c relay_data_shared(): to send/relay the peer a (text or binary) SCTP
+ * DataChannel message, possibly shared with other peers, without copying it.
  *
  * On the other hand, a plugin that wants to register at the gateway
  * needs to implement the \c janus_plugin interface. Besides, as a
@@ -64,23 +68,27 @@ janus_plugin *create(void) {
  * - \c incoming_rtp(): a callback to notify you a peer has sent you a RTP packet;
  * - \c incoming_rtcp(): a callback to notify you a peer has sent you a RTCP message;
  * - \c incoming_data(): a callback to notify you a peer has sent you a message on a SCTP DataChannel;
+ * - \c incoming_binary_data(): a callback to notify you a peer has sent you a binary message on a SCTP DataChannel;
  * - \c slow_link(): a callback to notify you a peer has sent a lot of NACKs recently, and the media path may be slow;
+ * - \c estimated_bandwidth(): a callback to notify you about how much bandwidth the core estimates is available towards a peer;
  * - \c hangup_media(): a callback to notify you the peer PeerConnection has been closed (e.g., after a DTLS alert);
  * - \c query_session(): this method is called by the gateway to get plugin-specific info on a session between you and a peer;
  * - \c destroy_session(): this method is called by the gateway to destroy a session between you and a peer.
  *
  * All the above methods and callbacks, except for \c incoming_rtp ,
- * \c incoming_rtcp , \c incoming_data and \c slow_link , are mandatory:
- * the Janus core will reject a plugin that doesn't implement any of the
- * mandatory callbacks. The previously mentioned ones, instead, are
+ * \c incoming_rtcp , \c incoming_data , \c incoming_binary_data , \c slow_link and \c estimated_bandwidth ,
+ * are mandatory: the Janus core will reject a plugin that doesn't implement
+ * any of the mandatory callbacks. The previously mentioned ones, instead, are
  * optional, so you're free to implement only those you care about. If
  * your plugin will not handle any data channel, for instance, it makes
- * sense to not implement the \c incoming_data callback at all. At the
+ * sense to not implement the \c incoming_data callback at all, while if
+ * you don't implement \c incoming_binary_data binary messages will be
+ * passed to \c incoming_data as well, as they've always been. At the
  * same time, if your plugin is ONLY going to use data channels and
  * can't care less about RTP or RTCP, \c incoming_rtp and \c incoming_rtcp
- * can be left out. Finally, \c slow_link is just there as a helper, some
- * additional information you may be interested about, but you're not
- * forced to receive it if you don't care.
+ * can be left out. Finally, \c slow_link and \c estimated_bandwidth are
+ * just there as helpers, some additional information you may be interested
+ * about, but you're not forced to receive it if you don't care.
  *
  * The gateway \c janus_callbacks interface is provided to a plugin, together
  * with the path to the configurations files folder, in the \c init() method.
@@ -157,6 +165,9 @@ janus_plugin *create(void) {
 
 #include <glib.h>
 
+#include "../rtp.h"
+#include "../rtcp.h"
+
 /*! \brief Version of the API, to match the one plugins were compiled against
  *
  * \note This was added in version 0.0.7 of the gateway, to address changes
@@ -165,8 +176,23 @@ janus_plugin *create(void) {
  * this work. Do NOT try to launch a pre 0.0.7 plugin on a >= 0.0.7
  * gateway or it will crash.
  *
+ * \note Version 10 changed the API in a single step, so plugins written
+ * for version 9 need to be updated as follows:
+ * - \c incoming_rtp() has a new \c extensions argument, with the RTP
+ * extensions the core already parsed for the packet (it may be NULL);
+ * - \c incoming_rtcp() has a new \c summary argument, with what the core
+ * already parsed out of the compound RTCP message (it may be NULL);
+ * - the new, optional, \c incoming_binary_data() and \c estimated_bandwidth()
+ * callbacks were added to the plugin interface, after \c incoming_data()
+ * and \c slow_link() respectively;
+ * - the new \c relay_rtp_shared(), \c relay_data_shared() and
+ * \c send_side_bwe_is_enabled() callbacks were added to the core interface.
+ *
+ * Since the plugin interface is a struct, plugins must be recompiled
+ * even if they don't use any of the new callbacks.
+ *
  */
-#define JANUS_PLUGIN_API_VERSION	9
+#define JANUS_PLUGIN_API_VERSION	10
 
 /*! \brief Initialization of all plugin properties to NULL
  *
@@ -200,7 +226,9 @@ static janus_plugin janus_echotest_plugin =
 		.incoming_rtp = NULL,			\
 		.incoming_rtcp = NULL,			\
 		.incoming_data = NULL,			\
+		.incoming_binary_data = NULL,	\
 		.slow_link = NULL,				\
+		.estimated_bandwidth = NULL,	\
 		.hangup_media = NULL,			\
 		.destroy_session = NULL,		\
 		.query_session = NULL, 			\
@@ -230,6 +258,32 @@ struct janus_plugin_session {
 	int stopped:1;
 };
 
+/*! \brief A data channel message, that can be relayed to many peers without copying it
+ * \note The buffer must not be modified once the message has been relayed */
+typedef struct janus_plugin_data {
+	/*! \brief Reference counter */
+	volatile gint ref;
+	/*! \brief Whether this is a binary message (text otherwise) */
+	gboolean binary;
+	/*! \brief The message data */
+	char *buffer;
+	/*! \brief The message length */
+	int length;
+} janus_plugin_data;
+
+/*! \brief Create a new shared data channel message, copying the provided buffer
+ * @param[in] buf The message data
+ * @param[in] len The message length
+ * @param[in] binary Whether this is a binary message (text otherwise)
+ * @returns A new janus_plugin_data instance with a single reference, or NULL in case of errors */
+janus_plugin_data *janus_plugin_data_new(char *buf, int len, gboolean binary);
+/*! \brief Take a reference to a shared data channel message
+ * @param[in] data The janus_plugin_data instance to take a reference to */
+void janus_plugin_data_ref(janus_plugin_data *data);
+/*! \brief Release a reference to a shared data channel message, freeing it if it was the last one
+ * @param[in] data The janus_plugin_data instance to release */
+void janus_plugin_data_unref(janus_plugin_data *data);
+
 /*! \brief The plugin session and callbacks interface */
 struct janus_plugin {
 	/*! \brief Plugin initialization/constructor
@@ -279,14 +333,16 @@ struct janus_plugin {
 	 * @param[in] handle The plugin/gateway session used for this peer
 	 * @param[in] video Whether this is an audio or a video frame
 	 * @param[in] buf The packet data (buffer)
-	 * @param[in] len The buffer lenght */
-	void (* const incoming_rtp)(janus_plugin_session *handle, int video, char *buf, int len);
+	 * @param[in] len The buffer lenght
+	 * @param[in] extensions The RTP extensions the core already parsed for this packet, if any */
+	void (* const incoming_rtp)(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtp_extensions *extensions);
 	/*! \brief Method to handle an incoming RTCP packet from a peer
 	 * @param[in] handle The plugin/gateway session used for this peer
 	 * @param[in] video Whether this is related to an audio or a video stream
 	 * @param[in] buf The message data (buffer)
-	 * @param[in] len The buffer lenght */
-	void (* const incoming_rtcp)(janus_plugin_session *handle, int video, char *buf, int len);
+	 * @param[in] len The buffer lenght
+	 * @param[in] summary The summary of the message the core already parsed, if any */
+	void (* const incoming_rtcp)(janus_plugin_session *handle, int video, char *buf, int len, const janus_rtcp_summary *summary);
 	/*! \brief Method to handle incoming SCTP/DataChannel data from a peer (text only, for the moment)
 	 * \note We currently only support text data, binary data will follow... please also notice that
 	 * DataChannels send unterminated strings, so you'll have to terminate them with a \0 yourself to
@@ -295,6 +351,13 @@ struct janus_plugin {
 	 * @param[in] buf The message data (buffer)
 	 * @param[in] len The buffer lenght */
 	void (* const incoming_data)(janus_plugin_session *handle, char *buf, int len);
+	/*! \brief Method to handle incoming binary SCTP/DataChannel data from a peer
+	 * \note If a plugin doesn't implement this, binary messages are passed to \c incoming_data
+	 * too. Messages the peer sent in fragments are only passed once they're complete
+	 * @param[in] handle The plugin/gateway session used for this peer
+	 * @param[in] buf The message data (buffer)
+	 * @param[in] len The buffer lenght */
+	void (* const incoming_binary_data)(janus_plugin_session *handle, char *buf, int len);
 	/*! \brief Method to be notified by the core when too many NACKs have
 	 * been received or sent by Janus, and so a slow or potentially
 	 * unreliable network is to be expected for this peer
@@ -312,6 +375,18 @@ struct janus_plugin {
 	 * or downlink (peer to Janus)
 	 * @param[in] video Whether this is related to an audio or a video stream */
 	void (* const slow_link)(janus_plugin_session *handle, int uplink, int video);
+	/*! \brief Method to be notified by the core about the bandwidth it estimates
+	 * is available towards a peer, using transport wide CC feedback
+	 * \note This is only called when \c send_side_bwe is enabled in the core
+	 * configuration and the PeerConnection negotiated the transport-wide-cc
+	 * extension, whenever the estimate changes significantly (or at least
+	 * once per second). Unlike REMB, this is computed by Janus itself, which
+	 * means it's available regardless of what the browser sends, and it
+	 * reacts to congestion faster: plugins can use it, e.g., to choose
+	 * which simulcast substream to send to a peer.
+	 * @param[in] handle The plugin/gateway session used for this peer
+	 * @param[in] bitrate The estimated available bandwidth, in bits per second */
+	void (* const estimated_bandwidth)(janus_plugin_session *handle, uint32_t bitrate);
 	/*! \brief Callback to be notified about DTLS alerts from a peer (i.e., the PeerConnection is not valid any more)
 	 * @param[in] handle The plugin/gateway session used for this peer */
 	void (* const hangup_media)(janus_plugin_session *handle);
@@ -347,6 +422,17 @@ struct janus_callbacks {
 	 * @param[in] buf The packet data (buffer)
 	 * @param[in] len The buffer lenght */
 	void (* const relay_rtp)(janus_plugin_session *handle, int video, char *buf, int len);
+	/*! \brief Callback to relay an RTP packet that is shared with other peers
+	 * \note Meant for fan-out (e.g., a publisher sending to many subscribers):
+	 * the payload is never modified, and the core only makes a copy of it
+	 * right before encrypting it for this peer, applying the header override.
+	 * The core takes its own reference to the packet, so you can release yours
+	 * as soon as you're done relaying it to all the peers you wanted to
+	 * @param[in] handle The plugin/gateway session used for this peer
+	 * @param[in] video Whether this is an audio or a video frame
+	 * @param[in] packet The shared RTP packet
+	 * @param[in] override The changes to the RTP header for this peer (sequence number, timestamp, etc.) */
+	void (* const relay_rtp_shared)(janus_plugin_session *handle, int video, janus_rtp_shared_packet *packet, janus_rtp_header_override *override);
 	/*! \brief Callback to relay RTCP messages to a peer
 	 * @param[in] handle The plugin/gateway session that will be used for this peer
 	 * @param[in] video Whether this is related to an audio or a video stream
@@ -358,6 +444,14 @@ struct janus_callbacks {
 	 * @param[in] buf The message data (buffer)
 	 * @param[in] len The buffer lenght */
 	void (* const relay_data)(janus_plugin_session *handle, char *buf, int len);
+	/*! \brief Callback to relay a text or binary SCTP/DataChannel message to a peer, without copying it
+	 * \note Meant for large messages (e.g., file transfers), and for messages sent to many
+	 * peers (e.g., a room): the core takes its own reference to the message, and only hands
+	 * it to the SCTP stack when it's time to send it, so you can release yours as soon as
+	 * you're done relaying it to all the peers you wanted to
+	 * @param[in] handle The plugin/gateway session that will be used for this peer
+	 * @param[in] data The shared message */
+	void (* const relay_data_shared)(janus_plugin_session *handle, janus_plugin_data *data);
 
 	/*! \brief Callback to ask the core to close a WebRTC PeerConnection
 	 * \note A call to this method will result in the core invoking the hangup_media
@@ -369,6 +463,11 @@ struct janus_callbacks {
 	 * callback on this plugin when done
 	 * @param[in] handle The plugin/gateway session to get rid of */
 	void (* const end_session)(janus_plugin_session *handle);
+	/*! \brief Callback to check whether the core estimates the bandwidth towards peers by itself
+	 * \note When it does, plugins can negotiate the transport-wide-cc extension with peers
+	 * they send media to, and they'll get \c estimated_bandwidth notifications for them
+	 * @returns TRUE if send-side bandwidth estimation is enabled, FALSE otherwise */
+	gboolean (* const send_side_bwe_is_enabled)(void);
 
 	/*! \brief Callback to check whether the event handlers mechanism is enabled
 	 * @returns TRUE if it is, FALSE if it isn't (which means notify_event should NOT be called) */
@@ -122,14 +122,14 @@ guint32 janus_rtcp_get_receiver_ssrc(char *packet, int len) {
 }
 
 /* Helper to handle an incoming SR: triggered by a call to janus_rtcp_fix_ssrc with fixssrc=0 */
-static void janus_rtcp_incoming_sr(janus_rtcp_context *ctx, janus_rtcp_sr *sr) {
+static void janus_rtcp_incoming_sr(janus_rtcp_context *ctx, const janus_sender_info *si) {
 	if(ctx == NULL)
 		return;
 	/* Update the context with info on the monotonic time of last SR received */
 	ctx->lsr_ts = janus_get_monotonic_time();
 	/* Compute the last SR received as well */
-	uint64_t ntp = ntohl(sr->si.ntp_ts_msw);
-	ntp = (ntp << 32) | ntohl(sr->si.ntp_ts_lsw);
+	uint64_t ntp = ntohl(si->ntp_ts_msw);
+	ntp = (ntp << 32) | ntohl(si->ntp_ts_lsw);
 	ctx->lsr = (ntp >> 16);
 }
 
@@ -174,21 +174,22 @@ static void janus_rtcp_rr_update_stats(rtcp_context *ctx, janus_report_block rb)
 }
 
 /* Helper to handle an incoming RR: triggered by a call to janus_rtcp_fix_ssrc with fixssrc=0 */
-static void janus_rtcp_incoming_rr(janus_rtcp_context *ctx, janus_rtcp_rr *rr) {
+/* The report block is the first one of the RR */
+static void janus_rtcp_incoming_rr(janus_rtcp_context *ctx, const janus_report_block *rb) {
 	if(ctx == NULL)
 		return;
 	/* FIXME Check the Record Blocks */
-	if(rr->header.rc > 0) {
-		double jitter = (double)ntohl(rr->rb[0].jitter);
-		uint32_t fraction = ntohl(rr->rb[0].flcnpl) >> 24;
-		uint32_t total = ntohl(rr->rb[0].flcnpl) & 0x00FFFFFF;
+	if(rb != NULL) {
+		double jitter = (double)ntohl(rb->jitter);
+		uint32_t fraction = ntohl(rb->flcnpl) >> 24;
+		uint32_t total = ntohl(rb->flcnpl) & 0x00FFFFFF;
 		JANUS_LOG(LOG_HUGE, "jitter=%f, fraction=%"SCNu32", loss=%"SCNu32"\n", jitter, fraction, total);
 		ctx->lost_remote = total;
 		ctx->jitter_remote = jitter;
-		janus_rtcp_rr_update_stats(ctx, rr->rb[0]);
+		janus_rtcp_rr_update_stats(ctx, *rb);
 		/* FIXME Compute round trip time */
-		uint32_t lsr = ntohl(rr->rb[0].lsr);
-		uint32_t dlsr = ntohl(rr->rb[0].delay);
+		uint32_t lsr = ntohl(rb->lsr);
+		uint32_t dlsr = ntohl(rb->delay);
 		if(lsr == 0)	/* Not enough info yet */
 			return;
 		struct timeval tv;
@@ -227,7 +228,7 @@ int janus_rtcp_fix_ssrc(janus_rtcp_context *ctx, char *packet, int len, int fixs
 				JANUS_LOG(LOG_HUGE, "     #%d SR (200)\n", pno);
 				janus_rtcp_sr *sr = (janus_rtcp_sr *)rtcp;
 				/* If an RTCP context was provided, update it with info on this SR */
-				janus_rtcp_incoming_sr(ctx, sr);
+				janus_rtcp_incoming_sr(ctx, &sr->si);
 				if(fixssrc && newssrcl) {
 					sr->ssrc = htonl(newssrcl);
 				}
@@ -241,7 +242,7 @@ int janus_rtcp_fix_ssrc(janus_rtcp_context *ctx, char *packet, int len, int fixs
 				JANUS_LOG(LOG_HUGE, "     #%d RR (201)\n", pno);
 				janus_rtcp_rr *rr = (janus_rtcp_rr *)rtcp;
 				/* If an RTCP context was provided, update it with info on this RR */
-				janus_rtcp_incoming_rr(ctx, rr);
+				janus_rtcp_incoming_rr(ctx, rr->header.rc > 0 ? &rr->rb[0] : NULL);
 				if(fixssrc && newssrcl) {
 					rr->ssrc = htonl(newssrcl);
 				}
@@ -440,6 +441,172 @@ int janus_rtcp_fix_ssrc(janus_rtcp_context *ctx, char *packet, int len, int fixs
 	return 0;
 }
 
+/* Helper to expand a PID+BLP NACK block into the sequence numbers it refers to */
+static int janus_rtcp_expand_nack(uint16_t pid, uint16_t blp, uint16_t *seqs, int count, int max) {
+	if(count < max)
+		seqs[count++] = pid;
+	int j = 0;
+	for(j=0; j<16 && count < max; j++) {
+		if(blp & (1 << j))
+			seqs[count++] = pid+j+1;
+	}
+	return count;
+}
+
+/* Helper to decode the bitrate in a REMB message */
+static uint32_t janus_rtcp_remb_bitrate(janus_rtcp_fb_remb *remb) {
+	/* FIXME From rtcp_utility.cc */
+	unsigned char *_ptrRTCPData = (unsigned char *)remb;
+	_ptrRTCPData += 4;	/* Skip unique identifier and num ssrc */
+	uint8_t brExp = (_ptrRTCPData[1] >> 2) & 0x3F;
+	uint32_t brMantissa = (_ptrRTCPData[1] & 0x03) << 16;
+	brMantissa += (_ptrRTCPData[2] << 8);
+	brMantissa += (_ptrRTCPData[3]);
+	return brMantissa << brExp;
+}
+
+int janus_rtcp_summarize(char *packet, int len, janus_rtcp_summary *summary) {
+	if(summary == NULL)
+		return -1;
+	memset(summary, 0, sizeof(*summary));
+	if(packet == NULL || len < 4)
+		return -1;
+	janus_rtcp_header *rtcp = (janus_rtcp_header *)packet;
+	if(rtcp->version != 2)
+		return -1;
+	int total = len;
+	while(rtcp) {
+		/* Make sure the whole packet is there, before accessing its content */
+		int length = ntohs(rtcp->length);
+		int plen = length*4+4;
+		if(plen > total)
+			break;
+		switch(rtcp->type) {
+			case RTCP_SR: {
+				/* SR, sender report */
+				if(plen < (int)(8 + sizeof(janus_sender_info)))
+					break;
+				janus_rtcp_sr *sr = (janus_rtcp_sr *)rtcp;
+				if(summary->sender_ssrc == 0)
+					summary->sender_ssrc = ntohl(sr->ssrc);
+				summary->has_sr = TRUE;
+				summary->sr = sr->si;
+				int i = 0, blocks = sr->header.rc;
+				for(i=0; i<blocks && 8+(int)sizeof(janus_sender_info)+(i+1)*(int)sizeof(janus_report_block) <= plen; i++) {
+					if(summary->receiver_ssrc == 0 && i == 0)
+						summary->receiver_ssrc = ntohl(sr->rb[0].ssrc);
+					if(summary->blocks_count < JANUS_RTCP_SUMMARY_MAX_BLOCKS)
+						summary->blocks[summary->blocks_count++] = sr->rb[i];
+				}
+				break;
+			}
+			case RTCP_RR: {
+				/* RR, receiver report */
+				if(plen < 8)
+					break;
+				janus_rtcp_rr *rr = (janus_rtcp_rr *)rtcp;
+				if(summary->sender_ssrc == 0)
+					summary->sender_ssrc = ntohl(rr->ssrc);
+				int i = 0, blocks = rr->header.rc;
+				for(i=0; i<blocks && 8+(i+1)*(int)sizeof(janus_report_block) <= plen; i++) {
+					if(i == 0) {
+						if(summary->receiver_ssrc == 0)
+							summary->receiver_ssrc = ntohl(rr->rb[0].ssrc);
+						summary->has_rr = TRUE;
+						summary->rr = rr->rb[0];
+					}
+					if(summary->blocks_count < JANUS_RTCP_SUMMARY_MAX_BLOCKS)
+						summary->blocks[summary->blocks_count++] = rr->rb[i];
+				}
+				break;
+			}
+			case RTCP_BYE:
+				summary->has_bye = TRUE;
+				break;
+			case RTCP_FIR:
+				summary->has_fir = TRUE;
+				break;
+			case RTCP_RTPFB: {
+				/* RTPFB, Transport layer FB message (rfc4585) */
+				if(plen < 12)
+					break;
+				janus_rtcp_fb *rtcpfb = (janus_rtcp_fb *)rtcp;
+				if(summary->sender_ssrc == 0)
+					summary->sender_ssrc = ntohl(rtcpfb->ssrc);
+				gint fmt = rtcp->rc;
+				if(fmt == 1) {
+					/* NACK */
+					int nacks = length-2;	/* Skip SSRCs */
+					int i = 0;
+					for(i=0; i<nacks; i++) {
+						janus_rtcp_nack *nack = (janus_rtcp_nack *)rtcpfb->fci + i;
+						summary->nacks_count = janus_rtcp_expand_nack(ntohs(nack->pid), ntohs(nack->blp),
+							summary->nacks, summary->nacks_count, JANUS_RTCP_SUMMARY_MAX_NACKS);
+					}
+				} else if(fmt == 15 && plen >= 20) {
+					/* Transport wide CC feedback */
+					uint8_t *fci = (uint8_t *)rtcpfb->fci;
+					summary->has_twcc = TRUE;
+					summary->twcc_base_seq = (fci[0] << 8) | fci[1];
+					summary->twcc_status_count = (fci[2] << 8) | fci[3];
+					int32_t reference_time = (fci[4] << 16) | (fci[5] << 8) | fci[6];
+					/* The reference time is a signed 24 bits integer */
+					if(reference_time & 0x00800000)
+						reference_time -= 0x01000000;
+					summary->twcc_reference_time = reference_time;
+					summary->twcc_fb_count = fci[7];
+				}
+				break;
+			}
+			case RTCP_PSFB: {
+				/* PSFB, Payload-specific FB message (rfc4585) */
+				if(plen < 12)
+					break;
+				janus_rtcp_fb *rtcpfb = (janus_rtcp_fb *)rtcp;
+				if(summary->sender_ssrc == 0)
+					summary->sender_ssrc = ntohl(rtcpfb->ssrc);
+				gint fmt = rtcp->rc;
+				if(fmt == 1) {
+					summary->has_pli = TRUE;
+				} else if(fmt == 15 && plen >= 20) {
+					janus_rtcp_fb_remb *remb = (janus_rtcp_fb_remb *)rtcpfb->fci;
+					if(remb->id[0] == 'R' && remb->id[1] == 'E' && remb->id[2] == 'M' && remb->id[3] == 'B')
+						summary->remb = janus_rtcp_remb_bitrate(remb);
+				}
+				break;
+			}
+			case RTCP_XR: {
+				/* XR, extended reports (rfc3611) */
+				if(plen < 8)
+					break;
+				janus_rtcp_xr *xr = (janus_rtcp_xr *)rtcp;
+				if(summary->sender_ssrc == 0)
+					summary->sender_ssrc = ntohl(xr->ssrc);
+				break;
+			}
+			default:
+				break;
+		}
+		/* Is this a compound packet? */
+		if(length == 0)
+			break;
+		total -= plen;
+		if(total <= 0)
+			break;
+		rtcp = (janus_rtcp_header *)((uint32_t*)rtcp + length + 1);
+	}
+	return 0;
+}
+
+void janus_rtcp_summary_update_context(janus_rtcp_context *ctx, const janus_rtcp_summary *summary) {
+	if(ctx == NULL || summary == NULL)
+		return;
+	if(summary->has_sr)
+		janus_rtcp_incoming_sr(ctx, &summary->sr);
+	if(summary->has_rr)
+		janus_rtcp_incoming_rr(ctx, &summary->rr);
+}
+
 char *janus_rtcp_filter(char *packet, int len, int *newlen) {
 	if(packet == NULL || len <= 0 || newlen == NULL)
 		return NULL;
@@ -795,6 +962,51 @@ GSList *janus_rtcp_get_nacks(char *packet, int len) {
 	return list;
 }
 
+int janus_rtcp_get_nack_blocks(char *packet, int len, janus_rtcp_nack *blocks, int max) {
+	if(packet == NULL || len < 4 || blocks == NULL || max <= 0)
+		return 0;
+	janus_rtcp_header *rtcp = (janus_rtcp_header *)packet;
+	if(rtcp->version != 2)
+		return 0;
+	int total = len, count = 0;
+	while(rtcp) {
+		int length = ntohs(rtcp->length);
+		if(length*4+4 > total)
+			break;
+		if(rtcp->type == RTCP_RTPFB && rtcp->rc == 1) {
+			janus_rtcp_fb *rtcpfb = (janus_rtcp_fb *)rtcp;
+			int nacks = length-2;	/* Skip SSRCs */
+			int i = 0;
+			for(i=0; i<nacks && count<max; i++) {
+				janus_rtcp_nack *nack = (janus_rtcp_nack *)rtcpfb->fci + i;
+				blocks[count].pid = ntohs(nack->pid);
+				blocks[count].blp = ntohs(nack->blp);
+				count++;
+			}
+		}
+		/* Is this a compound packet? */
+		if(length == 0)
+			break;
+		total -= length*4+4;
+		if(total <= 0 || count == max)
+			break;
+		rtcp = (janus_rtcp_header *)((uint32_t*)rtcp + length + 1);
+	}
+	return count;
+}
+
+int janus_rtcp_get_nacks_array(char *packet, int len, uint16_t *seqs, int max) {
+	if(seqs == NULL || max <= 0)
+		return 0;
+	/* Each block is at most 17 sequence numbers: 64 blocks fit any reasonable NACK */
+	janus_rtcp_nack blocks[64];
+	int blocks_count = janus_rtcp_get_nack_blocks(packet, len, blocks, 64);
+	int i = 0, count = 0;
+	for(i=0; i<blocks_count && count<max; i++)
+		count = janus_rtcp_expand_nack(blocks[i].pid, blocks[i].blp, seqs, count, max);
+	return count;
+}
+
 int janus_rtcp_remove_nacks(char *packet, int len) {
 	if(packet == NULL || len == 0)
 		return len;
@@ -859,15 +1071,7 @@ uint32_t janus_rtcp_get_remb(char *packet, int len) {
 				janus_rtcp_fb *rtcpfb = (janus_rtcp_fb *)rtcp;
 				janus_rtcp_fb_remb *remb = (janus_rtcp_fb_remb *)rtcpfb->fci;
 				if(remb->id[0] == 'R' && remb->id[1] == 'E' && remb->id[2] == 'M' && remb->id[3] == 'B') {
-					/* FIXME From rtcp_utility.cc */
-					unsigned char *_ptrRTCPData = (unsigned char *)remb;
-					_ptrRTCPData += 4;	/* Skip unique identifier and num ssrc */
-					//~ JANUS_LOG(LOG_VERB, " %02X %02X %02X %02X\n", _ptrRTCPData[0], _ptrRTCPData[1], _ptrRTCPData[2], _ptrRTCPData[3]);
-					uint8_t brExp = (_ptrRTCPData[1] >> 2) & 0x3F;
-					uint32_t brMantissa = (_ptrRTCPData[1] & 0x03) << 16;
-					brMantissa += (_ptrRTCPData[2] << 8);
-					brMantissa += (_ptrRTCPData[3]);
-					uint32_t bitrate = brMantissa << brExp;
+					uint32_t bitrate = janus_rtcp_remb_bitrate(remb);
 					JANUS_LOG(LOG_HUGE, "Got REMB bitrate %"SCNu32"\n", bitrate);
 					return bitrate;
 				}
@@ -1131,6 +1335,46 @@ int janus_rtcp_nacks(char *packet, int len, GSList *nacks) {
 	return words*4+4;
 }
 
+int janus_rtcp_nacks_array(char *packet, int len, const uint16_t *seqs, int count) {
+	if(packet == NULL || len < 16 || seqs == NULL || count <= 0)
+		return -1;
+	memset(packet, 0, len);
+	janus_rtcp_header *rtcp = (janus_rtcp_header *)packet;
+	/* Set header */
+	rtcp->version = 2;
+	rtcp->type = RTCP_RTPFB;
+	rtcp->rc = 1;	/* FMT=1 */
+	/* Now set NACK stuff: we build the blocks in host order, and only convert them at the end */
+	janus_rtcp_fb *rtcpfb = (janus_rtcp_fb *)rtcp;
+	janus_rtcp_nack *nack = (janus_rtcp_nack *)rtcpfb->fci;
+	uint16_t pid = seqs[0], blp = 0;
+	int words = 3, i = 0;
+	for(i=1; i<count; i++) {
+		uint16_t npid = seqs[i];
+		if((uint16_t)(npid-pid) < 1 || (uint16_t)(npid-pid) > 0x8000) {
+			JANUS_LOG(LOG_HUGE, "Skipping PID to NACK (%"SCNu16" already added)...\n", npid);
+		} else if((uint16_t)(npid-pid) > 16) {
+			/* Close this block, and start a new one with this sequence number as its root PID */
+			nack->pid = htons(pid);
+			nack->blp = htons(blp);
+			words++;
+			if(len < (words*4+4)) {
+				JANUS_LOG(LOG_ERR, "Buffer too small: %d < %d (at least %d NACK blocks needed)\n", len, words*4+4, words);
+				return -1;
+			}
+			nack = (janus_rtcp_nack *)(packet + words*4);
+			pid = npid;
+			blp = 0;
+		} else {
+			blp |= 1 << ((uint16_t)(npid-pid)-1);
+		}
+	}
+	nack->pid = htons(pid);
+	nack->blp = htons(blp);
+	rtcp->length = htons(words);
+	return words*4+4;
+}
+
 typedef enum janus_rtp_packet_status {
 	janus_rtp_packet_status_notreceived = 0,
 	janus_rtp_packet_status_smalldelta = 1,
@@ -1453,3 +1697,100 @@ int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssr
 	/* Done */
 	return len;
 }
+
+/* Helper to parse a single transport wide CC feedback message */
+static int janus_rtcp_parse_transport_wide_cc(guint8 *fci, int fci_len, janus_rtcp_transport_wide_cc_result *results, int max) {
+	if(fci_len < 8)
+		return -1;
+	uint16_t base_seq = (fci[0] << 8) | fci[1];
+	uint16_t status_count = (fci[2] << 8) | fci[3];
+	int32_t reference_time = (fci[4] << 16) | (fci[5] << 8) | fci[6];
+	if(reference_time & 0x00800000)
+		reference_time -= 0x01000000;
+	int count = MIN((int)status_count, max);
+	/* First of all, the packet status chunks: we temporarily store the
+	 * symbols in the received property, as we need them for the deltas */
+	int offset = 8, parsed = 0;
+	while(parsed < status_count) {
+		if(offset + 2 > fci_len)
+			return -1;
+		uint16_t chunk = (fci[offset] << 8) | fci[offset+1];
+		offset += 2;
+		if(!(chunk & 0x8000)) {
+			/* Run length chunk */
+			janus_rtp_packet_status symbol = (chunk >> 13) & 0x03;
+			int run = chunk & 0x1FFF, i = 0;
+			for(i=0; i<run && parsed < status_count; i++, parsed++) {
+				if(parsed < count)
+					results[parsed].received = symbol;
+			}
+		} else {
+			/* Status vector chunk: 14 1-bit symbols, or 7 2-bit symbols */
+			int two_bits = (chunk & 0x4000) ? 1 : 0;
+			int symbols = two_bits ? 7 : 14, i = 0;
+			for(i=0; i<symbols && parsed < status_count; i++, parsed++) {
+				janus_rtp_packet_status symbol = two_bits ?
+					((chunk >> (2*(6-i))) & 0x03) : ((chunk >> (13-i)) & 0x01);
+				if(parsed < count)
+					results[parsed].received = symbol;
+			}
+		}
+	}
+	/* Now the receive deltas, for all the packets that were received */
+	int64_t timestamp = (int64_t)reference_time * 64000;
+	int i = 0;
+	for(i=0; i<status_count; i++) {
+		janus_rtp_packet_status symbol = janus_rtp_packet_status_notreceived;
+		if(i < count) {
+			symbol = results[i].received;
+			results[i].seq = base_seq + i;
+			results[i].received = (symbol != janus_rtp_packet_status_notreceived);
+		} else {
+			/* We're not interested in these, but we may still have to skip their deltas */
+			break;
+		}
+		if(symbol == janus_rtp_packet_status_smalldelta) {
+			if(offset + 1 > fci_len)
+				return -1;
+			timestamp += fci[offset] * 250;
+			offset++;
+		} else if(symbol == janus_rtp_packet_status_largeornegativedelta) {
+			if(offset + 2 > fci_len)
+				return -1;
+			int16_t delta = (int16_t)((fci[offset] << 8) | fci[offset+1]);
+			timestamp += delta * 250;
+			offset += 2;
+		}
+		results[i].received_time = results[i].received ? timestamp : 0;
+	}
+	return count;
+}
+
+int janus_rtcp_get_transport_wide_cc_feedback(char *packet, int len, janus_rtcp_transport_wide_cc_result *results, int max) {
+	if(packet == NULL || len < 4 || results == NULL || max <= 0)
+		return -1;
+	janus_rtcp_header *rtcp = (janus_rtcp_header *)packet;
+	if(rtcp->version != 2)
+		return -1;
+	int total = len, count = 0;
+	while(rtcp) {
+		int length = ntohs(rtcp->length);
+		if(length*4+4 > total)
+			break;
+		if(rtcp->type == RTCP_RTPFB && rtcp->rc == 15 && length >= 4) {
+			janus_rtcp_fb *rtcpfb = (janus_rtcp_fb *)rtcp;
+			int res = janus_rtcp_parse_transport_wide_cc((guint8 *)rtcpfb->fci, length*4-8,
+				results+count, max-count);
+			if(res > 0)
+				count += res;
+		}
+		/* Is this a compound packet? */
+		if(length == 0)
+			break;
+		total -= length*4+4;
+		if(total <= 0 || count == max)
+			break;
+		rtcp = (janus_rtcp_header *)((uint32_t*)rtcp + length + 1);
+	}
+	return count;
+}
@@ -290,6 +290,64 @@ typedef struct rtcp_transport_wide_cc_stats
 } rtcp_transport_wide_cc_stats;
 typedef rtcp_transport_wide_cc_stats janus_rtcp_transport_wide_cc_stats;
 
+/*! \brief Status of a single packet, as reported in a transport wide CC feedback */
+typedef struct janus_rtcp_transport_wide_cc_result {
+	/*! \brief Transport wide sequence number of the packet */
+	uint16_t seq;
+	/*! \brief Whether the packet was received */
+	gboolean received;
+	/*! \brief When the packet was received, in microseconds (only meaningful
+	 * to compute differences between packets, and only valid if received is TRUE) */
+	int64_t received_time;
+} janus_rtcp_transport_wide_cc_result;
+
+/*! \brief Maximum number of report blocks a janus_rtcp_summary keeps track of */
+#define JANUS_RTCP_SUMMARY_MAX_BLOCKS	4
+/*! \brief Maximum number of NACKed sequence numbers a janus_rtcp_summary keeps track of */
+#define JANUS_RTCP_SUMMARY_MAX_NACKS	128
+
+/*! \brief Summary of everything we care about in a (compound) RTCP message, filled in a single pass */
+typedef struct janus_rtcp_summary {
+	/*! \brief SSRC of the sender of the first SR, RR, RTPFB, PSFB or XR (0 if none) */
+	guint32 sender_ssrc;
+	/*! \brief SSRC of the first report block of the first SR or RR (0 if none) */
+	guint32 receiver_ssrc;
+	/*! \brief Whether there was an SR */
+	gboolean has_sr;
+	/*! \brief Sender info of the last SR (network order) */
+	janus_sender_info sr;
+	/*! \brief Whether there was an RR with at least one report block */
+	gboolean has_rr;
+	/*! \brief First report block of the last RR (network order) */
+	janus_report_block rr;
+	/*! \brief Number of report blocks (from both SR and RR) in blocks */
+	int blocks_count;
+	/*! \brief Report blocks (network order) */
+	janus_report_block blocks[JANUS_RTCP_SUMMARY_MAX_BLOCKS];
+	/*! \brief Number of sequence numbers in nacks */
+	int nacks_count;
+	/*! \brief Sequence numbers that were NACKed, in the order they appear */
+	uint16_t nacks[JANUS_RTCP_SUMMARY_MAX_NACKS];
+	/*! \brief Whether there was a legacy (RFC2032) FIR */
+	gboolean has_fir;
+	/*! \brief Whether there was a PLI */
+	gboolean has_pli;
+	/*! \brief Bitrate of the last REMB (0 if none) */
+	uint32_t remb;
+	/*! \brief Whether there was a transport wide CC feedback */
+	gboolean has_twcc;
+	/*! \brief Base sequence number of the transport wide CC feedback */
+	uint16_t twcc_base_seq;
+	/*! \brief Packet status count of the transport wide CC feedback */
+	uint16_t twcc_status_count;
+	/*! \brief Reference time of the transport wide CC feedback (multiples of 64ms) */
+	int32_t twcc_reference_time;
+	/*! \brief Feedback packet count of the transport wide CC feedback */
+	uint8_t twcc_fb_count;
+	/*! \brief Whether there was a BYE */
+	gboolean has_bye;
+} janus_rtcp_summary;
+
 /*! \brief Method to retrieve the estimated round-trip time from an existing RTCP context
  * @param[in] ctx The RTCP context to query
  * @returns The estimated round-trip time */
@@ -338,6 +396,21 @@ guint32 janus_rtcp_get_receiver_ssrc(char *packet, int len);
  * @returns 0 in case of success, -1 on errors */
 int janus_rtcp_parse(janus_rtcp_context *ctx, char *packet, int len);
 
+/*! \brief Method to parse an RTCP message in a single pass, collecting all the info we care about
+ * \note Unlike the other helpers, this walks the compound packet only once: use
+ * janus_rtcp_summary_update_context() to update an RTCP context with the result
+ * @param[in] packet The message data
+ * @param[in] len The message data length in bytes
+ * @param[out] summary The janus_rtcp_summary instance to fill
+ * @returns 0 in case of success, -1 on errors */
+int janus_rtcp_summarize(char *packet, int len, janus_rtcp_summary *summary);
+
+/*! \brief Method to update an RTCP context with the SR/RR info in a summary
+ * \note This is equivalent to what janus_rtcp_parse() does to the context
+ * @param[in] ctx RTCP context to update
+ * @param[in] summary The janus_rtcp_summary instance to read */
+void janus_rtcp_summary_update_context(janus_rtcp_context *ctx, const janus_rtcp_summary *summary);
+
 /*! \brief Method to fix an RTCP message (http://tools.ietf.org/html/draft-ietf-straw-b2bua-rtcp-00)
  * @param[in] ctx RTCP context to update, if needed (optional)
  * @param[in] packet The message data
@@ -393,6 +466,22 @@ gboolean janus_rtcp_has_pli(char *packet, int len);
  * @returns A list of janus_nack elements containing the sequence numbers to send again */
 GSList *janus_rtcp_get_nacks(char *packet, int len);
 
+/*! \brief Method to parse an RTCP NACK message, without allocating anything
+ * @param[in] packet The message data
+ * @param[in] len The message data length in bytes
+ * @param[out] seqs Array to write the sequence numbers to send again to
+ * @param[in] max Size of the array: sequence numbers that don't fit are ignored
+ * @returns The number of sequence numbers written to the array */
+int janus_rtcp_get_nacks_array(char *packet, int len, uint16_t *seqs, int max);
+
+/*! \brief Method to parse an RTCP NACK message in its compact PID+BLP form, without allocating anything
+ * @param[in] packet The message data
+ * @param[in] len The message data length in bytes
+ * @param[out] blocks Array to write the NACK blocks to (host order)
+ * @param[in] max Size of the array: blocks that don't fit are ignored
+ * @returns The number of NACK blocks written to the array */
+int janus_rtcp_get_nack_blocks(char *packet, int len, janus_rtcp_nack *blocks, int max);
+
 /*! \brief Method to remove an RTCP NACK message
  * @param[in] packet The message data
  * @param[in] len The message data length in bytes
@@ -467,6 +556,14 @@ int janus_rtcp_pli(char *packet, int len);
  * @returns The message data length in bytes, if successful, -1 on errors */
 int janus_rtcp_nacks(char *packet, int len, GSList *nacks);
 
+/*! \brief Method to generate a new RTCP NACK message to report lost packets, from an array
+ * @param[in] packet The buffer data (MUST be at least 16 chars)
+ * @param[in] len The message data length in bytes
+ * @param[in] seqs Ordered array of the sequence numbers to NACK
+ * @param[in] count Number of sequence numbers in the array
+ * @returns The message data length in bytes, if successful, -1 on errors */
+int janus_rtcp_nacks_array(char *packet, int len, const uint16_t *seqs, int count);
+
 /*! \brief Method to generate a new RTCP transport wide message to report reception stats
  * @param[in] packet The buffer data (MUST be at least 16 chars)
  * @param[in] len The message data length in bytes
@@ -477,4 +574,12 @@ int janus_rtcp_nacks(char *packet, int len, GSList *nacks);
  * @returns The message data length in bytes, if successful, -1 on errors */
 int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t len, guint32 ssrc, guint32 media, guint8 feedback_packet_count, GQueue *transport_wide_cc_stats);
 
+/*! \brief Method to parse the transport wide CC feedback in an RTCP message
+ * @param[in] packet The message data
+ * @param[in] len The message data length in bytes
+ * @param[out] results Array to write the status of each reported packet to
+ * @param[in] max Size of the array: packets that don't fit are ignored
+ * @returns The number of packets written to the array, or -1 on errors */
+int janus_rtcp_get_transport_wide_cc_feedback(char *packet, int len, janus_rtcp_transport_wide_cc_result *results, int max);
+
 #endif
@@ -236,6 +236,202 @@ int janus_rtp_header_extension_parse_transport_wide_cc(char *buf, int len, int i
 	return 0;
 }
 
+int janus_rtp_header_extension_set_transport_wide_cc(char *buf, int len, int maxlen, int id,
+		uint16_t transSeqNum) {
+	if(!buf || len < 12 || id < 1 || id > 14)
+		return -1;
+	char *ext = NULL;
+	if(janus_rtp_header_extension_find(buf, len, id, NULL, NULL, &ext) == 0) {
+		/* The extension is there already, just update the sequence number */
+		if(ext == NULL || (*ext & 0x0F) != 1)
+			return -1;
+		ext[1] = (transSeqNum >> 8) & 0xFF;
+		ext[2] = transSeqNum & 0xFF;
+		return len;
+	}
+	janus_rtp_header *rtp = (janus_rtp_header *)buf;
+	int hlen = 12 + rtp->csrccount*4;
+	if(len < hlen)
+		return -1;
+	char element[4];
+	element[0] = (id << 4) | 0x01;
+	element[1] = (transSeqNum >> 8) & 0xFF;
+	element[2] = transSeqNum & 0xFF;
+	element[3] = 0x00;
+	janus_rtp_header_extension *header = (janus_rtp_header_extension *)(buf+hlen);
+	if(rtp->extension) {
+		if(len < hlen+4 || ntohs(header->type) != 0xBEDE) {
+			/* Two-byte headers, we don't touch those */
+			return -1;
+		}
+		int end = hlen + 4 + ntohs(header->length)*4;
+		if(len < end || len+4 > maxlen)
+			return -1;
+		/* Append the extension to the existing block */
+		memmove(buf+end+4, buf+end, len-end);
+		memcpy(buf+end, element, 4);
+		header->length = htons(ntohs(header->length)+1);
+		return len+4;
+	}
+	if(len+8 > maxlen)
+		return -1;
+	/* Add a new one-byte header block */
+	memmove(buf+hlen+8, buf+hlen, len-hlen);
+	header->type = htons(0xBEDE);
+	header->length = htons(1);
+	memcpy(buf+hlen+4, element, 4);
+	rtp->extension = 1;
+	return len+8;
+}
+
+void janus_rtp_extmap_from_sdp(const char *sdp, janus_rtp_extmap *extmap) {
+	if(extmap == NULL)
+		return;
+	memset(extmap, 0, sizeof(*extmap));
+	if(sdp == NULL)
+		return;
+	int id = janus_rtp_header_extension_get_id(sdp, JANUS_RTP_EXTMAP_AUDIO_LEVEL);
+	extmap->audio_level = id > 0 ? id : 0;
+	id = janus_rtp_header_extension_get_id(sdp, JANUS_RTP_EXTMAP_VIDEO_ORIENTATION);
+	extmap->video_orientation = id > 0 ? id : 0;
+	id = janus_rtp_header_extension_get_id(sdp, JANUS_RTP_EXTMAP_PLAYOUT_DELAY);
+	extmap->playout_delay = id > 0 ? id : 0;
+	id = janus_rtp_header_extension_get_id(sdp, JANUS_RTP_EXTMAP_RTP_STREAM_ID);
+	extmap->rtp_stream_id = id > 0 ? id : 0;
+	id = janus_rtp_header_extension_get_id(sdp, JANUS_RTP_EXTMAP_TRANSPORT_WIDE_CC);
+	extmap->transport_wide_cc = id > 0 ? id : 0;
+}
+
+/* Static helper to decode the value of a single extension, if it's one we know */
+static int janus_rtp_header_extension_decode(int id, uint8_t *data, int len,
+		const janus_rtp_extmap *extmap, janus_rtp_extensions *extensions) {
+	if(id == extmap->audio_level && len >= 1) {
+		extensions->audio_level_vad = (data[0] & 0x80) >> 7;
+		extensions->audio_level = data[0] & 0x7F;
+	} else if(id == extmap->video_orientation && len >= 1) {
+		extensions->video_back_camera = (data[0] & 0x08) >> 3;
+		extensions->video_flipped = (data[0] & 0x04) >> 2;
+		extensions->video_rotation = (data[0] & 0x03) * 90;
+	} else if(id == extmap->playout_delay && len >= 3) {
+		extensions->min_delay = (data[0] << 4) | (data[1] >> 4);
+		extensions->max_delay = ((data[1] & 0x0F) << 8) | data[2];
+	} else if(id == extmap->rtp_stream_id && len >= 1) {
+		int rid_len = len;
+		if(rid_len > (int)sizeof(extensions->rid)-1)
+			rid_len = sizeof(extensions->rid)-1;
+		memcpy(extensions->rid, data, rid_len);
+		extensions->rid[rid_len] = '\0';
+	} else if(id == extmap->transport_wide_cc && len >= 2) {
+		extensions->transport_seq_num = (data[0] << 8) | data[1];
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+int janus_rtp_header_extensions_parse(char *buf, int len, const janus_rtp_extmap *extmap,
+		janus_rtp_extensions *extensions) {
+	if(extensions == NULL)
+		return -1;
+	memset(extensions, 0, sizeof(*extensions));
+	extensions->audio_level = -1;
+	extensions->video_rotation = -1;
+	extensions->min_delay = -1;
+	extensions->max_delay = -1;
+	extensions->transport_seq_num = -1;
+	if(!buf || len < 12 || extmap == NULL)
+		return -1;
+	janus_rtp_header *rtp = (janus_rtp_header *)buf;
+	if(!rtp->extension)
+		return 0;
+	int hlen = 12;
+	if(rtp->csrccount)	/* Skip CSRC if needed */
+		hlen += rtp->csrccount*4;
+	if(len < hlen + 4)
+		return -1;
+	janus_rtp_header_extension *ext = (janus_rtp_header_extension *)(buf+hlen);
+	uint16_t profile = ntohs(ext->type);
+	int extlen = ntohs(ext->length)*4;
+	hlen += 4;
+	if(len <= (hlen + extlen))
+		return -1;
+	uint8_t *block = (uint8_t *)(buf+hlen);
+	int found = 0, i = 0;
+	if(profile == 0xBEDE) {
+		/* 1-Byte extensions: 4 bits of ID, 4 bits of length-1 */
+		while(i < extlen) {
+			uint8_t extid = block[i] >> 4;
+			if(extid == 0x0F) {
+				/* Reserved, stop here */
+				break;
+			} else if(extid == 0) {
+				/* Padding */
+				i++;
+				continue;
+			}
+			int idlen = (block[i] & 0x0F)+1;
+			if(i + 1 + idlen > extlen)
+				break;
+			found += janus_rtp_header_extension_decode(extid, block+i+1, idlen, extmap, extensions);
+			i += 1 + idlen;
+		}
+	} else if((profile & 0xFFF0) == 0x1000) {
+		/* 2-Byte extensions: 8 bits of ID, 8 bits of length */
+		while(i < extlen) {
+			uint8_t extid = block[i];
+			if(extid == 0) {
+				/* Padding */
+				i++;
+				continue;
+			}
+			if(i + 2 > extlen)
+				break;
+			int idlen = block[i+1];
+			if(i + 2 + idlen > extlen)
+				break;
+			found += janus_rtp_header_extension_decode(extid, block+i+2, idlen, extmap, extensions);
+			i += 2 + idlen;
+		}
+	}
+	return found;
+}
+
+/* Simulcast substreams bitrate tracking */
+void janus_rtp_simulcast_bitrates_update(janus_rtp_simulcast_bitrates *bitrates, int substream, int len, gint64 now) {
+	if(bitrates == NULL || substream < 0 || substream > 2)
+		return;
+	if(bitrates->updated == 0)
+		bitrates->updated = now;
+	bitrates->bytes[substream] += len;
+	gint64 elapsed = now - bitrates->updated;
+	if(elapsed >= G_USEC_PER_SEC) {
+		int i = 0;
+		for(i=0; i<3; i++) {
+			bitrates->bitrate[i] = (uint32_t)((guint64)bitrates->bytes[i] * 8 * G_USEC_PER_SEC / elapsed);
+			bitrates->bytes[i] = 0;
+		}
+		bitrates->updated = now;
+	}
+}
+
+int janus_rtp_simulcast_pick_substream(const janus_rtp_simulcast_bitrates *bitrates, int current, uint32_t bitrate) {
+	if(bitrates == NULL || bitrates->bitrate[0] == 0)
+		return -1;
+	/* Pick the highest substream that fits: we require some headroom to
+	 * switch to a higher substream, to avoid going back and forth */
+	int sc = 0;
+	for(sc=2; sc>0; sc--) {
+		uint32_t needed = bitrates->bitrate[sc];
+		if(needed == 0)
+			continue;
+		if(sc > current)
+			needed += needed/5;
+		if(needed <= bitrate)
+			return sc;
+	}
+	return 0;
+}
+
 /* RTP context related methods */
 void janus_rtp_switching_context_reset(janus_rtp_switching_context *context) {
 	if(context == NULL)
@@ -430,6 +626,54 @@ int janus_rtp_skew_compensate_video(janus_rtp_header *header, janus_rtp_switchin
 	return exit_status;
 }
 
+janus_rtp_shared_packet *janus_rtp_shared_packet_new(char *buf, int len) {
+	if(buf == NULL || len < RTP_HEADER_SIZE)
+		return NULL;
+	/* The packet and its buffer are a single allocation */
+	janus_rtp_shared_packet *packet = g_malloc(sizeof(janus_rtp_shared_packet) + len);
+	packet->ref = 1;
+	packet->buffer = (char *)packet + sizeof(janus_rtp_shared_packet);
+	packet->length = len;
+	memcpy(packet->buffer, buf, len);
+	return packet;
+}
+
+void janus_rtp_shared_packet_ref(janus_rtp_shared_packet *packet) {
+	if(packet == NULL)
+		return;
+	g_atomic_int_inc(&packet->ref);
+}
+
+void janus_rtp_shared_packet_unref(janus_rtp_shared_packet *packet) {
+	if(packet == NULL)
+		return;
+	if(g_atomic_int_dec_and_test(&packet->ref))
+		g_free(packet);
+}
+
+void janus_rtp_header_override_init(janus_rtp_header_override *override, janus_rtp_header *header) {
+	if(override == NULL || header == NULL)
+		return;
+	override->seq_number = ntohs(header->seq_number);
+	override->timestamp = ntohl(header->timestamp);
+	override->ssrc = 0;
+	override->payload_type = -1;
+	override->markerbit = -1;
+}
+
+void janus_rtp_header_override_apply(janus_rtp_header *header, const janus_rtp_header_override *override) {
+	if(header == NULL || override == NULL)
+		return;
+	header->seq_number = htons(override->seq_number);
+	header->timestamp = htonl(override->timestamp);
+	if(override->ssrc != 0)
+		header->ssrc = htonl(override->ssrc);
+	if(override->payload_type > -1)
+		header->type = override->payload_type;
+	if(override->markerbit > -1)
+		header->markerbit = override->markerbit ? 1 : 0;
+}
+
 void janus_rtp_header_update(janus_rtp_header *header, janus_rtp_switching_context *context, gboolean video, int step) {
 	if(header == NULL || context == NULL)
 		return;
@@ -151,6 +151,116 @@ int janus_rtp_header_extension_parse_rtp_stream_id(char *buf, int len, int id,
 int janus_rtp_header_extension_parse_transport_wide_cc(char *buf, int len, int id,
 	uint16_t *transSeqNum);
 
+/*! \brief Helper to add (or update) a transport-wide-cc RTP extension to an outgoing packet
+ * \note If the packet has no extensions yet, a one-byte header block is
+ * added; if it already has a one-byte header block, the extension is
+ * appended to it. Packets using two-byte headers are not modified.
+ * @param[in] buf The packet data
+ * @param[in] len The packet data length in bytes
+ * @param[in] maxlen The size of the buffer, which must have room for up to 8 more bytes
+ * @param[in] id The extension ID to use (1-14)
+ * @param[in] transSeqNum The transport wide sequence number to set
+ * @returns The new length of the packet, or -1 in case of errors */
+int janus_rtp_header_extension_set_transport_wide_cc(char *buf, int len, int maxlen, int id,
+	uint16_t transSeqNum);
+
+/*! \brief IDs negotiated for the RTP extensions we know about (0 means not negotiated) */
+typedef struct janus_rtp_extmap {
+	/*! \brief ssrc-audio-level extension ID */
+	int audio_level;
+	/*! \brief video-orientation extension ID */
+	int video_orientation;
+	/*! \brief playout-delay extension ID */
+	int playout_delay;
+	/*! \brief rtp-stream-id extension ID */
+	int rtp_stream_id;
+	/*! \brief transport-wide-cc extension ID */
+	int transport_wide_cc;
+} janus_rtp_extmap;
+
+/*! \brief Values of the RTP extensions found in a packet (negative values mean not present) */
+typedef struct janus_rtp_extensions {
+	/*! \brief Audio level in -dBov (0=max, 127=min) */
+	int audio_level;
+	/*! \brief Value of the voice activity (V) bit of the audio level */
+	gboolean audio_level_vad;
+	/*! \brief Video rotation, in degrees (0, 90, 180 or 270) */
+	int video_rotation;
+	/*! \brief Value of the Camera (C) bit of the video orientation */
+	gboolean video_back_camera;
+	/*! \brief Value of the Flip (F) bit of the video orientation */
+	gboolean video_flipped;
+	/*! \brief Minimum and maximum playout delay */
+	int min_delay, max_delay;
+	/*! \brief RTP stream ID (empty string if not present) */
+	char rid[16];
+	/*! \brief Transport wide sequence number */
+	int transport_seq_num;
+} janus_rtp_extensions;
+
+/*! \brief Helper to get the IDs of all the RTP extensions we know about from an SDP
+ * @param[in] sdp The SDP to parse
+ * @param[out] extmap The janus_rtp_extmap instance to fill */
+void janus_rtp_extmap_from_sdp(const char *sdp, janus_rtp_extmap *extmap);
+
+/*! \brief Helper to parse all the RTP extensions we know about in a single pass
+ * \note Both the one-byte (RFC5285) and the two-byte headers are supported
+ * @param[in] buf The packet data
+ * @param[in] len The packet data length in bytes
+ * @param[in] extmap The negotiated IDs of the extensions to look for
+ * @param[out] extensions The janus_rtp_extensions instance to fill
+ * @returns The number of extensions that were recognized, or -1 in case of errors */
+int janus_rtp_header_extensions_parse(char *buf, int len, const janus_rtp_extmap *extmap,
+	janus_rtp_extensions *extensions);
+
+/*! \brief Immutable RTP packet, that can be relayed to many peers (e.g., all
+ * the subscribers of a publisher) without each of them needing a copy
+ * \note The packet is reference counted: whoever needs it for longer than
+ * the call it was passed in (e.g., the core, while it's queued) takes a
+ * reference, and the packet is freed when the last reference is released.
+ * The buffer must not be modified once the packet has been created: what
+ * needs to be different for each peer goes in a janus_rtp_header_override */
+typedef struct janus_rtp_shared_packet {
+	/*! \brief Number of references to this packet */
+	volatile gint ref;
+	/*! \brief The RTP packet (header and payload) */
+	char *buffer;
+	/*! \brief Length of the RTP packet */
+	int length;
+} janus_rtp_shared_packet;
+
+/*! \brief Create a new shared RTP packet, copying the provided buffer
+ * @param[in] buf The RTP packet to share
+ * @param[in] len The length of the RTP packet
+ * @returns A new janus_rtp_shared_packet instance with a single reference, or NULL in case of errors */
+janus_rtp_shared_packet *janus_rtp_shared_packet_new(char *buf, int len);
+/*! \brief Take a reference to a shared RTP packet
+ * @param[in] packet The janus_rtp_shared_packet instance to take a reference to */
+void janus_rtp_shared_packet_ref(janus_rtp_shared_packet *packet);
+/*! \brief Release a reference to a shared RTP packet, freeing it if it was the last one
+ * @param[in] packet The janus_rtp_shared_packet instance to release */
+void janus_rtp_shared_packet_unref(janus_rtp_shared_packet *packet);
+
+/*! \brief Changes to the RTP header of a shared packet, for a specific peer */
+typedef struct janus_rtp_header_override {
+	/*! \brief Sequence number and timestamp to use (always applied) */
+	uint16_t seq_number;
+	uint32_t timestamp;
+	/*! \brief SSRC to use (0 to keep the one in the packet) */
+	uint32_t ssrc;
+	/*! \brief Payload type and marker bit to use (-1 to keep the ones in the packet) */
+	int payload_type, markerbit;
+} janus_rtp_header_override;
+
+/*! \brief Initialize a header override so that it keeps the RTP header of a packet as it is
+ * @param[out] override The janus_rtp_header_override instance to initialize
+ * @param[in] header The RTP header to take the sequence number and timestamp from */
+void janus_rtp_header_override_init(janus_rtp_header_override *override, janus_rtp_header *header);
+/*! \brief Apply a header override to the RTP header of a packet
+ * @param[in,out] header The RTP header to update
+ * @param[in] override The changes to apply */
+void janus_rtp_header_override_apply(janus_rtp_header *header, const janus_rtp_header_override *override);
+
 /*! \brief RTP context, in order to make sure SSRC changes result in coherent seq/ts increases */
 typedef struct janus_rtp_switching_context {
 	uint32_t a_last_ssrc, a_last_ts, a_base_ts, a_base_ts_prev, a_prev_ts, a_target_ts, a_start_ts,
@@ -178,6 +288,32 @@ void janus_rtp_switching_context_reset(janus_rtp_switching_context *context);
  * @param[in] step \b deprecated The expected timestamp step */
 void janus_rtp_header_update(janus_rtp_header *header, janus_rtp_switching_context *context, gboolean video, int step);
 
+/*! \brief Bitrate of each substream of a simulcast source, as seen by who receives it */
+typedef struct janus_rtp_simulcast_bitrates {
+	/*! \brief Bytes received for each substream since the last update */
+	uint32_t bytes[3];
+	/*! \brief Bitrate of each substream (updated once per second) */
+	uint32_t bitrate[3];
+	/*! \brief When the bitrates were last updated */
+	gint64 updated;
+} janus_rtp_simulcast_bitrates;
+
+/*! \brief Take note of a packet received on a simulcast substream, updating the bitrates once per second
+ * @param[in] bitrates The janus_rtp_simulcast_bitrates instance to update
+ * @param[in] substream The substream the packet was received on (0-2)
+ * @param[in] len The size of the packet
+ * @param[in] now The packet arrival monotonic time */
+void janus_rtp_simulcast_bitrates_update(janus_rtp_simulcast_bitrates *bitrates, int substream, int len, gint64 now);
+
+/*! \brief Pick the highest simulcast substream that fits in the estimated bandwidth towards a peer
+ * \note Switching to a higher substream than the current one requires 20% of headroom,
+ * to avoid going back and forth when the estimate is close to what the substream needs
+ * @param[in] bitrates The bitrates of the substreams
+ * @param[in] current The substream currently targeted for the peer
+ * @param[in] bitrate The estimated bandwidth towards the peer
+ * @returns The substream to target, or -1 if we don't know enough about the substreams yet */
+int janus_rtp_simulcast_pick_substream(const janus_rtp_simulcast_bitrates *bitrates, int current, uint32_t bitrate);
+
 #define RTP_AUDIO_SKEW_TH_MS 40
 #define RTP_VIDEO_SKEW_TH_MS 40
 #define SKEW_DETECTION_WAIT_TIME_SECS 15
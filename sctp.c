@@ -59,16 +59,19 @@ static uint16_t event_types[] = {
 
 int janus_sctp_data_to_dtls(void *instance, void *buffer, size_t length, uint8_t tos, uint8_t set_df);
 static int janus_sctp_incoming_data(struct socket *sock, union sctp_sockstore addr, void *data, size_t datalen, struct sctp_rcvinfo rcv, int flags, void *ulp_info);
+static int janus_sctp_send_space(struct socket *sock, uint32_t sb_free, void *ulp_info);
+static void janus_sctp_send_pending(janus_sctp_association *sctp);
 janus_sctp_channel *janus_sctp_find_channel_by_stream(janus_sctp_association *sctp, uint16_t stream);
 janus_sctp_channel *janus_sctp_find_free_channel(janus_sctp_association *sctp);
 uint16_t janus_sctp_find_free_stream(janus_sctp_association *sctp);
 void janus_sctp_request_more_streams(janus_sctp_association *sctp);
-int janus_sctp_send_open_request_message(struct socket *sock, uint16_t stream, uint8_t unordered, uint16_t pr_policy, uint32_t pr_value);
-int janus_sctp_send_open_response_message(struct socket *sock, uint16_t stream);
-int janus_sctp_send_open_ack_message(struct socket *sock, uint16_t stream);
+static int janus_sctp_send_control(janus_sctp_association *sctp, uint16_t stream, void *buffer, size_t length);
+int janus_sctp_send_open_request_message(janus_sctp_association *sctp, uint16_t stream, uint8_t unordered, uint16_t pr_policy, uint32_t pr_value);
+int janus_sctp_send_open_response_message(janus_sctp_association *sctp, uint16_t stream);
+int janus_sctp_send_open_ack_message(janus_sctp_association *sctp, uint16_t stream);
 void janus_sctp_send_deferred_messages(janus_sctp_association *sctp);
 int janus_sctp_open_channel(janus_sctp_association *sctp, uint8_t unordered, uint16_t pr_policy, uint32_t pr_value);
-int janus_sctp_send_text(janus_sctp_association *sctp, uint16_t id, char *text, size_t length);
+int janus_sctp_send_message(janus_sctp_association *sctp, uint16_t id, gboolean binary, char *buffer, size_t length);
 void janus_sctp_reset_outgoing_stream(janus_sctp_association *sctp, uint16_t stream);
 void janus_sctp_send_outgoing_stream_reset(janus_sctp_association *sctp);
 int janus_sctp_close_channel(janus_sctp_association *sctp, uint16_t id);
@@ -76,7 +79,7 @@ void janus_sctp_handle_open_request_message(janus_sctp_association *sctp, janus_
 void janus_sctp_handle_open_response_message(janus_sctp_association *sctp, janus_datachannel_open_response *rsp, size_t length, uint16_t stream);
 void janus_sctp_handle_open_ack_message(janus_sctp_association *sctp, janus_datachannel_ack *ack, size_t length, uint16_t stream);
 void janus_sctp_handle_unknown_message(char *msg, size_t length, uint16_t stream);
-void janus_sctp_handle_data_message(janus_sctp_association *sctp, char *buffer, size_t length, uint16_t stream);
+void janus_sctp_handle_data_message(janus_sctp_association *sctp, char *buffer, size_t length, uint16_t stream, gboolean binary);
 void janus_sctp_handle_message(janus_sctp_association *sctp, char *buffer, size_t length, uint32_t ppid, uint16_t stream, int flags);
 void janus_sctp_handle_association_change_event(struct sctp_assoc_change *sac);
 void janus_sctp_handle_peer_address_change_event(struct sctp_paddr_change *spc);
@@ -92,11 +95,58 @@ janus_sctp_message *janus_sctp_message_create(gboolean incoming, char *buffer, s
 void janus_sctp_message_destroy(janus_sctp_message *message);
 static janus_sctp_message exit_message;
 
+/* Pool of messages: SCTP packets are never larger than the DTLS MTU, so
+ * rather than allocating a struct and a buffer for each of them, we recycle
+ * structs with room for a packet right after them. Larger messages, if any,
+ * are allocated (and freed) as before */
+#define JANUS_SCTP_MESSAGE_BUFSIZE	1500
+#define JANUS_SCTP_MESSAGE_POOL_MAX	1024
+static janus_mutex message_pool_mutex = JANUS_MUTEX_INITIALIZER;
+static janus_sctp_message *message_pool = NULL;
+static int message_pool_count = 0;
+
+/* Shared workers: rather than a thread per association, which with many
+ * mostly idle data channels means many mostly idle threads, associations
+ * can be spread on a few workers. All the messages of an association go
+ * through the same worker, so they're still processed in order */
+typedef struct janus_sctp_worker {
+	guint id;
+	GThread *thread;
+	GAsyncQueue *messages;
+	/* Associations that have been destroyed, and that we'll free in a bit */
+	GQueue *closing;
+} janus_sctp_worker;
+static janus_sctp_worker *sctp_workers = NULL;
+static guint sctp_workers_num = 0;
+static void *janus_sctp_worker_thread(void *data);
+
 static gboolean sctp_running;
-int janus_sctp_init(void) {
+int janus_sctp_init(guint workers) {
 	/* Initialize the SCTP stack */
 	usrsctp_init(0, janus_sctp_data_to_dtls, NULL);
 	sctp_running = TRUE;
+	if(workers > 0) {
+		sctp_workers = g_malloc0(workers * sizeof(janus_sctp_worker));
+		guint w = 0;
+		for(w=0; w<workers; w++) {
+			janus_sctp_worker *worker = &sctp_workers[w];
+			worker->id = w+1;
+			worker->messages = g_async_queue_new_full((GDestroyNotify) janus_sctp_message_destroy);
+			worker->closing = g_queue_new();
+			GError *error = NULL;
+			char tname[16];
+			g_snprintf(tname, sizeof(tname), "sctp worker %u", worker->id);
+			worker->thread = g_thread_try_new(tname, &janus_sctp_worker_thread, worker, &error);
+			if(error != NULL) {
+				JANUS_LOG(LOG_FATAL, "Got error %d (%s) trying to launch SCTP worker #%u...\n",
+					error->code, error->message ? error->message : "??", worker->id);
+				g_error_free(error);
+				return -1;
+			}
+			sctp_workers_num++;
+		}
+		JANUS_LOG(LOG_INFO, "Started %u SCTP workers\n", sctp_workers_num);
+	}
 
 #ifdef DEBUG_SCTP
 	JANUS_LOG(LOG_WARN, "SCTP debugging to files enabled: going to save them in %s\n", debug_folder);
@@ -108,8 +158,33 @@ int janus_sctp_init(void) {
 }
 
 void janus_sctp_deinit(void) {
+	if(sctp_workers != NULL) {
+		guint w = 0;
+		for(w=0; w<sctp_workers_num; w++)
+			g_async_queue_push(sctp_workers[w].messages, &exit_message);
+		for(w=0; w<sctp_workers_num; w++) {
+			g_thread_join(sctp_workers[w].thread);
+			g_async_queue_unref(sctp_workers[w].messages);
+			g_queue_free(sctp_workers[w].closing);
+		}
+		g_free(sctp_workers);
+		sctp_workers = NULL;
+		sctp_workers_num = 0;
+	}
 	usrsctp_finish();
 	sctp_running = FALSE;
+	janus_mutex_lock(&message_pool_mutex);
+	while(message_pool != NULL) {
+		janus_sctp_message *message = message_pool;
+		message_pool = message->next;
+		g_free(message);
+	}
+	message_pool_count = 0;
+	janus_mutex_unlock(&message_pool_mutex);
+}
+
+guint janus_sctp_get_workers(void) {
+	return sctp_workers_num;
 }
 
 janus_sctp_association *janus_sctp_association_create(void *dtls, uint64_t handle_id, uint16_t udp_port) {
@@ -151,10 +226,16 @@ janus_sctp_association *janus_sctp_association_create(void *dtls, uint64_t handl
 	sctp->stream_buffer_counter = 0;
 	sctp->sock = NULL;
 	janus_mutex_init(&sctp->mutex);
+	sctp->pending = g_queue_new();
+	sctp->pending_bytes = 0;
+	janus_mutex_init(&sctp->send_mutex);
 
 	usrsctp_register_address((void *)sctp);
 	usrsctp_sysctl_set_sctp_ecn_enable(0);
-	if((sock = usrsctp_socket(AF_CONN, SOCK_STREAM, IPPROTO_SCTP, janus_sctp_incoming_data, NULL, 0, (void *)sctp)) == NULL) {
+	/* As soon as acknowledged data frees room for a piece of a message, we're told so
+	 * and send what we queued while the send buffer was full, if anything */
+	if((sock = usrsctp_socket(AF_CONN, SOCK_STREAM, IPPROTO_SCTP, janus_sctp_incoming_data,
+			janus_sctp_send_space, JANUS_SCTP_SEND_CHUNK, (void *)sctp)) == NULL) {
 		JANUS_LOG(LOG_ERR, "[%"SCNu64"] Error creating usrsctp socket... (%d)\n", handle_id, errno);
 		g_free(sctp);
 		sctp = NULL;
@@ -180,6 +261,14 @@ janus_sctp_association *janus_sctp_association_create(void *dtls, uint64_t handl
 		sctp = NULL;
 		return NULL;
 	}
+	/* Take care of record boundaries ourselves, so that large messages can be sent in pieces */
+	uint32_t eor = 1;
+	if(usrsctp_setsockopt(sock, IPPROTO_SCTP, SCTP_EXPLICIT_EOR, &eor, sizeof(eor))) {
+		JANUS_LOG(LOG_ERR, "[%"SCNu64"] setsockopt error: SCTP_EXPLICIT_EOR (%d)\n", handle_id, errno);
+		g_free(sctp);
+		sctp = NULL;
+		return NULL;
+	}
 	/* Disable Nagle */
 	uint32_t nodelay = 1;
 	if(usrsctp_setsockopt(sock, IPPROTO_SCTP, SCTP_NODELAY, &nodelay, sizeof(nodelay))) {
@@ -188,6 +277,13 @@ janus_sctp_association *janus_sctp_association_create(void *dtls, uint64_t handl
 		sctp = NULL;
 		return NULL;
 	}	
+	/* Never block the thread sending a message when the send buffer is full: we queue what's left instead */
+	if(usrsctp_set_non_blocking(sock, 1) < 0) {
+		JANUS_LOG(LOG_ERR, "[%"SCNu64"] Error making the SCTP socket non-blocking (%d)\n", handle_id, errno);
+		g_free(sctp);
+		sctp = NULL;
+		return NULL;
+	}
 	/* Enable the events of interest */
 	struct sctp_event event;
 	memset(&event, 0, sizeof(event));
@@ -234,10 +330,20 @@ janus_sctp_association *janus_sctp_association_create(void *dtls, uint64_t handl
 	/* We're done for now, the setup is done elsewhere */
 	janus_mutex_lock(&sctp->mutex);
 	sctp->sock = sock;
-	sctp->messages = g_async_queue_new_full((GDestroyNotify) janus_sctp_message_destroy);
 	sctp->buffer = NULL;
 	sctp->buflen = 0;
 	sctp->offset = 0;
+	sctp->discarding = FALSE;
+	sctp->sent_data = FALSE;
+	if(sctp_workers_num > 0) {
+		/* Use the queue of one of the shared workers */
+		janus_sctp_worker *worker = &sctp_workers[handle_id % sctp_workers_num];
+		sctp->messages = g_async_queue_ref(worker->messages);
+		JANUS_LOG(LOG_VERB, "[%"SCNu64"] SCTP association handled by worker #%u\n", handle_id, worker->id);
+		janus_mutex_unlock(&sctp->mutex);
+		return sctp;
+	}
+	sctp->messages = g_async_queue_new_full((GDestroyNotify) janus_sctp_message_destroy);
 	GError *error = NULL;
 	char tname[16];
 	g_snprintf(tname, sizeof(tname), "sctp %"SCNu64, sctp->handle_id);
@@ -292,7 +398,15 @@ void janus_sctp_association_destroy(janus_sctp_association *sctp) {
 	usrsctp_close(sctp->sock);
 	janus_mutex_lock(&sctp->mutex);
 	sctp->dtls = NULL;	/* This will get rid of the thread */
-	g_async_queue_push(sctp->messages, &exit_message);
+	if(sctp->thread != NULL) {
+		g_async_queue_push(sctp->messages, &exit_message);
+	} else {
+		/* The queue is shared with other associations: tell the worker which one to get rid of */
+		janus_sctp_message *message = janus_sctp_message_create(FALSE, NULL, 0);
+		message->sctp = sctp;
+		message->destroy = TRUE;
+		g_async_queue_push(sctp->messages, message);
+	}
 	janus_mutex_unlock(&sctp->mutex);
 }
 
@@ -301,8 +415,11 @@ void janus_sctp_data_from_dtls(janus_sctp_association *sctp, char *buf, int len)
 		return;
 	JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Data from DTLS to SCTP stack: %d bytes\n", sctp->handle_id, len);
 	janus_mutex_lock(&sctp->mutex);
-	if(sctp->messages != NULL)
-		g_async_queue_push(sctp->messages, janus_sctp_message_create(TRUE, buf, len));
+	if(sctp->messages != NULL && sctp->dtls != NULL) {
+		janus_sctp_message *message = janus_sctp_message_create(TRUE, buf, len);
+		message->sctp = sctp;
+		g_async_queue_push(sctp->messages, message);
+	}
 	janus_mutex_unlock(&sctp->mutex);
 }
 
@@ -312,8 +429,11 @@ int janus_sctp_data_to_dtls(void *instance, void *buffer, size_t length, uint8_t
 		return -1;
 	JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Data from SCTP to DTLS stack: %zu bytes\n", sctp->handle_id, length);
 	janus_mutex_lock(&sctp->mutex);
-	if(sctp->messages != NULL)
-		g_async_queue_push(sctp->messages, janus_sctp_message_create(FALSE, buffer, length));
+	if(sctp->messages != NULL && sctp->dtls != NULL && length > 0) {
+		janus_sctp_message *message = janus_sctp_message_create(FALSE, buffer, length);
+		message->sctp = sctp;
+		g_async_queue_push(sctp->messages, message);
+	}
 	janus_mutex_unlock(&sctp->mutex);
 	return 0;
 }
@@ -333,10 +453,26 @@ static int janus_sctp_incoming_data(struct socket *sock, union sctp_sockstore ad
 	return 1;
 }
 
-void janus_sctp_send_data(janus_sctp_association *sctp, char *buf, int len) {
+static int janus_sctp_send_space(struct socket *sock, uint32_t sb_free, void *ulp_info) {
+	janus_sctp_association *sctp = (janus_sctp_association *)ulp_info;
+	if(sctp == NULL)
+		return 0;
+	JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Room in the SCTP send buffer: %"SCNu32" bytes\n", sctp->handle_id, sb_free);
+	janus_mutex_lock(&sctp->send_mutex);
+	if(sctp->pending != NULL)
+		janus_sctp_send_pending(sctp);
+	janus_mutex_unlock(&sctp->send_mutex);
+	return 1;
+}
+
+void janus_sctp_send_data(janus_sctp_association *sctp, char *buf, int len, gboolean binary) {
 	if(sctp == NULL || buf == NULL || len <= 0)
 		return;
-	JANUS_LOG(LOG_VERB, "[%"SCNu64"] SCTP data to send (%d bytes) coming from a plugin: %.*s\n", sctp->handle_id, len, len, buf);
+	if(binary) {
+		JANUS_LOG(LOG_VERB, "[%"SCNu64"] SCTP binary data to send (%d bytes) coming from a plugin\n", sctp->handle_id, len);
+	} else {
+		JANUS_LOG(LOG_VERB, "[%"SCNu64"] SCTP data to send (%d bytes) coming from a plugin: %.*s\n", sctp->handle_id, len, len, buf);
+	}
 	/* FIXME Is there any open channel we can use? */
 	int i = 0, found = 0;
 	for(i = 0; i < NUMBER_OF_CHANNELS; i++) {
@@ -366,8 +502,7 @@ void janus_sctp_send_data(janus_sctp_association *sctp, char *buf, int len) {
 			//~ return;
 		//~ }
 	}
-	/* FIXME We're assuming this is a string (we don't support binary data yet) */
-	janus_sctp_send_text(sctp, i, buf, len);
+	janus_sctp_send_message(sctp, i, binary, buf, len);
 }
 
 
@@ -458,10 +593,9 @@ void janus_sctp_request_more_streams(janus_sctp_association *sctp) {
 	return;
 }
 
-int janus_sctp_send_open_request_message(struct socket *sock, uint16_t stream, uint8_t unordered, uint16_t pr_policy, uint32_t pr_value) {
+int janus_sctp_send_open_request_message(janus_sctp_association *sctp, uint16_t stream, uint8_t unordered, uint16_t pr_policy, uint32_t pr_value) {
 	/* XXX: This should be encoded in a better way */
 	janus_datachannel_open_request *req = NULL;
-	struct sctp_sndinfo sndinfo;
 
 	/* FIXME For open requests we send, we always use this label */
 	const char *label = "JanusDataChannel";
@@ -490,74 +624,31 @@ int janus_sctp_send_open_request_message(struct socket *sock, uint16_t stream, u
 	req->label_length = htons(label_size);
 	memcpy(&req->label, label, strlen(label));
 
-	memset(&sndinfo, 0, sizeof(struct sctp_sndinfo));
-	sndinfo.snd_sid = stream;
-	sndinfo.snd_flags = SCTP_EOR;
-	sndinfo.snd_ppid = htonl(DATA_CHANNEL_PPID_CONTROL);
-
-	if(usrsctp_sendv(sock,
-	                  req, sizeof(janus_datachannel_open_request) + label_size,
-	                  NULL, 0,
-	                  &sndinfo, (socklen_t)sizeof(struct sctp_sndinfo),
-	                  SCTP_SENDV_SNDINFO, 0) < 0) {
-		JANUS_LOG(LOG_ERR, "usrsctp_sendv error (%d)\n", errno);
-		g_free(req);
-		req = NULL;
-		return 0;
-	} else {
-		g_free(req);
-		req = NULL;
-		return 1;
-	}
+	int res = janus_sctp_send_control(sctp, stream, req, sizeof(janus_datachannel_open_request) + label_size);
+	g_free(req);
+	req = NULL;
+	return res;
 }
 
-int janus_sctp_send_open_response_message(struct socket *sock, uint16_t stream) {
+int janus_sctp_send_open_response_message(janus_sctp_association *sctp, uint16_t stream) {
 	/* XXX: This should be encoded in a better way */
 	janus_datachannel_open_response rsp;
-	struct sctp_sndinfo sndinfo;
 
 	memset(&rsp, 0, sizeof(janus_datachannel_open_response));
 	rsp.msg_type = DATA_CHANNEL_OPEN_RESPONSE;
 	rsp.error = 0;
 	rsp.flags = htons(0);
 	rsp.reverse_stream = htons(stream);
-	memset(&sndinfo, 0, sizeof(struct sctp_sndinfo));
-	sndinfo.snd_sid = stream;
-	sndinfo.snd_flags = SCTP_EOR;
-	sndinfo.snd_ppid = htonl(DATA_CHANNEL_PPID_CONTROL);
-	if(usrsctp_sendv(sock,
-	                  &rsp, sizeof(janus_datachannel_open_response),
-	                  NULL, 0,
-	                  &sndinfo, (socklen_t)sizeof(struct sctp_sndinfo),
-	                  SCTP_SENDV_SNDINFO, 0) < 0) {
-		JANUS_LOG(LOG_ERR, "usrsctp_sendv error (%d)\n", errno);
-		return 0;
-	} else {
-		return 1;
-	}
+	return janus_sctp_send_control(sctp, stream, &rsp, sizeof(janus_datachannel_open_response));
 }
 
-int janus_sctp_send_open_ack_message(struct socket *sock, uint16_t stream) {
+int janus_sctp_send_open_ack_message(janus_sctp_association *sctp, uint16_t stream) {
 	/* XXX: This should be encoded in a better way */
 	janus_datachannel_ack ack;
-	struct sctp_sndinfo sndinfo;
 
 	memset(&ack, 0, sizeof(janus_datachannel_ack));
 	ack.msg_type = DATA_CHANNEL_ACK;
-	memset(&sndinfo, 0, sizeof(struct sctp_sndinfo));
-	sndinfo.snd_sid = stream;
-	sndinfo.snd_flags = SCTP_EOR;
-	sndinfo.snd_ppid = htonl(DATA_CHANNEL_PPID_CONTROL);
-	if(usrsctp_sendv(sock,
-	                  &ack, sizeof(janus_datachannel_ack),
-	                  NULL, 0,
-	                  &sndinfo, (socklen_t)sizeof(struct sctp_sndinfo),
-	                  SCTP_SENDV_SNDINFO, 0) < 0) {
-		JANUS_LOG(LOG_ERR, "usrsctp_sendv error (%d)\n", errno);
-		return 0;
-	} else {
-		return 1;
-	}
+	return janus_sctp_send_control(sctp, stream, &ack, sizeof(janus_datachannel_ack));
 }
 
 void janus_sctp_send_deferred_messages(janus_sctp_association *sctp) {
@@ -567,7 +658,7 @@ void janus_sctp_send_deferred_messages(janus_sctp_association *sctp) {
 	for(i = 0; i < NUMBER_OF_CHANNELS; i++) {
 		channel = &(sctp->channels[i]);
 		if(channel->flags & DATA_CHANNEL_FLAGS_SEND_REQ) {
-			if(janus_sctp_send_open_request_message(sctp->sock, channel->stream, channel->unordered, channel->pr_policy, channel->pr_value)) {
+			if(janus_sctp_send_open_request_message(sctp, channel->stream, channel->unordered, channel->pr_policy, channel->pr_value)) {
 				channel->flags &= ~DATA_CHANNEL_FLAGS_SEND_REQ;
 			} else {
 				if(errno != EAGAIN) {
@@ -576,7 +667,7 @@ void janus_sctp_send_deferred_messages(janus_sctp_association *sctp) {
 			}
 		}
 		if(channel->flags & DATA_CHANNEL_FLAGS_SEND_RSP) {
-			if(janus_sctp_send_open_response_message(sctp->sock, channel->stream)) {
+			if(janus_sctp_send_open_response_message(sctp, channel->stream)) {
 				channel->flags &= ~DATA_CHANNEL_FLAGS_SEND_RSP;
 			} else {
 				if(errno != EAGAIN) {
@@ -585,7 +676,7 @@ void janus_sctp_send_deferred_messages(janus_sctp_association *sctp) {
 			}
 		}
 		if(channel->flags & DATA_CHANNEL_FLAGS_SEND_ACK) {
-			if(janus_sctp_send_open_ack_message(sctp->sock, channel->stream)) {
+			if(janus_sctp_send_open_ack_message(sctp, channel->stream)) {
 				channel->flags &= ~DATA_CHANNEL_FLAGS_SEND_ACK;
 			} else {
 				if(errno != EAGAIN) {
@@ -627,7 +718,7 @@ int janus_sctp_open_channel(janus_sctp_association *sctp, uint8_t unordered, uin
 	if(stream == 0) {
 		janus_sctp_request_more_streams(sctp);
 	} else {
-		if(janus_sctp_send_open_request_message(sctp->sock, stream, unordered, pr_policy, pr_value)) {
+		if(janus_sctp_send_open_request_message(sctp, stream, unordered, pr_policy, pr_value)) {
 			sctp->stream_channel[stream] = channel;
 		} else {
 			if(errno == EAGAIN) {
@@ -647,8 +738,120 @@ int janus_sctp_open_channel(janus_sctp_association *sctp, uint8_t unordered, uin
 	return 0;
 }
 
-int janus_sctp_send_text(janus_sctp_association *sctp, uint16_t id, char *text, size_t length) {
-	if(id >= NUMBER_OF_CHANNELS || text == NULL)
+/* Helper to abort the association when a message could only be sent in part: as
+ * records are ended explicitly, whatever we'd send next on the stream would be
+ * glued to it, and ending the record now would deliver a truncated message */
+static void janus_sctp_abort(janus_sctp_association *sctp) {
+	JANUS_LOG(LOG_ERR, "[%"SCNu64"] Couldn't send a message in full, aborting the SCTP association\n", sctp->handle_id);
+	struct sctp_sndinfo sndinfo;
+	memset(&sndinfo, 0, sizeof(struct sctp_sndinfo));
+	sndinfo.snd_flags = SCTP_ABORT;
+	if(usrsctp_sendv(sctp->sock, NULL, 0, NULL, 0,
+			&sndinfo, (socklen_t)sizeof(struct sctp_sndinfo),
+			SCTP_SENDV_SNDINFO, 0) < 0) {
+		JANUS_LOG(LOG_ERR, "[%"SCNu64"] Error aborting the SCTP association (%d)\n", sctp->handle_id, errno);
+	}
+}
+
+/* Helper to pass (what's left of) a message to the SCTP stack (send_mutex must be
+ * locked): large messages are passed in pieces, and only the last one ends the
+ * record, so that we never need room for the whole message in the send buffer.
+ * Returns 0 if the message was sent, 1 if the send buffer is full and the rest
+ * must be sent later (offset tells where to resume from), -1 in case of errors */
+static int janus_sctp_send_pieces(janus_sctp_association *sctp, struct sctp_sendv_spa *spa, char *buffer, size_t length, size_t *offset) {
+	while(*offset < length) {
+		size_t chunk = length - *offset;
+		if(chunk > JANUS_SCTP_SEND_CHUNK)
+			chunk = JANUS_SCTP_SEND_CHUNK;
+		if(*offset + chunk == length)
+			spa->sendv_sndinfo.snd_flags |= SCTP_EOR;
+		else
+			spa->sendv_sndinfo.snd_flags &= ~SCTP_EOR;
+		ssize_t sent = usrsctp_sendv(sctp->sock, buffer + *offset, chunk, NULL, 0,
+			spa, (socklen_t)sizeof(struct sctp_sendv_spa), SCTP_SENDV_SPA, 0);
+		if(sent < 0) {
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				return 1;
+			JANUS_LOG(LOG_ERR, "[%"SCNu64"] sctp_sendv error (%d)\n", sctp->handle_id, errno);
+			if(*offset > 0)
+				janus_sctp_abort(sctp);
+			return -1;
+		}
+		/* The stack may take only part of a piece: the record is only ended once it takes all of the last one */
+		*offset += sent;
+	}
+	return 0;
+}
+
+static void janus_sctp_pending_free(janus_sctp_pending *pending) {
+	if(pending == NULL)
+		return;
+	g_free(pending->buffer);
+	g_free(pending);
+}
+
+/* Helper to send the messages that were queued while the send buffer was full (send_mutex must be locked) */
+static void janus_sctp_send_pending(janus_sctp_association *sctp) {
+	janus_sctp_pending *pending = NULL;
+	while((pending = g_queue_peek_head(sctp->pending)) != NULL) {
+		if(janus_sctp_send_pieces(sctp, &pending->spa, pending->buffer, pending->length, &pending->offset) == 1) {
+			/* Still no room: we'll try again when the stack tells us there's some */
+			return;
+		}
+		g_queue_pop_head(sctp->pending);
+		sctp->pending_bytes -= pending->length;
+		janus_sctp_pending_free(pending);
+	}
+}
+
+/* Helper to send a DCEP message (OPEN, ACK) on a stream: it goes through the same
+ * path as data messages, so it's never sent in the middle of a record we only
+ * passed in part to the stack. If the send buffer is full, it's queued ahead of
+ * the data messages we didn't start sending yet (but after other DCEP messages,
+ * to keep them in order), as channels can't be used until they're open anyway.
+ * Returns 1 if the message was sent or queued, 0 in case of errors */
+static int janus_sctp_send_control(janus_sctp_association *sctp, uint16_t stream, void *buffer, size_t length) {
+	struct sctp_sendv_spa spa;
+	memset(&spa, 0, sizeof(struct sctp_sendv_spa));
+	spa.sendv_sndinfo.snd_sid = stream;
+	spa.sendv_sndinfo.snd_ppid = htonl(DATA_CHANNEL_PPID_CONTROL);
+	spa.sendv_flags = SCTP_SEND_SNDINFO_VALID;
+	janus_mutex_lock(&sctp->send_mutex);
+	janus_sctp_send_pending(sctp);
+	size_t offset = 0;
+	int res = 1;
+	if(g_queue_is_empty(sctp->pending))
+		res = janus_sctp_send_pieces(sctp, &spa, buffer, length, &offset);
+	if(res == 1) {
+		/* Control messages are tiny, and never dropped */
+		janus_sctp_pending *pending = g_malloc(sizeof(janus_sctp_pending));
+		pending->spa = spa;
+		pending->buffer = g_malloc(length);
+		memcpy(pending->buffer, buffer, length);
+		pending->length = length;
+		pending->offset = offset;
+		pending->control = TRUE;
+		guint position = 0;
+		GList *item = sctp->pending->head;
+		while(item != NULL) {
+			janus_sctp_pending *queued = (janus_sctp_pending *)item->data;
+			if(queued->offset == 0 && !queued->control)
+				break;
+			position++;
+			item = item->next;
+		}
+		g_queue_push_nth(sctp->pending, pending, position);
+		sctp->pending_bytes += length;
+		JANUS_LOG(LOG_HUGE, "[%"SCNu64"] SCTP send buffer full, queued control message on stream %"SCNu16"\n",
+			sctp->handle_id, stream);
+		res = 0;
+	}
+	janus_mutex_unlock(&sctp->send_mutex);
+	return res < 0 ? 0 : 1;
+}
+
+int janus_sctp_send_message(janus_sctp_association *sctp, uint16_t id, gboolean binary, char *buffer, size_t length) {
+	if(id >= NUMBER_OF_CHANNELS || buffer == NULL)
 		return -1;
 	struct sctp_sendv_spa spa;
 	janus_sctp_channel *channel = &sctp->channels[id];
@@ -665,24 +868,48 @@ int janus_sctp_send_text(janus_sctp_association *sctp, uint16_t id, char *text,
 	memset(&spa, 0, sizeof(struct sctp_sendv_spa));
 	spa.sendv_sndinfo.snd_sid = channel->stream;
 	if((channel->state == DATA_CHANNEL_OPEN) && (channel->unordered)) {
-		spa.sendv_sndinfo.snd_flags = SCTP_EOR | SCTP_UNORDERED;
-	} else {
-		spa.sendv_sndinfo.snd_flags = SCTP_EOR;
+		spa.sendv_sndinfo.snd_flags = SCTP_UNORDERED;
 	}
-	spa.sendv_sndinfo.snd_ppid = htonl(DATA_CHANNEL_PPID_DOMSTRING);
+	spa.sendv_sndinfo.snd_ppid = htonl(binary ? DATA_CHANNEL_PPID_BINARY : DATA_CHANNEL_PPID_DOMSTRING);
 	spa.sendv_flags = SCTP_SEND_SNDINFO_VALID;
 	if((channel->pr_policy == SCTP_PR_SCTP_TTL) || (channel->pr_policy == SCTP_PR_SCTP_RTX)) {
 		spa.sendv_prinfo.pr_policy = channel->pr_policy;
 		spa.sendv_prinfo.pr_value = channel->pr_value;
 		spa.sendv_flags |= SCTP_SEND_PRINFO_VALID;
 	}
-	if(usrsctp_sendv(sctp->sock, text, length, NULL, 0,
-			&spa, (socklen_t)sizeof(struct sctp_sendv_spa),
-			SCTP_SENDV_SPA, 0) < 0) {
-		JANUS_LOG(LOG_ERR, "[%"SCNu64"] sctp_sendv error (%d)\n", sctp->handle_id, errno);
+	janus_mutex_lock(&sctp->send_mutex);
+	/* Messages waiting for room in the send buffer go first: we never overtake them */
+	janus_sctp_send_pending(sctp);
+	size_t offset = 0;
+	int res = 1;
+	if(g_queue_is_empty(sctp->pending))
+		res = janus_sctp_send_pieces(sctp, &spa, buffer, length, &offset);
+	if(res == 1) {
+		/* The send buffer is full: if we started the record we have to finish it,
+		 * otherwise we only queue the message if the peer isn't too far behind */
+		if(offset == 0 && sctp->pending_bytes + length > JANUS_SCTP_MAX_PENDING_BYTES) {
+			janus_mutex_unlock(&sctp->send_mutex);
+			JANUS_LOG(LOG_WARN, "[%"SCNu64"] Too much data waiting to be sent on the SCTP association, dropping message (%zu bytes)\n",
+				sctp->handle_id, length);
+			return -1;
+		}
+		janus_sctp_pending *pending = g_malloc(sizeof(janus_sctp_pending));
+		pending->spa = spa;
+		pending->buffer = g_malloc(length);
+		memcpy(pending->buffer, buffer, length);
+		pending->length = length;
+		pending->offset = offset;
+		pending->control = FALSE;
+		g_queue_push_tail(sctp->pending, pending);
+		sctp->pending_bytes += length;
+		JANUS_LOG(LOG_HUGE, "[%"SCNu64"] SCTP send buffer full, queued message on channel %"SCNu16" (%zu bytes pending)\n",
+			sctp->handle_id, id, sctp->pending_bytes);
+		res = 0;
+	}
+	janus_mutex_unlock(&sctp->send_mutex);
+	if(res < 0)
 		return -1;
-	}
-	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Message sent on channel %"SCNu16"\n", sctp->handle_id, id); 
+	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Message sent on channel %"SCNu16"\n", sctp->handle_id, id);
 	return 0;
 }
 
@@ -798,7 +1025,7 @@ void janus_sctp_handle_open_request_message(janus_sctp_association *sctp, janus_
 	if(stream == 0) {
 		janus_sctp_request_more_streams(sctp);
 	} else {
-		if(janus_sctp_send_open_ack_message(sctp->sock, stream)) {
+		if(janus_sctp_send_open_ack_message(sctp, stream)) {
 			sctp->stream_channel[stream] = channel;
 		} else {
 			if(errno == EAGAIN) {
@@ -853,7 +1080,7 @@ void janus_sctp_handle_open_response_message(janus_sctp_association *sctp, janus
 	channel->stream = stream;
 	channel->state = DATA_CHANNEL_OPEN;
 	sctp->stream_channel[stream] = channel;
-	if(janus_sctp_send_open_ack_message(sctp->sock, stream)) {
+	if(janus_sctp_send_open_ack_message(sctp, stream)) {
 		channel->flags = 0;
 	} else {
 		channel->flags |= DATA_CHANNEL_FLAGS_SEND_ACK;
@@ -886,7 +1113,7 @@ void janus_sctp_handle_unknown_message(char *msg, size_t length, uint16_t stream
 	return;
 }
 
-void janus_sctp_handle_data_message(janus_sctp_association *sctp, char *buffer, size_t length, uint16_t stream) {
+void janus_sctp_handle_data_message(janus_sctp_association *sctp, char *buffer, size_t length, uint16_t stream, gboolean binary) {
 	janus_sctp_channel *channel;
 
 	channel = janus_sctp_find_channel_by_stream(sctp, stream);
@@ -905,12 +1132,15 @@ void janus_sctp_handle_data_message(janus_sctp_association *sctp, char *buffer,
 		JANUS_LOG(LOG_WARN, "[%"SCNu64"] Got data from this SCTP association but channel isn't open yet...\n", sctp->handle_id);
 		return;
 	} else {
-		/* Assuming DATA_CHANNEL_PPID_DOMSTRING */
-		/* XXX: Protect for non 0 terminated buffer */
-		JANUS_LOG(LOG_VERB, "[%"SCNu64"] Message received of length %zu on channel with id %d: %.*s\n",
-		       sctp->handle_id, length, channel->id, (int)length, buffer);
-		/* FIXME: notify this to the core */
-		janus_dtls_notify_data((janus_dtls_srtp *)sctp->dtls, buffer, (int)length);
+		if(binary) {
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Binary message received of length %zu on channel with id %d\n",
+			       sctp->handle_id, length, channel->id);
+		} else {
+			/* XXX: Protect for non 0 terminated buffer */
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Message received of length %zu on channel with id %d: %.*s\n",
+			       sctp->handle_id, length, channel->id, (int)length, buffer);
+		}
+		janus_dtls_notify_data((janus_dtls_srtp *)sctp->dtls, buffer, (int)length, binary);
 	}
 	return;
 }
@@ -960,30 +1190,51 @@ void janus_sctp_handle_message(janus_sctp_association *sctp, char *buffer, size_
 		case DATA_CHANNEL_PPID_BINARY:
 		case DATA_CHANNEL_PPID_DOMSTRING_PARTIAL:
 		case DATA_CHANNEL_PPID_BINARY_PARTIAL:
-			if((flags & MSG_EOR) &&
-					ppid != DATA_CHANNEL_PPID_DOMSTRING_PARTIAL &&
-					ppid != DATA_CHANNEL_PPID_BINARY_PARTIAL) {
+		{
+			gboolean binary = (ppid == DATA_CHANNEL_PPID_BINARY || ppid == DATA_CHANNEL_PPID_BINARY_PARTIAL);
+			gboolean complete = (flags & MSG_EOR) &&
+				ppid != DATA_CHANNEL_PPID_DOMSTRING_PARTIAL && ppid != DATA_CHANNEL_PPID_BINARY_PARTIAL;
+			if(sctp->discarding) {
+				/* We're dropping what's left of a message that was too large */
+				if(complete)
+					sctp->discarding = FALSE;
+				break;
+			}
+			if(complete && sctp->offset == 0) {
+				/* No buffering done, send this message as it is */
+				janus_sctp_handle_data_message(sctp, buffer, length, stream, binary);
+				break;
+			}
+			/* Partial message (or last part of one), buffer it */
+			if(sctp->offset + length > JANUS_SCTP_MAX_MESSAGE_SIZE) {
+				JANUS_LOG(LOG_WARN, "[%"SCNu64"] Message on stream %"SCNu16" is larger than %d bytes, dropping it\n",
+					sctp->handle_id, stream, JANUS_SCTP_MAX_MESSAGE_SIZE);
+				sctp->offset = 0;
+				sctp->discarding = !complete;
+				break;
+			}
+			if(length > (sctp->buflen - sctp->offset)) {
+				/* (re)Allocate the buffer, doubling it to avoid a realloc per piece */
+				size_t newlen = sctp->buflen ? sctp->buflen : BUFFER_SIZE;
+				while(newlen < sctp->offset + length)
+					newlen *= 2;
+				sctp->buffer = g_realloc(sctp->buffer, newlen);
+				sctp->buflen = newlen;
+			}
+			memcpy(sctp->buffer + sctp->offset, buffer, length);
+			sctp->offset += length;
+			if(complete) {
 				/* Message is complete, send it */
-				if(sctp->offset > 0) {
-					/* We buffered multiple partial messages */
-					janus_sctp_handle_data_message(sctp, sctp->buffer, sctp->offset, stream);
-					sctp->offset = 0;
-				} else {
-					/* No buffering done, send this message as it is */
-					janus_sctp_handle_data_message(sctp, buffer, length, stream);
-				}
-			} else {
-				/* Partial message, buffer only for now */
-				if(length > (sctp->buflen - sctp->offset)) {
-					/* (re)Allocate the buffer */
-					int newlen = sctp->buflen + (length - (sctp->buflen - sctp->offset));
-					sctp->buffer = g_realloc(sctp->buffer, newlen);
-					sctp->buflen = newlen;
-				}
-				memcpy(sctp->buffer + sctp->offset, buffer, length);
-				sctp->offset += length;
+				janus_sctp_handle_data_message(sctp, sctp->buffer, sctp->offset, stream, binary);
+				sctp->offset = 0;
 			}
 			break;
+		}
+		case DATA_CHANNEL_PPID_DOMSTRING_EMPTY:
+		case DATA_CHANNEL_PPID_BINARY_EMPTY:
+			/* Empty messages have a single byte we should ignore: nothing to pass to plugins */
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Empty message on stream %"SCNu16", ignoring\n", sctp->handle_id, stream);
+			break;
 		default:
 			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Message of length %zu, PPID %u on stream %u received.\n",
 				   sctp->handle_id, length, ppid, stream);
@@ -1252,6 +1503,69 @@ void janus_sctp_handle_notification(janus_sctp_association *sctp, union sctp_not
 }
 
 
+/* Helper to process a message for an association (returns FALSE if the association is gone) */
+static gboolean janus_sctp_process_message(janus_sctp_association *sctp, janus_sctp_message *message) {
+	janus_mutex_lock(&sctp->mutex);
+	if(sctp->dtls == NULL) {
+		/* No DTLS stack anymore, we're done */
+		janus_mutex_unlock(&sctp->mutex);
+		return FALSE;
+	}
+	/* Check incoming/outgoing messages */
+	if(!message->incoming) {
+#ifdef DEBUG_SCTP
+		if(sctp->debug_dump != NULL) {
+			/* Dump outgoing message */
+			char *dump = usrsctp_dumppacket(message->buffer, message->length, SCTP_DUMP_OUTBOUND);
+			if(dump != NULL) {
+				fwrite(dump, sizeof(char), strlen(dump), sctp->debug_dump);
+				fflush(sctp->debug_dump);
+				usrsctp_freedumpbuffer(dump);
+			}
+		}
+#endif
+		/* Encapsulate this data in DTLS and send it */
+		janus_dtls_send_sctp_data((janus_dtls_srtp *)sctp->dtls, message->buffer, message->length);
+		if(!sctp->sent_data)
+			sctp->sent_data = TRUE;
+	} else if(message->incoming && sctp->sent_data) {
+#ifdef DEBUG_SCTP
+		if(sctp->debug_dump != NULL) {
+			/* Dump incoming message */
+			char *dump = usrsctp_dumppacket(message->buffer, message->length, SCTP_DUMP_INBOUND);
+			if(dump != NULL) {
+				fwrite(dump, sizeof(char), strlen(dump), sctp->debug_dump);
+				fflush(sctp->debug_dump);
+				usrsctp_freedumpbuffer(dump);
+			}
+		}
+#endif
+		/* Pass this data to the SCTP association */
+		janus_mutex_unlock(&sctp->mutex);
+		usrsctp_conninput((void *)sctp, message->buffer, message->length, 0);
+		janus_mutex_lock(&sctp->mutex);
+	}
+	janus_mutex_unlock(&sctp->mutex);
+	return TRUE;
+}
+
+/* Helper to free the resources of an association, once we're sure usrsctp is done with it */
+static void janus_sctp_association_free(janus_sctp_association *sctp) {
+	g_async_queue_unref(sctp->messages);
+	sctp->messages = NULL;
+	sctp->thread = NULL;
+#ifdef DEBUG_SCTP
+	if(sctp->debug_dump != NULL)
+		fclose(sctp->debug_dump);
+	sctp->debug_dump = NULL;
+#endif
+	g_free(sctp->buffer);
+	g_queue_free_full(sctp->pending, (GDestroyNotify)janus_sctp_pending_free);
+	sctp->pending = NULL;
+	janus_mutex_destroy(&sctp->send_mutex);
+	g_free(sctp);
+}
+
 void *janus_sctp_thread(void *data) {
 	janus_sctp_association *sctp = (janus_sctp_association *)data;
 	if(sctp == NULL) {
@@ -1261,7 +1575,6 @@ void *janus_sctp_thread(void *data) {
 	}
 	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Starting thread for SCTP association\n", sctp->handle_id);
 	janus_sctp_message *message = NULL;
-	gboolean sent_data = FALSE;
 	while(sctp->dtls != NULL && sctp_running) {
 		/* Anything to do at all? */
 		message = g_async_queue_pop(sctp->messages);
@@ -1269,91 +1582,121 @@ void *janus_sctp_thread(void *data) {
 			continue;
 		if(message == &exit_message)
 			break;
-		janus_mutex_lock(&sctp->mutex);
-		if(sctp->dtls == NULL) {
-			/* No DTLS stack anymore, we're done */
-			janus_sctp_message_destroy(message);
-			message = NULL;
-			janus_mutex_unlock(&sctp->mutex);
-			break;
-		}
-		/* Check incoming/outgoing messages */
-		if(!message->incoming) {
-#ifdef DEBUG_SCTP
-			if(sctp->debug_dump != NULL) {
-				/* Dump outgoing message */
-				char *dump = usrsctp_dumppacket(message->buffer, message->length, SCTP_DUMP_OUTBOUND);
-				if(dump != NULL) {
-					fwrite(dump, sizeof(char), strlen(dump), sctp->debug_dump);
-					fflush(sctp->debug_dump);
-					usrsctp_freedumpbuffer(dump);
-				}
-			}
-#endif
-			/* Encapsulate this data in DTLS and send it */
-			janus_dtls_send_sctp_data((janus_dtls_srtp *)sctp->dtls, message->buffer, message->length);
-			janus_sctp_message_destroy(message);
-			message = NULL;
-			if(!sent_data)
-				sent_data = TRUE;
-		} else if(message->incoming && sent_data) {
-#ifdef DEBUG_SCTP
-			if(sctp->debug_dump != NULL) {
-				/* Dump incoming message */
-				char *dump = usrsctp_dumppacket(message->buffer, message->length, SCTP_DUMP_INBOUND);
-				if(dump != NULL) {
-					fwrite(dump, sizeof(char), strlen(dump), sctp->debug_dump);
-					fflush(sctp->debug_dump);
-					usrsctp_freedumpbuffer(dump);
-				}
-			}
-#endif
-			/* Pass this data to the SCTP association */
-			janus_mutex_unlock(&sctp->mutex);
-			usrsctp_conninput((void *)sctp, message->buffer, message->length, 0);
-			janus_mutex_lock(&sctp->mutex);
-		}
-		janus_mutex_unlock(&sctp->mutex);
+		gboolean alive = janus_sctp_process_message(sctp, message);
 		janus_sctp_message_destroy(message);
 		message = NULL;
+		if(!alive)
+			break;
 	}
 	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Leaving SCTP association thread\n", sctp->handle_id);
 	/* This association has been destroyed, wait a bit and then free all the resources */
 	g_usleep (1*G_USEC_PER_SEC);
-	g_async_queue_unref(sctp->messages);
-	sctp->messages = NULL;
-	sctp->thread = NULL;
-#ifdef DEBUG_SCTP
-	if(sctp->debug_dump != NULL)
-		fclose(sctp->debug_dump);
-	sctp->debug_dump = NULL;
-#endif
-	g_free(sctp->buffer);
-	g_free(sctp);
+	janus_sctp_association_free(sctp);
 	sctp = NULL;
 	g_thread_unref(g_thread_self());
 	return NULL;
 }
 
+/* Associations waiting to be freed by a worker */
+typedef struct janus_sctp_closing {
+	janus_sctp_association *sctp;
+	gint64 free_at;
+} janus_sctp_closing;
+
+static void *janus_sctp_worker_thread(void *data) {
+	janus_sctp_worker *worker = (janus_sctp_worker *)data;
+	JANUS_LOG(LOG_INFO, "Joining SCTP worker #%u\n", worker->id);
+	janus_sctp_message *message = NULL;
+	while(sctp_running) {
+		/* If there are associations to free, don't wait for messages forever */
+		if(g_queue_is_empty(worker->closing))
+			message = g_async_queue_pop(worker->messages);
+		else
+			message = g_async_queue_timeout_pop(worker->messages, 100000);
+		if(message == &exit_message)
+			break;
+		if(message != NULL) {
+			janus_sctp_association *sctp = message->sctp;
+			if(message->destroy) {
+				/* Just as dedicated threads do, wait a bit before freeing the resources */
+				JANUS_LOG(LOG_VERB, "[%"SCNu64"] SCTP association removed from worker #%u\n", sctp->handle_id, worker->id);
+				janus_sctp_closing *closing = g_malloc(sizeof(janus_sctp_closing));
+				closing->sctp = sctp;
+				closing->free_at = janus_get_monotonic_time() + G_USEC_PER_SEC;
+				g_queue_push_tail(worker->closing, closing);
+			} else if(sctp != NULL) {
+				janus_sctp_process_message(sctp, message);
+			}
+			janus_sctp_message_destroy(message);
+			message = NULL;
+		}
+		/* Any association we can get rid of? */
+		gint64 now = janus_get_monotonic_time();
+		janus_sctp_closing *closing = NULL;
+		while((closing = g_queue_peek_head(worker->closing)) != NULL && closing->free_at <= now) {
+			g_queue_pop_head(worker->closing);
+			janus_sctp_association_free(closing->sctp);
+			g_free(closing);
+		}
+	}
+	/* We're shutting down */
+	janus_sctp_closing *closing = NULL;
+	while((closing = g_queue_pop_head(worker->closing)) != NULL) {
+		janus_sctp_association_free(closing->sctp);
+		g_free(closing);
+	}
+	JANUS_LOG(LOG_INFO, "Leaving SCTP worker #%u\n", worker->id);
+	return NULL;
+}
+
 janus_sctp_message *janus_sctp_message_create(gboolean incoming, char *buffer, size_t length) {
-	if(buffer == NULL || length == 0)
+	if((buffer == NULL && length > 0) || (buffer != NULL && length == 0))
 		return NULL;
-	janus_sctp_message *message = g_malloc(sizeof(janus_sctp_message));
-	message->buffer = g_malloc(length);
-	memcpy(message->buffer, buffer, length);
+	janus_sctp_message *message = NULL;
+	if(length > JANUS_SCTP_MESSAGE_BUFSIZE) {
+		/* Too large for the pool */
+		message = g_malloc(sizeof(janus_sctp_message));
+		message->buffer = g_malloc(length);
+	} else {
+		janus_mutex_lock(&message_pool_mutex);
+		message = message_pool;
+		if(message != NULL) {
+			message_pool = message->next;
+			message_pool_count--;
+		}
+		janus_mutex_unlock(&message_pool_mutex);
+		if(message == NULL)
+			message = g_malloc(sizeof(janus_sctp_message) + JANUS_SCTP_MESSAGE_BUFSIZE);
+		message->buffer = (char *)message + sizeof(janus_sctp_message);
+	}
+	if(length > 0)
+		memcpy(message->buffer, buffer, length);
 	message->length = length;
 	message->incoming = incoming;
+	message->destroy = FALSE;
+	message->sctp = NULL;
+	message->next = NULL;
 	return message;
 }
 
 void janus_sctp_message_destroy(janus_sctp_message *message) {
 	if(message == NULL || message == &exit_message)
 		return;
-	if(message->buffer != NULL)
+	if(message->buffer != (char *)message + sizeof(janus_sctp_message)) {
+		/* Not from the pool */
 		g_free(message->buffer);
-	message->buffer = NULL;
+		g_free(message);
+		return;
+	}
+	janus_mutex_lock(&message_pool_mutex);
+	if(message_pool_count < JANUS_SCTP_MESSAGE_POOL_MAX) {
+		message->next = message_pool;
+		message_pool = message;
+		message_pool_count++;
+		message = NULL;
+	}
+	janus_mutex_unlock(&message_pool_mutex);
 	g_free(message);
-	message = NULL;
 }
 
 #endif
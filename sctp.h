@@ -47,8 +47,13 @@
 
 
 /*! \brief SCTP stuff initialization
+ * @param[in] workers Number of threads that should take care of all the SCTP associations (0 means a dedicated thread per association)
  * \returns 0 on success, a negative integer otherwise */
-int janus_sctp_init(void);
+int janus_sctp_init(guint workers);
+
+/*! \brief Method to get the number of threads shared by all the SCTP associations
+ * @returns The number of workers (0 if each association has its own thread) */
+guint janus_sctp_get_workers(void);
 
 /*! \brief SCTP stuff de-initialization */
 void janus_sctp_deinit(void);
@@ -63,6 +68,15 @@ void janus_sctp_deinit(void);
 #define DATA_CHANNEL_PPID_BINARY_PARTIAL    52
 #define DATA_CHANNEL_PPID_BINARY            53
 #define DATA_CHANNEL_PPID_DOMSTRING_PARTIAL 54
+#define DATA_CHANNEL_PPID_DOMSTRING_EMPTY   56
+#define DATA_CHANNEL_PPID_BINARY_EMPTY      57
+
+/* Largest message we accept from a peer, once reassembled (what browsers advertise by default) */
+#define JANUS_SCTP_MAX_MESSAGE_SIZE	262144
+/* Large outgoing messages are passed to the SCTP stack in pieces this big (explicit EOR) */
+#define JANUS_SCTP_SEND_CHUNK		16384
+/* How much outgoing data we queue per association while the SCTP send buffer is full, before dropping messages */
+#define JANUS_SCTP_MAX_PENDING_BYTES	(4*1024*1024)
 
 #define DATA_CHANNEL_CLOSED     0
 #define DATA_CHANNEL_CONNECTING 1
@@ -90,6 +104,20 @@ typedef struct janus_sctp_channel {
 	uint32_t flags;
 } janus_sctp_channel;
 
+/*! \brief Outgoing message waiting for room in the SCTP send buffer */
+typedef struct janus_sctp_pending {
+	/*! \brief Stream, PPID and reliability settings to send the message with */
+	struct sctp_sendv_spa spa;
+	/*! \brief The message data */
+	char *buffer;
+	/*! \brief The message length */
+	size_t length;
+	/*! \brief How much of the message has already been passed to the SCTP stack */
+	size_t offset;
+	/*! \brief Whether this is a DCEP message, which is queued ahead of data messages */
+	gboolean control;
+} janus_sctp_pending;
+
 typedef struct janus_sctp_association {
 	/*! \brief Opaque pointer to the DTLS instance related to this SCTP association */
 	void *dtls;
@@ -109,16 +137,26 @@ typedef struct janus_sctp_association {
 	uint16_t local_port;
 	/*! \brief Remote port to be used for SCTP */
 	uint16_t remote_port;
-	/*! \brief Queue of incoming/outgoing messages */
+	/*! \brief Queue of incoming/outgoing messages (shared with other associations, when they're handled by a worker) */
 	GAsyncQueue *messages;
+	/*! \brief Whether we sent any data already (incoming data is ignored until then) */
+	gboolean sent_data;
 	/*! \brief Buffer for handling partial messages */
 	char *buffer;
 	/*! \brief Current size of the buffer for handling partial messages */
 	size_t buflen;
 	/*! \brief Current offset of the buffer for handling partial messages */
 	size_t offset;
-	/*! \brief Thread for handling SCTP messaging */
+	/*! \brief Whether we're dropping the rest of a partial message that was too large */
+	gboolean discarding;
+	/*! \brief Thread for handling SCTP messaging (NULL if this association is handled by a shared worker) */
 	GThread *thread;
+	/*! \brief Outgoing messages waiting for room in the send buffer (the socket is non-blocking), in order */
+	GQueue *pending;
+	/*! \brief How many bytes the messages waiting for room in the send buffer amount to */
+	size_t pending_bytes;
+	/*! \brief Mutex to serialize sending messages, and to protect the queue of pending ones */
+	janus_mutex send_mutex;
 #ifdef DEBUG_SCTP
 	FILE *debug_dump;
 #endif
@@ -128,12 +166,18 @@ typedef struct janus_sctp_association {
 
 /*! \brief Helper structure to handle incoming and outgoing messages */
 typedef struct janus_sctp_message {
+	/*! \brief SCTP association this message is related to */
+	janus_sctp_association *sctp;
 	/*! \brief Whether the message is incoming or outgoing */
 	gboolean incoming;
+	/*! \brief Whether this is a request to get rid of the association, rather than data */
+	gboolean destroy;
 	/*! \brief The message data */
 	char *buffer;
 	/*! \brief The message length */
 	size_t length;
+	/*! \brief Next message in the pool of free ones */
+	struct janus_sctp_message *next;
 } janus_sctp_message;
 
 
@@ -209,8 +253,9 @@ void janus_sctp_data_from_dtls(janus_sctp_association *sctp, char *buf, int len)
 /*! \brief Method to send data via SCTP to the peer
  * \param[in] sctp The SCTP association this data is from
  * \param[in] buf The data buffer
- * \param[in] len The buffer length */
-void janus_sctp_send_data(janus_sctp_association *sctp, char *buf, int len);
+ * \param[in] len The buffer length
+ * \param[in] binary Whether this is a binary message (text otherwise) */
+void janus_sctp_send_data(janus_sctp_association *sctp, char *buf, int len, gboolean binary);
 
 #endif
 
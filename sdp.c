@@ -71,7 +71,7 @@ int janus_sdp_process(void *ice_handle, janus_sdp *remote_sdp, gboolean update)
 #ifdef HAVE_SCTP
 	int data = 0;
 #endif
-	gboolean rtx = FALSE;
+	gboolean rtx = FALSE, fec = FALSE;
 	/* Ok, let's start with global attributes */
 	GList *temp = remote_sdp->attributes;
 	while(temp) {
@@ -202,6 +202,14 @@ int janus_sdp_process(void *ice_handle, janus_sdp *remote_sdp, gboolean update)
 					g_list_free(stream->video_payload_types);
 					stream->video_payload_types = g_list_copy(m->ptypes);
 				}
+				/* If we offered RED and ULPFEC, check if the peer accepted them: as we only
+				 * generate FEC, and don't expect any, we only do that for recvonly peers */
+				if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ULPFEC) && !stream->video_recv &&
+						stream->video_red_payload_type > 0 && stream->video_ulpfec_payload_type > 0 &&
+						g_list_find(m->ptypes, GINT_TO_POINTER(stream->video_red_payload_type)) &&
+						g_list_find(m->ptypes, GINT_TO_POINTER(stream->video_ulpfec_payload_type))) {
+					fec = TRUE;
+				}
 			} else {
 				/* Video rejected? */
 				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Video rejected by peer...\n", handle->handle_id);
@@ -495,8 +503,7 @@ int janus_sdp_process(void *ice_handle, janus_sdp *remote_sdp, gboolean update)
 						memset(stream->audio_rtcp_ctx, 0, sizeof(*stream->audio_rtcp_ctx));
 						stream->audio_rtcp_ctx->tb = 48000;	/* May change later */
 					}
-					if(component->last_seqs_audio)
-						janus_seq_list_free(&component->last_seqs_audio);
+					janus_seq_window_reset(component->audio_seq_window);
 					janus_mutex_unlock(&component->mutex);
 				}
 				stream->audio_ssrc_peer = stream->audio_ssrc_peer_new;
@@ -517,8 +524,7 @@ int janus_sdp_process(void *ice_handle, janus_sdp *remote_sdp, gboolean update)
 								memset(stream->video_rtcp_ctx[vindex], 0, sizeof(*stream->video_rtcp_ctx[vindex]));
 								stream->video_rtcp_ctx[vindex]->tb = 90000;
 							}
-							if(component->last_seqs_video[vindex])
-								janus_seq_list_free(&component->last_seqs_video[vindex]);
+							janus_seq_window_reset(component->video_seq_window[vindex]);
 							janus_mutex_unlock(&component->mutex);
 						}
 					}
@@ -548,11 +554,24 @@ int janus_sdp_process(void *ice_handle, janus_sdp *remote_sdp, gboolean update)
 		}
 		temp = temp->next;
 	}
+	/* Update the table we use to route incoming packets by SSRC */
+	janus_ice_stream_update_ssrc_table(stream);
 	/* Disable RFC4588 if the peer didn't negotiate it */
 	if(!rtx) {
 		janus_flags_clear(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX);
 		stream->video_ssrc_rtx = 0;
 	}
+	/* Disable FEC if the peer didn't accept it, or prepare the generator if it did */
+	if(!fec) {
+		janus_flags_clear(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ULPFEC);
+	} else if(stream->fec == NULL) {
+		JANUS_LOG(LOG_VERB, "[%"SCNu64"] Protecting video with ULPFEC (red=%d, ulpfec=%d)\n",
+			handle->handle_id, stream->video_red_payload_type, stream->video_ulpfec_payload_type);
+		stream->fec = janus_fec_context_create(stream->video_red_payload_type,
+			stream->video_ulpfec_payload_type, janus_ice_get_fec_overhead());
+		if(stream->fec == NULL)
+			janus_flags_clear(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ULPFEC);
+	}
 	/* Cleanup */
 	g_free(ruser);
 	g_free(rpass);
@@ -1207,6 +1226,16 @@ char *janus_sdp_merge(void *ice_handle, janus_sdp *anon, gboolean offer) {
 						g_list_free(ptypes);
 					}
 				}
+				if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ULPFEC) && m->direction == JANUS_SDP_SENDONLY &&
+						stream->video_red_payload_type > 0 && stream->video_ulpfec_payload_type > 0) {
+					/* Add RED and ULPFEC, as we'll protect the video we send */
+					m->ptypes = g_list_append(m->ptypes, GINT_TO_POINTER(stream->video_red_payload_type));
+					m->ptypes = g_list_append(m->ptypes, GINT_TO_POINTER(stream->video_ulpfec_payload_type));
+					janus_sdp_attribute *a = janus_sdp_attribute_create("rtpmap", "%d red/90000", stream->video_red_payload_type);
+					m->attributes = g_list_append(m->attributes, a);
+					a = janus_sdp_attribute_create("rtpmap", "%d ulpfec/90000", stream->video_ulpfec_payload_type);
+					m->attributes = g_list_append(m->attributes, a);
+				}
 			}
 #ifdef HAVE_SCTP
 		} else if(m->type == JANUS_SDP_APPLICATION) {
@@ -0,0 +1,114 @@
+/*! \file    shardedmap.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Sharded map with 64-bit keys
+ * \details  Implementation of a map split in shards. The shard a key
+ * belongs to is picked using the top bits of a Fibonacci hash of the
+ * key, which spreads sequential and clustered keys (as clients may
+ * choose them) evenly across shards.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include "shardedmap.h"
+#include "utils.h"
+
+#define JANUS_SHARDED_MAP_MAX_BITS	8
+
+static janus_sharded_map_shard *janus_sharded_map_shard_get(janus_sharded_map *map, guint64 key) {
+	if(map->bits == 0)
+		return &map->shards[0];
+	guint64 hash = key * G_GUINT64_CONSTANT(0x9E3779B97F4A7C15);
+	return &map->shards[hash >> (64 - map->bits)];
+}
+
+janus_sharded_map *janus_sharded_map_create(guint bits) {
+	if(bits > JANUS_SHARDED_MAP_MAX_BITS)
+		bits = JANUS_SHARDED_MAP_MAX_BITS;
+	janus_sharded_map *map = g_malloc0(sizeof(janus_sharded_map));
+	map->bits = bits;
+	guint count = 1 << bits, i = 0;
+	map->shards = g_malloc0(count * sizeof(janus_sharded_map_shard));
+	for(i=0; i<count; i++) {
+		janus_mutex_init(&map->shards[i].mutex);
+		map->shards[i].table = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, NULL);
+	}
+	return map;
+}
+
+void janus_sharded_map_destroy(janus_sharded_map *map) {
+	if(map == NULL)
+		return;
+	guint count = 1 << map->bits, i = 0;
+	for(i=0; i<count; i++) {
+		g_hash_table_destroy(map->shards[i].table);
+		janus_mutex_destroy(&map->shards[i].mutex);
+	}
+	g_free(map->shards);
+	g_free(map);
+}
+
+void janus_sharded_map_insert(janus_sharded_map *map, guint64 key, gpointer value) {
+	if(map == NULL)
+		return;
+	janus_sharded_map_shard *shard = janus_sharded_map_shard_get(map, key);
+	janus_mutex_lock(&shard->mutex);
+	g_hash_table_insert(shard->table, janus_uint64_dup(key), value);
+	janus_mutex_unlock(&shard->mutex);
+}
+
+gboolean janus_sharded_map_remove(janus_sharded_map *map, guint64 key) {
+	if(map == NULL)
+		return FALSE;
+	janus_sharded_map_shard *shard = janus_sharded_map_shard_get(map, key);
+	janus_mutex_lock(&shard->mutex);
+	gboolean removed = g_hash_table_remove(shard->table, &key);
+	janus_mutex_unlock(&shard->mutex);
+	return removed;
+}
+
+gpointer janus_sharded_map_lookup(janus_sharded_map *map, guint64 key) {
+	if(map == NULL)
+		return NULL;
+	janus_sharded_map_shard *shard = janus_sharded_map_shard_get(map, key);
+	janus_mutex_lock(&shard->mutex);
+	gpointer value = g_hash_table_lookup(shard->table, &key);
+	janus_mutex_unlock(&shard->mutex);
+	return value;
+}
+
+GList *janus_sharded_map_list(janus_sharded_map *map, janus_sharded_map_filter filter, gpointer user_data, gboolean remove) {
+	if(map == NULL)
+		return NULL;
+	GList *list = NULL;
+	guint count = 1 << map->bits, i = 0;
+	for(i=0; i<count; i++) {
+		janus_sharded_map_shard *shard = &map->shards[i];
+		janus_mutex_lock(&shard->mutex);
+		GHashTableIter iter;
+		gpointer value;
+		g_hash_table_iter_init(&iter, shard->table);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			if(value == NULL || (filter != NULL && !filter(value, user_data)))
+				continue;
+			list = g_list_prepend(list, value);
+			if(remove)
+				g_hash_table_iter_remove(&iter);
+		}
+		janus_mutex_unlock(&shard->mutex);
+	}
+	return list;
+}
+
+guint janus_sharded_map_size(janus_sharded_map *map) {
+	if(map == NULL)
+		return 0;
+	guint size = 0, count = 1 << map->bits, i = 0;
+	for(i=0; i<count; i++) {
+		janus_mutex_lock(&map->shards[i].mutex);
+		size += g_hash_table_size(map->shards[i].table);
+		janus_mutex_unlock(&map->shards[i].mutex);
+	}
+	return size;
+}
@@ -0,0 +1,82 @@
+/*! \file    shardedmap.h
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Sharded map with 64-bit keys (headers)
+ * \details  Implementation of a map with 64-bit integer keys that is split
+ * in shards, each with its own lock and hash table, so that threads
+ * looking up different keys rarely contend on the same mutex. This is
+ * used by the core for the sessions map, which every Janus API request
+ * looks up. Keys may be chosen by clients, so they're mixed with a
+ * multiplicative hash before picking a shard. The map doesn't own the
+ * values it contains: it's up to the owner to manage their lifetime.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef _JANUS_SHARDEDMAP_H
+#define _JANUS_SHARDEDMAP_H
+
+#include <glib.h>
+
+#include "mutex.h"
+
+/*! \brief Shard of a map: a hash table with its own lock */
+typedef struct janus_sharded_map_shard {
+	/*! \brief Mutex protecting the table */
+	janus_mutex mutex;
+	/*! \brief Hash table of the values in this shard */
+	GHashTable *table;
+} janus_sharded_map_shard;
+
+/*! \brief Sharded map */
+typedef struct janus_sharded_map {
+	/*! \brief Number of bits of the hash used to pick a shard */
+	guint bits;
+	/*! \brief Shards of the map (1 << bits of them) */
+	janus_sharded_map_shard *shards;
+} janus_sharded_map;
+
+/*! \brief Callback to filter the values to return in janus_sharded_map_list
+ * @param[in] value A value in the map
+ * @param[in] user_data The opaque pointer passed to janus_sharded_map_list
+ * @returns TRUE if the value should be returned, FALSE otherwise */
+typedef gboolean (*janus_sharded_map_filter)(gpointer value, gpointer user_data);
+
+/*! \brief Create a new sharded map
+ * @param[in] bits The map will have 2^bits shards (0-8)
+ * @returns A new janus_sharded_map instance */
+janus_sharded_map *janus_sharded_map_create(guint bits);
+/*! \brief Destroy a sharded map
+ * \note The values still in the map are not freed
+ * @param[in] map The janus_sharded_map instance to destroy */
+void janus_sharded_map_destroy(janus_sharded_map *map);
+/*! \brief Add a value to the map (or replace the one with the same key)
+ * @param[in] map The janus_sharded_map instance to update
+ * @param[in] key The key of the value
+ * @param[in] value The value to add */
+void janus_sharded_map_insert(janus_sharded_map *map, guint64 key, gpointer value);
+/*! \brief Remove a value from the map
+ * @param[in] map The janus_sharded_map instance to update
+ * @param[in] key The key of the value to remove
+ * @returns TRUE if the value was in the map, FALSE otherwise */
+gboolean janus_sharded_map_remove(janus_sharded_map *map, guint64 key);
+/*! \brief Look a value up, only locking the shard it belongs to
+ * @param[in] map The janus_sharded_map instance to query
+ * @param[in] key The key of the value to look up
+ * @returns The value, or NULL if it's not in the map */
+gpointer janus_sharded_map_lookup(janus_sharded_map *map, guint64 key);
+/*! \brief Get a list of the values in the map, walking the shards one at a time
+ * \note As the shards are not all locked at the same time, this is not an atomic snapshot of the map
+ * @param[in] map The janus_sharded_map instance to query
+ * @param[in] filter Callback to pick the values to return (optional, all values are returned if NULL)
+ * @param[in] user_data Opaque pointer to pass to the filter
+ * @param[in] remove Whether the values that are returned should also be removed from the map
+ * @returns A GList of values (to free with g_list_free) */
+GList *janus_sharded_map_list(janus_sharded_map *map, janus_sharded_map_filter filter, gpointer user_data, gboolean remove);
+/*! \brief Get the number of values in the map
+ * @param[in] map The janus_sharded_map instance to query
+ * @returns The number of values in the map */
+guint janus_sharded_map_size(janus_sharded_map *map);
+
+#endif
@@ -0,0 +1,89 @@
+/*! \file    ssrctable.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Lock-free table of the SSRCs of a peer
+ * \details  Implementation of the table the ICE loop uses to route
+ * incoming packets by SSRC. SSRCs are hashed to a slot, and collisions
+ * are resolved with linear probing: since the table is always rebuilt
+ * from scratch and never has SSRCs removed, a lookup can stop at the
+ * first empty slot it finds.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <string.h>
+
+#include "ssrctable.h"
+
+#define JANUS_SSRC_ROUTE_VIDEO	0x01
+#define JANUS_SSRC_ROUTE_RTX	0x02
+#define JANUS_SSRC_ROUTE_VINDEX(route)	(((route) >> 2) & 0x03)
+
+static inline guint janus_ssrc_table_slot(guint32 ssrc) {
+	/* Fibonacci hashing: SSRCs are random anyway, this just spreads them */
+	return (ssrc * 2654435761U) >> 28;
+}
+
+void janus_ssrc_table_update_begin(janus_ssrc_table *table) {
+	if(table == NULL)
+		return;
+	/* Let readers know an update is in progress */
+	g_atomic_int_inc(&table->version);
+	memset(table->ssrc, 0, sizeof(table->ssrc));
+	memset(table->route, 0, sizeof(table->route));
+}
+
+void janus_ssrc_table_add(janus_ssrc_table *table, guint32 ssrc, gboolean video, int vindex, gboolean rtx) {
+	if(table == NULL || ssrc == 0)
+		return;
+	guint slot = janus_ssrc_table_slot(ssrc), i = 0;
+	for(i=0; i<JANUS_SSRC_TABLE_SIZE; i++) {
+		guint index = (slot + i) & (JANUS_SSRC_TABLE_SIZE-1);
+		if(table->ssrc[index] == 0 || table->ssrc[index] == ssrc) {
+			/* If the same SSRC was advertised twice, the first one wins */
+			if(table->ssrc[index] == 0) {
+				table->ssrc[index] = ssrc;
+				table->route[index] = (video ? JANUS_SSRC_ROUTE_VIDEO : 0) |
+					(rtx ? JANUS_SSRC_ROUTE_RTX : 0) | ((vindex & 0x03) << 2);
+			}
+			return;
+		}
+	}
+}
+
+void janus_ssrc_table_update_end(janus_ssrc_table *table) {
+	if(table == NULL)
+		return;
+	g_atomic_int_inc(&table->version);
+}
+
+gboolean janus_ssrc_table_lookup(janus_ssrc_table *table, guint32 ssrc, int *video, int *vindex, int *rtx) {
+	if(table == NULL)
+		return FALSE;
+	gint version = g_atomic_int_get(&table->version);
+	if(ssrc == 0 || (version & 1))
+		return FALSE;
+	guint slot = janus_ssrc_table_slot(ssrc), i = 0;
+	guint8 route = 0;
+	gboolean found = FALSE;
+	for(i=0; i<JANUS_SSRC_TABLE_SIZE; i++) {
+		guint index = (slot + i) & (JANUS_SSRC_TABLE_SIZE-1);
+		if(table->ssrc[index] == 0)
+			break;
+		if(table->ssrc[index] == ssrc) {
+			route = table->route[index];
+			found = TRUE;
+			break;
+		}
+	}
+	if(!found || g_atomic_int_get(&table->version) != version)
+		return FALSE;
+	if(video)
+		*video = (route & JANUS_SSRC_ROUTE_VIDEO) ? 1 : 0;
+	if(vindex)
+		*vindex = JANUS_SSRC_ROUTE_VINDEX(route);
+	if(rtx)
+		*rtx = (route & JANUS_SSRC_ROUTE_RTX) ? 1 : 0;
+	return TRUE;
+}
@@ -0,0 +1,60 @@
+/*! \file    ssrctable.h
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Lock-free table of the SSRCs of a peer (headers)
+ * \details  Compact table to map the SSRCs a peer sends on a stream to
+ * what they are (audio or video, simulcast index, rtx), so that the ICE
+ * loop can route incoming packets with a single lookup. The table uses
+ * open addressing and a version number as a sequence lock: readers never
+ * lock, but check the version before and after a lookup, and treat the
+ * lookup as failed if the table was being updated in the meanwhile (the
+ * version is odd while an update is in progress). Writers are expected
+ * to be serialized by the owner of the table (e.g., the stream mutex).
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef _JANUS_SSRCTABLE_H
+#define _JANUS_SSRCTABLE_H
+
+#include <glib.h>
+
+/*! \brief Number of slots in the table (power of two, larger than the 7 SSRCs a stream can have) */
+#define JANUS_SSRC_TABLE_SIZE	16
+
+/*! \brief Table of the SSRCs of a peer */
+typedef struct janus_ssrc_table {
+	/*! \brief SSRCs (0 means the slot is empty) */
+	guint32 ssrc[JANUS_SSRC_TABLE_SIZE];
+	/*! \brief What each SSRC is (whether it's video, whether it's rtx, and the simulcast index) */
+	guint8 route[JANUS_SSRC_TABLE_SIZE];
+	/*! \brief Version of the table, incremented before and after each update */
+	volatile gint version;
+} janus_ssrc_table;
+
+/*! \brief Start updating a table: readers will fail their lookups until janus_ssrc_table_update_end is called
+ * \note This also empties the table, as it's always rebuilt from scratch
+ * @param[in] table The janus_ssrc_table instance to update */
+void janus_ssrc_table_update_begin(janus_ssrc_table *table);
+/*! \brief Add an SSRC to a table that is being updated
+ * \note SSRCs equal to 0 are ignored, and if the same SSRC is added twice, the first one wins
+ * @param[in] table The janus_ssrc_table instance to update
+ * @param[in] ssrc The SSRC to add
+ * @param[in] video Whether the SSRC is video
+ * @param[in] vindex The simulcast index of the SSRC (0-2)
+ * @param[in] rtx Whether the SSRC is for RFC4588 retransmissions */
+void janus_ssrc_table_add(janus_ssrc_table *table, guint32 ssrc, gboolean video, int vindex, gboolean rtx);
+/*! \brief Done updating a table: readers can look SSRCs up again
+ * @param[in] table The janus_ssrc_table instance that was updated */
+void janus_ssrc_table_update_end(janus_ssrc_table *table);
+/*! \brief Look up an SSRC, without locking
+ * @param[in] table The janus_ssrc_table instance to look the SSRC up in
+ * @param[in] ssrc The SSRC to look up
+ * @param[out] video Whether the SSRC is video
+ * @param[out] vindex The simulcast index of the SSRC
+ * @param[out] rtx Whether the SSRC is for RFC4588 retransmissions
+ * @returns TRUE if the SSRC was found, FALSE if it's unknown, or if the table was being updated */
+gboolean janus_ssrc_table_lookup(janus_ssrc_table *table, guint32 ssrc, int *video, int *vindex, int *rtx);
+
+#endif
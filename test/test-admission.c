@@ -0,0 +1,176 @@
+/*! \file    test-admission.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Tests for the bounded admission control
+ * \details  Checks that no more jobs than allowed are admitted at the
+ * same time, that queued jobs get their slot in the order they asked for
+ * one, that cancelled jobs never get one, and that a limit of 0 admits
+ * everything. It also runs a burst of jobs through a pool of workers the
+ * way the DTLS handshake workers use the helper, checking that the limit
+ * holds and that every job eventually completes.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../admission.h"
+
+static int failures = 0;
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while(0)
+
+#define TEST_ADMISSION_MAX		4
+#define TEST_ADMISSION_JOBS		2000
+#define TEST_ADMISSION_WORKERS	8
+
+#define JOB(n)	GUINT_TO_POINTER(n)
+
+static int destroyed = 0;
+static void test_admission_destroy(gpointer job) {
+	destroyed++;
+}
+
+static void test_admission_limit(void) {
+	janus_admission admission;
+	janus_admission_init(&admission, 2);
+	CHECK(janus_admission_enter(&admission, JOB(1)));
+	CHECK(janus_admission_enter(&admission, JOB(2)));
+	CHECK(!janus_admission_enter(&admission, JOB(3)));
+	CHECK(!janus_admission_enter(&admission, JOB(4)));
+	CHECK(!janus_admission_enter(&admission, JOB(5)));
+	CHECK(admission.active == 2);
+	CHECK(janus_admission_waiting(&admission) == 3);
+	/* A cancelled job is skipped, the others are admitted in order */
+	CHECK(janus_admission_cancel(&admission, JOB(4)));
+	CHECK(!janus_admission_cancel(&admission, JOB(4)));
+	CHECK(janus_admission_leave(&admission) == JOB(3));
+	CHECK(admission.active == 2);
+	CHECK(janus_admission_leave(&admission) == JOB(5));
+	CHECK(janus_admission_leave(&admission) == NULL);
+	CHECK(admission.active == 1);
+	CHECK(janus_admission_leave(&admission) == NULL);
+	CHECK(admission.active == 0);
+	/* Leaving more times than entering doesn't underflow */
+	CHECK(janus_admission_leave(&admission) == NULL);
+	CHECK(admission.active == 0);
+	/* Jobs still queued are handed to the callback when clearing */
+	CHECK(janus_admission_enter(&admission, JOB(6)));
+	CHECK(janus_admission_enter(&admission, JOB(7)));
+	CHECK(!janus_admission_enter(&admission, JOB(8)));
+	CHECK(!janus_admission_enter(&admission, JOB(9)));
+	destroyed = 0;
+	janus_admission_clear(&admission, test_admission_destroy);
+	CHECK(destroyed == 2);
+	CHECK(admission.active == 0);
+	CHECK(janus_admission_waiting(&admission) == 0);
+}
+
+static void test_admission_unlimited(void) {
+	janus_admission admission;
+	janus_admission_init(&admission, 0);
+	guint i = 0;
+	for(i=1; i<=1000; i++)
+		CHECK(janus_admission_enter(&admission, JOB(i)));
+	CHECK(admission.active == 1000);
+	CHECK(janus_admission_waiting(&admission) == 0);
+	for(i=1; i<=1000; i++)
+		CHECK(janus_admission_leave(&admission) == NULL);
+	CHECK(admission.active == 0);
+	janus_admission_clear(&admission, NULL);
+}
+
+/* Burst of jobs through a pool of workers: the mutex plays the role of
+ * handshake_mutex in dtls.c, and the jobs queue the one of handshake_jobs */
+static janus_admission pool_admission;
+static GMutex pool_mutex;
+static GCond pool_cond;
+static GQueue *pool_jobs = NULL;
+static guint pool_peak = 0, pool_completed = 0, pool_admitted = 0;
+static gboolean pool_ordered = TRUE, pool_stop = FALSE;
+
+/* Jobs must be admitted in the order they asked for a slot (pool_mutex must be locked) */
+static void test_admission_run(gpointer job) {
+	pool_admitted++;
+	if(GPOINTER_TO_UINT(job) != pool_admitted)
+		pool_ordered = FALSE;
+	if(pool_admission.active > pool_peak)
+		pool_peak = pool_admission.active;
+	g_queue_push_tail(pool_jobs, job);
+	g_cond_signal(&pool_cond);
+}
+
+static void *test_admission_worker(void *data) {
+	g_mutex_lock(&pool_mutex);
+	while(TRUE) {
+		while(g_queue_is_empty(pool_jobs) && !pool_stop)
+			g_cond_wait(&pool_cond, &pool_mutex);
+		if(g_queue_is_empty(pool_jobs))
+			break;
+		g_queue_pop_head(pool_jobs);
+		g_mutex_unlock(&pool_mutex);
+		/* Pretend to do some work, without the lock */
+		volatile guint spin = 0;
+		while(spin < 20000)
+			spin++;
+		g_mutex_lock(&pool_mutex);
+		pool_completed++;
+		gpointer next = janus_admission_leave(&pool_admission);
+		if(next != NULL)
+			test_admission_run(next);
+		if(pool_completed == TEST_ADMISSION_JOBS) {
+			pool_stop = TRUE;
+			g_cond_broadcast(&pool_cond);
+		}
+	}
+	g_mutex_unlock(&pool_mutex);
+	return NULL;
+}
+
+static void test_admission_pool(void) {
+	janus_admission_init(&pool_admission, TEST_ADMISSION_MAX);
+	g_mutex_init(&pool_mutex);
+	g_cond_init(&pool_cond);
+	pool_jobs = g_queue_new();
+	GThread *workers[TEST_ADMISSION_WORKERS];
+	guint i = 0;
+	for(i=0; i<TEST_ADMISSION_WORKERS; i++)
+		workers[i] = g_thread_new("worker", test_admission_worker, NULL);
+	/* A burst, as when a whole room reconnects at the same time */
+	for(i=1; i<=TEST_ADMISSION_JOBS; i++) {
+		g_mutex_lock(&pool_mutex);
+		if(janus_admission_enter(&pool_admission, JOB(i)))
+			test_admission_run(JOB(i));
+		g_mutex_unlock(&pool_mutex);
+	}
+	for(i=0; i<TEST_ADMISSION_WORKERS; i++)
+		g_thread_join(workers[i]);
+	CHECK(pool_completed == TEST_ADMISSION_JOBS);
+	CHECK(pool_admitted == TEST_ADMISSION_JOBS);
+	CHECK(pool_peak <= TEST_ADMISSION_MAX);
+	CHECK(pool_ordered);
+	CHECK(pool_admission.active == 0);
+	CHECK(janus_admission_waiting(&pool_admission) == 0);
+	janus_admission_clear(&pool_admission, NULL);
+	g_queue_free(pool_jobs);
+	g_cond_clear(&pool_cond);
+	g_mutex_clear(&pool_mutex);
+}
+
+int main(int argc, char *argv[]) {
+	test_admission_limit();
+	test_admission_unlimited();
+	test_admission_pool();
+	if(failures > 0) {
+		fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("Admission control: all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,178 @@
+/*! \file    test-bwe.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Tests for the send-side bandwidth estimator
+ * \details  Drives the estimator with a deterministic simulation: a sender
+ * paces packets at the current estimate through a bottleneck link with a
+ * FIFO queue (and tail drop), and the receiver sends transport wide CC
+ * feedback every 100ms. Since the estimator never reads a clock, the
+ * simulation can run minutes of traffic in a few milliseconds, and
+ * check that the estimate converges to the capacity of the link, that it
+ * follows the capacity when it drops, and that it stays within the
+ * configured boundaries when the link is not a bottleneck.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../bwe.h"
+#include "../debug.h"
+
+/* The core would define these */
+int janus_log_level = LOG_NONE;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+
+static int failures = 0;
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while(0)
+
+#define TEST_BWE_PACKET_SIZE	1200
+#define TEST_BWE_BASE_DELAY		20000
+#define TEST_BWE_MAX_QUEUE		300000
+#define TEST_BWE_FEEDBACK		100000
+#define TEST_BWE_MAX_PENDING	1024
+
+/* Simulated path: a bottleneck link with a FIFO queue */
+typedef struct test_bwe_path {
+	/* Capacity of the link, in bits per second */
+	guint32 capacity;
+	/* When the link will be done sending what's in the queue */
+	gint64 busy_until;
+	/* Packets waiting to be reported in the next feedback */
+	janus_rtcp_transport_wide_cc_result pending[TEST_BWE_MAX_PENDING];
+	int pending_count;
+} test_bwe_path;
+
+/* Send a packet on the path, and figure out if and when it will be received */
+static void test_bwe_path_send(test_bwe_path *path, guint16 seq, int size, gint64 now) {
+	if(path->busy_until < now)
+		path->busy_until = now;
+	if(path->pending_count == TEST_BWE_MAX_PENDING)
+		return;
+	janus_rtcp_transport_wide_cc_result *r = &path->pending[path->pending_count++];
+	r->seq = seq;
+	if(path->busy_until - now > TEST_BWE_MAX_QUEUE) {
+		/* The queue is full: tail drop */
+		r->received = FALSE;
+		r->received_time = 0;
+		return;
+	}
+	path->busy_until += (gint64)size * 8 * G_USEC_PER_SEC / path->capacity;
+	r->received = TRUE;
+	r->received_time = path->busy_until + TEST_BWE_BASE_DELAY;
+}
+
+/* Run the simulation for a while, and return the average estimate over its last quarter */
+static guint32 test_bwe_run(janus_bwe_context *bwe, test_bwe_path *path, gint64 *now, gint64 duration) {
+	gint64 end = *now + duration, next_feedback = *now + TEST_BWE_FEEDBACK;
+	guint64 sum = 0, samples = 0;
+	while(*now < end) {
+		/* Pace packets at the current estimate */
+		guint32 estimate = janus_bwe_get_estimate(bwe);
+		guint16 seq = janus_bwe_next_seq(bwe);
+		janus_bwe_packet_sent(bwe, seq, TEST_BWE_PACKET_SIZE, *now);
+		test_bwe_path_send(path, seq, TEST_BWE_PACKET_SIZE, *now);
+		*now += (gint64)TEST_BWE_PACKET_SIZE * 8 * G_USEC_PER_SEC / estimate;
+		if(*now >= next_feedback) {
+			/* The feedback arrives after the base delay, and only covers what was received
+			 * by the time it was sent (what's still queued is reported in later feedback) */
+			janus_rtcp_transport_wide_cc_result results[TEST_BWE_MAX_PENDING];
+			int ready = 0, waiting = 0, i = 0;
+			for(i=0; i<path->pending_count && i<TEST_BWE_MAX_PENDING; i++) {
+				janus_rtcp_transport_wide_cc_result *r = &path->pending[i];
+				if(!r->received || r->received_time <= next_feedback)
+					results[ready++] = *r;
+				else
+					path->pending[waiting++] = *r;
+			}
+			path->pending_count = waiting;
+			estimate = janus_bwe_feedback(bwe, results, ready, next_feedback + TEST_BWE_BASE_DELAY);
+			if(*now >= end - duration/4) {
+				sum += estimate;
+				samples++;
+			}
+			next_feedback += TEST_BWE_FEEDBACK;
+		}
+	}
+	return samples ? (guint32)(sum/samples) : janus_bwe_get_estimate(bwe);
+}
+
+static void test_bwe_converges(void) {
+	/* Starting low on a 1.5mbps link, we should ramp up to it without overshooting too much */
+	janus_bwe_context *bwe = janus_bwe_context_create(300000, JANUS_BWE_MIN_BITRATE, JANUS_BWE_MAX_BITRATE);
+	test_bwe_path path = { .capacity = 1500000 };
+	gint64 now = 1000000;
+	guint32 estimate = test_bwe_run(bwe, &path, &now, 60*G_USEC_PER_SEC);
+	printf("Converge to 1.5mbps: %"SCNu32"\n", estimate);
+	CHECK(estimate >= 1500000/2 && estimate <= 1500000*13/10);
+	janus_bwe_context_destroy(bwe);
+}
+
+static void test_bwe_follows_drop(void) {
+	/* Once converged on a 2.5mbps link, the capacity drops to 800kbps */
+	janus_bwe_context *bwe = janus_bwe_context_create(300000, JANUS_BWE_MIN_BITRATE, JANUS_BWE_MAX_BITRATE);
+	test_bwe_path path = { .capacity = 2500000 };
+	gint64 now = 1000000;
+	guint32 before = test_bwe_run(bwe, &path, &now, 60*G_USEC_PER_SEC);
+	path.capacity = 800000;
+	guint32 after = test_bwe_run(bwe, &path, &now, 20*G_USEC_PER_SEC);
+	printf("Capacity drop 2.5mbps -> 800kbps: %"SCNu32" -> %"SCNu32"\n", before, after);
+	CHECK(before >= 2500000/2);
+	CHECK(after >= 800000/2 && after <= 800000*13/10);
+	janus_bwe_context_destroy(bwe);
+}
+
+static void test_bwe_boundaries(void) {
+	/* On a link that is not a bottleneck, the estimate reaches (and stays at) the maximum */
+	janus_bwe_context *bwe = janus_bwe_context_create(300000, 100000, 2000000);
+	test_bwe_path path = { .capacity = 50000000 };
+	gint64 now = 1000000;
+	guint32 estimate = test_bwe_run(bwe, &path, &now, 60*G_USEC_PER_SEC);
+	printf("Unconstrained, capped to 2mbps: %"SCNu32"\n", estimate);
+	CHECK(estimate >= 2000000*9/10 && estimate <= 2000000);
+	janus_bwe_context_destroy(bwe);
+	/* On a link much slower than the minimum, the estimate never goes below it */
+	bwe = janus_bwe_context_create(300000, 100000, 2000000);
+	path.capacity = 50000;
+	path.busy_until = 0;
+	path.pending_count = 0;
+	now = 1000000;
+	estimate = test_bwe_run(bwe, &path, &now, 30*G_USEC_PER_SEC);
+	printf("Link below the minimum: %"SCNu32"\n", estimate);
+	CHECK(estimate >= 100000);
+	janus_bwe_context_destroy(bwe);
+}
+
+static void test_bwe_unsent(void) {
+	/* Packets we fail to protect or send must not use up a sequence number */
+	janus_bwe_context *bwe = janus_bwe_context_create(300000, JANUS_BWE_MIN_BITRATE, JANUS_BWE_MAX_BITRATE);
+	guint16 seq = janus_bwe_next_seq(bwe);
+	CHECK(janus_bwe_next_seq(bwe) == seq);
+	janus_bwe_packet_sent(bwe, seq, TEST_BWE_PACKET_SIZE, 1000000);
+	CHECK(janus_bwe_next_seq(bwe) == (guint16)(seq+1));
+	CHECK(bwe->history[seq & (JANUS_BWE_HISTORY_SIZE-1)].seq == seq);
+	CHECK(bwe->history[(seq+1) & (JANUS_BWE_HISTORY_SIZE-1)].sent_time == 0);
+	janus_bwe_context_destroy(bwe);
+}
+
+int main(int argc, char *argv[]) {
+	test_bwe_unsent();
+	test_bwe_converges();
+	test_bwe_follows_drop();
+	test_bwe_boundaries();
+	if(failures > 0) {
+		fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("Bandwidth estimation: all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,325 @@
+/*! \file    test-dtls.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    DTLS handshake throughput benchmark
+ * \details  Initializes the DTLS stack with janus_dtls_srtp_init, as the
+ * core does, letting it autogenerate an RSA or ECDSA certificate and cache
+ * it in a temporary folder: it checks the certificate is of the type we
+ * asked for, and that initializing again picks the cached one (same
+ * fingerprint) rather than generating a new one. It then runs complete
+ * DTLS-SRTP handshakes between stacks created on the shared context
+ * janus_dtls_srtp_init prepared and a client acting as a browser,
+ * exchanging the packets over memory BIOs so that only the cryptographic
+ * and state machine costs are measured. It checks that handshakes complete
+ * and negotiate an SRTP profile, and prints how long generating and
+ * loading the certificate took, and how many handshakes per second each
+ * key type manages, both on a single thread and with several threads
+ * sharing the same contexts (as the DTLS handshake workers do), which
+ * shows how much the threads contend on the shared OpenSSL state. The
+ * optional arguments set the number of handshakes and of threads.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include "../janus.h"
+#include "../dtls.h"
+#include "../debug.h"
+
+/* The core would define these */
+int janus_log_level = LOG_NONE;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+
+/* dtls.c hands handshake results, events and data channel messages to the
+ * rest of the core: we only handshake over memory BIOs, so none of these is
+ * ever called, but they must be there for the test to link */
+gint janus_is_stopping(void) {
+	return 0;
+}
+gboolean janus_events_is_enabled(void) {
+	return FALSE;
+}
+void janus_events_notify_handlers(int type, guint64 session_id, ...) {
+}
+void janus_ice_dtls_handshake_done(janus_ice_handle *handle, janus_ice_component *component) {
+}
+void janus_ice_incoming_data(janus_ice_handle *handle, char *buffer, int length, gboolean binary) {
+}
+void janus_ice_webrtc_hangup(janus_ice_handle *handle, const char *reason) {
+}
+#ifdef HAVE_SCTP
+janus_sctp_association *janus_sctp_association_create(void *dtls, uint64_t handle_id, uint16_t udp_port) {
+	return NULL;
+}
+int janus_sctp_association_setup(janus_sctp_association *sctp) {
+	return -1;
+}
+void janus_sctp_association_destroy(janus_sctp_association *sctp) {
+}
+void janus_sctp_data_from_dtls(janus_sctp_association *sctp, char *buf, int len) {
+}
+void janus_sctp_send_data(janus_sctp_association *sctp, char *buf, int len, gboolean binary) {
+}
+#endif
+
+static int failures = 0;
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while(0)
+
+/* What browsers offer: whatever we offer, there must be a profile in common */
+#define TEST_DTLS_BROWSER_SRTP	"SRTP_AEAD_AES_128_GCM:SRTP_AES128_CM_SHA1_80"
+#define TEST_DTLS_MTU		1200
+#define TEST_DTLS_HANDSHAKES	100
+#define TEST_DTLS_THREADS		4
+
+/* Generate the self-signed certificate of the browser: browsers use ECDSA P-256 */
+static int test_dtls_browser_keys(X509 **certificate, EVP_PKEY **private_key) {
+	EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+	if(ctx == NULL || EVP_PKEY_keygen_init(ctx) <= 0) {
+		EVP_PKEY_CTX_free(ctx);
+		return -1;
+	}
+	EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1);
+	EVP_PKEY_CTX_set_ec_param_enc(ctx, OPENSSL_EC_NAMED_CURVE);
+	*private_key = NULL;
+	int res = EVP_PKEY_keygen(ctx, private_key);
+	EVP_PKEY_CTX_free(ctx);
+	if(res <= 0)
+		return -1;
+	*certificate = X509_new();
+	X509_set_version(*certificate, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(*certificate), 1);
+	X509_gmtime_adj(X509_get_notBefore(*certificate), -1 * 60 * 60 * 24);
+	X509_gmtime_adj(X509_get_notAfter(*certificate), 60 * 60 * 24 * 30);
+	X509_set_pubkey(*certificate, *private_key);
+	X509_NAME *name = X509_get_subject_name(*certificate);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"WebRTC", -1, -1, 0);
+	X509_set_issuer_name(*certificate, name);
+	if(!X509_sign(*certificate, *private_key, EVP_sha256())) {
+		X509_free(*certificate);
+		EVP_PKEY_free(*private_key);
+		return -1;
+	}
+	return 0;
+}
+
+static int test_dtls_browser_verify_callback(int preverify_ok, X509_STORE_CTX *ctx) {
+	/* Fingerprints are checked against the SDP, so we accept self-signed certificates */
+	return 1;
+}
+
+/* Create the context of the browser: ours is the one janus_dtls_srtp_init prepared */
+static SSL_CTX *test_dtls_browser_context(void) {
+	SSL_CTX *ctx = SSL_CTX_new(DTLS_method());
+	if(ctx == NULL)
+		return NULL;
+	SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, test_dtls_browser_verify_callback);
+	SSL_CTX_set_tlsext_use_srtp(ctx, TEST_DTLS_BROWSER_SRTP);
+	X509 *certificate = NULL;
+	EVP_PKEY *private_key = NULL;
+	if(test_dtls_browser_keys(&certificate, &private_key) < 0) {
+		SSL_CTX_free(ctx);
+		return NULL;
+	}
+	int res = SSL_CTX_use_certificate(ctx, certificate) && SSL_CTX_use_PrivateKey(ctx, private_key) &&
+		SSL_CTX_check_private_key(ctx);
+	X509_free(certificate);
+	EVP_PKEY_free(private_key);
+	if(!res) {
+		SSL_CTX_free(ctx);
+		return NULL;
+	}
+	SSL_CTX_set_read_ahead(ctx, 1);
+	return ctx;
+}
+
+/* One side of a handshake: the stack, and the memory BIOs it reads from and writes to */
+typedef struct test_dtls_peer {
+	SSL *ssl;
+	BIO *read_bio, *write_bio;
+} test_dtls_peer;
+
+static gboolean test_dtls_peer_init(test_dtls_peer *peer, SSL_CTX *ctx, gboolean server) {
+	peer->ssl = SSL_new(ctx);
+	if(peer->ssl == NULL)
+		return FALSE;
+	peer->read_bio = BIO_new(BIO_s_mem());
+	peer->write_bio = BIO_new(BIO_s_mem());
+	BIO_set_mem_eof_return(peer->read_bio, -1);
+	BIO_set_mem_eof_return(peer->write_bio, -1);
+	SSL_set_bio(peer->ssl, peer->read_bio, peer->write_bio);
+	/* Memory BIOs can't tell the path MTU, so use the one we use for media */
+	SSL_set_options(peer->ssl, SSL_OP_NO_QUERY_MTU);
+	SSL_set_mtu(peer->ssl, TEST_DTLS_MTU);
+	if(server) {
+		/* Same options janus_dtls_srtp_create sets on each stack */
+		SSL_set_options(peer->ssl, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION | SSL_OP_SINGLE_ECDH_USE);
+		SSL_set_accept_state(peer->ssl);
+	} else {
+		SSL_set_connect_state(peer->ssl);
+	}
+	return TRUE;
+}
+
+/* Move whatever a peer wrote to the other peer, as the network would */
+static gboolean test_dtls_peer_flush(test_dtls_peer *from, test_dtls_peer *to) {
+	char buf[TEST_DTLS_MTU * 8];
+	gboolean sent = FALSE;
+	int len = 0;
+	while((len = BIO_read(from->write_bio, buf, sizeof(buf))) > 0) {
+		BIO_write(to->read_bio, buf, len);
+		sent = TRUE;
+	}
+	return sent;
+}
+
+/* Run a complete handshake between two new stacks, returning TRUE if it succeeded */
+static gboolean test_dtls_handshake(SSL_CTX *server_ctx, SSL_CTX *client_ctx) {
+	test_dtls_peer server = { 0 }, client = { 0 };
+	gboolean done = FALSE;
+	if(test_dtls_peer_init(&server, server_ctx, TRUE) && test_dtls_peer_init(&client, client_ctx, FALSE)) {
+		int rounds = 0;
+		while(rounds < 20) {
+			int cres = SSL_do_handshake(client.ssl);
+			gboolean moved = test_dtls_peer_flush(&client, &server);
+			int sres = SSL_do_handshake(server.ssl);
+			moved |= test_dtls_peer_flush(&server, &client);
+			if(cres == 1 && sres == 1) {
+				done = TRUE;
+				break;
+			}
+			if(!moved && SSL_get_error(client.ssl, cres) != SSL_ERROR_WANT_READ)
+				break;
+			rounds++;
+		}
+		/* Both sides must agree on an SRTP profile, or there would be no keys to export */
+		SRTP_PROTECTION_PROFILE *profile = SSL_get_selected_srtp_profile(server.ssl);
+		if(done && (profile == NULL || profile != SSL_get_selected_srtp_profile(client.ssl)))
+			done = FALSE;
+	}
+	if(server.ssl)
+		SSL_free(server.ssl);
+	if(client.ssl)
+		SSL_free(client.ssl);
+	ERR_clear_error();
+	return done;
+}
+
+/* Handshakes a thread runs on the shared contexts */
+typedef struct test_dtls_job {
+	SSL_CTX *server_ctx, *client_ctx;
+	int handshakes;
+} test_dtls_job;
+static volatile gint completed = 0;
+
+static void *test_dtls_thread(void *data) {
+	test_dtls_job *job = (test_dtls_job *)data;
+	int i = 0;
+	for(i=0; i<job->handshakes; i++) {
+		if(test_dtls_handshake(job->server_ctx, job->client_ctx))
+			g_atomic_int_inc(&completed);
+	}
+	return NULL;
+}
+
+/* Run a number of handshakes on some threads, returning how many per second */
+static double test_dtls_benchmark(SSL_CTX *server_ctx, SSL_CTX *client_ctx, int handshakes, int threads) {
+	test_dtls_job job = { .server_ctx = server_ctx, .client_ctx = client_ctx, .handshakes = handshakes };
+	GThread **workers = g_malloc0(threads * sizeof(GThread *));
+	g_atomic_int_set(&completed, 0);
+	int i = 0;
+	gint64 start = g_get_monotonic_time();
+	for(i=0; i<threads; i++)
+		workers[i] = g_thread_new("dtls", test_dtls_thread, &job);
+	for(i=0; i<threads; i++)
+		g_thread_join(workers[i]);
+	gint64 elapsed = g_get_monotonic_time() - start;
+	g_free(workers);
+	CHECK(g_atomic_int_get(&completed) == handshakes * threads);
+	return elapsed > 0 ? (double)g_atomic_int_get(&completed) * G_USEC_PER_SEC / elapsed : 0;
+}
+
+int main(int argc, char *argv[]) {
+	int handshakes = argc > 1 ? atoi(argv[1]) : TEST_DTLS_HANDSHAKES;
+	if(handshakes < 1)
+		handshakes = TEST_DTLS_HANDSHAKES;
+	int threads = argc > 2 ? atoi(argv[2]) : TEST_DTLS_THREADS;
+	if(threads < 1)
+		threads = TEST_DTLS_THREADS;
+	SSL_CTX *browser_ctx = test_dtls_browser_context();
+	CHECK(browser_ctx != NULL);
+	char *cache = g_dir_make_tmp("janus-test-dtls-XXXXXX", NULL);
+	CHECK(cache != NULL);
+	if(browser_ctx == NULL || cache == NULL) {
+		SSL_CTX_free(browser_ctx);
+		g_free(cache);
+		return 1;
+	}
+	/* Timings depend on the machine, so they're only printed */
+	int k = 0;
+	for(k=0; k<2; k++) {
+		gboolean ecdsa = (k == 1);
+		/* The first time there's nothing cached, so a certificate is generated */
+		gint64 start = g_get_monotonic_time();
+		CHECK(janus_dtls_srtp_init(NULL, NULL, NULL, ecdsa, cache) == 0);
+		gint64 generated = g_get_monotonic_time() - start;
+		SSL_CTX *ctx = janus_dtls_get_context();
+		CHECK(ctx != NULL);
+		if(ctx == NULL)
+			break;
+		EVP_PKEY *key = SSL_CTX_get0_privatekey(ctx);
+		CHECK(key != NULL && EVP_PKEY_id(key) == (ecdsa ? EVP_PKEY_EC : EVP_PKEY_RSA));
+		char *fingerprint = g_strdup(janus_dtls_get_local_fingerprint());
+		char name[32];
+		g_snprintf(name, sizeof(name), "janus-dtls-%s.pem", ecdsa ? "ecdsa" : "rsa");
+		char *cached = g_build_filename(cache, name, NULL);
+		CHECK(g_file_test(cached, G_FILE_TEST_IS_REGULAR));
+		janus_dtls_srtp_cleanup();
+		/* The second time, the certificate we cached must be used */
+		start = g_get_monotonic_time();
+		CHECK(janus_dtls_srtp_init(NULL, NULL, NULL, ecdsa, cache) == 0);
+		gint64 loaded = g_get_monotonic_time() - start;
+		CHECK(!strcmp(fingerprint, janus_dtls_get_local_fingerprint()));
+		ctx = janus_dtls_get_context();
+		CHECK(ctx != NULL);
+		if(ctx != NULL) {
+			/* All stacks share the context, as they do in the core */
+			double single = test_dtls_benchmark(ctx, browser_ctx, handshakes, 1);
+			double multi = test_dtls_benchmark(ctx, browser_ctx, handshakes, threads);
+			printf("DTLS: %s, certificate generated in %.1f ms, loaded from the cache in %.1f ms\n",
+				ecdsa ? "ECDSA" : "RSA", (double)generated / 1000, (double)loaded / 1000);
+			printf("DTLS: %s, %d handshakes per thread, 1 thread %.1f/s, %d threads %.1f/s (x%.2f)\n",
+				ecdsa ? "ECDSA" : "RSA", handshakes, single, threads, multi, single > 0 ? multi / single : 0);
+		}
+		janus_dtls_srtp_cleanup();
+		g_unlink(cached);
+		g_free(cached);
+		g_free(fingerprint);
+	}
+	g_rmdir(cache);
+	g_free(cache);
+	SSL_CTX_free(browser_ctx);
+	if(failures > 0) {
+		fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("DTLS: all checks passed\n");
+	return 0;
+}
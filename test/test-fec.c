@@ -0,0 +1,310 @@
+/*! \file    test-fec.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Tests for the ULPFEC generator
+ * \details  Protects a synthetic video stream with the ULPFEC generator,
+ * drops packets on the way, and then does what a receiver would: it
+ * removes the RED encapsulation, and uses the FEC packets to recover the
+ * media packets that were lost (RFC5109, single packet per group). The
+ * recovered packets must be identical to the ones that were sent. This
+ * is done for every possible single loss in a group first, and then on
+ * a longer stream with random losses, counting how many packets could
+ * be recovered.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../fec.h"
+#include "../rtp.h"
+#include "../debug.h"
+
+/* The core would define these */
+int janus_log_level = LOG_NONE;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+
+static int failures = 0;
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while(0)
+
+#define TEST_FEC_RED_PT		116
+#define TEST_FEC_ULPFEC_PT	117
+#define TEST_FEC_VIDEO_PT	96
+#define TEST_FEC_SSRC		0x12345678
+#define TEST_FEC_BUFSIZE	1600
+#define TEST_FEC_MAX_PACKETS	2048
+
+/* A packet, as sent or as received */
+typedef struct test_fec_packet {
+	char data[TEST_FEC_BUFSIZE];
+	int length;
+} test_fec_packet;
+
+/* What the sender sent (before RED), and what the receiver got (after removing RED), by sequence number */
+static test_fec_packet *sent = NULL, *received = NULL;
+static gboolean got[TEST_FEC_MAX_PACKETS];
+/* FEC packets the receiver got (RED removed) */
+static test_fec_packet *fecs = NULL;
+static int fecs_count = 0;
+
+/* Simple deterministic PRNG, so that the test always does the same thing */
+static guint32 test_fec_seed = 1;
+static guint32 test_fec_rand(void) {
+	test_fec_seed = test_fec_seed * 1103515245 + 12345;
+	return (test_fec_seed >> 16) & 0x7FFF;
+}
+
+/* Create a media packet, with a random payload and, sometimes, a one-byte header extension */
+static int test_fec_media(char *buf, guint16 seq, guint32 ts, gboolean marker) {
+	memset(buf, 0, 12);
+	janus_rtp_header *header = (janus_rtp_header *)buf;
+	header->version = 2;
+	header->type = TEST_FEC_VIDEO_PT;
+	header->markerbit = marker;
+	header->seq_number = htons(seq);
+	header->timestamp = htonl(ts);
+	header->ssrc = htonl(TEST_FEC_SSRC);
+	int len = 12;
+	if(test_fec_rand() % 2) {
+		header->extension = 1;
+		guint8 *ext = (guint8 *)buf + len;
+		ext[0] = 0xBE;
+		ext[1] = 0xDE;
+		ext[2] = 0;
+		ext[3] = 1;
+		ext[4] = 0x10;	/* ID 1, length 1 */
+		ext[5] = test_fec_rand() & 0xFF;
+		ext[6] = 0;
+		ext[7] = 0;
+		len += 8;
+	}
+	int plen = 20 + test_fec_rand() % 1100, i = 0;
+	for(i=0; i<plen; i++)
+		buf[len+i] = test_fec_rand() & 0xFF;
+	return len + plen;
+}
+
+/* Receiver: remove the RED encapsulation, and put the packet where it belongs */
+static void test_fec_receive(char *buf, int len) {
+	janus_rtp_header *header = (janus_rtp_header *)buf;
+	CHECK(header->type == TEST_FEC_RED_PT);
+	int plen = 0;
+	char *payload = janus_rtp_payload(buf, len, &plen);
+	if(payload == NULL || plen < 1) {
+		CHECK(payload != NULL && plen >= 1);
+		return;
+	}
+	/* Primary block only: the first byte is the actual payload type (F bit not set) */
+	guint8 pt = (guint8)payload[0];
+	CHECK((pt & 0x80) == 0);
+	int hlen = payload - buf;
+	memmove(payload, payload + 1, len - hlen - 1);
+	len--;
+	header->type = pt;
+	guint16 seq = ntohs(header->seq_number);
+	test_fec_packet *p = NULL;
+	if(pt == TEST_FEC_ULPFEC_PT) {
+		p = &fecs[fecs_count++];
+	} else {
+		CHECK(pt == TEST_FEC_VIDEO_PT);
+		p = &received[seq % TEST_FEC_MAX_PACKETS];
+		got[seq % TEST_FEC_MAX_PACKETS] = TRUE;
+	}
+	memcpy(p->data, buf, len);
+	p->length = len;
+}
+
+/* Receiver: try to recover a lost packet using a FEC packet (RFC5109, section 8) */
+static int test_fec_recover(test_fec_packet *fec) {
+	guint8 *f = (guint8 *)fec->data + 12;
+	int flen = fec->length - 12;
+	if(flen < 14 || (f[0] & 0x40)) {
+		/* Too short, or long mask (we never generate those) */
+		CHECK(flen >= 14 && !(f[0] & 0x40));
+		return -1;
+	}
+	guint16 seq_base = 0, length = 0, protection_length = 0, mask = 0;
+	guint32 ts = 0;
+	memcpy(&seq_base, f+2, 2);
+	memcpy(&ts, f+4, 4);
+	memcpy(&length, f+8, 2);
+	memcpy(&protection_length, f+10, 2);
+	memcpy(&mask, f+12, 2);
+	seq_base = ntohs(seq_base);
+	ts = ntohl(ts);
+	length = ntohs(length);
+	protection_length = ntohs(protection_length);
+	mask = ntohs(mask);
+	CHECK(protection_length == flen - 14);
+	/* Find out which of the protected packets are missing */
+	int missing = -1, lost = 0, i = 0;
+	for(i=0; i<16; i++) {
+		if(!(mask & (0x8000 >> i)))
+			continue;
+		guint16 seq = seq_base + i;
+		if(!got[seq % TEST_FEC_MAX_PACKETS]) {
+			missing = seq;
+			lost++;
+		}
+	}
+	if(lost != 1)
+		return 0;
+	/* XOR the FEC packet with all the other packets of the group */
+	guint8 header[2] = { f[0], f[1] };
+	guint8 payload[TEST_FEC_BUFSIZE];
+	memset(payload, 0, sizeof(payload));
+	memcpy(payload, f+14, protection_length);
+	for(i=0; i<16; i++) {
+		if(!(mask & (0x8000 >> i)))
+			continue;
+		guint16 seq = seq_base + i;
+		if(seq == missing)
+			continue;
+		test_fec_packet *p = &received[seq % TEST_FEC_MAX_PACKETS];
+		janus_rtp_header *rtp = (janus_rtp_header *)p->data;
+		header[0] ^= (guint8)p->data[0];
+		header[1] ^= (guint8)p->data[1];
+		ts ^= ntohl(rtp->timestamp);
+		length ^= (guint16)(p->length - 12);
+		int j = 0;
+		for(j=12; j<p->length; j++)
+			payload[j-12] ^= (guint8)p->data[j];
+	}
+	if(length > protection_length) {
+		CHECK(length <= protection_length);
+		return -1;
+	}
+	/* Rebuild the packet */
+	test_fec_packet *r = &received[missing % TEST_FEC_MAX_PACKETS];
+	r->data[0] = (char)(0x80 | (header[0] & 0x3F));
+	r->data[1] = (char)header[1];
+	guint16 nseq = htons(missing);
+	memcpy(r->data+2, &nseq, 2);
+	guint32 nts = htonl(ts);
+	memcpy(r->data+4, &nts, 4);
+	guint32 nssrc = htonl(TEST_FEC_SSRC);
+	memcpy(r->data+8, &nssrc, 4);
+	memcpy(r->data+12, payload, length);
+	r->length = 12 + length;
+	got[missing % TEST_FEC_MAX_PACKETS] = TRUE;
+	return 1;
+}
+
+/* Sender: send a stream of media packets through the FEC generator, dropping some on the way */
+static void test_fec_send(janus_fec_context *fec, int packets, gboolean (*drop)(int index, gboolean is_fec, void *data), void *data) {
+	memset(got, 0, sizeof(got));
+	fecs_count = 0;
+	char buf[TEST_FEC_BUFSIZE];
+	int i = 0, index = 0;
+	guint32 ts = 1000;
+	for(i=0; i<packets; i++) {
+		if(i % 5 == 0)
+			ts += 3000;
+		int len = test_fec_media(buf, (guint16)(100 + i), ts, (i % 5) == 4);
+		/* The generator shifts the sequence numbers to make room for FEC */
+		janus_fec_update_seq(fec, buf, len);
+		guint16 seq = ntohs(((janus_rtp_header *)buf)->seq_number);
+		memcpy(sent[seq % TEST_FEC_MAX_PACKETS].data, buf, len);
+		sent[seq % TEST_FEC_MAX_PACKETS].length = len;
+		int rlen = janus_fec_protect(fec, buf, len, sizeof(buf));
+		CHECK(rlen == len + 1);
+		if(!drop(index++, FALSE, data))
+			test_fec_receive(buf, rlen);
+		int flen = janus_fec_generate(fec, buf, sizeof(buf));
+		CHECK(flen >= 0);
+		if(flen > 0 && !drop(index++, TRUE, data))
+			test_fec_receive(buf, flen);
+	}
+}
+
+/* Check that all the packets we got (or recovered) are identical to what was sent */
+static int test_fec_compare(guint16 first, int count) {
+	int i = 0, have = 0;
+	for(i=0; i<count; i++) {
+		guint16 seq = first + i;
+		if(!got[seq % TEST_FEC_MAX_PACKETS])
+			continue;
+		if(sent[seq % TEST_FEC_MAX_PACKETS].length == 0)
+			continue;	/* This sequence number was a FEC packet */
+		have++;
+		test_fec_packet *s = &sent[seq % TEST_FEC_MAX_PACKETS], *r = &received[seq % TEST_FEC_MAX_PACKETS];
+		CHECK(s->length == r->length && !memcmp(s->data, r->data, s->length));
+	}
+	return have;
+}
+
+/* Drop exactly one media packet in the group */
+static gboolean test_fec_drop_one(int index, gboolean is_fec, void *data) {
+	return !is_fec && index == *(int *)data;
+}
+
+static void test_fec_every_single_loss(void) {
+	/* With 25% overhead we get a FEC packet every 4 media packets: try losing each of them */
+	int lost = 0;
+	for(lost=0; lost<4; lost++) {
+		memset(sent, 0, TEST_FEC_MAX_PACKETS * sizeof(test_fec_packet));
+		janus_fec_context *fec = janus_fec_context_create(TEST_FEC_RED_PT, TEST_FEC_ULPFEC_PT, 25);
+		CHECK(fec != NULL && fec->group_size == 4);
+		test_fec_send(fec, 4, test_fec_drop_one, &lost);
+		CHECK(fecs_count == 1);
+		CHECK(!got[(100 + lost) % TEST_FEC_MAX_PACKETS]);
+		CHECK(test_fec_recover(&fecs[0]) == 1);
+		CHECK(test_fec_compare(100, 4) == 4);
+		janus_fec_context_destroy(fec);
+	}
+}
+
+/* Drop packets at random */
+static gboolean test_fec_drop_random(int index, gboolean is_fec, void *data) {
+	return (int)(test_fec_rand() % 100) < *(int *)data;
+}
+
+static void test_fec_random_losses(void) {
+	memset(sent, 0, TEST_FEC_MAX_PACKETS * sizeof(test_fec_packet));
+	janus_fec_context *fec = janus_fec_context_create(TEST_FEC_RED_PT, TEST_FEC_ULPFEC_PT, 20);
+	int loss = 5, packets = 1500;
+	test_fec_send(fec, packets, test_fec_drop_random, &loss);
+	/* Media and FEC packets share the sequence number space */
+	int total = packets + fec->fec_packets, before = 0, after = 0, i = 0;
+	CHECK(fec->media_packets == (guint32)packets && fec->fec_packets == (guint32)(packets/5));
+	before = test_fec_compare(100, total);
+	int recovered = 0;
+	for(i=0; i<fecs_count; i++) {
+		int res = test_fec_recover(&fecs[i]);
+		CHECK(res >= 0);
+		if(res > 0)
+			recovered++;
+	}
+	after = test_fec_compare(100, total);
+	printf("Random losses (%d%%): received %d/%d media packets, recovered %d with FEC (%d/%d)\n",
+		loss, before, packets, recovered, after, packets);
+	CHECK(recovered > 0);
+	CHECK(after == before + recovered);
+	janus_fec_context_destroy(fec);
+}
+
+int main(int argc, char *argv[]) {
+	sent = g_malloc0(TEST_FEC_MAX_PACKETS * sizeof(test_fec_packet));
+	received = g_malloc0(TEST_FEC_MAX_PACKETS * sizeof(test_fec_packet));
+	fecs = g_malloc0(TEST_FEC_MAX_PACKETS * sizeof(test_fec_packet));
+	test_fec_every_single_loss();
+	test_fec_random_losses();
+	g_free(sent);
+	g_free(received);
+	g_free(fecs);
+	if(failures > 0) {
+		fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("ULPFEC: all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,437 @@
+/*! \file    test-msgpack.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Tests for the MessagePack utilities
+ * \details  Checks that JSON values are encoded with the byte sequences
+ * the MessagePack specification mandates (so that other encoders and
+ * decoders interoperate), that values survive an encode/decode round
+ * trip across all the length boundaries, that the representations we
+ * never produce but other encoders may are decoded as well, and that
+ * truncated or malformed input is rejected with an error. It then prints
+ * how long encoding and decoding take with MessagePack and with jansson,
+ * on a mix of the messages a busy deployment exchanges the most (trickle
+ * candidates, keepalives, plugin events and requests carrying an SDP),
+ * and how large they are on the wire.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../msgpack-utils.h"
+
+static int failures = 0;
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while(0)
+
+/* Encode a value, compare it to the expected bytes, and decode it back */
+static void test_msgpack_vector(json_t *json, const char *expected, size_t expected_len) {
+	size_t len = 0;
+	char *buf = janus_msgpack_encode(json, &len);
+	CHECK(buf != NULL);
+	if(buf == NULL) {
+		json_decref(json);
+		return;
+	}
+	CHECK(len == expected_len && memcmp(buf, expected, len) == 0);
+	json_error_t error;
+	json_t *decoded = janus_msgpack_decode(buf, len, &error);
+	CHECK(decoded != NULL && json_equal(json, decoded));
+	json_decref(decoded);
+	g_free(buf);
+	json_decref(json);
+}
+#define VECTOR(json, bytes) test_msgpack_vector(json, bytes, sizeof(bytes)-1)
+
+static void test_msgpack_encoding(void) {
+	/* Integers use the smallest representation that fits */
+	VECTOR(json_integer(0), "\x00");
+	VECTOR(json_integer(127), "\x7f");
+	VECTOR(json_integer(128), "\xcc\x80");
+	VECTOR(json_integer(256), "\xcd\x01\x00");
+	VECTOR(json_integer(65536), "\xce\x00\x01\x00\x00");
+	VECTOR(json_integer(4294967296LL), "\xcf\x00\x00\x00\x01\x00\x00\x00\x00");
+	VECTOR(json_integer(-1), "\xff");
+	VECTOR(json_integer(-32), "\xe0");
+	VECTOR(json_integer(-33), "\xd0\xdf");
+	VECTOR(json_integer(-129), "\xd1\xff\x7f");
+	VECTOR(json_integer(-32769), "\xd2\xff\xff\x7f\xff");
+	VECTOR(json_integer(-2147483649LL), "\xd3\xff\xff\xff\xff\x7f\xff\xff\xff");
+	/* Reals are always doubles */
+	VECTOR(json_real(1.5), "\xcb\x3f\xf8\x00\x00\x00\x00\x00\x00");
+	VECTOR(json_null(), "\xc0");
+	VECTOR(json_false(), "\xc2");
+	VECTOR(json_true(), "\xc3");
+	VECTOR(json_string(""), "\xa0");
+	VECTOR(json_string("janus"), "\xa5janus");
+	json_t *array = json_array();
+	json_array_append_new(array, json_integer(1));
+	json_array_append_new(array, json_string("a"));
+	VECTOR(array, "\x92\x01\xa1\x61");
+	json_t *object = json_object();
+	json_object_set_new(object, "compact", json_true());
+	VECTOR(object, "\x81\xa7" "compact" "\xc3");
+}
+
+/* Round trip a string and an array of the given length, checking the header used */
+static void test_msgpack_length(size_t size, guint8 string_type, guint8 array_type) {
+	char *str = g_malloc0(size+1);
+	memset(str, 'x', size);
+	json_t *array = json_array();
+	size_t i = 0;
+	for(i=0; i<size; i++)
+		json_array_append_new(array, json_integer(i & 0x7f));
+	json_t *values[2] = { json_string(str), array };
+	guint8 types[2] = { string_type, array_type };
+	int n = 0;
+	for(n=0; n<2; n++) {
+		size_t len = 0;
+		char *buf = janus_msgpack_encode(values[n], &len);
+		CHECK(buf != NULL && len > size);
+		if(buf == NULL)
+			continue;
+		CHECK((guint8)buf[0] == types[n]);
+		json_t *decoded = janus_msgpack_decode(buf, len, NULL);
+		CHECK(decoded != NULL && json_equal(values[n], decoded));
+		json_decref(decoded);
+		g_free(buf);
+	}
+	json_decref(values[0]);
+	json_decref(values[1]);
+	g_free(str);
+}
+
+static void test_msgpack_roundtrip(void) {
+	/* Fix, 8, 16 and 32 bit lengths (there's no array8 type) */
+	test_msgpack_length(15, 0xaf, 0x9f);
+	test_msgpack_length(16, 0xb0, 0xdc);
+	test_msgpack_length(31, 0xbf, 0xdc);
+	test_msgpack_length(32, 0xd9, 0xdc);
+	test_msgpack_length(255, 0xd9, 0xdc);
+	test_msgpack_length(256, 0xda, 0xdc);
+	test_msgpack_length(65535, 0xda, 0xdc);
+	test_msgpack_length(65536, 0xdb, 0xdd);
+	/* A typical Janus API request, with nested objects and all types */
+	json_t *message = json_object();
+	json_object_set_new(message, "janus", json_string("message"));
+	json_object_set_new(message, "session_id", json_integer(8327193786384617LL));
+	json_object_set_new(message, "handle_id", json_integer(G_MAXINT64));
+	json_object_set_new(message, "transaction", json_string("Zp7cVw3Lq4yP"));
+	json_t *body = json_object();
+	json_object_set_new(body, "request", json_string("configure"));
+	json_object_set_new(body, "audio", json_true());
+	json_object_set_new(body, "video", json_false());
+	json_object_set_new(body, "bitrate", json_integer(-1));
+	json_object_set_new(body, "ratio", json_real(-0.125));
+	json_object_set_new(body, "display", json_string("\xc3\xa8\xe2\x82\xac\xf0\x9f\x8e\xa5"));
+	json_object_set_new(body, "secret", json_null());
+	json_t *streams = json_array();
+	int i = 0;
+	for(i=0; i<20; i++) {
+		json_t *stream = json_object();
+		json_object_set_new(stream, "mid", json_integer(i));
+		json_object_set_new(stream, "send", json_boolean(i % 2));
+		json_array_append_new(streams, stream);
+	}
+	json_object_set_new(body, "streams", streams);
+	json_object_set_new(message, "body", body);
+	size_t len = 0;
+	char *buf = janus_msgpack_encode(message, &len);
+	CHECK(buf != NULL);
+	json_error_t error;
+	json_t *decoded = janus_msgpack_decode(buf, len, &error);
+	CHECK(decoded != NULL && json_equal(message, decoded));
+	json_decref(decoded);
+	/* Any truncation must be rejected */
+	size_t cut = 0;
+	for(cut=0; cut<len; cut++) {
+		decoded = janus_msgpack_decode(buf, cut, &error);
+		CHECK(decoded == NULL);
+		CHECK(error.text[0] != '\0');
+		json_decref(decoded);
+	}
+	g_free(buf);
+	json_decref(message);
+}
+
+/* Decode a buffer, and compare the result to what we expect (NULL if it should fail) */
+static void test_msgpack_decode(const char *buf, size_t len, json_t *expected) {
+	json_error_t error;
+	json_t *decoded = janus_msgpack_decode(buf, len, &error);
+	if(expected == NULL) {
+		CHECK(decoded == NULL);
+		CHECK(error.text[0] != '\0');
+	} else {
+		CHECK(decoded != NULL && json_equal(expected, decoded));
+	}
+	json_decref(decoded);
+	json_decref(expected);
+}
+#define DECODE(bytes, json) test_msgpack_decode(bytes, sizeof(bytes)-1, json)
+
+static void test_msgpack_decoding(void) {
+	/* Representations other encoders may use */
+	DECODE("\xd0\x05", json_integer(5));
+	DECODE("\xcd\x00\x01", json_integer(1));
+	DECODE("\xca\x3f\xc0\x00\x00", json_real(1.5));
+	DECODE("\xd9\x01\x61", json_string("a"));
+	DECODE("\xdc\x00\x00", json_array());
+	json_t *object = json_object();
+	json_object_set_new(object, "a", json_integer(1));
+	DECODE("\xde\x00\x01\xd9\x01\x61\x01", object);
+	/* Invalid input */
+	DECODE("", NULL);
+	DECODE("\x01\x02", NULL);
+	DECODE("\xc4\x01\x00", NULL);
+	DECODE("\xd4\x01\x00", NULL);
+	DECODE("\xc1", NULL);
+	DECODE("\x81\x01\x01", NULL);
+	DECODE("\xa2\xc3\x28", NULL);
+	DECODE("\xa1\x00", NULL);
+	DECODE("\xcf\xff\x00\x00\x00\x00\x00\x00\x00", NULL);
+	DECODE("\xdd\xff\xff\xff\xff", NULL);
+	/* Too deeply nested arrays */
+	char deep[JANUS_MSGPACK_MAX_DEPTH+3];
+	memset(deep, 0x91, sizeof(deep)-1);
+	deep[sizeof(deep)-1] = 0x00;
+	test_msgpack_decode(deep, sizeof(deep), NULL);
+}
+
+/* A realistic offer, as browsers send it when publishing audio and video */
+static const char *test_msgpack_sdp =
+	"v=0\r\no=- 4611731400430051336 2 IN IP4 127.0.0.1\r\ns=-\r\nt=0 0\r\n"
+	"a=group:BUNDLE 0 1\r\na=extmap-allow-mixed\r\na=msid-semantic: WMS 3c1e3a3e-0f0b-4d62-9b3c-6d2f3e0f8e21\r\n"
+	"m=audio 9 UDP/TLS/RTP/SAVPF 111 63 9 0 8 13 110 126\r\nc=IN IP4 0.0.0.0\r\na=rtcp:9 IN IP4 0.0.0.0\r\n"
+	"a=ice-ufrag:Xk3b\r\na=ice-pwd:Qj7rS2k9Lp0vT4wE8yU1iO6a\r\na=ice-options:trickle\r\n"
+	"a=fingerprint:sha-256 7B:8B:F0:65:5F:78:E2:51:3B:AC:6F:F3:3F:46:1B:35:DC:B8:5F:64:1A:24:C2:43:F0:A1:58:D0:A1:2C:19:08\r\n"
+	"a=setup:actpass\r\na=mid:0\r\na=extmap:1 urn:ietf:params:rtp-hdrext:ssrc-audio-level\r\n"
+	"a=extmap:2 http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time\r\n"
+	"a=extmap:3 http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01\r\n"
+	"a=extmap:4 urn:ietf:params:rtp-hdrext:sdes:mid\r\na=sendonly\r\n"
+	"a=msid:3c1e3a3e-0f0b-4d62-9b3c-6d2f3e0f8e21 5d0e6c2a-7f41-4b8e-a7c3-0c2d9b1e6f47\r\na=rtcp-mux\r\n"
+	"a=rtpmap:111 opus/48000/2\r\na=rtcp-fb:111 transport-cc\r\na=fmtp:111 minptime=10;useinbandfec=1\r\n"
+	"a=rtpmap:63 red/48000/2\r\na=fmtp:63 111/111\r\na=rtpmap:9 G722/8000\r\na=rtpmap:0 PCMU/8000\r\n"
+	"a=rtpmap:8 PCMA/8000\r\na=rtpmap:13 CN/8000\r\na=rtpmap:110 telephone-event/48000\r\na=rtpmap:126 telephone-event/8000\r\n"
+	"a=ssrc:2394871562 cname:V6Yk0xw7Xh4nQ9zB\r\na=ssrc:2394871562 msid:3c1e3a3e-0f0b-4d62-9b3c-6d2f3e0f8e21 5d0e6c2a-7f41-4b8e-a7c3-0c2d9b1e6f47\r\n"
+	"m=video 9 UDP/TLS/RTP/SAVPF 96 97 102 103 104 105 106 107 108 109 127 125 39 40 45 46 98 99 100 101\r\n"
+	"c=IN IP4 0.0.0.0\r\na=rtcp:9 IN IP4 0.0.0.0\r\na=ice-ufrag:Xk3b\r\na=ice-pwd:Qj7rS2k9Lp0vT4wE8yU1iO6a\r\na=ice-options:trickle\r\n"
+	"a=fingerprint:sha-256 7B:8B:F0:65:5F:78:E2:51:3B:AC:6F:F3:3F:46:1B:35:DC:B8:5F:64:1A:24:C2:43:F0:A1:58:D0:A1:2C:19:08\r\n"
+	"a=setup:actpass\r\na=mid:1\r\na=extmap:14 urn:ietf:params:rtp-hdrext:toffset\r\n"
+	"a=extmap:2 http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time\r\na=extmap:13 urn:3gpp:video-orientation\r\n"
+	"a=extmap:3 http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01\r\n"
+	"a=extmap:5 http://www.webrtc.org/experiments/rtp-hdrext/playout-delay\r\n"
+	"a=extmap:4 urn:ietf:params:rtp-hdrext:sdes:mid\r\na=extmap:10 urn:ietf:params:rtp-hdrext:sdes:rtp-stream-id\r\n"
+	"a=extmap:11 urn:ietf:params:rtp-hdrext:sdes:repaired-rtp-stream-id\r\na=sendonly\r\n"
+	"a=msid:3c1e3a3e-0f0b-4d62-9b3c-6d2f3e0f8e21 8a4f2c1d-3e5b-4a6c-9d7e-1f2a3b4c5d6e\r\na=rtcp-mux\r\na=rtcp-rsize\r\n"
+	"a=rtpmap:96 VP8/90000\r\na=rtcp-fb:96 goog-remb\r\na=rtcp-fb:96 transport-cc\r\na=rtcp-fb:96 ccm fir\r\n"
+	"a=rtcp-fb:96 nack\r\na=rtcp-fb:96 nack pli\r\na=rtpmap:97 rtx/90000\r\na=fmtp:97 apt=96\r\n"
+	"a=rtpmap:102 H264/90000\r\na=rtcp-fb:102 goog-remb\r\na=rtcp-fb:102 transport-cc\r\na=rtcp-fb:102 ccm fir\r\n"
+	"a=rtcp-fb:102 nack\r\na=rtcp-fb:102 nack pli\r\na=fmtp:102 level-asymmetry-allowed=1;packetization-mode=1;profile-level-id=42001f\r\n"
+	"a=rtpmap:103 rtx/90000\r\na=fmtp:103 apt=102\r\na=rtpmap:104 H264/90000\r\na=rtcp-fb:104 goog-remb\r\n"
+	"a=rtcp-fb:104 transport-cc\r\na=rtcp-fb:104 ccm fir\r\na=rtcp-fb:104 nack\r\na=rtcp-fb:104 nack pli\r\n"
+	"a=fmtp:104 level-asymmetry-allowed=1;packetization-mode=0;profile-level-id=42001f\r\n"
+	"a=rtpmap:105 rtx/90000\r\na=fmtp:105 apt=104\r\na=rtpmap:39 AV1/90000\r\na=rtcp-fb:39 goog-remb\r\n"
+	"a=rtcp-fb:39 transport-cc\r\na=rtcp-fb:39 ccm fir\r\na=rtcp-fb:39 nack\r\na=rtcp-fb:39 nack pli\r\n"
+	"a=rtpmap:40 rtx/90000\r\na=fmtp:40 apt=39\r\na=rtpmap:98 VP9/90000\r\na=rtcp-fb:98 goog-remb\r\n"
+	"a=rtcp-fb:98 transport-cc\r\na=rtcp-fb:98 ccm fir\r\na=rtcp-fb:98 nack\r\na=rtcp-fb:98 nack pli\r\n"
+	"a=fmtp:98 profile-id=0\r\na=rtpmap:99 rtx/90000\r\na=fmtp:99 apt=98\r\n"
+	"a=rtpmap:125 red/90000\r\na=rtpmap:107 rtx/90000\r\na=fmtp:107 apt=125\r\na=rtpmap:127 ulpfec/90000\r\n"
+	"a=ssrc-group:FID 1680329101 3301846027\r\na=ssrc:1680329101 cname:V6Yk0xw7Xh4nQ9zB\r\n"
+	"a=ssrc:1680329101 msid:3c1e3a3e-0f0b-4d62-9b3c-6d2f3e0f8e21 8a4f2c1d-3e5b-4a6c-9d7e-1f2a3b4c5d6e\r\n"
+	"a=ssrc:3301846027 cname:V6Yk0xw7Xh4nQ9zB\r\n"
+	"a=ssrc:3301846027 msid:3c1e3a3e-0f0b-4d62-9b3c-6d2f3e0f8e21 8a4f2c1d-3e5b-4a6c-9d7e-1f2a3b4c5d6e\r\n";
+
+/* Sets the fields all Janus API messages addressed to a handle have */
+static json_t *test_msgpack_request(const char *janus, gboolean handle) {
+	json_t *message = json_object();
+	json_object_set_new(message, "janus", json_string(janus));
+	json_object_set_new(message, "session_id", json_integer(8327193786384617LL));
+	if(handle)
+		json_object_set_new(message, "handle_id", json_integer(2907481537269013LL));
+	json_object_set_new(message, "transaction", json_string("Zp7cVw3Lq4yP"));
+	return message;
+}
+
+#define TEST_MSGPACK_TYPES		4
+#define TEST_MSGPACK_MIX		20
+#define TEST_MSGPACK_ITERATIONS	20000
+static const char *test_msgpack_type_names[TEST_MSGPACK_TYPES] = {
+	"trickle", "keepalive", "event", "message+jsep"
+};
+/* How often each type shows up, every TEST_MSGPACK_MIX messages: trickle
+ * candidates dominate while setting up, keepalives and events after that */
+static const int test_msgpack_type_weights[TEST_MSGPACK_TYPES] = { 10, 4, 5, 1 };
+
+static json_t *test_msgpack_message(int type) {
+	json_t *message = NULL;
+	switch(type) {
+		case 0: {
+			message = test_msgpack_request("trickle", TRUE);
+			json_t *candidate = json_object();
+			json_object_set_new(candidate, "candidate",
+				json_string("candidate:3892487014 1 udp 2122260223 192.168.1.10 54321 typ host generation 0 ufrag Xk3b network-id 1 network-cost 10"));
+			json_object_set_new(candidate, "sdpMid", json_string("0"));
+			json_object_set_new(candidate, "sdpMLineIndex", json_integer(0));
+			json_object_set_new(message, "candidate", candidate);
+			break;
+		}
+		case 1:
+			message = test_msgpack_request("keepalive", FALSE);
+			break;
+		case 2: {
+			/* A VideoRoom event announcing new publishers */
+			message = test_msgpack_request("event", FALSE);
+			json_object_set_new(message, "sender", json_integer(2907481537269013LL));
+			json_t *publishers = json_array();
+			int i = 0;
+			for(i=0; i<3; i++) {
+				json_t *publisher = json_object();
+				json_object_set_new(publisher, "id", json_integer(4710562934810 + i));
+				json_object_set_new(publisher, "display", json_string("Publisher"));
+				json_object_set_new(publisher, "talking", json_false());
+				json_t *streams = json_array();
+				int m = 0;
+				for(m=0; m<2; m++) {
+					json_t *stream = json_object();
+					json_object_set_new(stream, "type", json_string(m ? "video" : "audio"));
+					json_object_set_new(stream, "mindex", json_integer(m));
+					json_object_set_new(stream, "mid", json_string(m ? "1" : "0"));
+					json_object_set_new(stream, "codec", json_string(m ? "vp8" : "opus"));
+					json_array_append_new(streams, stream);
+				}
+				json_object_set_new(publisher, "streams", streams);
+				json_array_append_new(publishers, publisher);
+			}
+			json_t *data = json_object();
+			json_object_set_new(data, "videoroom", json_string("event"));
+			json_object_set_new(data, "room", json_integer(1234));
+			json_object_set_new(data, "publishers", publishers);
+			json_t *plugindata = json_object();
+			json_object_set_new(plugindata, "plugin", json_string("janus.plugin.videoroom"));
+			json_object_set_new(plugindata, "data", data);
+			json_object_set_new(message, "plugindata", plugindata);
+			break;
+		}
+		case 3: {
+			message = test_msgpack_request("message", TRUE);
+			json_t *body = json_object();
+			json_object_set_new(body, "request", json_string("configure"));
+			json_object_set_new(body, "audio", json_true());
+			json_object_set_new(body, "video", json_true());
+			json_object_set_new(message, "body", body);
+			json_t *jsep = json_object();
+			json_object_set_new(jsep, "type", json_string("offer"));
+			json_object_set_new(jsep, "sdp", json_string(test_msgpack_sdp));
+			json_object_set_new(message, "jsep", jsep);
+			break;
+		}
+		default:
+			break;
+	}
+	return message;
+}
+
+/* The formats we compare: MessagePack, and JSON as the transports format it by default and when compact */
+#define TEST_MSGPACK_FORMATS	3
+static const char *test_msgpack_format_names[TEST_MSGPACK_FORMATS] = {
+	"MessagePack", "JSON (indented)", "JSON (compact)"
+};
+static const size_t test_msgpack_json_flags[TEST_MSGPACK_FORMATS] = {
+	0, JSON_INDENT(3) | JSON_PRESERVE_ORDER, JSON_COMPACT | JSON_PRESERVE_ORDER
+};
+
+static char *test_msgpack_encode_as(int format, json_t *message, size_t *len) {
+	if(format == 0)
+		return janus_msgpack_encode(message, len);
+	char *text = json_dumps(message, test_msgpack_json_flags[format]);
+	*len = text ? strlen(text) : 0;
+	return text;
+}
+
+static json_t *test_msgpack_decode_as(int format, const char *buf, size_t len) {
+	json_error_t error;
+	if(format == 0)
+		return janus_msgpack_decode(buf, len, &error);
+	return json_loads(buf, 0, &error);
+}
+
+static void test_msgpack_free(int format, char *buf) {
+	/* We allocate MessagePack buffers with glib, and jansson uses malloc */
+	if(format == 0)
+		g_free(buf);
+	else
+		free(buf);
+}
+
+static void test_msgpack_benchmark(void) {
+	json_t *messages[TEST_MSGPACK_TYPES];
+	char *encoded[TEST_MSGPACK_FORMATS][TEST_MSGPACK_TYPES];
+	size_t lengths[TEST_MSGPACK_FORMATS][TEST_MSGPACK_TYPES];
+	int type = 0, format = 0, mix[TEST_MSGPACK_MIX], n = 0;
+	for(type=0; type<TEST_MSGPACK_TYPES; type++) {
+		messages[type] = test_msgpack_message(type);
+		int w = 0;
+		for(w=0; w<test_msgpack_type_weights[type]; w++)
+			mix[n++] = type;
+	}
+	CHECK(n == TEST_MSGPACK_MIX);
+	/* Whatever the format, what we decode must be what we encoded */
+	for(format=0; format<TEST_MSGPACK_FORMATS; format++) {
+		for(type=0; type<TEST_MSGPACK_TYPES; type++) {
+			encoded[format][type] = test_msgpack_encode_as(format, messages[type], &lengths[format][type]);
+			CHECK(encoded[format][type] != NULL);
+			json_t *decoded = test_msgpack_decode_as(format, encoded[format][type], lengths[format][type]);
+			CHECK(decoded != NULL && json_equal(messages[type], decoded));
+			json_decref(decoded);
+		}
+	}
+	/* Timings depend on the machine, so they're only printed */
+	for(type=0; type<TEST_MSGPACK_TYPES; type++) {
+		printf("MessagePack: %-12s %5zu bytes, %5zu as indented JSON, %5zu as compact JSON\n",
+			test_msgpack_type_names[type], lengths[0][type], lengths[1][type], lengths[2][type]);
+	}
+	for(format=0; format<TEST_MSGPACK_FORMATS; format++) {
+		gint64 start = g_get_monotonic_time();
+		size_t bytes = 0, len = 0;
+		int i = 0;
+		for(i=0; i<TEST_MSGPACK_ITERATIONS; i++) {
+			char *buf = test_msgpack_encode_as(format, messages[mix[i % TEST_MSGPACK_MIX]], &len);
+			bytes += len;
+			test_msgpack_free(format, buf);
+		}
+		gint64 encoding = g_get_monotonic_time() - start;
+		start = g_get_monotonic_time();
+		for(i=0; i<TEST_MSGPACK_ITERATIONS; i++) {
+			type = mix[i % TEST_MSGPACK_MIX];
+			json_decref(test_msgpack_decode_as(format, encoded[format][type], lengths[format][type]));
+		}
+		gint64 decoding = g_get_monotonic_time() - start;
+		printf("MessagePack: %-16s encode %6.2f us/msg, decode %6.2f us/msg, %6.1f bytes/msg on average\n",
+			test_msgpack_format_names[format], (double)encoding / TEST_MSGPACK_ITERATIONS,
+			(double)decoding / TEST_MSGPACK_ITERATIONS, (double)bytes / TEST_MSGPACK_ITERATIONS);
+	}
+	for(format=0; format<TEST_MSGPACK_FORMATS; format++)
+		for(type=0; type<TEST_MSGPACK_TYPES; type++)
+			test_msgpack_free(format, encoded[format][type]);
+	for(type=0; type<TEST_MSGPACK_TYPES; type++)
+		json_decref(messages[type]);
+}
+
+int main(int argc, char *argv[]) {
+	test_msgpack_encoding();
+	test_msgpack_roundtrip();
+	test_msgpack_decoding();
+	test_msgpack_benchmark();
+	if(failures > 0) {
+		fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("MessagePack: all checks passed\n");
+	return 0;
+}
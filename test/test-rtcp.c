@@ -0,0 +1,282 @@
+/*! \file    test-rtcp.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Tests for the single-pass RTCP parser
+ * \details  Builds the compound RTCP packets browsers typically send (an
+ * SR or RR, followed by SDES, REMB, NACK, PLI or a legacy FIR), and checks
+ * that what janus_rtcp_summarize finds matches what the individual helpers
+ * (janus_rtcp_has_fir, janus_rtcp_get_nacks and so on) return. It then
+ * prints how long the ICE loop and the plugins took to handle the same
+ * packets before (one walk per helper, plus a GSList for the NACKs) and
+ * now (a single summary), and the cost of each helper on its own.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include "../rtcp.h"
+#include "../debug.h"
+#include "../utils.h"
+
+int janus_log_level = LOG_NONE;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+
+static int failures = 0;
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while(0)
+
+#define TEST_RTCP_PACKETS		5
+#define TEST_RTCP_BUFSIZE		1500
+#define TEST_RTCP_ITERATIONS	1000000
+#define TEST_RTCP_SENDER_SSRC	0x11223344
+#define TEST_RTCP_MEDIA_SSRC	0x55667788
+
+typedef struct test_rtcp_packet {
+	char buffer[TEST_RTCP_BUFSIZE];
+	int length;
+} test_rtcp_packet;
+static test_rtcp_packet packets[TEST_RTCP_PACKETS];
+
+/* Adds an SR or RR with a single report block, and returns its length */
+static int test_rtcp_report(char *buf, gboolean sr) {
+	int plen = sr ? (int)sizeof(janus_rtcp_sr) : (int)sizeof(janus_rtcp_rr);
+	memset(buf, 0, plen);
+	janus_rtcp_header *rtcp = (janus_rtcp_header *)buf;
+	rtcp->version = 2;
+	rtcp->type = sr ? RTCP_SR : RTCP_RR;
+	rtcp->rc = 1;
+	rtcp->length = htons((plen/4)-1);
+	janus_report_block *rb = NULL;
+	if(sr) {
+		janus_rtcp_sr *report = (janus_rtcp_sr *)buf;
+		report->ssrc = htonl(TEST_RTCP_SENDER_SSRC);
+		report->si.ntp_ts_msw = htonl(3800000000u);
+		report->si.rtp_ts = htonl(123456);
+		report->si.s_packets = htonl(1000);
+		report->si.s_octets = htonl(1000000);
+		rb = &report->rb[0];
+	} else {
+		janus_rtcp_rr *report = (janus_rtcp_rr *)buf;
+		report->ssrc = htonl(TEST_RTCP_SENDER_SSRC);
+		rb = &report->rb[0];
+	}
+	rb->ssrc = htonl(TEST_RTCP_MEDIA_SSRC);
+	rb->flcnpl = htonl(0x01000010);
+	rb->ehsnr = htonl(54321);
+	rb->jitter = htonl(42);
+	return plen;
+}
+
+/* Builds the mix of compound packets */
+static void test_rtcp_build(void) {
+	int i = 0, fir_seq = 0;
+	uint16_t nacks[] = { 1000, 1001, 1003, 1020, 1100 };
+	for(i=0; i<TEST_RTCP_PACKETS; i++) {
+		char *buf = packets[i].buffer;
+		int len = test_rtcp_report(buf, i == 0);
+		switch(i) {
+			case 0:
+				len += janus_rtcp_sdes_cname(buf+len, TEST_RTCP_BUFSIZE-len, "janusbenchmark", 14);
+				break;
+			case 1:
+				len += janus_rtcp_remb(buf+len, 24, 1500000);
+				break;
+			case 2:
+				len += janus_rtcp_nacks_array(buf+len, TEST_RTCP_BUFSIZE-len, nacks, G_N_ELEMENTS(nacks));
+				break;
+			case 3:
+				len += janus_rtcp_pli(buf+len, 12);
+				break;
+			case 4:
+				len += janus_rtcp_fir_legacy(buf+len, 20, &fir_seq);
+				break;
+			default:
+				break;
+		}
+		packets[i].length = len;
+	}
+}
+
+/* The summary must say what the individual helpers say */
+static void test_rtcp_agreement(void) {
+	int i = 0;
+	for(i=0; i<TEST_RTCP_PACKETS; i++) {
+		char *buf = packets[i].buffer;
+		int len = packets[i].length;
+		janus_rtcp_summary summary;
+		CHECK(janus_rtcp_summarize(buf, len, &summary) == 0);
+		CHECK(summary.sender_ssrc == janus_rtcp_get_sender_ssrc(buf, len));
+		CHECK(summary.receiver_ssrc == janus_rtcp_get_receiver_ssrc(buf, len));
+		CHECK(summary.receiver_ssrc == TEST_RTCP_MEDIA_SSRC);
+		CHECK(summary.has_bye == janus_rtcp_has_bye(buf, len));
+		CHECK(summary.has_fir == janus_rtcp_has_fir(buf, len));
+		CHECK(summary.has_pli == janus_rtcp_has_pli(buf, len));
+		CHECK(summary.remb == janus_rtcp_get_remb(buf, len));
+		GSList *nacks = janus_rtcp_get_nacks(buf, len), *list = nacks;
+		CHECK(summary.nacks_count == (int)g_slist_length(nacks));
+		int n = 0;
+		for(n=0; list != NULL && n < summary.nacks_count; n++, list = list->next)
+			CHECK(summary.nacks[n] == GPOINTER_TO_UINT(list->data));
+		g_slist_free(nacks);
+	}
+	/* Make sure the mix covers everything we compare */
+	janus_rtcp_summary summary;
+	janus_rtcp_summarize(packets[0].buffer, packets[0].length, &summary);
+	CHECK(summary.has_sr);
+	janus_rtcp_summarize(packets[1].buffer, packets[1].length, &summary);
+	CHECK(summary.has_rr && summary.remb > 0);
+	janus_rtcp_summarize(packets[2].buffer, packets[2].length, &summary);
+	CHECK(summary.nacks_count == 5);
+	janus_rtcp_summarize(packets[3].buffer, packets[3].length, &summary);
+	CHECK(summary.has_pli);
+	janus_rtcp_summarize(packets[4].buffer, packets[4].length, &summary);
+	CHECK(summary.has_fir);
+}
+
+typedef enum test_rtcp_helper {
+	test_rtcp_helper_parse = 0,
+	test_rtcp_helper_has_fir,
+	test_rtcp_helper_has_pli,
+	test_rtcp_helper_get_remb,
+	test_rtcp_helper_get_nacks,
+	test_rtcp_helper_fix_ssrc,
+	test_rtcp_helper_filter,
+	test_rtcp_helper_summarize,
+	test_rtcp_helper_before,
+	test_rtcp_helper_after,
+	test_rtcp_helpers
+} test_rtcp_helper;
+static const char *test_rtcp_helper_names[test_rtcp_helpers] = {
+	"janus_rtcp_parse",
+	"janus_rtcp_has_fir",
+	"janus_rtcp_has_pli",
+	"janus_rtcp_get_remb",
+	"janus_rtcp_get_nacks",
+	"janus_rtcp_fix_ssrc",
+	"janus_rtcp_filter",
+	"janus_rtcp_summarize",
+	"before (one walk per helper)",
+	"now (single summary)"
+};
+
+/* Runs one helper (or what the core and plugins did with a packet, before and
+ * now) on a packet, returning something that depends on the result, so that
+ * the compiler can't skip the work */
+static guint64 test_rtcp_run(test_rtcp_helper helper, janus_rtcp_context *ctx, char *buf, int len) {
+	guint64 result = 0;
+	switch(helper) {
+		case test_rtcp_helper_parse:
+			result = janus_rtcp_parse(ctx, buf, len);
+			break;
+		case test_rtcp_helper_has_fir:
+			result = janus_rtcp_has_fir(buf, len);
+			break;
+		case test_rtcp_helper_has_pli:
+			result = janus_rtcp_has_pli(buf, len);
+			break;
+		case test_rtcp_helper_get_remb:
+			result = janus_rtcp_get_remb(buf, len);
+			break;
+		case test_rtcp_helper_get_nacks: {
+			GSList *nacks = janus_rtcp_get_nacks(buf, len);
+			result = g_slist_length(nacks);
+			g_slist_free(nacks);
+			break;
+		}
+		case test_rtcp_helper_fix_ssrc:
+			/* Only parse, without changing the packet */
+			result = janus_rtcp_fix_ssrc(ctx, buf, len, 0, 0, 0);
+			break;
+		case test_rtcp_helper_filter: {
+			int newlen = 0;
+			char *filtered = janus_rtcp_filter(buf, len, &newlen);
+			result = newlen;
+			g_free(filtered);
+			break;
+		}
+		case test_rtcp_helper_summarize: {
+			janus_rtcp_summary summary;
+			janus_rtcp_summarize(buf, len, &summary);
+			result = summary.sender_ssrc + summary.nacks_count;
+			break;
+		}
+		case test_rtcp_helper_before: {
+			/* What janus_ice_cb_nice_recv and the VideoRoom plugin used to do */
+			result = janus_rtcp_has_bye(buf, len);
+			result += janus_rtcp_get_sender_ssrc(buf, len);
+			janus_rtcp_parse(ctx, buf, len);
+			GSList *nacks = janus_rtcp_get_nacks(buf, len);
+			result += g_slist_length(nacks);
+			g_slist_free(nacks);
+			result += janus_rtcp_has_fir(buf, len);
+			result += janus_rtcp_has_pli(buf, len);
+			result += janus_rtcp_get_remb(buf, len);
+			break;
+		}
+		case test_rtcp_helper_after: {
+			/* What they do now */
+			janus_rtcp_summary summary;
+			janus_rtcp_summarize(buf, len, &summary);
+			janus_rtcp_summary_update_context(ctx, &summary);
+			result = summary.has_bye + summary.sender_ssrc + summary.nacks_count +
+				summary.has_fir + summary.has_pli + summary.remb;
+			break;
+		}
+		default:
+			break;
+	}
+	return result;
+}
+
+static void test_rtcp_benchmark(void) {
+	janus_rtcp_context ctx;
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.tb = 90000;
+	/* Both ways of handling a packet must see the same things */
+	int i = 0;
+	for(i=0; i<TEST_RTCP_PACKETS; i++) {
+		CHECK(test_rtcp_run(test_rtcp_helper_before, &ctx, packets[i].buffer, packets[i].length) ==
+			test_rtcp_run(test_rtcp_helper_after, &ctx, packets[i].buffer, packets[i].length));
+	}
+	/* Timings depend on the machine, so they're only printed */
+	guint64 sink = 0;
+	double ns[test_rtcp_helpers];
+	int h = 0;
+	for(h=0; h<test_rtcp_helpers; h++) {
+		gint64 start = janus_get_monotonic_time();
+		int n = 0;
+		for(n=0; n<TEST_RTCP_ITERATIONS; n++) {
+			test_rtcp_packet *packet = &packets[n % TEST_RTCP_PACKETS];
+			sink += test_rtcp_run(h, &ctx, packet->buffer, packet->length);
+		}
+		gint64 elapsed = janus_get_monotonic_time() - start;
+		ns[h] = (double)elapsed * 1000 / TEST_RTCP_ITERATIONS;
+		printf("RTCP: %-30s %6.1f ns/packet\n", test_rtcp_helper_names[h], ns[h]);
+	}
+	printf("RTCP: handling a packet is %.1fx faster with the summary (%d packets, sink %"SCNu64")\n",
+		ns[test_rtcp_helper_after] > 0 ? ns[test_rtcp_helper_before] / ns[test_rtcp_helper_after] : 0,
+		TEST_RTCP_ITERATIONS, sink);
+}
+
+int main(int argc, char *argv[]) {
+	test_rtcp_build();
+	test_rtcp_agreement();
+	test_rtcp_benchmark();
+	if(failures > 0) {
+		fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("RTCP: all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,196 @@
+/*! \file    test-sctp.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Loopback test for the SCTP data channels
+ * \details  Connects two SCTP associations within the same process, with
+ * the DTLS layer replaced by a function that hands what one association
+ * sends straight to the other one. Once a data channel is open, it sends
+ * a burst of large binary messages, far more than fits in the send
+ * buffer, so that sending has to wait for the peer to acknowledge data:
+ * every message must arrive exactly once, intact and in order, and the
+ * sender is expected to back off and try again when a message is refused
+ * because too much data is already waiting to be sent. Halfway through,
+ * while data is still waiting for room in the send buffer, it opens a
+ * second channel, whose DCEP messages must not be lost or mixed up with
+ * the data. It then prints the throughput and how much data had to be
+ * queued at most.
+ *
+ * \ingroup protocols
+ * \ref protocols
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../sctp.h"
+#include "../dtls.h"
+#include "../debug.h"
+
+/* The core would define these */
+int janus_log_level = LOG_NONE;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+
+/* Defined in sctp.c, but not exported in sctp.h */
+int janus_sctp_open_channel(janus_sctp_association *sctp, uint8_t unordered, uint16_t pr_policy, uint32_t pr_value);
+int janus_sctp_send_message(janus_sctp_association *sctp, uint16_t id, gboolean binary, char *buffer, size_t length);
+
+static int failures = 0;
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while(0)
+
+#define TEST_SCTP_PORT			5000
+#define TEST_SCTP_MESSAGES		200
+#define TEST_SCTP_MESSAGE_SIZE	(64*1024)
+#define TEST_SCTP_TIMEOUT		(30*G_USEC_PER_SEC)
+
+/* The DTLS stacks are never looked into: their addresses only tell the peers apart */
+static int dtls_a, dtls_b;
+static janus_sctp_association *sctp_a = NULL, *sctp_b = NULL;
+
+/* What the receiving side got so far */
+static GMutex received_mutex;
+static guint received = 0, corrupted = 0;
+static guint64 received_bytes = 0;
+
+/* Each message carries its index, and a pattern derived from it */
+static void test_sctp_fill(char *buffer, size_t length, guint index) {
+	size_t i = 0;
+	for(i=0; i<length; i++)
+		buffer[i] = (char)((index * 31 + i) & 0xFF);
+	memcpy(buffer, &index, sizeof(index));
+}
+
+/* Replaces the DTLS layer: what an association sends is received by the other one */
+int janus_dtls_send_sctp_data(janus_dtls_srtp *dtls, char *buf, int len) {
+	if((void *)dtls == (void *)&dtls_a)
+		janus_sctp_data_from_dtls(sctp_b, buf, len);
+	else if((void *)dtls == (void *)&dtls_b)
+		janus_sctp_data_from_dtls(sctp_a, buf, len);
+	return len;
+}
+
+/* Replaces the DTLS layer: a message was received on a data channel */
+void janus_dtls_notify_data(janus_dtls_srtp *dtls, char *buf, int len, gboolean binary) {
+	if((void *)dtls != (void *)&dtls_b)
+		return;
+	g_mutex_lock(&received_mutex);
+	char *expected = g_malloc(TEST_SCTP_MESSAGE_SIZE);
+	test_sctp_fill(expected, TEST_SCTP_MESSAGE_SIZE, received);
+	/* A message arriving out of order, or glued to another one, wouldn't match */
+	if(!binary || len != TEST_SCTP_MESSAGE_SIZE || memcmp(buf, expected, len))
+		corrupted++;
+	g_free(expected);
+	received++;
+	received_bytes += len;
+	g_mutex_unlock(&received_mutex);
+}
+
+/* Wait until a channel is open on both sides, returning FALSE on timeout */
+static gboolean test_sctp_wait_open(guint id) {
+	gint64 deadline = g_get_monotonic_time() + TEST_SCTP_TIMEOUT;
+	while(g_get_monotonic_time() < deadline) {
+		if(sctp_a->channels[id].state == DATA_CHANNEL_OPEN && sctp_b->channels[id].state == DATA_CHANNEL_OPEN)
+			return TRUE;
+		g_usleep(1000);
+	}
+	return FALSE;
+}
+
+/* Wait until the association is up, returning FALSE on timeout */
+static gboolean test_sctp_wait_established(janus_sctp_association *sctp) {
+	gint64 deadline = g_get_monotonic_time() + TEST_SCTP_TIMEOUT;
+	while(g_get_monotonic_time() < deadline) {
+		struct sctp_status status;
+		socklen_t len = (socklen_t)sizeof(struct sctp_status);
+		memset(&status, 0, sizeof(status));
+		if(usrsctp_getsockopt(sctp->sock, IPPROTO_SCTP, SCTP_STATUS, &status, &len) == 0 &&
+				status.sstat_state == SCTP_ESTABLISHED)
+			return TRUE;
+		g_usleep(1000);
+	}
+	return FALSE;
+}
+
+static void test_sctp_loopback(void) {
+	g_mutex_init(&received_mutex);
+	sctp_a = janus_sctp_association_create(&dtls_a, 1, TEST_SCTP_PORT);
+	sctp_b = janus_sctp_association_create(&dtls_b, 2, TEST_SCTP_PORT);
+	CHECK(sctp_a != NULL && sctp_b != NULL);
+	if(sctp_a == NULL || sctp_b == NULL)
+		return;
+	/* As with browsers, both sides connect at the same time */
+	CHECK(janus_sctp_association_setup(sctp_a) == 0);
+	CHECK(janus_sctp_association_setup(sctp_b) == 0);
+	CHECK(test_sctp_wait_established(sctp_a));
+	CHECK(test_sctp_wait_established(sctp_b));
+	CHECK(janus_sctp_open_channel(sctp_a, 0, SCTP_PR_SCTP_NONE, 0) == 0);
+	gboolean open = test_sctp_wait_open(0);
+	CHECK(open);
+	if(open) {
+		char *buffer = g_malloc(TEST_SCTP_MESSAGE_SIZE);
+		size_t peak = 0;
+		guint i = 0, refused = 0;
+		gint64 start = g_get_monotonic_time(), deadline = start + TEST_SCTP_TIMEOUT;
+		for(i=0; i<TEST_SCTP_MESSAGES && g_get_monotonic_time() < deadline; i++) {
+			if(i == TEST_SCTP_MESSAGES/2) {
+				/* The OPEN request goes ahead of the data that's still queued */
+				CHECK(janus_sctp_open_channel(sctp_a, 0, SCTP_PR_SCTP_NONE, 0) == 0);
+			}
+			test_sctp_fill(buffer, TEST_SCTP_MESSAGE_SIZE, i);
+			/* A refused message was not sent at all: back off and try again */
+			while(janus_sctp_send_message(sctp_a, 0, TRUE, buffer, TEST_SCTP_MESSAGE_SIZE) < 0 &&
+					g_get_monotonic_time() < deadline) {
+				refused++;
+				g_usleep(1000);
+			}
+			janus_mutex_lock(&sctp_a->send_mutex);
+			if(sctp_a->pending_bytes > peak)
+				peak = sctp_a->pending_bytes;
+			janus_mutex_unlock(&sctp_a->send_mutex);
+		}
+		/* What's still queued is sent as the peer acknowledges what it got */
+		gboolean done = FALSE;
+		while(!done && g_get_monotonic_time() < deadline) {
+			g_mutex_lock(&received_mutex);
+			done = (received + corrupted == TEST_SCTP_MESSAGES) || corrupted > 0;
+			g_mutex_unlock(&received_mutex);
+			if(!done)
+				g_usleep(1000);
+		}
+		gint64 elapsed = g_get_monotonic_time() - start;
+		g_free(buffer);
+		CHECK(test_sctp_wait_open(1));
+		g_mutex_lock(&received_mutex);
+		CHECK(received == TEST_SCTP_MESSAGES);
+		CHECK(corrupted == 0);
+		CHECK(received_bytes == (guint64)TEST_SCTP_MESSAGES * TEST_SCTP_MESSAGE_SIZE);
+		/* Timings depend on the machine, so they're only printed */
+		printf("SCTP: %u messages of %d bytes in %.1f ms (%.1f MB/s), at most %zu bytes queued, %u refused\n",
+			received, TEST_SCTP_MESSAGE_SIZE, (double)elapsed / 1000,
+			elapsed > 0 ? (double)received_bytes / elapsed : 0, peak, refused);
+		g_mutex_unlock(&received_mutex);
+	}
+	janus_sctp_association_destroy(sctp_a);
+	janus_sctp_association_destroy(sctp_b);
+	/* Give the association threads the time to get rid of them */
+	g_usleep(G_USEC_PER_SEC / 2);
+	g_mutex_clear(&received_mutex);
+}
+
+int main(int argc, char *argv[]) {
+	CHECK(janus_sctp_init(0) == 0);
+	test_sctp_loopback();
+	janus_sctp_deinit();
+	if(failures > 0) {
+		fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("SCTP: all checks passed\n");
+	return 0;
+}
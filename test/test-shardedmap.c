@@ -0,0 +1,191 @@
+/*! \file    test-shardedmap.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Tests for the sharded map
+ * \details  Checks the basic map operations, that sequential keys (as
+ * the core generates for sessions) are spread evenly across shards, and
+ * that concurrent inserts, lookups and removals keep the map consistent.
+ * It also prints how long lookup threads take with a single shard and
+ * with the number of shards the core uses, as a rough contention figure.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../shardedmap.h"
+#include "../debug.h"
+#include "../utils.h"
+
+int janus_log_level = LOG_NONE;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+int lock_debug = 0;
+
+static int failures = 0;
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while(0)
+
+#define TEST_SHARDEDMAP_BITS		4
+#define TEST_SHARDEDMAP_KEYS		4096
+#define TEST_SHARDEDMAP_THREADS		4
+#define TEST_SHARDEDMAP_LOOKUPS		500000
+
+static gboolean test_shardedmap_odd(gpointer value, gpointer user_data) {
+	return (GPOINTER_TO_UINT(value) & 1) == 1;
+}
+
+static void test_shardedmap_basic(void) {
+	janus_sharded_map *map = janus_sharded_map_create(TEST_SHARDEDMAP_BITS);
+	CHECK(janus_sharded_map_size(map) == 0);
+	CHECK(janus_sharded_map_lookup(map, 1) == NULL);
+	guint64 i = 0;
+	for(i=1; i<=100; i++)
+		janus_sharded_map_insert(map, i, GUINT_TO_POINTER(i));
+	CHECK(janus_sharded_map_size(map) == 100);
+	CHECK(janus_sharded_map_lookup(map, 42) == GUINT_TO_POINTER(42));
+	/* Replacing a value doesn't change the size */
+	janus_sharded_map_insert(map, 42, GUINT_TO_POINTER(43));
+	CHECK(janus_sharded_map_lookup(map, 42) == GUINT_TO_POINTER(43));
+	CHECK(janus_sharded_map_size(map) == 100);
+	CHECK(janus_sharded_map_remove(map, 42));
+	CHECK(!janus_sharded_map_remove(map, 42));
+	CHECK(janus_sharded_map_lookup(map, 42) == NULL);
+	CHECK(janus_sharded_map_size(map) == 99);
+	/* Keys at the edges of the range work too */
+	janus_sharded_map_insert(map, G_MAXUINT64, GUINT_TO_POINTER(7));
+	CHECK(janus_sharded_map_lookup(map, G_MAXUINT64) == GUINT_TO_POINTER(7));
+	CHECK(janus_sharded_map_remove(map, G_MAXUINT64));
+	/* Listing with a filter, without and then with removal */
+	GList *list = janus_sharded_map_list(map, test_shardedmap_odd, NULL, FALSE);
+	CHECK(g_list_length(list) == 50);
+	g_list_free(list);
+	CHECK(janus_sharded_map_size(map) == 99);
+	list = janus_sharded_map_list(map, test_shardedmap_odd, NULL, TRUE);
+	CHECK(g_list_length(list) == 50);
+	g_list_free(list);
+	CHECK(janus_sharded_map_size(map) == 49);
+	CHECK(janus_sharded_map_lookup(map, 1) == NULL);
+	CHECK(janus_sharded_map_lookup(map, 2) == GUINT_TO_POINTER(2));
+	list = janus_sharded_map_list(map, NULL, NULL, TRUE);
+	CHECK(g_list_length(list) == 49);
+	g_list_free(list);
+	CHECK(janus_sharded_map_size(map) == 0);
+	janus_sharded_map_destroy(map);
+}
+
+static void test_shardedmap_distribution(void) {
+	/* Sequential keys, and keys that only differ in the high bits,
+	 * should both end up spread evenly across the shards */
+	guint64 steps[] = { 1, G_GUINT64_CONSTANT(1) << 32 };
+	guint s = 0;
+	for(s=0; s<G_N_ELEMENTS(steps); s++) {
+		janus_sharded_map *map = janus_sharded_map_create(TEST_SHARDEDMAP_BITS);
+		guint64 i = 0;
+		for(i=0; i<TEST_SHARDEDMAP_KEYS; i++)
+			janus_sharded_map_insert(map, (i+1) * steps[s], GUINT_TO_POINTER(1));
+		guint count = 1 << TEST_SHARDEDMAP_BITS, n = 0, min = G_MAXUINT, max = 0;
+		for(n=0; n<count; n++) {
+			guint size = g_hash_table_size(map->shards[n].table);
+			min = MIN(min, size);
+			max = MAX(max, size);
+		}
+		guint expected = TEST_SHARDEDMAP_KEYS / count;
+		CHECK(min >= expected / 2);
+		CHECK(max <= expected * 2);
+		janus_sharded_map_destroy(map);
+	}
+}
+
+static janus_sharded_map *shared_map = NULL;
+static volatile gint mismatches = 0;
+
+/* Each thread owns a range of keys it adds and removes, while looking up
+ * the keys of the other threads, which must be either missing or right */
+static void *test_shardedmap_worker(void *data) {
+	guint64 base = GPOINTER_TO_UINT(data) * TEST_SHARDEDMAP_KEYS;
+	int round = 0;
+	guint64 i = 0;
+	for(round=0; round<20; round++) {
+		for(i=1; i<=TEST_SHARDEDMAP_KEYS; i++)
+			janus_sharded_map_insert(shared_map, base + i, GSIZE_TO_POINTER(base + i));
+		for(i=1; i<=TEST_SHARDEDMAP_KEYS * TEST_SHARDEDMAP_THREADS; i++) {
+			gpointer value = janus_sharded_map_lookup(shared_map, i);
+			if(value != NULL && GPOINTER_TO_SIZE(value) != i)
+				g_atomic_int_inc(&mismatches);
+		}
+		for(i=1; i<=TEST_SHARDEDMAP_KEYS; i++) {
+			if(!janus_sharded_map_remove(shared_map, base + i))
+				g_atomic_int_inc(&mismatches);
+		}
+	}
+	return NULL;
+}
+
+static void test_shardedmap_concurrency(void) {
+	shared_map = janus_sharded_map_create(TEST_SHARDEDMAP_BITS);
+	GThread *threads[TEST_SHARDEDMAP_THREADS];
+	guint i = 0;
+	for(i=0; i<TEST_SHARDEDMAP_THREADS; i++)
+		threads[i] = g_thread_new("worker", test_shardedmap_worker, GUINT_TO_POINTER(i));
+	for(i=0; i<TEST_SHARDEDMAP_THREADS; i++)
+		g_thread_join(threads[i]);
+	CHECK(g_atomic_int_get(&mismatches) == 0);
+	CHECK(janus_sharded_map_size(shared_map) == 0);
+	janus_sharded_map_destroy(shared_map);
+	shared_map = NULL;
+}
+
+static void *test_shardedmap_reader(void *data) {
+	guint64 i = 0, key = GPOINTER_TO_UINT(data);
+	for(i=0; i<TEST_SHARDEDMAP_LOOKUPS; i++) {
+		key = (key * 1103515245 + 12345) % TEST_SHARDEDMAP_KEYS;
+		if(janus_sharded_map_lookup(shared_map, key + 1) == NULL)
+			g_atomic_int_inc(&mismatches);
+	}
+	return NULL;
+}
+
+static gint64 test_shardedmap_contention(guint bits) {
+	shared_map = janus_sharded_map_create(bits);
+	guint64 k = 0;
+	for(k=1; k<=TEST_SHARDEDMAP_KEYS; k++)
+		janus_sharded_map_insert(shared_map, k, GUINT_TO_POINTER(1));
+	GThread *threads[TEST_SHARDEDMAP_THREADS];
+	gint64 start = janus_get_monotonic_time();
+	guint i = 0;
+	for(i=0; i<TEST_SHARDEDMAP_THREADS; i++)
+		threads[i] = g_thread_new("reader", test_shardedmap_reader, GUINT_TO_POINTER(i+1));
+	for(i=0; i<TEST_SHARDEDMAP_THREADS; i++)
+		g_thread_join(threads[i]);
+	gint64 elapsed = janus_get_monotonic_time() - start;
+	janus_sharded_map_destroy(shared_map);
+	shared_map = NULL;
+	return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+	test_shardedmap_basic();
+	test_shardedmap_distribution();
+	test_shardedmap_concurrency();
+	/* Timings depend on the machine, so they're only printed */
+	gint64 single = test_shardedmap_contention(0);
+	gint64 sharded = test_shardedmap_contention(TEST_SHARDEDMAP_BITS);
+	CHECK(g_atomic_int_get(&mismatches) == 0);
+	printf("Sharded map: %d threads x %d lookups, 1 shard %"SCNi64"ms, %d shards %"SCNi64"ms\n",
+		TEST_SHARDEDMAP_THREADS, TEST_SHARDEDMAP_LOOKUPS, single/1000,
+		1 << TEST_SHARDEDMAP_BITS, sharded/1000);
+	if(failures > 0) {
+		fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("Sharded map: all checks passed\n");
+	return 0;
+}
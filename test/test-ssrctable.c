@@ -0,0 +1,278 @@
+/*! \file    test-ssrctable.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Tests for the lock-free SSRC table
+ * \details  Checks that the SSRC table routes SSRCs the way the ICE loop
+ * expects (including collisions and duplicates), and that lookups made
+ * by readers racing with a writer that keeps rebuilding the table either
+ * fail or return a consistent route, never a mix of two versions. It
+ * also classifies a mix of packets both with the chain of comparisons
+ * the ICE loop used before the table and with a table lookup, checking
+ * they agree, and prints how long each takes per packet.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../ssrctable.h"
+
+static int failures = 0;
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while(0)
+
+/* Build a table with the SSRCs of a stream using simulcast and rtx */
+static void test_ssrctable_fill(janus_ssrc_table *table, guint32 base) {
+	janus_ssrc_table_update_begin(table);
+	int vindex = 0;
+	for(vindex=0; vindex<3; vindex++) {
+		janus_ssrc_table_add(table, base + vindex, TRUE, vindex, FALSE);
+		janus_ssrc_table_add(table, base + 10 + vindex, TRUE, vindex, TRUE);
+	}
+	janus_ssrc_table_add(table, base + 20, FALSE, 0, FALSE);
+	janus_ssrc_table_update_end(table);
+}
+
+static void test_ssrctable_routing(void) {
+	janus_ssrc_table table;
+	memset(&table, 0, sizeof(table));
+	int video = -1, vindex = -1, rtx = -1;
+	/* Empty table */
+	CHECK(!janus_ssrc_table_lookup(&table, 1234, &video, &vindex, &rtx));
+	test_ssrctable_fill(&table, 1000);
+	int i = 0;
+	for(i=0; i<3; i++) {
+		CHECK(janus_ssrc_table_lookup(&table, 1000 + i, &video, &vindex, &rtx));
+		CHECK(video == 1 && vindex == i && rtx == 0);
+		CHECK(janus_ssrc_table_lookup(&table, 1010 + i, &video, &vindex, &rtx));
+		CHECK(video == 1 && vindex == i && rtx == 1);
+	}
+	CHECK(janus_ssrc_table_lookup(&table, 1020, &video, &vindex, &rtx));
+	CHECK(video == 0 && vindex == 0 && rtx == 0);
+	/* Unknown SSRCs, and 0, are never found */
+	CHECK(!janus_ssrc_table_lookup(&table, 999, &video, &vindex, &rtx));
+	CHECK(!janus_ssrc_table_lookup(&table, 0, &video, &vindex, &rtx));
+	/* The same SSRC advertised twice: the first one wins */
+	janus_ssrc_table_update_begin(&table);
+	janus_ssrc_table_add(&table, 42, TRUE, 2, FALSE);
+	janus_ssrc_table_add(&table, 42, FALSE, 0, FALSE);
+	janus_ssrc_table_update_end(&table);
+	CHECK(janus_ssrc_table_lookup(&table, 42, &video, &vindex, &rtx));
+	CHECK(video == 1 && vindex == 2);
+	/* Rebuilding the table forgets the old SSRCs */
+	CHECK(!janus_ssrc_table_lookup(&table, 1000, &video, &vindex, &rtx));
+	/* Lookups fail while an update is in progress */
+	janus_ssrc_table_update_begin(&table);
+	janus_ssrc_table_add(&table, 42, TRUE, 2, FALSE);
+	CHECK(!janus_ssrc_table_lookup(&table, 42, &video, &vindex, &rtx));
+	janus_ssrc_table_update_end(&table);
+	CHECK(janus_ssrc_table_lookup(&table, 42, &video, &vindex, &rtx));
+}
+
+static void test_ssrctable_collisions(void) {
+	/* Fill the whole table: linear probing must still find everything */
+	janus_ssrc_table table;
+	memset(&table, 0, sizeof(table));
+	janus_ssrc_table_update_begin(&table);
+	guint32 i = 0;
+	for(i=1; i<=JANUS_SSRC_TABLE_SIZE; i++)
+		janus_ssrc_table_add(&table, i * 16, (i % 2), i % 3, (i % 5) == 0);
+	/* No room for more */
+	janus_ssrc_table_add(&table, 7, TRUE, 0, FALSE);
+	janus_ssrc_table_update_end(&table);
+	int video = 0, vindex = 0, rtx = 0;
+	for(i=1; i<=JANUS_SSRC_TABLE_SIZE; i++) {
+		CHECK(janus_ssrc_table_lookup(&table, i * 16, &video, &vindex, &rtx));
+		CHECK(video == (int)(i % 2) && vindex == (int)(i % 3) && rtx == ((i % 5) == 0));
+	}
+	CHECK(!janus_ssrc_table_lookup(&table, 7, &video, &vindex, &rtx));
+}
+
+/* Concurrency: a writer alternates between two sets of SSRCs, where the
+ * same SSRC has a different route in each set, while readers look up */
+#define TEST_SSRCTABLE_READERS		4
+#define TEST_SSRCTABLE_ITERATIONS	200000
+static janus_ssrc_table shared_table;
+static volatile gint writer_done = 0;
+static volatile gint inconsistent = 0, hits = 0;
+
+static void test_ssrctable_build(int round) {
+	janus_ssrc_table_update_begin(&shared_table);
+	int vindex = 0;
+	for(vindex=0; vindex<3; vindex++) {
+		/* Even rounds: plain video; odd rounds: rtx, with a shifted simulcast index */
+		if(round % 2 == 0)
+			janus_ssrc_table_add(&shared_table, 5000 + vindex, TRUE, vindex, FALSE);
+		else
+			janus_ssrc_table_add(&shared_table, 5000 + vindex, TRUE, (vindex + 1) % 3, TRUE);
+	}
+	janus_ssrc_table_update_end(&shared_table);
+}
+
+static gpointer test_ssrctable_writer(gpointer data) {
+	int round = 0;
+	for(round=0; round<TEST_SSRCTABLE_ITERATIONS/10; round++)
+		test_ssrctable_build(round);
+	g_atomic_int_set(&writer_done, 1);
+	return NULL;
+}
+
+static gpointer test_ssrctable_reader(gpointer data) {
+	int video = 0, vindex = 0, rtx = 0, i = 0, found = 0;
+	while(i < TEST_SSRCTABLE_ITERATIONS || !g_atomic_int_get(&writer_done)) {
+		guint32 ssrc = 5000 + (i % 3);
+		i++;
+		if(!janus_ssrc_table_lookup(&shared_table, ssrc, &video, &vindex, &rtx))
+			continue;
+		found++;
+		int expected = rtx ? (int)((ssrc - 5000 + 1) % 3) : (int)(ssrc - 5000);
+		if(video != 1 || vindex != expected)
+			g_atomic_int_inc(&inconsistent);
+	}
+	g_atomic_int_add(&hits, found);
+	return NULL;
+}
+
+static void test_ssrctable_concurrency(void) {
+	memset(&shared_table, 0, sizeof(shared_table));
+	test_ssrctable_build(0);
+	GThread *readers[TEST_SSRCTABLE_READERS];
+	int i = 0;
+	for(i=0; i<TEST_SSRCTABLE_READERS; i++)
+		readers[i] = g_thread_new("reader", test_ssrctable_reader, NULL);
+	GThread *writer = g_thread_new("writer", test_ssrctable_writer, NULL);
+	g_thread_join(writer);
+	for(i=0; i<TEST_SSRCTABLE_READERS; i++)
+		g_thread_join(readers[i]);
+	CHECK(g_atomic_int_get(&inconsistent) == 0);
+	CHECK(g_atomic_int_get(&hits) > 0);
+	/* An even number of updates happened, so the table is not being updated anymore */
+	CHECK((g_atomic_int_get(&shared_table.version) & 1) == 0);
+}
+
+/* Benchmark: the SSRCs of a peer doing simulcast with rtx, as a stream has them */
+#define TEST_SSRCTABLE_MIX			4096
+#define TEST_SSRCTABLE_PACKETS		20000000
+typedef struct test_ssrctable_peer {
+	guint32 audio_ssrc_peer;
+	guint32 video_ssrc_peer[3];
+	guint32 video_ssrc_peer_rtx[3];
+} test_ssrctable_peer;
+
+/* How janus_ice_cb_nice_recv classified RTP packets before the table */
+static gboolean test_ssrctable_classify(test_ssrctable_peer *peer, guint32 ssrc, int *video, int *vindex, int *rtx) {
+	*video = ((peer->video_ssrc_peer[0] == ssrc
+		|| peer->video_ssrc_peer_rtx[0] == ssrc
+		|| peer->video_ssrc_peer[1] == ssrc
+		|| peer->video_ssrc_peer_rtx[1] == ssrc
+		|| peer->video_ssrc_peer[2] == ssrc
+		|| peer->video_ssrc_peer_rtx[2] == ssrc) ? 1 : 0);
+	*vindex = 0;
+	*rtx = 0;
+	if(!*video)
+		return (peer->audio_ssrc_peer == ssrc);
+	if(peer->video_ssrc_peer[1] == ssrc) {
+		*vindex = 1;
+	} else if(peer->video_ssrc_peer[2] == ssrc) {
+		*vindex = 2;
+	} else if(peer->video_ssrc_peer[0] != ssrc) {
+		*rtx = 1;
+		if(peer->video_ssrc_peer_rtx[1] == ssrc)
+			*vindex = 1;
+		else if(peer->video_ssrc_peer_rtx[2] == ssrc)
+			*vindex = 2;
+	}
+	return TRUE;
+}
+
+static void test_ssrctable_benchmark(void) {
+	test_ssrctable_peer peer = {
+		.audio_ssrc_peer = 0x1a2b3c4d,
+		.video_ssrc_peer = { 0x11111111, 0x22222222, 0x33333333 },
+		.video_ssrc_peer_rtx = { 0x44444444, 0x55555555, 0x66666666 }
+	};
+	janus_ssrc_table table;
+	memset(&table, 0, sizeof(table));
+	janus_ssrc_table_update_begin(&table);
+	int vindex = 0;
+	for(vindex=0; vindex<3; vindex++) {
+		janus_ssrc_table_add(&table, peer.video_ssrc_peer[vindex], TRUE, vindex, FALSE);
+		janus_ssrc_table_add(&table, peer.video_ssrc_peer_rtx[vindex], TRUE, vindex, TRUE);
+	}
+	janus_ssrc_table_add(&table, peer.audio_ssrc_peer, FALSE, 0, FALSE);
+	janus_ssrc_table_update_end(&table);
+	/* What a publisher sends: mostly video, spread over the layers (the top
+	 * layer being the busiest), some audio, a few retransmissions, and the
+	 * occasional packet with an SSRC we don't know */
+	static guint32 mix[TEST_SSRCTABLE_MIX];
+	guint32 seed = 1;
+	int i = 0;
+	for(i=0; i<TEST_SSRCTABLE_MIX; i++) {
+		seed = seed * 1103515245 + 12345;
+		guint32 r = (seed >> 16) % 100;
+		if(r < 15)
+			mix[i] = peer.audio_ssrc_peer;
+		else if(r < 25)
+			mix[i] = peer.video_ssrc_peer[0];
+		else if(r < 45)
+			mix[i] = peer.video_ssrc_peer[1];
+		else if(r < 95)
+			mix[i] = peer.video_ssrc_peer[2];
+		else if(r < 99)
+			mix[i] = peer.video_ssrc_peer_rtx[r % 3];
+		else
+			mix[i] = 0xdeadbeef;
+	}
+	/* Both ways must agree on every packet */
+	int video = 0, rtx = 0, cvideo = 0, cvindex = 0, crtx = 0;
+	for(i=0; i<TEST_SSRCTABLE_MIX; i++) {
+		gboolean found = janus_ssrc_table_lookup(&table, mix[i], &video, &vindex, &rtx);
+		gboolean cfound = test_ssrctable_classify(&peer, mix[i], &cvideo, &cvindex, &crtx);
+		CHECK(found == cfound);
+		if(found && cfound)
+			CHECK(video == cvideo && vindex == cvindex && rtx == crtx);
+	}
+	/* Timings depend on the machine, so they're only printed. The ICE loop reads
+	 * the SSRCs from the stream for each packet: going through a volatile pointer
+	 * keeps the compiler from turning them into constants, which it can't do there */
+	test_ssrctable_peer *volatile stream = &peer;
+	volatile int sink = 0;
+	int sum = 0;
+	gint64 start = g_get_monotonic_time();
+	for(i=0; i<TEST_SSRCTABLE_PACKETS; i++) {
+		if(test_ssrctable_classify(stream, mix[i & (TEST_SSRCTABLE_MIX-1)], &video, &vindex, &rtx))
+			sum += video + vindex + rtx;
+	}
+	gint64 chain = g_get_monotonic_time() - start;
+	sink = sum;
+	sum = 0;
+	start = g_get_monotonic_time();
+	for(i=0; i<TEST_SSRCTABLE_PACKETS; i++) {
+		if(janus_ssrc_table_lookup(&table, mix[i & (TEST_SSRCTABLE_MIX-1)], &video, &vindex, &rtx))
+			sum += video + vindex + rtx;
+	}
+	gint64 lookup = g_get_monotonic_time() - start;
+	CHECK(sum == sink);
+	printf("SSRC table: %d packets, compare chain %.2fns/packet, table lookup %.2fns/packet (x%.2f)\n",
+		TEST_SSRCTABLE_PACKETS, (double)chain * 1000 / TEST_SSRCTABLE_PACKETS,
+		(double)lookup * 1000 / TEST_SSRCTABLE_PACKETS, lookup > 0 ? (double)chain / lookup : 0);
+}
+
+int main(int argc, char *argv[]) {
+	test_ssrctable_routing();
+	test_ssrctable_collisions();
+	test_ssrctable_concurrency();
+	test_ssrctable_benchmark();
+	if(failures > 0) {
+		fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("SSRC table: all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,177 @@
+/*! \file    timerwheel.c
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Hierarchical timer wheel
+ * \details  Implementation of a hierarchical timer wheel. Time is split
+ * in ticks: a timer is placed in the first level if it expires within
+ * the next JANUS_TIMER_WHEEL_SLOTS ticks, in the second level if it
+ * expires within the next JANUS_TIMER_WHEEL_SLOTS^2 ticks, and so on.
+ * Whenever the first level wraps around, the slot of the second level
+ * that covers the next round is emptied, and its timers are placed
+ * again, which moves them to the first level; the same happens, less
+ * and less often, for the higher levels. Timers that expire further in
+ * the future than the wheel can cover are kept in the last slot they
+ * can fit in, and just cascade down again when they get there.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include "timerwheel.h"
+
+janus_timer_wheel *janus_timer_wheel_create(gint64 tick, gint64 now) {
+	if(tick < 1)
+		tick = 1;
+	janus_timer_wheel *wheel = g_malloc0(sizeof(janus_timer_wheel));
+	wheel->tick = tick;
+	wheel->current = now / tick;
+	return wheel;
+}
+
+void janus_timer_wheel_destroy(janus_timer_wheel *wheel) {
+	g_free(wheel);
+}
+
+void janus_timer_wheel_entry_init(janus_timer_wheel_entry *entry, gpointer data) {
+	if(entry == NULL)
+		return;
+	entry->expires = 0;
+	entry->level = -1;
+	entry->slot = -1;
+	entry->prev = NULL;
+	entry->next = NULL;
+	entry->data = data;
+}
+
+/* Helpers to add a timer to, or remove it from, the slot it belongs to */
+static void janus_timer_wheel_link(janus_timer_wheel *wheel, janus_timer_wheel_entry *entry) {
+	gint64 delta = entry->expires - wheel->current;
+	gint64 expires = entry->expires;
+	int level = 0;
+	if(delta < 0) {
+		/* Already expired: make it expire at the next tick we process */
+		expires = wheel->current;
+		delta = 0;
+	}
+	while(level < JANUS_TIMER_WHEEL_LEVELS-1 && delta >= ((gint64)1 << (JANUS_TIMER_WHEEL_BITS*(level+1))))
+		level++;
+	if(level == JANUS_TIMER_WHEEL_LEVELS-1 && delta >= ((gint64)1 << (JANUS_TIMER_WHEEL_BITS*JANUS_TIMER_WHEEL_LEVELS)))
+		expires = wheel->current + ((gint64)1 << (JANUS_TIMER_WHEEL_BITS*JANUS_TIMER_WHEEL_LEVELS)) - 1;
+	int slot = (expires >> (JANUS_TIMER_WHEEL_BITS*level)) & (JANUS_TIMER_WHEEL_SLOTS-1);
+	entry->level = level;
+	entry->slot = slot;
+	entry->prev = NULL;
+	entry->next = wheel->slots[level][slot];
+	if(entry->next != NULL)
+		entry->next->prev = entry;
+	wheel->slots[level][slot] = entry;
+	wheel->levels[level]++;
+	wheel->count++;
+}
+
+static void janus_timer_wheel_unlink(janus_timer_wheel *wheel, janus_timer_wheel_entry *entry) {
+	if(entry->prev != NULL)
+		entry->prev->next = entry->next;
+	else
+		wheel->slots[entry->level][entry->slot] = entry->next;
+	if(entry->next != NULL)
+		entry->next->prev = entry->prev;
+	wheel->levels[entry->level]--;
+	wheel->count--;
+	entry->level = -1;
+	entry->slot = -1;
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+void janus_timer_wheel_schedule(janus_timer_wheel *wheel, janus_timer_wheel_entry *entry, gint64 deadline) {
+	if(wheel == NULL || entry == NULL)
+		return;
+	if(entry->level >= 0)
+		janus_timer_wheel_unlink(wheel, entry);
+	/* Round up, so that a timer never expires before its deadline */
+	entry->expires = (deadline + wheel->tick - 1) / wheel->tick;
+	janus_timer_wheel_link(wheel, entry);
+}
+
+void janus_timer_wheel_cancel(janus_timer_wheel *wheel, janus_timer_wheel_entry *entry) {
+	if(wheel == NULL || entry == NULL || entry->level < 0)
+		return;
+	janus_timer_wheel_unlink(wheel, entry);
+}
+
+gboolean janus_timer_wheel_is_scheduled(janus_timer_wheel_entry *entry) {
+	return (entry != NULL && entry->level >= 0);
+}
+
+/* Helper to move the timers of a slot of a higher level where they belong now */
+static void janus_timer_wheel_cascade(janus_timer_wheel *wheel, int level, int slot) {
+	janus_timer_wheel_entry *entry = wheel->slots[level][slot];
+	wheel->slots[level][slot] = NULL;
+	while(entry != NULL) {
+		janus_timer_wheel_entry *next = entry->next;
+		wheel->levels[level]--;
+		wheel->count--;
+		janus_timer_wheel_link(wheel, entry);
+		entry = next;
+	}
+}
+
+GList *janus_timer_wheel_advance(janus_timer_wheel *wheel, gint64 now) {
+	if(wheel == NULL)
+		return NULL;
+	GList *expired = NULL;
+	gint64 target = now / wheel->tick;
+	while(wheel->current <= target) {
+		if(wheel->count == 0) {
+			/* Nothing to do, just catch up */
+			wheel->current = target + 1;
+			break;
+		}
+		/* If a level wrapped around, bring the timers of the next round of the level above down */
+		int level = 1;
+		while(level < JANUS_TIMER_WHEEL_LEVELS &&
+				(wheel->current & (((gint64)1 << (JANUS_TIMER_WHEEL_BITS*level)) - 1)) == 0) {
+			janus_timer_wheel_cascade(wheel, level,
+				(wheel->current >> (JANUS_TIMER_WHEEL_BITS*level)) & (JANUS_TIMER_WHEEL_SLOTS-1));
+			level++;
+		}
+		/* Collect the timers of this tick */
+		int slot = wheel->current & (JANUS_TIMER_WHEEL_SLOTS-1);
+		janus_timer_wheel_entry *entry = NULL;
+		while((entry = wheel->slots[0][slot]) != NULL) {
+			janus_timer_wheel_unlink(wheel, entry);
+			expired = g_list_prepend(expired, entry);
+		}
+		wheel->current++;
+	}
+	return g_list_reverse(expired);
+}
+
+GList *janus_timer_wheel_clear(janus_timer_wheel *wheel) {
+	if(wheel == NULL)
+		return NULL;
+	GList *timers = NULL;
+	int level = 0, slot = 0;
+	for(level=0; level<JANUS_TIMER_WHEEL_LEVELS; level++) {
+		for(slot=0; slot<JANUS_TIMER_WHEEL_SLOTS; slot++) {
+			janus_timer_wheel_entry *entry = NULL;
+			while((entry = wheel->slots[level][slot]) != NULL) {
+				janus_timer_wheel_unlink(wheel, entry);
+				timers = g_list_prepend(timers, entry);
+			}
+		}
+	}
+	return timers;
+}
+
+guint janus_timer_wheel_occupancy(janus_timer_wheel *wheel, guint levels[JANUS_TIMER_WHEEL_LEVELS]) {
+	if(wheel == NULL)
+		return 0;
+	int i = 0;
+	for(i=0; i<JANUS_TIMER_WHEEL_LEVELS; i++) {
+		if(levels != NULL)
+			levels[i] = wheel->levels[i];
+	}
+	return wheel->count;
+}
@@ -0,0 +1,99 @@
+/*! \file    timerwheel.h
+ * \author   agent <agent@local>
+ * \copyright GNU General Public License v3
+ * \brief    Hierarchical timer wheel (headers)
+ * \details  Implementation of a hierarchical timer wheel, used by the
+ * watchdogs of the core (e.g., session timeouts and handle cleanup) so
+ * that each tick only touches the entries that are about to expire,
+ * rather than iterating on all sessions or handles. Timers due in the
+ * near future are kept in the slots of the first level, one per tick;
+ * timers due later are kept in coarser levels, and moved to finer ones
+ * (cascading) as time goes by. Entries are embedded in the objects they
+ * refer to, so adding and removing timers never allocates memory. The
+ * wheel has no lock of its own: it's up to the owner to protect it.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef _JANUS_TIMERWHEEL_H
+#define _JANUS_TIMERWHEEL_H
+
+#include <glib.h>
+
+/*! \brief Number of levels of the wheel */
+#define JANUS_TIMER_WHEEL_LEVELS	4
+/*! \brief Number of bits of the tick number each level takes care of */
+#define JANUS_TIMER_WHEEL_BITS		6
+/*! \brief Number of slots in each level */
+#define JANUS_TIMER_WHEEL_SLOTS		(1 << JANUS_TIMER_WHEEL_BITS)
+
+/*! \brief Timer, to embed in the object it refers to */
+typedef struct janus_timer_wheel_entry {
+	/*! \brief Tick this timer expires at */
+	gint64 expires;
+	/*! \brief Level and slot the timer is in (level is -1 if the timer isn't scheduled) */
+	int level, slot;
+	/*! \brief Previous and next timers in the same slot */
+	struct janus_timer_wheel_entry *prev, *next;
+	/*! \brief Opaque pointer to the object the timer refers to */
+	gpointer data;
+} janus_timer_wheel_entry;
+
+/*! \brief Hierarchical timer wheel */
+typedef struct janus_timer_wheel {
+	/*! \brief Duration of a tick, in microseconds */
+	gint64 tick;
+	/*! \brief Next tick to process */
+	gint64 current;
+	/*! \brief Slots of all levels */
+	janus_timer_wheel_entry *slots[JANUS_TIMER_WHEEL_LEVELS][JANUS_TIMER_WHEEL_SLOTS];
+	/*! \brief Number of timers currently scheduled, in each level and overall */
+	guint levels[JANUS_TIMER_WHEEL_LEVELS], count;
+} janus_timer_wheel;
+
+/*! \brief Create a new timer wheel
+ * @param[in] tick The duration of a tick, in microseconds
+ * @param[in] now The current monotonic time, in microseconds
+ * @returns A new janus_timer_wheel instance */
+janus_timer_wheel *janus_timer_wheel_create(gint64 tick, gint64 now);
+/*! \brief Destroy a timer wheel
+ * \note Timers still in the wheel are simply forgotten
+ * @param[in] wheel The janus_timer_wheel instance to destroy */
+void janus_timer_wheel_destroy(janus_timer_wheel *wheel);
+/*! \brief Initialize a timer, before it's used for the first time
+ * @param[in] entry The timer to initialize
+ * @param[in] data Opaque pointer to the object the timer refers to */
+void janus_timer_wheel_entry_init(janus_timer_wheel_entry *entry, gpointer data);
+/*! \brief Schedule a timer (or reschedule it, if it was scheduled already)
+ * \note Timers expire at the first tick following the deadline
+ * @param[in] wheel The janus_timer_wheel instance to add the timer to
+ * @param[in] entry The timer to schedule
+ * @param[in] deadline When the timer should expire (monotonic time, in microseconds) */
+void janus_timer_wheel_schedule(janus_timer_wheel *wheel, janus_timer_wheel_entry *entry, gint64 deadline);
+/*! \brief Cancel a timer, if it was scheduled
+ * @param[in] wheel The janus_timer_wheel instance the timer is in
+ * @param[in] entry The timer to cancel */
+void janus_timer_wheel_cancel(janus_timer_wheel *wheel, janus_timer_wheel_entry *entry);
+/*! \brief Check whether a timer is scheduled
+ * @param[in] entry The timer to check
+ * @returns TRUE if the timer is scheduled, FALSE otherwise */
+gboolean janus_timer_wheel_is_scheduled(janus_timer_wheel_entry *entry);
+/*! \brief Advance the wheel, and get the timers that expired
+ * \note Expired timers are removed from the wheel before they're returned,
+ * which means they can be scheduled again right away (e.g., in the same wheel)
+ * @param[in] wheel The janus_timer_wheel instance to advance
+ * @param[in] now The current monotonic time, in microseconds
+ * @returns A GList of the janus_timer_wheel_entry instances that expired, if any (to free with g_list_free) */
+GList *janus_timer_wheel_advance(janus_timer_wheel *wheel, gint64 now);
+/*! \brief Remove all timers from the wheel, and get them, e.g., to release the objects they refer to
+ * @param[in] wheel The janus_timer_wheel instance to empty
+ * @returns A GList of the janus_timer_wheel_entry instances that were scheduled, if any (to free with g_list_free) */
+GList *janus_timer_wheel_clear(janus_timer_wheel *wheel);
+/*! \brief Get the number of timers in each level of the wheel, for the Admin API
+ * @param[in] wheel The janus_timer_wheel instance to query
+ * @param[out] levels Array the number of timers in each level will be written to
+ * @returns The total number of timers in the wheel */
+guint janus_timer_wheel_occupancy(janus_timer_wheel *wheel, guint levels[JANUS_TIMER_WHEEL_LEVELS]);
+
+#endif
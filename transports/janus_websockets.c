@@ -39,6 +39,7 @@
 #include "../config.h"
 #include "../mutex.h"
 #include "../utils.h"
+#include "../msgpack-utils.h"
 
 
 /* Transport plugin information */
@@ -115,11 +116,29 @@ static GThread *ws_thread = NULL;
 void *janus_websockets_thread(void *data);
 
 
+/* Outgoing message (JSON text, or MessagePack if the client negotiated it) */
+typedef struct janus_websockets_message {
+	char *payload;							/* The serialized message */
+	size_t length;							/* Length of the serialized message */
+	gboolean msgpack;						/* Whether the message was encoded with MessagePack (and so allocated by us) */
+} janus_websockets_message;
+static void janus_websockets_message_free(janus_websockets_message *message) {
+	if(message == NULL)
+		return;
+	if(message->msgpack)
+		g_free(message->payload);
+	else
+		free(message->payload);
+	g_free(message);
+}
+
 /* WebSocket client session */
 typedef struct janus_websockets_client {
 	struct lws *wsi;						/* The libwebsockets client instance */
+	gboolean msgpack;						/* Whether the client negotiated MessagePack rather than JSON */
 	GAsyncQueue *messages;					/* Queue of outgoing messages to push */
 	char *incoming;							/* Buffer containing the incoming message to process (in case there are fragments) */
+	size_t incoming_len;					/* Length of the incoming message so far */
 	unsigned char *buffer;					/* Buffer containing the message to send */
 	int buflen;								/* Length of the buffer (may be resized after re-allocations) */
 	int bufpending;							/* Data an interrupted previous write couldn't send */
@@ -161,25 +180,46 @@ static int janus_websockets_admin_callback_secure(
 		struct lws *wsi,
 		enum lws_callback_reasons reason,
 		void *user, void *in, size_t len);
-/* Protocol mappings */
+/* Callbacks for WebSockets-related events, when MessagePack is negotiated */
+static int janus_websockets_msgpack_callback(
+		struct lws *wsi,
+		enum lws_callback_reasons reason,
+		void *user, void *in, size_t len);
+static int janus_websockets_msgpack_callback_secure(
+		struct lws *wsi,
+		enum lws_callback_reasons reason,
+		void *user, void *in, size_t len);
+static int janus_websockets_admin_msgpack_callback(
+		struct lws *wsi,
+		enum lws_callback_reasons reason,
+		void *user, void *in, size_t len);
+static int janus_websockets_admin_msgpack_callback_secure(
+		struct lws *wsi,
+		enum lws_callback_reasons reason,
+		void *user, void *in, size_t len);
+/* Protocol mappings: the -msgpack variants use MessagePack, rather than JSON, on the wire */
 static struct lws_protocols ws_protocols[] = {
 	{ "http-only", janus_websockets_callback_http, 0, 0 },
 	{ "janus-protocol", janus_websockets_callback, sizeof(janus_websockets_client), 0 },
+	{ "janus-protocol-msgpack", janus_websockets_msgpack_callback, sizeof(janus_websockets_client), 0 },
 	{ NULL, NULL, 0 }
 };
 static struct lws_protocols sws_protocols[] = {
 	{ "http-only", janus_websockets_callback_https, 0, 0 },
 	{ "janus-protocol", janus_websockets_callback_secure, sizeof(janus_websockets_client), 0 },
+	{ "janus-protocol-msgpack", janus_websockets_msgpack_callback_secure, sizeof(janus_websockets_client), 0 },
 	{ NULL, NULL, 0 }
 };
 static struct lws_protocols admin_ws_protocols[] = {
 	{ "http-only", janus_websockets_callback_http, 0, 0 },
 	{ "janus-admin-protocol", janus_websockets_admin_callback, sizeof(janus_websockets_client), 0 },
+	{ "janus-admin-protocol-msgpack", janus_websockets_admin_msgpack_callback, sizeof(janus_websockets_client), 0 },
 	{ NULL, NULL, 0 }
 };
 static struct lws_protocols admin_sws_protocols[] = {
 	{ "http-only", janus_websockets_callback_https, 0, 0 },
 	{ "janus-admin-protocol", janus_websockets_admin_callback_secure, sizeof(janus_websockets_client), 0 },
+	{ "janus-admin-protocol-msgpack", janus_websockets_admin_msgpack_callback_secure, sizeof(janus_websockets_client), 0 },
 	{ NULL, NULL, 0 }
 };
 /* Helper for debugging reasons */
@@ -745,15 +785,16 @@ static void janus_websockets_destroy_client(
 	ws_client->wsi = NULL;
 	/* Remove messages queue too, if needed */
 	if(ws_client->messages != NULL) {
-		char *response = NULL;
+		janus_websockets_message *response = NULL;
 		while((response = g_async_queue_try_pop(ws_client->messages)) != NULL) {
-			g_free(response);
+			janus_websockets_message_free(response);
 		}
 		g_async_queue_unref(ws_client->messages);
 	}
 	/* ... and the shared buffers */
 	g_free(ws_client->incoming);
 	ws_client->incoming = NULL;
+	ws_client->incoming_len = 0;
 	g_free(ws_client->buffer);
 	ws_client->buffer = NULL;
 	ws_client->buflen = 0;
@@ -817,8 +858,23 @@ int janus_websockets_send_message(void *transport, void *request_id, gboolean ad
 		return -1;
 	}
 	janus_mutex_lock(&client->mutex);
-	/* Convert to string and enqueue */
-	char *payload = json_dumps(message, json_format);
+	/* Serialize (to JSON or MessagePack, depending on what was negotiated) and enqueue */
+	janus_websockets_message *payload = g_malloc(sizeof(janus_websockets_message));
+	payload->msgpack = client->msgpack;
+	if(client->msgpack) {
+		payload->payload = janus_msgpack_encode(message, &payload->length);
+	} else {
+		payload->payload = json_dumps(message, json_format);
+		payload->length = payload->payload ? strlen(payload->payload) : 0;
+	}
+	if(payload->payload == NULL) {
+		JANUS_LOG(LOG_ERR, "Error serializing message...\n");
+		g_free(payload);
+		janus_mutex_unlock(&client->mutex);
+		janus_mutex_unlock(&old_wss_mutex);
+		json_decref(message);
+		return -1;
+	}
 	g_async_queue_push(client->messages, payload);
 	lws_callback_on_writable(client->wsi);
 	janus_mutex_unlock(&client->mutex);
@@ -911,7 +967,7 @@ static int janus_websockets_callback_https(
 static int janus_websockets_common_callback(
 		struct lws *wsi,
 		enum lws_callback_reasons reason,
-		void *user, void *in, size_t len, gboolean admin)
+		void *user, void *in, size_t len, gboolean admin, gboolean msgpack)
 {
 	const char *log_prefix = admin ? "AdminWSS" : "WSS";
 	janus_websockets_client *ws_client = (janus_websockets_client *)user;
@@ -945,6 +1001,7 @@ static int janus_websockets_common_callback(
 			janus_mutex_unlock(&old_wss_mutex);
 			/* Prepare the session */
 			ws_client->wsi = wsi;
+			ws_client->msgpack = msgpack;
 			ws_client->messages = g_async_queue_new();
 			ws_client->buffer = NULL;
 			ws_client->buflen = 0;
@@ -961,6 +1018,7 @@ static int janus_websockets_common_callback(
 				json_t *info = json_object();
 				json_object_set_new(info, "event", json_string("connected"));
 				json_object_set_new(info, "admin_api", admin ? json_true() : json_false());
+				json_object_set_new(info, "msgpack", msgpack ? json_true() : json_false());
 				json_object_set_new(info, "ip", json_string(ip));
 				gateway->notify_event(&janus_websockets_transport, ws_client, info);
 			}
@@ -979,26 +1037,35 @@ static int janus_websockets_common_callback(
 				ws_client->incoming = g_malloc(len+1);
 				memcpy(ws_client->incoming, in, len);
 				ws_client->incoming[len] = '\0';
-				JANUS_LOG(LOG_HUGE, "%s\n", ws_client->incoming);
+				ws_client->incoming_len = len;
+				if(!ws_client->msgpack)
+					JANUS_LOG(LOG_HUGE, "%s\n", ws_client->incoming);
 			} else {
-				size_t offset = strlen(ws_client->incoming);
+				size_t offset = ws_client->incoming_len;
 				JANUS_LOG(LOG_HUGE, "[%s-%p] Appending fragment: offset %zu, %zu bytes, %zu remaining\n", log_prefix, wsi, offset, len, remaining);
 				ws_client->incoming = g_realloc(ws_client->incoming, offset+len+1);
 				memcpy(ws_client->incoming+offset, in, len);
 				ws_client->incoming[offset+len] = '\0';
-				JANUS_LOG(LOG_HUGE, "%s\n", ws_client->incoming+offset);
+				ws_client->incoming_len += len;
+				if(!ws_client->msgpack)
+					JANUS_LOG(LOG_HUGE, "%s\n", ws_client->incoming+offset);
 			}
 			if(remaining > 0 || !lws_is_final_fragment(wsi)) {
 				/* Still waiting for some more fragments */
 				JANUS_LOG(LOG_HUGE, "[%s-%p] Waiting for more fragments\n", log_prefix, wsi);
 				return 0;
 			}
-			JANUS_LOG(LOG_HUGE, "[%s-%p] Done, parsing message: %zu bytes\n", log_prefix, wsi, strlen(ws_client->incoming));
-			/* If we got here, the message is complete: parse the JSON payload */
+			JANUS_LOG(LOG_HUGE, "[%s-%p] Done, parsing message: %zu bytes\n", log_prefix, wsi, ws_client->incoming_len);
+			/* If we got here, the message is complete: parse the JSON (or MessagePack) payload */
 			json_error_t error;
-			json_t *root = json_loads(ws_client->incoming, 0, &error);
+			json_t *root = NULL;
+			if(ws_client->msgpack)
+				root = janus_msgpack_decode(ws_client->incoming, ws_client->incoming_len, &error);
+			else
+				root = json_loads(ws_client->incoming, 0, &error);
 			g_free(ws_client->incoming);
 			ws_client->incoming = NULL;
+			ws_client->incoming_len = 0;
 			/* Notify the core, passing both the object and, since it may be needed, the error */
 			gateway->incoming_request(&janus_websockets_transport, ws_client, NULL, admin, root, &error);
 			return 0;
@@ -1015,7 +1082,8 @@ static int janus_websockets_common_callback(
 						&& !ws_client->destroy && !g_atomic_int_get(&stopping)) {
 					JANUS_LOG(LOG_HUGE, "[%s-%p] Completing pending WebSocket write (still need to write last %d bytes)...\n",
 						log_prefix, wsi, ws_client->bufpending);
-					int sent = lws_write(wsi, ws_client->buffer + ws_client->bufoffset, ws_client->bufpending, LWS_WRITE_TEXT);
+					int sent = lws_write(wsi, ws_client->buffer + ws_client->bufoffset, ws_client->bufpending,
+						ws_client->msgpack ? LWS_WRITE_BINARY : LWS_WRITE_TEXT);
 					JANUS_LOG(LOG_HUGE, "[%s-%p]   -- Sent %d/%d bytes\n", log_prefix, wsi, sent, ws_client->bufpending);
 					if(sent > -1 && sent < ws_client->bufpending) {
 						/* We still couldn't send everything that was left, we'll try and complete this in the next round */
@@ -1032,29 +1100,30 @@ static int janus_websockets_common_callback(
 					return 0;
 				}
 				/* Shoot all the pending messages */
-				char *response = g_async_queue_try_pop(ws_client->messages);
+				janus_websockets_message *response = g_async_queue_try_pop(ws_client->messages);
 				if(response && !ws_client->destroy && !g_atomic_int_get(&stopping)) {
 					/* Gotcha! */
-					int buflen = LWS_SEND_BUFFER_PRE_PADDING + strlen(response) + LWS_SEND_BUFFER_POST_PADDING;
+					int buflen = LWS_SEND_BUFFER_PRE_PADDING + response->length + LWS_SEND_BUFFER_POST_PADDING;
 					if (buflen > ws_client->buflen) {
 						/* We need a larger shared buffer */
-						JANUS_LOG(LOG_HUGE, "[%s-%p] Re-allocating to %d bytes (was %d, response is %zu bytes)\n", log_prefix, wsi, buflen, ws_client->buflen, strlen(response));
+						JANUS_LOG(LOG_HUGE, "[%s-%p] Re-allocating to %d bytes (was %d, response is %zu bytes)\n", log_prefix, wsi, buflen, ws_client->buflen, response->length);
 						ws_client->buflen = buflen;
 						ws_client->buffer = g_realloc(ws_client->buffer, buflen);
 					}
-					memcpy(ws_client->buffer + LWS_SEND_BUFFER_PRE_PADDING, response, strlen(response));
-					JANUS_LOG(LOG_HUGE, "[%s-%p] Sending WebSocket message (%zu bytes)...\n", log_prefix, wsi, strlen(response));
-					int sent = lws_write(wsi, ws_client->buffer + LWS_SEND_BUFFER_PRE_PADDING, strlen(response), LWS_WRITE_TEXT);
-					JANUS_LOG(LOG_HUGE, "[%s-%p]   -- Sent %d/%zu bytes\n", log_prefix, wsi, sent, strlen(response));
-					if(sent > -1 && sent < (int)strlen(response)) {
+					memcpy(ws_client->buffer + LWS_SEND_BUFFER_PRE_PADDING, response->payload, response->length);
+					JANUS_LOG(LOG_HUGE, "[%s-%p] Sending WebSocket message (%zu bytes)...\n", log_prefix, wsi, response->length);
+					int sent = lws_write(wsi, ws_client->buffer + LWS_SEND_BUFFER_PRE_PADDING, response->length,
+						ws_client->msgpack ? LWS_WRITE_BINARY : LWS_WRITE_TEXT);
+					JANUS_LOG(LOG_HUGE, "[%s-%p]   -- Sent %d/%zu bytes\n", log_prefix, wsi, sent, response->length);
+					if(sent > -1 && sent < (int)response->length) {
 						/* We couldn't send everything in a single write, we'll complete this in the next round */
-						ws_client->bufpending = strlen(response) - sent;
+						ws_client->bufpending = response->length - sent;
 						ws_client->bufoffset = LWS_SEND_BUFFER_PRE_PADDING + sent;
 						JANUS_LOG(LOG_HUGE, "[%s-%p]   -- Couldn't write all bytes (%d missing), setting offset %d\n",
 							log_prefix, wsi, ws_client->bufpending, ws_client->bufoffset);
 					}
 					/* We can get rid of the message */
-					free(response);
+					janus_websockets_message_free(response);
 					/* Done for this round, check the next response/notification later */
 					lws_callback_on_writable(wsi);
 					janus_mutex_unlock(&ws_client->mutex);
@@ -1093,7 +1162,7 @@ static int janus_websockets_callback(
 		enum lws_callback_reasons reason,
 		void *user, void *in, size_t len)
 {
-	return janus_websockets_common_callback(wsi, reason, user, in, len, FALSE);
+	return janus_websockets_common_callback(wsi, reason, user, in, len, FALSE, FALSE);
 }
 
 static int janus_websockets_callback_secure(
@@ -1111,7 +1180,7 @@ static int janus_websockets_admin_callback(
 		enum lws_callback_reasons reason,
 		void *user, void *in, size_t len)
 {
-	return janus_websockets_common_callback(wsi, reason, user, in, len, TRUE);
+	return janus_websockets_common_callback(wsi, reason, user, in, len, TRUE, FALSE);
 }
 
 static int janus_websockets_admin_callback_secure(
@@ -1122,3 +1191,38 @@ static int janus_websockets_admin_callback_secure(
 	/* We just forward the event to the Admin API handler */
 	return janus_websockets_admin_callback(wsi, reason, user, in, len);
 }
+
+/* These callbacks handle Janus and Admin API requests encoded with MessagePack */
+static int janus_websockets_msgpack_callback(
+		struct lws *wsi,
+		enum lws_callback_reasons reason,
+		void *user, void *in, size_t len)
+{
+	return janus_websockets_common_callback(wsi, reason, user, in, len, FALSE, TRUE);
+}
+
+static int janus_websockets_msgpack_callback_secure(
+		struct lws *wsi,
+		enum lws_callback_reasons reason,
+		void *user, void *in, size_t len)
+{
+	/* We just forward the event to the Janus API handler */
+	return janus_websockets_msgpack_callback(wsi, reason, user, in, len);
+}
+
+static int janus_websockets_admin_msgpack_callback(
+		struct lws *wsi,
+		enum lws_callback_reasons reason,
+		void *user, void *in, size_t len)
+{
+	return janus_websockets_common_callback(wsi, reason, user, in, len, TRUE, TRUE);
+}
+
+static int janus_websockets_admin_msgpack_callback_secure(
+		struct lws *wsi,
+		enum lws_callback_reasons reason,
+		void *user, void *in, size_t len)
+{
+	/* We just forward the event to the Admin API handler */
+	return janus_websockets_admin_msgpack_callback(wsi, reason, user, in, len);
+}